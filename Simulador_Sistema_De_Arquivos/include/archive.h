@@ -0,0 +1,22 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+// Importação e exportação de árvores inteiras entre o sistema hospedeiro e o simulado.
+// Cada operação percorre a árvore uma única vez: uma thread cuida do lado do hospedeiro
+// (ler os arquivos na importação, gravar os arquivos ou o .tar na exportação) enquanto a thread
+// que chamou usa o sistema de arquivos; as duas se comunicam por uma fila limitada em bytes.
+
+// Totais de uma importação ou exportação.
+typedef struct {
+    unsigned int files;
+    unsigned int dirs;
+    unsigned int skipped;     // Entradas ignoradas (tipo não suportado, grandes demais ou com erro).
+    unsigned long long bytes; // Bytes de conteúdo dos arquivos transferidos.
+    double seconds;
+} ArchiveStats;
+
+//Declarações das funções de importação e exportação
+int archive_import(const char* host_dir, const char* fs_dir, ArchiveStats* stats);
+int archive_export(const char* fs_dir, const char* target, ArchiveStats* stats);
+
+#endif
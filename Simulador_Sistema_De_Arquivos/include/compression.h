@@ -0,0 +1,11 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+// Tamanho máximo de saída do compressor para uma entrada de 'n' bytes (pior caso).
+#define LZ_COMPRESS_BOUND(n) ((n) + ((n) / 255) + 16)
+
+//Declarações das funções de compressão (formato de bloco estilo LZ4)
+int lz_compress(const unsigned char* src, int src_len, unsigned char* dst, int dst_capacity);
+int lz_decompress(const unsigned char* src, int src_len, unsigned char* dst, int dst_capacity);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+//Declarações das funções de checksum (CRC32C, polinômio de Castagnoli)
+unsigned int crc32c(const void* data, unsigned int length);
+const char* crc32c_implementation();
+
+#endif
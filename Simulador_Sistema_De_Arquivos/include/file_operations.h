@@ -3,14 +3,84 @@
 
 #include "filesystem_core.h"
 
+// Modos de abertura de fs_fopen (combináveis com |).
+#define FS_O_READ   0x01
+#define FS_O_WRITE  0x02
+#define FS_O_CREATE 0x04
+#define FS_O_TRUNC  0x08
+#define FS_O_APPEND 0x10
+
+// Origens de fs_fseek.
+#define FS_SEEK_SET 0
+#define FS_SEEK_CUR 1
+#define FS_SEEK_END 2
+
+// Opções de fs_opendir.
+#define FS_READDIR_PLUS 0x01 // fs_readdir também devolve o i-node de cada entrada (lidos em lote).
+
+// Uma entrada devolvida por fs_readdir.
+typedef struct {
+    char name[MAX_FILENAME_LENGTH];
+    unsigned int inode_num;
+    Inode inode; // Preenchido apenas com FS_READDIR_PLUS.
+} FsDirEntry;
+
+// Opções de fs_defrag.
+#define FS_DEFRAG_COMPACT 0x01 // Também aproxima os arquivos do início da área de dados e compacta a tabela de i-nodes.
+#define FS_DEFRAG_DRY_RUN 0x02 // Só mede a fragmentação, sem mover nada.
+
+// Resultado de fs_defrag: a fragmentação e a vazão de leitura antes e depois.
+typedef struct {
+    unsigned int files;              // Arquivos e diretórios com pelo menos um bloco.
+    unsigned int extents_before;     // Sequências de blocos contíguos, somadas entre os arquivos.
+    unsigned int extents_after;
+    unsigned int fragmented_before;  // Arquivos com mais de um extent.
+    unsigned int fragmented_after;
+    unsigned int files_moved;
+    unsigned int blocks_moved;
+    unsigned int inodes_moved;
+    double read_mib_per_s_before;    // Leitura de todos os arquivos, com a cache do hospedeiro descartada.
+    double read_mib_per_s_after;
+} FsDefragReport;
+
+// Estado das operações de um sistema de arquivos (arquivos abertos, escritas pendentes, dicas).
+typedef struct OpsState OpsState;
+
 //Declaração das funções
-int fs_ls(const char* path);
+int fs_ls(const char* path, int long_format);
 int fs_mkdir(const char* path);
 int fs_check_path_is_dir(const char* path);
 int fs_write(const char* simulated_path, const char* real_path);
+int fs_write_buffer(const char* simulated_path, const void* data, long size, int* compressed);
 int fs_cat(const char* path);
 int fs_rm(const char* path);
 int fs_rmdir(const char* path);
 int fs_mv(const char* old_path, const char* new_path);
+int fs_sync();
+int fs_rm_recursive(const char* path);
+int fs_cp(const char* src_path, const char* dst_path, int recursive);
+int fs_du(const char* path);
+int fs_defrag(int flags, FsDefragReport* report);
+int fs_defrag_step();
+int fs_shrink(unsigned int spare_blocks, unsigned int* old_total, unsigned int* new_total);
+int fs_fopen(const char* path, int flags);
+int fs_fread(int fd, void* buffer, unsigned int count);
+int fs_fwrite(int fd, const void* buffer, unsigned int count);
+long fs_fseek(int fd, long offset, int whence);
+int fs_ftruncate(int fd, unsigned int size);
+int fs_fclose(int fd);
+int fs_stat(const char* path, Inode* inode);
+int fs_lookup(const char* path);
+int fs_lstat(const char* path, Inode* inode);
+int fs_link(const char* existing_path, const char* new_path);
+int fs_symlink(const char* target, const char* link_path);
+int fs_readlink(const char* path, char* buffer, unsigned int size);
+int fs_list_dir(const char* path, int (*callback)(const char* name, unsigned int inode_num, const Inode* inode, void* context), void* context);
+int fs_opendir(const char* path, int flags);
+int fs_readdir(int dd, FsDirEntry* entries, unsigned int max_entries);
+int fs_closedir(int dd);
+OpsState* ops_state_create();
+void ops_state_destroy(OpsState* state);
+void ops_state_select(OpsState* state);
 
 #endif
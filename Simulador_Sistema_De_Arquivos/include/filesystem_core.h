@@ -1,12 +1,32 @@
 #ifndef FILESYSTEM_CORE_H
 #define FILESYSTEM_CORE_H
 
+#include <stdint.h>
 #include <time.h> 
 
 // --- CONSTANTES ---
 #define MAGIC_NUMBER 0xDA7A        
 #define MAX_FILENAME_LENGTH 28     
 
+// Tamanhos de bloco aceitos por fs_format (potências de 2).
+#define FS_MIN_BLOCK_SIZE 1024
+#define FS_MAX_BLOCK_SIZE 65536
+
+// Formato dos i-nodes no disco. A versão 0 (imagens antigas) grava a struct Inode crua, cujo
+// tamanho depende da ABI; a versão 1 usa DiskInode, com largura fixa e 128 bytes por i-node.
+// Imagens novas usam slots de 256 bytes: os 128 após o DiskInode guardam atributos estendidos.
+#define FS_INODE_VERSION_LEGACY 0
+#define FS_INODE_VERSION 1
+#define FS_INODE_SLOT_SIZE 128
+#define FS_INODE_INLINE_XATTR_SIZE 128
+
+// Compressão por extent: cada extent guarda até COMPRESSION_EXTENT_SIZE bytes lógicos.
+#define INODE_FLAG_COMPRESSED 0x1
+#define INODE_FLAG_INLINE_XATTR 0x2 // A área de atributos do slot está em uso (senão é lixo de um i-node antigo).
+#define INODE_FLAG_INLINE_DATA 0x4  // A área do slot guarda o alvo de um link simbólico (link rápido, sem bloco).
+#define COMPRESSION_EXTENT_SIZE 16384
+#define MAX_COMPRESSED_EXTENTS 12
+
 // --- ESTRUTURAS DE DADOS ---
 typedef struct {
     unsigned int magic_number;
@@ -17,10 +37,17 @@ typedef struct {
     unsigned int block_bitmap_start_block;
     unsigned int inode_table_start_block;
     unsigned int data_blocks_start_block;
+    unsigned int checksum_start_block; // Área com um CRC32C por bloco do disco.
+    unsigned int checksum_blocks;
+    unsigned int inode_version;        // FS_INODE_VERSION_* (0 em imagens anteriores ao campo).
+    unsigned int inode_size;           // Bytes por i-node na tabela.
+    // Diferente de 0 enquanto a área de checksums pode estar atrás dos blocos que cobre (entre a
+    // primeira escrita e o disk_sync seguinte); mantido pelo gerenciador de disco.
+    unsigned int checksums_pending;
 } Superblock;
 
 typedef struct {
-    unsigned int mode; // 0 = arquivo, 1 = diretório
+    unsigned int mode; // 0 = arquivo, 1 = diretório, 2 = link simbólico
     unsigned int link_count;
     unsigned int size_in_bytes;
     time_t creation_time;
@@ -29,23 +56,84 @@ typedef struct {
     unsigned int direct_blocks[12];
     unsigned int single_indirect_block;
     unsigned int double_indirect_block;
+    unsigned int flags; // INODE_FLAG_*
+    // Bytes armazenados de cada extent comprimido; igual ao tamanho lógico se guardado sem compressão.
+    unsigned short compressed_extent_size[MAX_COMPRESSED_EXTENTS];
+    // Bloco dos atributos estendidos que não couberam no slot (0 = nenhum). Ocupa o que era
+    // preenchimento no fim da struct, então o formato das imagens antigas não muda.
+    unsigned int xattr_block;
 } Inode;
 
+// I-node como gravado no disco (versão 1): só tipos de largura fixa, sem preenchimento.
+// Os campos consultados com mais frequência ficam juntos nos primeiros 16 bytes.
+typedef struct {
+    uint16_t mode;
+    uint16_t flags;
+    uint32_t link_count;
+    uint32_t size_in_bytes;
+    uint32_t xattr_block;
+    int64_t creation_time;
+    int64_t modification_time;
+    int64_t last_access_time;
+    uint32_t direct_blocks[12];
+    uint32_t single_indirect_block;
+    uint32_t double_indirect_block;
+    uint16_t compressed_extent_size[MAX_COMPRESSED_EXTENTS];
+    uint8_t padding[8];
+} DiskInode;
+
+// Falha a compilação se DiskInode deixar de ter exatamente FS_INODE_SLOT_SIZE bytes.
+typedef char disk_inode_size_check[sizeof(DiskInode) == FS_INODE_SLOT_SIZE ? 1 : -1];
+
+// Estado de um sistema de arquivos montado (superbloco e buffers reaproveitados).
+typedef struct CoreState CoreState;
+
+// Cabeçalho de um i-node (tipo, flags, links e tamanho), lido sem decodificar o resto.
+typedef struct {
+    unsigned int mode;
+    unsigned int flags;
+    unsigned int link_count;
+    unsigned int size_in_bytes;
+} InodeHeader;
+
 typedef struct {
     char name[MAX_FILENAME_LENGTH];
     unsigned int inode_number;
 } DirEntry;
 
 // Declarações das funções
-void fs_format(unsigned int disk_size, unsigned int block_size);
+int fs_format(unsigned int disk_size, unsigned int block_size, unsigned int bytes_per_inode);
 int fs_mount(); 
-void fs_write_inode(unsigned int inode_num, const Inode* inode_data);
+int fs_write_inode(unsigned int inode_num, const Inode* inode_data);
 void fs_read_inode(unsigned int inode_num, Inode* inode_buffer);
+void fs_read_inodes(const unsigned int* inode_nums, unsigned int count, Inode* inodes);
+void fs_read_inode_header(unsigned int inode_num, InodeHeader* header);
+void fs_inode_from_disk(const DiskInode* disk, Inode* inode);
+void fs_inode_to_disk(const Inode* inode, DiskInode* disk);
+unsigned int fs_read_inode_inline(unsigned int inode_num, Inode* inode, unsigned char* inline_area);
+int fs_write_inode_inline(unsigned int inode_num, const Inode* inode, const unsigned char* inline_area);
+void fs_touch_inode(unsigned int inode_num, time_t modification_time, time_t last_access_time);
+int fs_flush_inode_times();
 int fs_alloc_inode();
+int fs_alloc_inodes(unsigned int count, unsigned int* inode_nums);
 int fs_alloc_block();
+int fs_alloc_blocks(unsigned int count, unsigned int* blocks);
+int fs_alloc_extent(unsigned int count, unsigned int* blocks);
 void fs_free_inode(int inode_num);
+void fs_free_inodes(const unsigned int* inode_nums, unsigned int count);
+int fs_used_inodes(unsigned int first, unsigned int range, unsigned int* inode_nums);
 void fs_free_block(int block_num);
+void fs_free_blocks(const unsigned int* blocks, unsigned int count);
+void fs_set_online_discard(int enabled);
+int fs_trim(unsigned int* ranges, unsigned int* blocks);
+int fs_resize(unsigned int total_blocks);
 
 Superblock fs_get_superblock_info();
+void* fs_get_block_buffer();
+void fs_put_block_buffer(void* buffer);
+void fs_release_buffers();
+CoreState* core_state_create();
+void core_state_destroy(CoreState* state);
+void core_state_select(CoreState* state);
 
 #endif
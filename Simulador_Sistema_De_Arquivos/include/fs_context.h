@@ -0,0 +1,18 @@
+#ifndef FS_CONTEXT_H
+#define FS_CONTEXT_H
+
+// Contexto de um sistema de arquivos: a imagem, o superbloco montado e o estado das operações
+// (arquivos abertos, escritas pendentes, caches). Todas as funções do núcleo atuam sobre o
+// contexto selecionado na thread que as chama; sem seleção, é usado o contexto padrão, que
+// abre DISK_DEFAULT_PATH (ou o caminho de disk_set_path). Com vários contextos, um processo
+// monta várias imagens ao mesmo tempo, e threads diferentes podem usar contextos diferentes
+// em paralelo. Um mesmo contexto não deve ser usado por duas threads ao mesmo tempo.
+typedef struct FsContext FsContext;
+
+//Declarações das funções de contexto
+FsContext* fs_context_create(const char* disk_path);
+FsContext* fs_context_select(FsContext* context);
+FsContext* fs_context_current();
+void fs_context_destroy(FsContext* context);
+
+#endif
@@ -1,12 +1,59 @@
 #ifndef GERENCIADOR_DE_DISCO_H
 #define GERENCIADOR_DE_DISCO_H
 
+// Imagem usada quando nenhum caminho é informado.
+#define DISK_DEFAULT_PATH "dados/meu_so.disk"
+
+// Volume distribuído (estilo RAID-0): a imagem é um arquivo de texto que começa com
+// DISK_VOLUME_HEADER e lista os membros; os blocos são espalhados entre eles em faixas.
+#define DISK_VOLUME_HEADER "MEUFS-VOLUME 1"
+#define DISK_MAX_MEMBERS 8
+
+// Estado de uma imagem aberta (arquivo, tamanho do bloco, checksums e contadores).
+typedef struct DiskState DiskState;
+
+// Contadores de E/S acumulados pelo gerenciador de disco.
+typedef struct {
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+    unsigned long checksums_verified;
+    unsigned long checksum_errors;
+} DiskStats;
+
+// Observador das escritas (usado pelo crashtest): chamado depois de cada bloco gravado, com o
+// conteúdo, e com data NULL para cada bloco descartado (lido como zeros a partir daí). Depois de
+// cada espera pelo disco (fdatasync) recebe DISK_WRITE_BARRIER: as escritas anteriores já são duráveis.
+typedef void (*DiskWriteHook)(unsigned int block_num, const void* data, void* context);
+#define DISK_WRITE_BARRIER 0xFFFFFFFFu
+
 //Declarações das funções do gerenciador de disco
 int disk_format(unsigned int disk_size, unsigned int block_size);
 int disk_mount();
 int disk_unmount();
+int disk_sync();
 int disk_read_block(unsigned int block_num, void* buffer);
 int disk_write_block(unsigned int block_num, const void* buffer);
+int disk_read_blocks(const unsigned int* block_nums, unsigned int count, void* buffer);
+int disk_write_blocks(const unsigned int* block_nums, unsigned int count, const void* buffer);
+void disk_prefetch_blocks(unsigned int start_block, unsigned int count);
+void disk_drop_cache();
+int disk_discard_blocks(unsigned int start_block, unsigned int count);
+int disk_truncate(unsigned int total_blocks);
+unsigned long long disk_allocated_bytes();
 void disk_set_block_size(unsigned int block_size);
+void disk_set_path(const char* path);
+void disk_get_stats(DiskStats* stats);
+void disk_reset_stats();
+int disk_enable_checksums(unsigned int checksum_start_block, unsigned int checksum_blocks, unsigned int total_blocks,
+                          unsigned int flag_offset);
+const char* disk_get_path();
+int disk_set_members(const char* const* member_paths, unsigned int count, unsigned int stripe_size);
+int disk_is_volume(const char* path);
+DiskState* disk_state_create(const char* path);
+void disk_state_destroy(DiskState* state);
+void disk_state_select(DiskState* state);
+void disk_set_write_hook(DiskWriteHook hook, void* context);
 
 #endif
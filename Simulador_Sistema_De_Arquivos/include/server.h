@@ -0,0 +1,62 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Protocolo binário do modo servidor (socket Unix local, ordem de bytes nativa).
+// Cada pedido é um RequestHeader seguido de 'length' bytes de dados; cada resposta é um
+// ResponseHeader seguido de 'length' bytes. Um cliente pode enviar vários pedidos sem esperar
+// as respostas (pipelining): elas voltam na mesma ordem, com o mesmo request_id.
+//
+// Dados de cada operação (caminhos são um unsigned short com o tamanho seguido dos bytes):
+//   OP_STAT     caminho                                  -> ProtocolStat
+//   OP_LIST     caminho                                  -> (ProtocolStat, unsigned char tamanho, nome)*
+//   OP_READ     caminho, unsigned int posição, unsigned int quantidade -> bytes lidos
+//   OP_WRITE    caminho, unsigned char flags, unsigned int posição, bytes -> unsigned int escritos
+//   OP_TRUNCATE caminho, unsigned int tamanho            -> nada
+//   OP_MKDIR    caminho                                  -> nada
+//   OP_RM       caminho, unsigned char flags             -> nada
+//   OP_RMDIR    caminho                                  -> nada
+//   OP_MV       caminho de origem, caminho de destino    -> nada
+//   OP_SYNC     nada                                     -> nada
+
+#define SERVER_SOCKET_PATH "dados/meu_so.sock"
+#define PROTOCOL_MAX_PAYLOAD (1024 * 1024)
+
+#define OP_STAT     1
+#define OP_LIST     2
+#define OP_READ     3
+#define OP_WRITE    4
+#define OP_TRUNCATE 5
+#define OP_MKDIR    6
+#define OP_RM       7
+#define OP_RMDIR    8
+#define OP_MV       9
+#define OP_SYNC     10
+
+#define OP_WRITE_TRUNCATE 0x1 // OP_WRITE: zera o arquivo antes de escrever (o arquivo é criado se não existir).
+#define OP_RM_RECURSIVE   0x1 // OP_RM: remove a árvore inteira.
+
+typedef struct {
+    unsigned int length;
+    unsigned int request_id;
+    unsigned char opcode;
+    unsigned char reserved[3];
+} RequestHeader;
+
+typedef struct {
+    unsigned int length;
+    unsigned int request_id;
+    int status; // 0 em caso de sucesso, -1 em caso de erro
+} ResponseHeader;
+
+typedef struct {
+    unsigned int inode_num;
+    unsigned int mode;
+    unsigned int link_count;
+    unsigned int size_in_bytes;
+    long long modification_time;
+} ProtocolStat;
+
+// Declarações das funções do servidor
+int server_run(const char* socket_path, int background_defrag);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef XATTR_H
+#define XATTR_H
+
+// Atributos estendidos (pares nome/valor) de arquivos e diretórios. Os pequenos ficam na área
+// de FS_INODE_INLINE_XATTR_SIZE bytes do próprio slot do i-node, lida junto com ele; os que não
+// cabem vão para um bloco exclusivo do i-node (Inode.xattr_block). Uma consulta lê no máximo
+// esse bloco além do i-node.
+//
+// Formato das duas áreas: entradas seguidas de um cabeçalho XattrEntryHeader, do nome e do
+// valor (sem terminadores), até uma entrada com name_length 0 ou o fim da área. O bloco começa
+// com XATTR_BLOCK_MAGIC.
+
+#define XATTR_NAME_MAX 255
+#define XATTR_BLOCK_MAGIC 0x52544158u // "XATR"
+
+typedef struct {
+    unsigned char name_length;
+    unsigned char reserved;
+    unsigned short value_length;
+} XattrEntryHeader;
+
+//Declarações das funções de atributos estendidos
+int fs_setxattr(const char* path, const char* name, const void* value, unsigned int size);
+int fs_getxattr(const char* path, const char* name, void* value, unsigned int capacity);
+int fs_listxattr(const char* path, int (*callback)(const char* name, const void* value, unsigned int size, void* context), void* context);
+int fs_removexattr(const char* path, const char* name);
+
+#endif
@@ -0,0 +1,754 @@
+#define _POSIX_C_SOURCE 200809L
+#include "archive.h"
+#include "filesystem_core.h"
+#include "file_operations.h"
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+extern int g_compress_mode;
+
+// Quantos bytes (conteúdo e cabeçalhos dos itens) podem estar na fila ao mesmo tempo. Com a
+// fila cheia, o lado mais rápido espera o outro; a memória usada não depende do tamanho da árvore.
+#define ARCHIVE_QUEUE_BYTES (8 * 1024 * 1024)
+#define TAR_BLOCK_SIZE 512
+
+typedef enum { ITEM_DIR, ITEM_FILE, ITEM_END } ArchiveItemKind;
+
+// Um diretório ou arquivo em trânsito entre as threads. O caminho é relativo à raiz da árvore
+// ("" para a própria raiz) e usa '/' como separador.
+typedef struct ArchiveItem {
+    ArchiveItemKind kind;
+    char path[1024];
+    unsigned long long size;
+    long long mtime;
+    unsigned char* data; // Conteúdo do arquivo (NULL para diretórios e arquivos vazios).
+    struct ArchiveItem* next;
+} ArchiveItem;
+
+// Fila limitada em bytes, com um produtor e um consumidor.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    ArchiveItem* head;
+    ArchiveItem* tail;
+    size_t bytes;
+    int failed; // O consumidor desistiu: o produtor para de enfileirar.
+} ArchiveQueue;
+
+// Estado da thread que lê a árvore do hospedeiro na importação.
+typedef struct {
+    ArchiveQueue* queue;
+    const char* host_dir;
+    unsigned long long max_file_size;
+    unsigned int skipped;
+} ImportReader;
+
+// Estado da thread que grava a árvore (ou o .tar) no hospedeiro na exportação.
+typedef struct {
+    ArchiveQueue* queue;
+    const char* target;
+    FILE* tar; // NULL quando o destino é um diretório.
+    int failed;
+} ExportWriter;
+
+// Um filho de diretório guardado antes da descida (fs_list_dir mantém um diretório aberto,
+// e a tabela de diretórios abertos é pequena para uma árvore profunda).
+typedef struct {
+    char name[MAX_FILENAME_LENGTH];
+    Inode inode;
+} ExportChild;
+
+typedef struct {
+    ExportChild* items;
+    unsigned int count;
+    unsigned int capacity;
+} ExportChildList;
+
+// --- Protótipos de Funções Auxiliares (Estáticas) ---
+static void queue_init(ArchiveQueue* queue);
+static void queue_destroy(ArchiveQueue* queue);
+static size_t item_cost(const ArchiveItem* item);
+static int queue_push(ArchiveQueue* queue, ArchiveItem* item);
+static ArchiveItem* queue_pop(ArchiveQueue* queue);
+static void queue_fail(ArchiveQueue* queue);
+static ArchiveItem* new_item(ArchiveItemKind kind, const char* path);
+static void free_item(ArchiveItem* item);
+static int join_path(char* buffer, size_t size, const char* base, const char* relative);
+static double elapsed_seconds(const struct timespec* start);
+static void* import_reader_thread(void* arg);
+static int import_walk(ImportReader* reader, const char* relative);
+static int import_item(const char* fs_dir, const ArchiveItem* item, ArchiveStats* stats);
+static void* export_writer_thread(void* arg);
+static int export_walk(ArchiveQueue* queue, const char* fs_path, const char* relative, ArchiveStats* stats);
+static int collect_child(const char* name, unsigned int inode_num, const Inode* inode, void* context);
+static int export_read_file(const char* fs_path, unsigned long long size, unsigned char** data);
+static int export_item_to_dir(ExportWriter* writer, const ArchiveItem* item);
+static int export_item_to_tar(ExportWriter* writer, const ArchiveItem* item);
+static int tar_write_header(FILE* out, const char* name, int is_dir, unsigned long long size, long long mtime);
+static int tar_split_name(const char* name, char* prefix, char* short_name);
+static void tar_octal(unsigned char* field, int width, unsigned long long value);
+
+
+/*
+ * Importa uma árvore do sistema hospedeiro para o sistema simulado em uma única passagem.
+ * Uma thread percorre e lê a árvore do hospedeiro enquanto a thread que chamou cria os
+ * diretórios e arquivos no sistema simulado (que só é usado por ela). Arquivos já existentes
+ * são substituídos; links simbólicos, dispositivos e arquivos que não cabem em um i-node são
+ * ignorados e contados em 'skipped'.
+ * input:
+ * host_dir - O diretório de origem no sistema hospedeiro.
+ * fs_dir - O diretório de destino no sistema simulado (criado se não existir).
+ * stats - Recebe os totais da importação.
+ * output:
+ * 0 em caso de sucesso (mesmo com entradas ignoradas), -1 em caso de erro.
+ */
+int archive_import(const char* host_dir, const char* fs_dir, ArchiveStats* stats) {
+    memset(stats, 0, sizeof(ArchiveStats));
+    struct stat st;
+    if (stat(host_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "import: '%s' nao e um diretorio do sistema hospedeiro.\n", host_dir);
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ArchiveQueue queue;
+    queue_init(&queue);
+    Superblock sb = fs_get_superblock_info();
+    ImportReader reader = { &queue, host_dir, 0, 0 };
+    // Sem compressão, um arquivo cabe em 12 blocos; com ela, o limite depende dos dados.
+    reader.max_file_size = g_compress_mode ? ARCHIVE_QUEUE_BYTES : 12ull * sb.block_size;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, import_reader_thread, &reader) != 0) {
+        fprintf(stderr, "import: Nao foi possivel criar a thread de leitura.\n");
+        queue_destroy(&queue);
+        return -1;
+    }
+
+    int result = 0;
+    ArchiveItem* item;
+    while ((item = queue_pop(&queue))->kind != ITEM_END) {
+        if (result == 0 && import_item(fs_dir, item, stats) != 0) {
+            result = -1;
+            queue_fail(&queue);
+        }
+        free_item(item);
+    }
+    free_item(item);
+    pthread_join(thread, NULL);
+    queue_destroy(&queue);
+
+    if (result == 0 && fs_sync() != 0) result = -1;
+    stats->skipped += reader.skipped;
+    stats->seconds = elapsed_seconds(&start);
+    return result;
+}
+
+/*
+ * Exporta uma árvore do sistema simulado para o hospedeiro em uma única passagem: para um
+ * diretório (criado se não existir) ou, se o destino terminar em ".tar", para um arquivo tar
+ * (formato ustar). A thread que chamou lê o sistema simulado enquanto outra grava no hospedeiro.
+ * input:
+ * fs_dir - O diretório de origem no sistema simulado.
+ * target - O diretório ou arquivo .tar de destino no sistema hospedeiro.
+ * stats - Recebe os totais da exportação.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro.
+ */
+int archive_export(const char* fs_dir, const char* target, ArchiveStats* stats) {
+    memset(stats, 0, sizeof(ArchiveStats));
+    Inode root;
+    if (fs_stat(fs_dir, &root) < 0 || root.mode != 1) {
+        fprintf(stderr, "export: '%s' nao e um diretorio.\n", fs_dir);
+        return -1;
+    }
+
+    ExportWriter writer = { NULL, target, NULL, 0 };
+    size_t target_length = strlen(target);
+    if (target_length > 4 && strcmp(target + target_length - 4, ".tar") == 0) {
+        writer.tar = fopen(target, "wb");
+        if (!writer.tar) {
+            perror("export: Nao foi possivel criar o arquivo tar");
+            return -1;
+        }
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ArchiveQueue queue;
+    queue_init(&queue);
+    writer.queue = &queue;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, export_writer_thread, &writer) != 0) {
+        fprintf(stderr, "export: Nao foi possivel criar a thread de gravacao.\n");
+        queue_destroy(&queue);
+        if (writer.tar) fclose(writer.tar);
+        return -1;
+    }
+
+    int result = export_walk(&queue, fs_dir, "", stats);
+    queue_push(&queue, new_item(ITEM_END, ""));
+    pthread_join(thread, NULL);
+    queue_destroy(&queue);
+    if (writer.failed) result = -1;
+
+    if (writer.tar) {
+        // O fim do arquivo tar são dois blocos zerados.
+        static const unsigned char zeros[2 * TAR_BLOCK_SIZE];
+        if (fwrite(zeros, 1, sizeof(zeros), writer.tar) != sizeof(zeros)) result = -1;
+        if (fclose(writer.tar) != 0) result = -1;
+        if (result != 0 && !writer.failed) fprintf(stderr, "export: Erro ao gravar '%s'.\n", target);
+    }
+    stats->seconds = elapsed_seconds(&start);
+    return result;
+}
+
+
+// --- IMPLEMENTAÇÃO DAS FUNÇÕES AUXILIARES (ESTÁTICAS) ---
+
+/*
+ * Inicializa uma fila vazia.
+ * input:
+ * queue - A fila.
+ * output: nenhum.
+ */
+static void queue_init(ArchiveQueue* queue) {
+    memset(queue, 0, sizeof(ArchiveQueue));
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+/*
+ * Libera os recursos de uma fila (já vazia).
+ * input:
+ * queue - A fila.
+ * output: nenhum.
+ */
+static void queue_destroy(ArchiveQueue* queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+}
+
+/*
+ * Calcula quanto um item ocupa do limite da fila.
+ * input:
+ * item - O item.
+ * output: O tamanho do item em bytes, incluindo o conteúdo.
+ */
+static size_t item_cost(const ArchiveItem* item) {
+    return sizeof(ArchiveItem) + (size_t) item->size;
+}
+
+/*
+ * Enfileira um item, esperando enquanto a fila estiver cheia. Um item maior que o limite
+ * inteiro entra quando a fila estiver vazia. A fila passa a ser dona do item.
+ * input:
+ * queue - A fila.
+ * item - O item.
+ * output: 0 em caso de sucesso, -1 se o consumidor desistiu (o item é liberado; ITEM_END sempre entra).
+ */
+static int queue_push(ArchiveQueue* queue, ArchiveItem* item) {
+    size_t cost = item_cost(item);
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->failed && queue->bytes > 0 && queue->bytes + cost > ARCHIVE_QUEUE_BYTES) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    if (queue->failed && item->kind != ITEM_END) {
+        pthread_mutex_unlock(&queue->lock);
+        free_item(item);
+        return -1;
+    }
+    item->next = NULL;
+    if (queue->tail) queue->tail->next = item;
+    else queue->head = item;
+    queue->tail = item;
+    queue->bytes += cost;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+/*
+ * Retira o próximo item da fila, esperando enquanto ela estiver vazia.
+ * input:
+ * queue - A fila.
+ * output: O item (liberado pelo chamador com free_item).
+ */
+static ArchiveItem* queue_pop(ArchiveQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->head) pthread_cond_wait(&queue->not_empty, &queue->lock);
+    ArchiveItem* item = queue->head;
+    queue->head = item->next;
+    if (!queue->head) queue->tail = NULL;
+    queue->bytes -= item_cost(item);
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+/*
+ * Marca que o consumidor desistiu: o produtor deixa de enfileirar e só envia o ITEM_END.
+ * input:
+ * queue - A fila.
+ * output: nenhum.
+ */
+static void queue_fail(ArchiveQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->failed = 1;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/*
+ * Cria um item sem conteúdo.
+ * input:
+ * kind - O tipo do item.
+ * path - O caminho relativo.
+ * output: O item.
+ */
+static ArchiveItem* new_item(ArchiveItemKind kind, const char* path) {
+    ArchiveItem* item = (ArchiveItem*) calloc(1, sizeof(ArchiveItem));
+    item->kind = kind;
+    snprintf(item->path, sizeof(item->path), "%s", path);
+    return item;
+}
+
+/*
+ * Libera um item e seu conteúdo.
+ * input:
+ * item - O item.
+ * output: nenhum.
+ */
+static void free_item(ArchiveItem* item) {
+    free(item->data);
+    free(item);
+}
+
+/*
+ * Monta o caminho base/relativo (com um dos dois vazio, devolve o outro).
+ * input:
+ * buffer, size - O buffer de destino e seu tamanho.
+ * base - O caminho base.
+ * relative - O caminho relativo.
+ * output: 0 em caso de sucesso, -1 se o caminho não couber no buffer.
+ */
+static int join_path(char* buffer, size_t size, const char* base, const char* relative) {
+    int length;
+    if (relative[0] == '\0') length = snprintf(buffer, size, "%s", base);
+    else if (base[0] == '\0') length = snprintf(buffer, size, "%s", relative);
+    else length = snprintf(buffer, size, "%s%s%s", base, base[strlen(base) - 1] == '/' ? "" : "/", relative);
+    return length < 0 || (size_t) length >= size ? -1 : 0;
+}
+
+/*
+ * Calcula o tempo decorrido desde 'start'.
+ * input:
+ * start - O instante inicial (CLOCK_MONOTONIC).
+ * output: Os segundos decorridos.
+ */
+static double elapsed_seconds(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Thread de leitura da importação: percorre a árvore do hospedeiro e enfileira cada diretório
+ * antes do seu conteúdo, terminando com ITEM_END. Não usa o sistema simulado.
+ * input:
+ * arg - O ImportReader.
+ * output: NULL.
+ */
+static void* import_reader_thread(void* arg) {
+    ImportReader* reader = (ImportReader*) arg;
+    if (queue_push(reader->queue, new_item(ITEM_DIR, "")) == 0) import_walk(reader, "");
+    queue_push(reader->queue, new_item(ITEM_END, ""));
+    return NULL;
+}
+
+/*
+ * Enfileira o conteúdo de um diretório do hospedeiro, descendo nos subdiretórios.
+ * input:
+ * reader - O estado da leitura.
+ * relative - O caminho do diretório relativo à raiz da importação.
+ * output: 0 para continuar, -1 se o consumidor desistiu.
+ */
+static int import_walk(ImportReader* reader, const char* relative) {
+    char host_path[1024];
+    if (join_path(host_path, sizeof(host_path), reader->host_dir, relative) != 0) { reader->skipped++; return 0; }
+    DIR* dir = opendir(host_path);
+    if (!dir) {
+        fprintf(stderr, "import: Nao foi possivel abrir '%s': %s\n", host_path, strerror(errno));
+        reader->skipped++;
+        return 0;
+    }
+
+    int result = 0;
+    struct dirent* entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char child[1024], child_host[1024];
+        struct stat st;
+        if (strlen(entry->d_name) >= MAX_FILENAME_LENGTH ||
+            join_path(child, sizeof(child), relative, entry->d_name) != 0 ||
+            join_path(child_host, sizeof(child_host), reader->host_dir, child) != 0 ||
+            lstat(child_host, &st) != 0) {
+            reader->skipped++;
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            ArchiveItem* item = new_item(ITEM_DIR, child);
+            item->mtime = st.st_mtime;
+            result = queue_push(reader->queue, item);
+            if (result == 0) result = import_walk(reader, child);
+        } else if (S_ISREG(st.st_mode) && (unsigned long long) st.st_size <= reader->max_file_size) {
+            ArchiveItem* item = new_item(ITEM_FILE, child);
+            item->size = st.st_size;
+            item->mtime = st.st_mtime;
+            FILE* file = fopen(child_host, "rb");
+            if (item->size > 0) item->data = (unsigned char*) malloc(item->size);
+            if (!file || (item->size > 0 && fread(item->data, 1, item->size, file) != item->size)) {
+                fprintf(stderr, "import: Erro ao ler '%s'.\n", child_host);
+                reader->skipped++;
+                free_item(item);
+            } else {
+                result = queue_push(reader->queue, item);
+            }
+            if (file) fclose(file);
+        } else {
+            fprintf(stderr, "import: '%s' ignorado (%s).\n", child_host, S_ISREG(st.st_mode) ? "nao cabe em um i-node" : "nao e arquivo regular nem diretorio");
+            reader->skipped++;
+        }
+    }
+    closedir(dir);
+    return result;
+}
+
+/*
+ * Cria no sistema simulado um item recebido da thread de leitura.
+ * input:
+ * fs_dir - O diretório de destino da importação.
+ * item - O item.
+ * stats - Os totais (atualizados).
+ * output: 0 para continuar (o item pode ter sido ignorado), -1 se a importação deve parar.
+ */
+static int import_item(const char* fs_dir, const ArchiveItem* item, ArchiveStats* stats) {
+    char path[1024];
+    if (join_path(path, sizeof(path), fs_dir, item->path) != 0) { stats->skipped++; return 0; }
+
+    // fs_write_buffer já substitui um arquivo existente; só um diretório no lugar impede a cópia.
+    Inode existing;
+    int exists = fs_stat(path, &existing) >= 0;
+    if (item->kind == ITEM_DIR) {
+        if (exists && existing.mode == 1) return 0;
+        if (exists || fs_mkdir(path) != 0) {
+            fprintf(stderr, "import: Nao foi possivel criar o diretorio '%s'.\n", path);
+            if (item->path[0] == '\0') return -1;
+            stats->skipped++;
+            return 0;
+        }
+        stats->dirs++;
+        return 0;
+    }
+
+    if (exists && existing.mode == 1) {
+        fprintf(stderr, "import: '%s' ja existe e e um diretorio.\n", path);
+        stats->skipped++;
+        return 0;
+    }
+    if (fs_write_buffer(path, item->data, (long) item->size, NULL) != 0) {
+        stats->skipped++;
+        return 0;
+    }
+    stats->files++;
+    stats->bytes += item->size;
+    return 0;
+}
+
+/*
+ * Thread de gravação da exportação: grava cada item no diretório ou no tar de destino até o
+ * ITEM_END. Depois de um erro, só descarta os itens restantes. Não usa o sistema simulado.
+ * input:
+ * arg - O ExportWriter.
+ * output: NULL.
+ */
+static void* export_writer_thread(void* arg) {
+    ExportWriter* writer = (ExportWriter*) arg;
+    ArchiveItem* item;
+    while ((item = queue_pop(writer->queue))->kind != ITEM_END) {
+        if (!writer->failed) {
+            int result = writer->tar ? export_item_to_tar(writer, item) : export_item_to_dir(writer, item);
+            if (result != 0) {
+                writer->failed = 1;
+                queue_fail(writer->queue);
+            }
+        }
+        free_item(item);
+    }
+    free_item(item);
+    return NULL;
+}
+
+/*
+ * Enfileira um diretório do sistema simulado e, em seguida, todo o seu conteúdo.
+ * input:
+ * queue - A fila da thread de gravação.
+ * fs_path - O caminho do diretório no sistema simulado.
+ * relative - O caminho do diretório relativo à raiz da exportação.
+ * stats - Os totais (atualizados).
+ * output: 0 em caso de sucesso, -1 se a leitura falhou ou a gravação desistiu.
+ */
+static int export_walk(ArchiveQueue* queue, const char* fs_path, const char* relative, ArchiveStats* stats) {
+    Inode inode;
+    if (fs_stat(fs_path, &inode) < 0) return -1;
+    ArchiveItem* dir_item = new_item(ITEM_DIR, relative);
+    dir_item->mtime = inode.modification_time;
+    if (queue_push(queue, dir_item) != 0) return -1;
+    if (relative[0] != '\0') stats->dirs++;
+
+    ExportChildList children = { NULL, 0, 0 };
+    if (fs_list_dir(fs_path, collect_child, &children) != 0) return -1;
+
+    int result = 0;
+    for (unsigned int i = 0; i < children.count && result == 0; i++) {
+        char child_fs[1024], child_relative[1024];
+        if (join_path(child_fs, sizeof(child_fs), fs_path, children.items[i].name) != 0 ||
+            join_path(child_relative, sizeof(child_relative), relative, children.items[i].name) != 0) {
+            stats->skipped++;
+            continue;
+        }
+        const Inode* child = &children.items[i].inode;
+
+        if (child->mode == 1) {
+            result = export_walk(queue, child_fs, child_relative, stats);
+        } else if (child->mode == 2) {
+            fprintf(stderr, "export: Link simbolico '%s' ignorado.\n", child_fs);
+            stats->skipped++;
+        } else {
+            ArchiveItem* item = new_item(ITEM_FILE, child_relative);
+            item->size = child->size_in_bytes;
+            item->mtime = child->modification_time;
+            if (export_read_file(child_fs, item->size, &item->data) != 0) {
+                free_item(item);
+                result = -1;
+                break;
+            }
+            stats->files++;
+            stats->bytes += item->size;
+            result = queue_push(queue, item);
+        }
+    }
+    free(children.items);
+    return result;
+}
+
+/*
+ * Callback de fs_list_dir que guarda cada filho em uma ExportChildList.
+ * input:
+ * name, inode_num, inode - A entrada.
+ * context - A ExportChildList.
+ * output: 0 (continua a listagem).
+ */
+static int collect_child(const char* name, unsigned int inode_num, const Inode* inode, void* context) {
+    (void) inode_num;
+    ExportChildList* list = (ExportChildList*) context;
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->items = (ExportChild*) realloc(list->items, list->capacity * sizeof(ExportChild));
+    }
+    strncpy(list->items[list->count].name, name, MAX_FILENAME_LENGTH - 1);
+    list->items[list->count].name[MAX_FILENAME_LENGTH - 1] = '\0';
+    list->items[list->count].inode = *inode;
+    list->count++;
+    return 0;
+}
+
+/*
+ * Lê um arquivo inteiro do sistema simulado para um buffer novo.
+ * input:
+ * fs_path - O caminho do arquivo.
+ * size - O tamanho do arquivo em bytes.
+ * data - Recebe o buffer (NULL para arquivos vazios; liberado pelo chamador).
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int export_read_file(const char* fs_path, unsigned long long size, unsigned char** data) {
+    *data = NULL;
+    int fd = fs_fopen(fs_path, FS_O_READ);
+    if (fd < 0) return -1;
+    if (size > 0) *data = (unsigned char*) malloc(size);
+
+    unsigned long long done = 0;
+    while (done < size) {
+        int count = fs_fread(fd, *data + done, (unsigned int) (size - done));
+        if (count <= 0) break;
+        done += count;
+    }
+    fs_fclose(fd);
+    if (done != size) {
+        fprintf(stderr, "export: Erro ao ler '%s'.\n", fs_path);
+        free(*data);
+        *data = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Grava um item no diretório de destino, preservando a data de modificação dos arquivos.
+ * input:
+ * writer - O estado da gravação.
+ * item - O item.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int export_item_to_dir(ExportWriter* writer, const ArchiveItem* item) {
+    char path[1024];
+    if (join_path(path, sizeof(path), writer->target, item->path) != 0) {
+        fprintf(stderr, "export: Caminho longo demais: '%s'\n", item->path);
+        return -1;
+    }
+    if (item->kind == ITEM_DIR) {
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "export: Nao foi possivel criar '%s': %s\n", path, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    FILE* file = fopen(path, "wb");
+    int ok = file && (item->size == 0 || fwrite(item->data, 1, item->size, file) == item->size);
+    if (file && fclose(file) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "export: Erro ao gravar '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct utimbuf times = { (time_t) item->mtime, (time_t) item->mtime };
+    utime(path, &times);
+    return 0;
+}
+
+/*
+ * Acrescenta um item ao arquivo tar: o cabeçalho e o conteúdo completado até 512 bytes.
+ * A raiz da exportação não gera entrada.
+ * input:
+ * writer - O estado da gravação.
+ * item - O item.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int export_item_to_tar(ExportWriter* writer, const ArchiveItem* item) {
+    static const unsigned char padding[TAR_BLOCK_SIZE];
+    if (item->path[0] == '\0') return 0;
+    if (tar_write_header(writer->tar, item->path, item->kind == ITEM_DIR, item->size, item->mtime) != 0) return -1;
+    if (item->size == 0) return 0;
+
+    size_t tail = (size_t) (item->size % TAR_BLOCK_SIZE);
+    if (fwrite(item->data, 1, item->size, writer->tar) != item->size ||
+        (tail != 0 && fwrite(padding, 1, TAR_BLOCK_SIZE - tail, writer->tar) != TAR_BLOCK_SIZE - tail)) {
+        fprintf(stderr, "export: Erro ao gravar '%s': %s\n", writer->target, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Grava o cabeçalho ustar de uma entrada.
+ * input:
+ * out - O arquivo tar.
+ * name - O caminho da entrada, relativo à raiz.
+ * is_dir - 1 para diretório.
+ * size - O tamanho do conteúdo (0 para diretórios).
+ * mtime - A data de modificação.
+ * output: 0 em caso de sucesso, -1 se o caminho não couber no cabeçalho ou a gravação falhar.
+ */
+static int tar_write_header(FILE* out, const char* name, int is_dir, unsigned long long size, long long mtime) {
+    unsigned char header[TAR_BLOCK_SIZE];
+    char full_name[1024], prefix[156], short_name[101];
+    memset(header, 0, sizeof(header));
+    if (snprintf(full_name, sizeof(full_name), "%s%s", name, is_dir ? "/" : "") >= (int) sizeof(full_name) ||
+        tar_split_name(full_name, prefix, short_name) != 0) {
+        fprintf(stderr, "export: Caminho longo demais para o formato tar: '%s'\n", name);
+        return -1;
+    }
+
+    // Campos numéricos em octal, terminados em '\0' (ver o formato ustar do POSIX).
+    memcpy(header, short_name, strlen(short_name));
+    tar_octal(header + 100, 8, is_dir ? 0755 : 0644);
+    tar_octal(header + 108, 8, 0);
+    tar_octal(header + 116, 8, 0);
+    tar_octal(header + 124, 12, size);
+    tar_octal(header + 136, 12, mtime < 0 ? 0 : (unsigned long long) mtime);
+    memset(header + 148, ' ', 8); // O checksum é calculado com o próprio campo em branco.
+    header[156] = is_dir ? '5' : '0';
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    memcpy(header + 345, prefix, strlen(prefix));
+
+    unsigned int checksum = 0;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) checksum += header[i];
+    tar_octal(header + 148, 7, checksum);
+    header[155] = ' ';
+
+    if (fwrite(header, 1, sizeof(header), out) != sizeof(header)) return -1;
+    return 0;
+}
+
+/*
+ * Divide um caminho nos campos prefix (até 155 bytes) e name (até 100 bytes) do ustar,
+ * cortando em uma '/'.
+ * input:
+ * name - O caminho completo.
+ * prefix - Recebe o prefixo (vazio se o caminho couber em name).
+ * short_name - Recebe o restante.
+ * output: 0 em caso de sucesso, -1 se não houver corte possível.
+ */
+static int tar_split_name(const char* name, char* prefix, char* short_name) {
+    size_t length = strlen(name);
+    if (length <= 100) {
+        prefix[0] = '\0';
+        strcpy(short_name, name);
+        return 0;
+    }
+    // A '/' final de um diretório faz parte do nome, então o corte procura antes dela.
+    for (size_t cut = length - 2; cut > 0; cut--) {
+        if (name[cut] != '/') continue;
+        if (length - cut - 1 > 100) return -1;
+        if (cut > 155) continue;
+        memcpy(prefix, name, cut);
+        prefix[cut] = '\0';
+        strcpy(short_name, name + cut + 1);
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Escreve um campo numérico do cabeçalho tar: width - 1 dígitos octais seguidos de '\0'.
+ * Valores que não cabem ficam com o maior valor representável.
+ * input:
+ * field - O início do campo.
+ * width - O tamanho do campo em bytes.
+ * value - O valor.
+ * output: nenhum.
+ */
+static void tar_octal(unsigned char* field, int width, unsigned long long value) {
+    int digits = width - 1;
+    if (digits < 22 && value >> (3 * digits) != 0) value = (1ull << (3 * digits)) - 1;
+    field[digits] = '\0';
+    for (int i = digits - 1; i >= 0; i--) {
+        field[i] = (unsigned char) ('0' + (value & 7));
+        value >>= 3;
+    }
+}
@@ -0,0 +1,189 @@
+#include "compression.h"
+#include <string.h>
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5   // Os últimos bytes da entrada são sempre literais.
+#define LZ_MATCH_LIMIT 12    // Nenhum match começa nos últimos 12 bytes.
+#define LZ_MAX_OFFSET 65535
+
+/*
+ * Lê 4 bytes de uma posição arbitrária (sem exigir alinhamento).
+ * input:
+ * p - Ponteiro para os bytes.
+ * output: O valor de 32 bits lido.
+ */
+static unsigned int lz_read32(const unsigned char* p) {
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*
+ * Calcula o índice da tabela hash para uma sequência de 4 bytes.
+ * input:
+ * seq - Os 4 bytes lidos como inteiro.
+ * output: O índice na tabela hash.
+ */
+static unsigned int lz_hash(unsigned int seq) {
+    return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/*
+ * Escreve um comprimento estendido (bytes de 255 seguidos do resto).
+ * input:
+ * op - Ponteiro para a posição de escrita (avançado pela função).
+ * end - Fim do buffer de saída.
+ * len - O valor restante do comprimento (já descontado o nibble 15).
+ * output: 0 em caso de sucesso, -1 se não houver espaço.
+ */
+static int lz_write_length(unsigned char** op, unsigned char* end, int len) {
+    while (len >= 255) {
+        if (*op >= end) return -1;
+        *(*op)++ = 255;
+        len -= 255;
+    }
+    if (*op >= end) return -1;
+    *(*op)++ = (unsigned char) len;
+    return 0;
+}
+
+/*
+ * Emite uma sequência: token, literais e (se match_len > 0) offset e comprimento do match.
+ * input:
+ * op - Ponteiro para a posição de escrita (avançado pela função).
+ * end - Fim do buffer de saída.
+ * literals - Início dos literais.
+ * literal_len - Quantidade de literais.
+ * offset - Distância para trás do match.
+ * match_len - Tamanho do match (0 para a última sequência, só de literais).
+ * output: 0 em caso de sucesso, -1 se não houver espaço.
+ */
+static int lz_emit_sequence(unsigned char** op, unsigned char* end, const unsigned char* literals,
+                            int literal_len, int offset, int match_len) {
+    if (*op >= end) return -1;
+    unsigned char* token = (*op)++;
+    int match_code = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+    *token = (unsigned char) (((literal_len >= 15 ? 15 : literal_len) << 4) | (match_code >= 15 ? 15 : match_code));
+    if (literal_len >= 15 && lz_write_length(op, end, literal_len - 15) != 0) return -1;
+
+    if (end - *op < literal_len) return -1;
+    memcpy(*op, literals, literal_len);
+    *op += literal_len;
+
+    if (match_len == 0) return 0;
+
+    if (end - *op < 2) return -1;
+    *(*op)++ = (unsigned char) (offset & 0xFF);
+    *(*op)++ = (unsigned char) (offset >> 8);
+    if (match_code >= 15 && lz_write_length(op, end, match_code - 15) != 0) return -1;
+    return 0;
+}
+
+/*
+ * Comprime um buffer no formato de bloco estilo LZ4 (token, literais, offset de 16 bits).
+ * input:
+ * src - Dados de entrada.
+ * src_len - Tamanho da entrada em bytes.
+ * dst - Buffer de saída.
+ * dst_capacity - Capacidade do buffer de saída (LZ_COMPRESS_BOUND garante sucesso).
+ * output: O tamanho comprimido em bytes, ou -1 se a saída não couber em dst.
+ */
+int lz_compress(const unsigned char* src, int src_len, unsigned char* dst, int dst_capacity) {
+    int hash_table[1 << LZ_HASH_BITS];
+    memset(hash_table, 0, sizeof(hash_table));
+
+    unsigned char* op = dst;
+    unsigned char* end = dst + dst_capacity;
+    int anchor = 0;
+    int ip = 0;
+    int match_limit = src_len - LZ_MATCH_LIMIT;
+
+    while (ip < match_limit) {
+        unsigned int seq = lz_read32(src + ip);
+        unsigned int h = lz_hash(seq);
+        int ref = hash_table[h] - 1; // 0 na tabela significa posição vazia
+        hash_table[h] = ip + 1;
+
+        if (ref < 0 || ip - ref > LZ_MAX_OFFSET || lz_read32(src + ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        int match_len = LZ_MIN_MATCH;
+        while (ip + match_len < src_len - LZ_LAST_LITERALS && src[ref + match_len] == src[ip + match_len]) {
+            match_len++;
+        }
+
+        if (lz_emit_sequence(&op, end, src + anchor, ip - anchor, ip - ref, match_len) != 0) return -1;
+        ip += match_len;
+        anchor = ip;
+    }
+
+    if (lz_emit_sequence(&op, end, src + anchor, src_len - anchor, 0, 0) != 0) return -1;
+    return (int) (op - dst);
+}
+
+/*
+ * Descomprime um buffer gerado por lz_compress, validando todos os limites.
+ * input:
+ * src - Dados comprimidos.
+ * src_len - Tamanho dos dados comprimidos.
+ * dst - Buffer de saída.
+ * dst_capacity - Capacidade do buffer de saída.
+ * output: O tamanho descomprimido em bytes, ou -1 se os dados estiverem corrompidos.
+ */
+int lz_decompress(const unsigned char* src, int src_len, unsigned char* dst, int dst_capacity) {
+    int ip = 0;
+    int op = 0;
+
+    while (ip < src_len) {
+        unsigned char token = src[ip++];
+
+        int literal_len = token >> 4;
+        if (literal_len == 15) {
+            unsigned char b;
+            do {
+                if (ip >= src_len) return -1;
+                b = src[ip++];
+                literal_len += b;
+            } while (b == 255);
+        }
+        if (literal_len > src_len - ip || literal_len > dst_capacity - op) return -1;
+        memcpy(dst + op, src + ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+
+        if (ip >= src_len) break; // Última sequência: somente literais.
+
+        if (src_len - ip < 2) return -1;
+        int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return -1;
+
+        int match_len = token & 0x0F;
+        if (match_len == 15) {
+            unsigned char b;
+            do {
+                if (ip >= src_len) return -1;
+                b = src[ip++];
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ_MIN_MATCH;
+        if (match_len > dst_capacity - op) return -1;
+
+        if (offset >= match_len) {
+            memcpy(dst + op, dst + op - offset, match_len);
+        } else {
+            // Match sobreposto à região que está sendo escrita: cópia byte a byte.
+            for (int i = 0; i < match_len; i++) {
+                dst[op + i] = dst[op - offset + i];
+            }
+        }
+        op += match_len;
+    }
+
+    return op;
+}
@@ -0,0 +1,240 @@
+#include "crc32c.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u // Polinômio de Castagnoli, forma refletida.
+#define CRC32C_SHORT 256        // Tamanho de cada um dos três fluxos intercalados (potência de 2).
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const unsigned char* data, unsigned int length);
+
+static uint32_t crc_table[8][256];
+static uint32_t crc_short_shift[4][256]; // Operador "acrescentar CRC32C_SHORT bytes zero" por byte.
+static crc32c_fn crc_impl = NULL;
+static const char* crc_impl_name = "nenhuma";
+
+/*
+ * Monta as tabelas do algoritmo slicing-by-8 usado quando não há suporte de hardware.
+ * input: nenhum.
+ * output: nenhum.
+ */
+static void crc32c_init_tables() {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc_table[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = crc_table[0][n];
+        for (int t = 1; t < 8; t++) {
+            crc = crc_table[0][crc & 0xFF] ^ (crc >> 8);
+            crc_table[t][n] = crc;
+        }
+    }
+}
+
+/*
+ * CRC32C portátil, processando 8 bytes por iteração (slicing-by-8).
+ * input:
+ * crc - O valor parcial do CRC (já invertido).
+ * data - Os bytes a processar.
+ * length - Quantidade de bytes.
+ * output: O valor parcial atualizado.
+ */
+static uint32_t crc32c_portable(uint32_t crc, const unsigned char* data, unsigned int length) {
+    while (length >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, data, 4);
+        memcpy(&hi, data + 4, 4);
+        lo ^= crc;
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+              crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+              crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        data += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = crc_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+/*
+ * Multiplica uma matriz 32x32 sobre GF(2) por um vetor.
+ * input:
+ * mat - A matriz (uma coluna por bit do vetor).
+ * vec - O vetor.
+ * output: O produto.
+ */
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+/*
+ * Eleva uma matriz 32x32 sobre GF(2) ao quadrado.
+ * input:
+ * square - Recebe o resultado.
+ * mat - A matriz de entrada.
+ * output: nenhum.
+ */
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2_matrix_times(mat, mat[n]);
+    }
+}
+
+/*
+ * Monta as tabelas que deslocam um CRC por 'len' bytes zero, usadas para combinar fluxos paralelos.
+ * input:
+ * shift - As 4 tabelas de 256 entradas a preencher.
+ * len - Quantidade de bytes zero (potência de 2).
+ * output: nenhum.
+ */
+static void crc32c_init_shift(uint32_t shift[4][256], unsigned int len) {
+    uint32_t even[32], odd[32];
+
+    // Operador para um bit zero; os quadrados sucessivos dobram a quantidade de zeros.
+    odd[0] = CRC32C_POLY;
+    for (int n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+    gf2_matrix_square(even, odd); // 2 bits
+    gf2_matrix_square(odd, even); // 4 bits
+    for (;;) {
+        gf2_matrix_square(even, odd);
+        len >>= 1;
+        if (len == 0) break;
+        gf2_matrix_square(odd, even);
+        len >>= 1;
+        if (len == 0) {
+            memcpy(even, odd, sizeof(even));
+            break;
+        }
+    }
+
+    for (uint32_t n = 0; n < 256; n++) {
+        shift[0][n] = gf2_matrix_times(even, n);
+        shift[1][n] = gf2_matrix_times(even, n << 8);
+        shift[2][n] = gf2_matrix_times(even, n << 16);
+        shift[3][n] = gf2_matrix_times(even, n << 24);
+    }
+}
+
+/*
+ * Aplica uma tabela de deslocamento a um CRC.
+ * input:
+ * shift - As tabelas geradas por crc32c_init_shift.
+ * crc - O CRC a deslocar.
+ * output: O CRC deslocado.
+ */
+static uint32_t crc32c_shift(uint32_t shift[4][256], uint32_t crc) {
+    return shift[0][crc & 0xFF] ^ shift[1][(crc >> 8) & 0xFF] ^
+           shift[2][(crc >> 16) & 0xFF] ^ shift[3][crc >> 24];
+}
+
+/*
+ * CRC32C usando a instrução crc32 do SSE4.2, 8 bytes por instrução.
+ * Três fluxos independentes são intercalados para esconder a latência da instrução
+ * e depois combinados com crc32c_shift.
+ * input:
+ * crc - O valor parcial do CRC (já invertido).
+ * data - Os bytes a processar.
+ * length - Quantidade de bytes.
+ * output: O valor parcial atualizado.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char* data, unsigned int length) {
+    uint64_t crc64 = crc;
+    while (length >= 3 * CRC32C_SHORT) {
+        uint64_t crc1 = 0, crc2 = 0;
+        const unsigned char* end = data + CRC32C_SHORT;
+        do {
+            uint64_t w0, w1, w2;
+            memcpy(&w0, data, 8);
+            memcpy(&w1, data + CRC32C_SHORT, 8);
+            memcpy(&w2, data + 2 * CRC32C_SHORT, 8);
+            crc64 = _mm_crc32_u64(crc64, w0);
+            crc1 = _mm_crc32_u64(crc1, w1);
+            crc2 = _mm_crc32_u64(crc2, w2);
+            data += 8;
+        } while (data < end);
+        crc64 = crc32c_shift(crc_short_shift, (uint32_t) crc64) ^ crc1;
+        crc64 = crc32c_shift(crc_short_shift, (uint32_t) crc64) ^ crc2;
+        data += 2 * CRC32C_SHORT;
+        length -= 3 * CRC32C_SHORT;
+    }
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = (uint32_t) crc64;
+    while (length >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        length -= 4;
+    }
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+/*
+ * Escolhe a implementação do CRC32C conforme a CPU (SSE4.2 quando disponível).
+ * input: nenhum.
+ * output: nenhum.
+ */
+static void crc32c_select_implementation() {
+#ifdef CRC32C_HAVE_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_init_shift(crc_short_shift, CRC32C_SHORT);
+        crc_impl = crc32c_sse42;
+        crc_impl_name = "sse4.2";
+        return;
+    }
+#endif
+    crc32c_init_tables();
+    crc_impl = crc32c_portable;
+    crc_impl_name = "portatil (slicing-by-8)";
+}
+
+/*
+ * Calcula o CRC32C de um buffer.
+ * input:
+ * data - Os bytes a processar.
+ * length - Quantidade de bytes.
+ * output: O CRC32C dos dados.
+ */
+unsigned int crc32c(const void* data, unsigned int length) {
+    if (!crc_impl) crc32c_select_implementation();
+    return crc_impl(0xFFFFFFFFu, (const unsigned char*) data, length) ^ 0xFFFFFFFFu;
+}
+
+/*
+ * Retorna o nome da implementação de CRC32C em uso.
+ * input: nenhum.
+ * output: Uma string descrevendo a implementação.
+ */
+const char* crc32c_implementation() {
+    if (!crc_impl) crc32c_select_implementation();
+    return crc_impl_name;
+}
@@ -1,31 +1,247 @@
+#define _POSIX_C_SOURCE 200112L
 #include "file_operations.h"
 #include "gerenciador_de_disco.h"
+#include "compression.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 extern int g_verbose_mode;
+extern int g_compress_mode;
+
+// Alocação adiada: 'write' guarda os blocos do arquivo em memória e só aloca espaço em disco
+// no flush (fs_sync, leitura do arquivo ou quando os dados pendentes passam do limite).
+#define DELALLOC_MAX_PENDING_BYTES (4 * 1024 * 1024)
+
+typedef struct PendingWrite {
+    unsigned int inode_num;
+    unsigned int block_count;
+    unsigned char* data; // block_count blocos, já no formato em que serão gravados
+    // Tamanho, flag de compressão e extents: no disco o i-node fica vazio até o flush, que grava
+    // tudo isso junto com os blocos (um crash antes dele deixa um arquivo vazio, não um de zeros).
+    unsigned int size_in_bytes;
+    unsigned int flags;
+    unsigned short compressed_extent_size[MAX_COMPRESSED_EXTENTS];
+    struct PendingWrite* next;
+} PendingWrite;
+
+
+// Lista de números (i-nodes ou blocos) coletados ao percorrer uma árvore.
+typedef struct {
+    unsigned int* items;
+    unsigned int count;
+    unsigned int capacity;
+} NumberList;
+
+// Conteúdo de um diretório carregado de uma vez: as entradas de todos os seus blocos e os i-nodes dos filhos.
+typedef struct {
+    DirEntry* entries;         // Entradas de todos os blocos, na ordem do disco.
+    unsigned int entry_count;
+    unsigned int* child_slots; // Posição em 'entries' de cada filho (sem "." e "..").
+    Inode* child_inodes;
+    unsigned int child_count;
+} DirListing;
+
+// Tabela de arquivos abertos pela API de handles (fs_fopen, fs_fread, fs_fwrite, ...).
+// O i-node é relido a cada operação, então vários handles para o mesmo arquivo continuam coerentes.
+#define MAX_OPEN_FILES 32
+
+typedef struct {
+    int in_use;
+    unsigned int inode_num;
+    int flags;             // FS_O_*
+    unsigned int offset;
+} OpenFile;
+
+
+// Tabela de diretórios abertos por fs_opendir. As entradas são lidas uma vez na abertura e
+// fs_readdir percorre essa cópia em lotes, sem reler os blocos do diretório. O vetor de
+// entradas de cada posição é mantido ao fechar e reaproveitado na próxima abertura.
+#define MAX_OPEN_DIRS 16
+
+typedef struct {
+    int in_use;
+    int flags;             // FS_READDIR_*
+    DirEntry* entries;     // Entradas de todos os blocos, na ordem do disco.
+    size_t entries_capacity; // Bytes alocados em 'entries'.
+    unsigned int entry_count;
+    unsigned int position; // Próxima entrada a examinar.
+} OpenDir;
+
+
+// Quantas entradas fs_ls e fs_list_dir pedem a fs_readdir por vez.
+#define READDIR_BATCH 64
+
+// Quantos i-nodes cada passo da desfragmentação em segundo plano examina, no máximo.
+#define DEFRAG_STEP_INODES 64
+
+// Dicas por diretório, mantidas em memória enquanto o sistema está montado: quantas entradas
+// estão em uso e a partir de qual posição pode haver uma livre. Com elas, inserir uma entrada
+// lê e grava um único bloco e o rmdir não precisa contar as entradas. A tabela é só um cache
+// (mapeamento direto por número de i-node); sem dica, as funções voltam a percorrer o diretório.
+#define DIR_HINT_SLOTS 256
+
+typedef struct {
+    int valid;
+    unsigned int dir_inode_num;
+    unsigned int entry_count; // Entradas em uso, incluindo "." e "..".
+    unsigned int first_free;  // Posição (bloco * entradas por bloco + entrada) antes da qual não há posição livre.
+} DirHint;
+
+// Onde find_entry_in_dir encontrou a última entrada; remove_entry_from_dir confere essa
+// posição antes de percorrer o diretório de novo (o padrão é procurar e depois remover).
+typedef struct {
+    int valid;
+    unsigned int dir_inode_num;
+    unsigned int inode_num;
+    unsigned int position;
+} LastLookup;
+
+// Cache de resolução de caminhos: caminho completo -> i-node final, já com os links simbólicos
+// seguidos. Só resoluções bem-sucedidas entram; qualquer entrada de diretório removida,
+// renomeada ou redirecionada invalida a cache inteira de uma vez (path_generation). Caminhos
+// maiores que PATH_CACHE_MAX_PATH não são guardados.
+#define PATH_CACHE_SLOTS 128
+#define PATH_CACHE_MAX_PATH 120
+
+// Quantos links simbólicos uma resolução segue antes de desistir (ciclos de links).
+#define MAX_SYMLINK_FOLLOWS 16
+
+typedef struct {
+    int valid;
+    unsigned int generation;
+    unsigned int inode_num;
+    int follow_last;
+    char path[PATH_CACHE_MAX_PATH];
+} PathCacheEntry;
+
+// Tempo de acesso no estilo relatime: uma leitura só atualiza o atime se ele não for mais
+// recente que o mtime ou se tiver mais de RELATIME_INTERVAL segundos. A atualização fica
+// pendente no núcleo (fs_touch_inode) e não grava a tabela de i-nodes na hora.
+#define RELATIME_INTERVAL (24 * 60 * 60)
+
+// Estado das operações sobre um sistema de arquivos montado. Cada contexto (fs_context.h) tem
+// o seu; as funções deste módulo usam o estado selecionado na thread que as chama.
+struct OpsState {
+    PendingWrite* pending_writes;
+    unsigned long pending_bytes;
+    OpenFile open_files[MAX_OPEN_FILES];
+    OpenDir open_dirs[MAX_OPEN_DIRS];
+    DirHint dir_hints[DIR_HINT_SLOTS];
+    LastLookup last_lookup;
+    PathCacheEntry path_cache[PATH_CACHE_SLOTS];
+    unsigned int path_generation;
+    FsDirEntry* ls_entries;   // Vetor de fs_ls, mantido entre chamadas: só cresce.
+    unsigned int ls_capacity;
+    unsigned char* transfer;  // Buffer de vários blocos para leituras grandes (cat, cp): só cresce.
+    size_t transfer_capacity;
+    unsigned char* extent_stored; // Blocos de um extent comprimido, ou a saída do compressor: só cresce.
+    size_t extent_stored_capacity;
+    unsigned char* extent_raw;    // Um extent descomprimido (COMPRESSION_EXTENT_SIZE bytes).
+    unsigned int defrag_cursor;   // Próximo i-node examinado por fs_defrag_step.
+};
+
+static OpsState default_ops;
+static __thread OpsState* ops_g = &default_ops;
+
+// Próximos i-nodes e blocos pré-alocados a usar na cópia de uma árvore.
+typedef struct {
+    const unsigned int* inodes;
+    unsigned int next_inode;
+    const unsigned int* blocks;
+    unsigned int next_block;
+} CopyCursor;
+
+// Um arquivo ou diretório visto pela desfragmentação.
+typedef struct {
+    unsigned int inode_num;
+    unsigned int parent_num; // Diretório com a entrada que aponta para ele (a raiz aponta para si mesma).
+    Inode inode;
+} DefragItem;
+
+// Todos os arquivos e diretórios da árvore, coletados para a desfragmentação.
+typedef struct {
+    DefragItem* items;
+    unsigned int count;
+    unsigned int capacity;
+} DefragList;
 
 // --- Protótipos de Funções Auxiliares (Estáticas) ---
 static int find_inode_by_path(const char* path, Inode* result_inode);
+static int resolve_path(const char* path, int follow_last, Inode* result_inode);
 static int find_entry_in_dir(int dir_inode_num, const char* name, DirEntry* result_entry);
+static int find_entry_in_dir_inode(int dir_inode_num, const Inode* dir_inode, const char* name, DirEntry* result_entry);
 static int add_entry_to_dir(int parent_inode_num, const char* new_entry_name, int new_inode_num);
+static int remove_entry_from_dir(int parent_inode_num, const Inode* parent_inode, const char* name, unsigned int inode_num);
+static int update_entry_in_dir(int dir_inode_num, const Inode* dir_inode, const char* name, const char* new_name, unsigned int new_inode_num);
+static DirHint* dir_hint_get(unsigned int dir_inode_num);
+static void dir_hint_set(unsigned int dir_inode_num, unsigned int entry_count, unsigned int first_free);
+static void dir_hint_forget(unsigned int dir_inode_num);
+static void dir_hint_entry_removed(unsigned int dir_inode_num, unsigned int position);
+static int is_descendant_dir(int dir_inode_num, unsigned int ancestor_inode_num);
+static void release_file_inode(int inode_num, const Inode* inode);
+static int unlink_file_inode(int inode_num, Inode* inode);
+static int read_symlink_target(const Inode* inode, const unsigned char* inline_area, char* target, unsigned int size);
+static PathCacheEntry* path_cache_slot(const char* path, int follow_last);
+static PathCacheEntry* path_cache_get(const char* path, int follow_last);
+static void path_cache_set(const char* path, int follow_last, unsigned int inode_num);
+static void path_cache_invalidate();
+static void touch_access_time(unsigned int inode_num, const Inode* inode);
+static int pack_file_data(const unsigned char* raw, long file_size, Inode* inode, unsigned char** packed, unsigned int* block_count);
+static int pack_compressed_data(const unsigned char* raw, long file_size, Inode* inode, unsigned char* packed, unsigned int* block_count);
+static int flush_pending_writes();
+static int flush_pending_write(PendingWrite* pending, const unsigned int* preallocated);
+static int flush_inode_if_pending(unsigned int inode_num);
+static int drop_pending_write(unsigned int inode_num);
+static void apply_pending_layout(unsigned int inode_num, Inode* inode);
+static int cat_compressed_data(const Inode* inode);
+static void number_list_push(NumberList* list, unsigned int value);
+static unsigned int count_inode_blocks(const Inode* inode);
+static DirEntry* read_dir_entries(const Inode* dir_inode, unsigned int* entry_count);
+static int load_dir_entries(const Inode* dir_inode, DirEntry** entries, size_t* capacity, unsigned int* entry_count);
+static int load_dir_listing(const Inode* dir_inode, DirListing* listing);
+static void free_dir_listing(DirListing* listing);
+static int collect_tree(unsigned int inode_num, const Inode* inode, NumberList* inodes, NumberList* blocks, NumberList* xattr_blocks, NumberList* linked);
+static int copy_tree(unsigned int src_inode_num, const Inode* src_inode, unsigned int new_parent_num, CopyCursor* cursor);
+static unsigned long du_tree(const char* path, const Inode* inode);
+static OpenFile* get_open_file(int fd, int required_flag);
+static int open_dir_inode(const Inode* dir_inode, int flags);
+static int compare_dir_entries(const void* a, const void* b);
+static void print_ls_entry(const char* name, unsigned int inode_num, const Inode* inode, int long_format);
+static void close_handles_for_inode(unsigned int inode_num);
+static int create_empty_file(const char* path, Inode* inode);
+static int allocate_missing_blocks(Inode* inode, unsigned int last_index, unsigned char* fresh);
+static int truncate_inode(unsigned int inode_num, Inode* inode, unsigned int new_size);
+static int read_raw_range(const Inode* inode, unsigned int offset, unsigned char* buffer, unsigned int count);
+static int read_compressed_range(const Inode* inode, unsigned int offset, unsigned char* buffer, unsigned int count);
+static unsigned char* get_transfer_buffer(size_t size);
+static unsigned char* get_extent_buffers(unsigned char** raw_buffer);
+static int collect_defrag_items(unsigned int inode_num, unsigned int parent_num, const Inode* inode, DefragList* list);
+static unsigned int count_extents(const Inode* inode);
+static void measure_fragmentation(const DefragList* list, unsigned int* files, unsigned int* extents, unsigned int* fragmented);
+static double measure_read_rate(const DefragList* list);
+static int relocate_item(DefragItem* item, int compact);
+static int relocate_tail_blocks(DefragItem* item, unsigned int limit);
+static int compare_items_by_first_block(const void* a, const void* b);
+static int compare_items_by_inode_desc(const void* a, const void* b);
+static int is_inode_open(unsigned int inode_num);
+static int retarget_dir_entries(unsigned int dir_inode_num, unsigned int old_num, unsigned int new_num);
+static int move_inode(DefragList* list, DefragItem* item, unsigned int new_num);
 
 
 /*
- * Lista o conteúdo de um diretório.
+ * Lista o conteúdo de um diretório, em ordem alfabética.
  * input: 
  * path - Caminho para o diretório ou arquivo a ser listado.
+ * long_format - 1 para mostrar tipo, links, tamanho e data de modificação de cada entrada (ls -l).
  * output: 
  * 0 em caso de sucesso, -1 em caso de erro.
  */
-int fs_ls(const char* path) {
+int fs_ls(const char* path, int long_format) {
     printf("Listando conteudo de: %s\n", path);
     printf("----------------------------------\n");
     
-    Superblock sb = fs_get_superblock_info();
-    
     Inode target_inode;
     int inode_num = find_inode_by_path(path, &target_inode);
 
@@ -36,27 +252,35 @@ int fs_ls(const char* path) {
 
     if (target_inode.mode != 1) { 
         const char* filename = strrchr(path, '/');
-        printf("%s\n", filename ? filename + 1 : path);
+        print_ls_entry(filename ? filename + 1 : path, (unsigned int) inode_num, &target_inode, long_format);
         return 0;
     }
 
-    DirEntry* dir_entries = (DirEntry*) malloc(sb.block_size);
-    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+    int dd = open_dir_inode(&target_inode, long_format ? FS_READDIR_PLUS : 0);
+    if (dd < 0) {
+        fprintf(stderr, "ls: erro ao ler o diretorio '%s'.\n", path);
+        return -1;
+    }
 
-    for (int i = 0; i < 12; i++) {
-        unsigned int block_num = target_inode.direct_blocks[i];
-        if (block_num == 0) break;
+    unsigned int count = 0;
+    int batch_count;
+    do {
+        if (count + READDIR_BATCH > ops_g->ls_capacity) {
+            ops_g->ls_capacity = ops_g->ls_capacity ? ops_g->ls_capacity * 2 : READDIR_BATCH;
+            ops_g->ls_entries = (FsDirEntry*) realloc(ops_g->ls_entries, ops_g->ls_capacity * sizeof(FsDirEntry));
+        }
+        batch_count = fs_readdir(dd, ops_g->ls_entries + count, READDIR_BATCH);
+        if (batch_count > 0) count += batch_count;
+    } while (batch_count > 0);
+    fs_closedir(dd);
 
-        disk_read_block(block_num, dir_entries);
+    FsDirEntry* entries = ops_g->ls_entries;
 
-        for (unsigned int j = 0; j < entries_per_block; j++) {
-            if (dir_entries[j].name[0] != '\0') {
-                printf("%s\n", dir_entries[j].name);
-            }
-        }
+    qsort(entries, count, sizeof(FsDirEntry), compare_dir_entries);
+    for (unsigned int i = 0; i < count; i++) {
+        print_ls_entry(entries[i].name, entries[i].inode_num, &entries[i].inode, long_format);
     }
 
-    free(dir_entries);
     printf("----------------------------------\n");
     return 0;
 }
@@ -105,26 +329,35 @@ int fs_mkdir(const char* path) {
     }
 
     Inode new_inode;
+    memset(&new_inode, 0, sizeof(Inode));
     new_inode.mode = 1;
     new_inode.link_count = 2;
     new_inode.size_in_bytes = fs_get_superblock_info().block_size;
-    new_inode.creation_time = time(NULL);
-    new_inode.modification_time = time(NULL);
-    new_inode.last_access_time = time(NULL);
+    time_t now = time(NULL);
+    new_inode.creation_time = now;
+    new_inode.modification_time = now;
+    new_inode.last_access_time = now;
     new_inode.direct_blocks[0] = new_block_num;
     for(int i = 1; i < 12; i++) new_inode.direct_blocks[i] = 0;
     new_inode.single_indirect_block = 0;
     new_inode.double_indirect_block = 0;
-    fs_write_inode(new_inode_num, &new_inode);
+    if (fs_write_inode(new_inode_num, &new_inode) != 0) {
+        fprintf(stderr, "mkdir: nao foi possivel gravar o i-node de '%s'.\n", path);
+        fs_free_block(new_block_num);
+        fs_free_inode(new_inode_num);
+        return -1;
+    }
 
     Superblock sb = fs_get_superblock_info();
-    DirEntry* new_dir_block = (DirEntry*) calloc(1, sb.block_size);
+    DirEntry* new_dir_block = (DirEntry*) fs_get_block_buffer();
+    memset(new_dir_block, 0, sb.block_size);
     strcpy(new_dir_block[0].name, ".");
     new_dir_block[0].inode_number = new_inode_num;
     strcpy(new_dir_block[1].name, "..");
     new_dir_block[1].inode_number = parent_inode_num;
     disk_write_block(new_block_num, new_dir_block);
-    free(new_dir_block);
+    fs_put_block_buffer(new_dir_block);
+    dir_hint_set(new_inode_num, 2, 2);
 
     if (add_entry_to_dir(parent_inode_num, new_dir_name, new_inode_num) != 0) {
         fprintf(stderr, "mkdir: erro ao adicionar entrada no diretorio pai (pode estar cheio).\n");
@@ -153,6 +386,44 @@ int fs_write(const char* simulated_path, const char* real_path) {
     long real_file_size = ftell(real_file);
     fseek(real_file, 0, SEEK_SET);
 
+    // O conteúdo vai para o buffer de transferência (o caminho de escrita não o usa) e é copiado
+    // para os blocos empacotados. O limite é o maior conteúdo que cabe em um i-node, o que também
+    // limita o crescimento do buffer.
+    long max_size = g_compress_mode ? (long) MAX_COMPRESSED_EXTENTS * COMPRESSION_EXTENT_SIZE
+                                    : 12L * fs_get_superblock_info().block_size;
+    if (real_file_size > max_size) {
+        fprintf(stderr, "write: Arquivo grande demais para o i-node.\n");
+        fclose(real_file);
+        return -1;
+    }
+    unsigned char* raw = get_transfer_buffer(real_file_size > 0 ? (size_t) real_file_size : 1);
+    if (!raw || fread(raw, 1, real_file_size, real_file) != (size_t) real_file_size) {
+        fprintf(stderr, "write: Erro ao ler o arquivo real.\n");
+        fclose(real_file);
+        return -1;
+    }
+    fclose(real_file);
+
+    int compressed = 0;
+    int result = fs_write_buffer(simulated_path, raw, real_file_size, &compressed);
+    if (result == 0) printf("Arquivo '%s' escrito com sucesso%s.\n", simulated_path, compressed ? " (comprimido)" : "");
+    return result;
+}
+
+/*
+ * Cria um arquivo no sistema simulado com o conteúdo de um buffer, substituindo um arquivo
+ * regular ou link de mesmo nome (os outros links físicos do arquivo antigo continuam com ele). Os dados ficam com alocação adiada e são comprimidos se
+ * g_compress_mode estiver ligado; o arquivo antigo só é removido depois de os novos dados
+ * terem sido preparados.
+ * input:
+ * simulated_path - O caminho de destino no sistema simulado.
+ * data - O conteúdo.
+ * size - O tamanho do conteúdo em bytes.
+ * compressed - Recebe 1 se o arquivo foi gravado comprimido (pode ser NULL).
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro.
+ */
+int fs_write_buffer(const char* simulated_path, const void* data, long size, int* compressed) {
     char path_copy[1024];
     strncpy(path_copy, simulated_path, 1023);
     path_copy[1023] = '\0';
@@ -165,58 +436,97 @@ int fs_write(const char* simulated_path, const char* real_path) {
     int parent_inode_num = find_inode_by_path(parent_path, &parent_inode);
     if (parent_inode_num < 0) {
         fprintf(stderr, "write: Diretorio pai '%s' nao encontrado.\n", parent_path);
-        fclose(real_file);
         return -1;
     }
+    DirEntry old_entry;
+    Inode old_inode;
+    int replacing = find_entry_in_dir(parent_inode_num, new_file_name, &old_entry) == 0;
+    if (replacing) {
+        fs_read_inode(old_entry.inode_number, &old_inode);
+        if (old_inode.mode == 1) {
+            fprintf(stderr, "write: '%s' e um diretorio.\n", simulated_path);
+            return -1;
+        }
+    }
+
+    Inode new_inode;
+    memset(&new_inode, 0, sizeof(Inode));
+    new_inode.mode = 0; // 0 = arquivo regular
+    new_inode.link_count = 1;
+    new_inode.size_in_bytes = size;
+    time_t now = time(NULL);
+    new_inode.creation_time = now;
+    new_inode.modification_time = now;
+    new_inode.last_access_time = now;
+
+    unsigned char* packed = NULL;
+    unsigned int block_count = 0;
+    if (pack_file_data((const unsigned char*) data, size, &new_inode, &packed, &block_count) != 0) return -1;
 
     int new_inode_num = fs_alloc_inode();
     if (new_inode_num < 0) {
         fprintf(stderr, "write: Nao ha i-nodes livres.\n");
-        fclose(real_file);
+        free(packed);
         return -1;
     }
-    Inode new_inode;
-    new_inode.mode = 0; // 0 = arquivo regular
-    new_inode.link_count = 1;
-    new_inode.size_in_bytes = real_file_size;
-    new_inode.creation_time = time(NULL);
-    new_inode.modification_time = time(NULL);
-    new_inode.last_access_time = time(NULL);
-	for(int i = 0; i < 12; i++) new_inode.direct_blocks[i] = 0;
-
-    Superblock sb = fs_get_superblock_info();
-    char* buffer = (char*) malloc(sb.block_size);
-    long bytes_remaining = real_file_size;
-    int block_count = 0;
-
-    while(bytes_remaining > 0 && block_count < 12) {
-        size_t bytes_to_read = (bytes_remaining > (long)sb.block_size) ? sb.block_size : bytes_remaining;
-        fread(buffer, 1, bytes_to_read, real_file);
-        
-        int new_block_num = fs_alloc_block();
-        if (new_block_num < 0) {
-            fprintf(stderr, "write: Sem espaco em disco para alocar bloco.\n");
-            fclose(real_file);
-            free(buffer);
-            return -1;
-        }
+    if (replacing) {
+        unlink_file_inode(old_entry.inode_number, &old_inode);
+        remove_entry_from_dir(parent_inode_num, &parent_inode, new_file_name, old_entry.inode_number);
+    }
 
-        disk_write_block(new_block_num, buffer);
-        new_inode.direct_blocks[block_count] = new_block_num;
+    // O i-node vai para o disco já agora, vazio; tamanho, dados e blocos só no flush.
+    Inode empty_inode = new_inode;
+    if (block_count > 0) {
+        empty_inode.size_in_bytes = 0;
+        empty_inode.flags &= ~INODE_FLAG_COMPRESSED;
+        memset(empty_inode.compressed_extent_size, 0, sizeof(empty_inode.compressed_extent_size));
+    }
+    if (fs_write_inode(new_inode_num, &empty_inode) != 0) {
+        fprintf(stderr, "write: Nao foi possivel gravar o i-node de '%s'.\n", simulated_path);
+        fs_free_inode(new_inode_num);
+        free(packed);
+        return -1;
+    }
+    if (add_entry_to_dir(parent_inode_num, new_file_name, new_inode_num) != 0) {
+        fprintf(stderr, "write: Diretorio '%s' cheio.\n", parent_path);
+        fs_free_inode(new_inode_num);
+        free(packed);
+        return -1;
+    }
 
-        bytes_remaining -= bytes_to_read;
-        block_count++;
+    if (block_count > 0) {
+        PendingWrite* pending = (PendingWrite*) malloc(sizeof(PendingWrite));
+        pending->inode_num = new_inode_num;
+        pending->block_count = block_count;
+        pending->data = packed;
+        pending->size_in_bytes = new_inode.size_in_bytes;
+        pending->flags = new_inode.flags & INODE_FLAG_COMPRESSED;
+        memcpy(pending->compressed_extent_size, new_inode.compressed_extent_size, sizeof(pending->compressed_extent_size));
+        pending->next = ops_g->pending_writes;
+        ops_g->pending_writes = pending;
+        ops_g->pending_bytes += (unsigned long) block_count * fs_get_superblock_info().block_size;
+        if (ops_g->pending_bytes > DELALLOC_MAX_PENDING_BYTES) flush_pending_writes();
+    } else {
+        free(packed);
     }
-    
-    fclose(real_file);
-    free(buffer);
-    fs_write_inode(new_inode_num, &new_inode);
-    add_entry_to_dir(parent_inode_num, new_file_name, new_inode_num);
 
-    printf("Arquivo '%s' escrito com sucesso.\n", simulated_path);
+    if (compressed) *compressed = (new_inode.flags & INODE_FLAG_COMPRESSED) != 0;
     return 0;
 }
 
+/*
+ * Grava no disco todos os arquivos com alocação adiada, alocando seus blocos, e torna duráveis
+ * todas as escritas feitas até aqui, incluindo os checksums (disk_sync).
+ * input: nenhum.
+ * output: 0 em caso de sucesso, -1 se algum arquivo não pôde ser gravado.
+ */
+int fs_sync() {
+    int result = flush_pending_writes();
+    if (fs_flush_inode_times() != 0) result = -1;
+    if (disk_sync() != 0) result = -1; // Por último: os checksums vão depois dos blocos que cobrem.
+    return result;
+}
+
 /*
  * Exibe o conteúdo de um arquivo simulado na saída padrão.
  * input:
@@ -226,36 +536,45 @@ int fs_write(const char* simulated_path, const char* real_path) {
  */
 int fs_cat(const char* path) {
     Inode target_inode;
-    if (find_inode_by_path(path, &target_inode) < 0) {
+    int inode_num = find_inode_by_path(path, &target_inode);
+    if (inode_num < 0) {
         fprintf(stderr, "cat: %s: Arquivo ou diretorio nao encontrado\n", path);
         return -1;
     }
+    if (flush_inode_if_pending(inode_num) == 1) {
+        fs_read_inode(inode_num, &target_inode);
+    }
     if (target_inode.mode != 0) {
         fprintf(stderr, "cat: %s: Nao e um arquivo\n", path);
         return -1;
     }
+    touch_access_time(inode_num, &target_inode);
     if (target_inode.size_in_bytes == 0) {
         return 0;
     }
+    if (target_inode.flags & INODE_FLAG_COMPRESSED) {
+        return cat_compressed_data(&target_inode);
+    }
 
     Superblock sb = fs_get_superblock_info();
-    char* buffer = (char*) malloc(sb.block_size);
-    long bytes_remaining = target_inode.size_in_bytes;
-
-    for(int i = 0; i < 12 && target_inode.direct_blocks[i] != 0; i++) {
-        disk_read_block(target_inode.direct_blocks[i], buffer);
-        size_t bytes_to_write = (bytes_remaining > (long)sb.block_size) ? sb.block_size : bytes_remaining;
-        fwrite(buffer, 1, bytes_to_write, stdout);
-        bytes_remaining -= bytes_to_write;
-        if (bytes_remaining <= 0) break;
+    unsigned int block_count = 0;
+    while (block_count < 12 && target_inode.direct_blocks[block_count] != 0 &&
+           (unsigned long long) block_count * sb.block_size < target_inode.size_in_bytes) block_count++;
+
+    // Todos os blocos num único pedido: num volume distribuído, os membros são lidos em paralelo.
+    unsigned char* buffer = get_transfer_buffer((size_t) block_count * sb.block_size);
+    if (!buffer || disk_read_blocks(target_inode.direct_blocks, block_count, buffer) != 0) {
+        fprintf(stderr, "cat: %s: Erro ao ler os blocos do arquivo.\n", path);
+        return -1;
     }
-    
-    free(buffer);
+    size_t available = (size_t) block_count * sb.block_size;
+    fwrite(buffer, 1, target_inode.size_in_bytes < available ? target_inode.size_in_bytes : available, stdout);
     return 0;
 }
 
 /*
- * Remove um arquivo do sistema de arquivos.
+ * Remove um arquivo ou link simbólico do sistema de arquivos. Os blocos só são liberados
+ * quando o último link físico do arquivo é removido.
  * input:
  * path - O caminho para o arquivo a ser removido.
  * output:
@@ -279,35 +598,13 @@ int fs_rm(const char* path) {
     }
     Inode inode_to_rm;
     fs_read_inode(entry_to_rm.inode_number, &inode_to_rm);
-    if (inode_to_rm.mode != 0) {
+    if (inode_to_rm.mode == 1) {
         fprintf(stderr, "rm: %s: Nao e um arquivo. Use 'rmdir' para diretorios.\n", path);
         return -1;
     }
 
-    for (int i = 0; i < 12; i++) {
-        if (inode_to_rm.direct_blocks[i] != 0) {
-            fs_free_block(inode_to_rm.direct_blocks[i]);
-        }
-    }
-    fs_free_inode(entry_to_rm.inode_number);
-
-    Superblock sb = fs_get_superblock_info();
-    DirEntry* dir_buffer = (DirEntry*) malloc(sb.block_size);
-    for (int i = 0; i < 12; i++) {
-        if (parent_inode.direct_blocks[i] != 0) {
-            disk_read_block(parent_inode.direct_blocks[i], dir_buffer);
-            for (unsigned int j = 0; j < (sb.block_size / sizeof(DirEntry)); j++) {
-                if (dir_buffer[j].inode_number == entry_to_rm.inode_number) {
-                    dir_buffer[j].name[0] = '\0';
-                    dir_buffer[j].inode_number = 0;
-                    disk_write_block(parent_inode.direct_blocks[i], dir_buffer);
-                    goto entry_removed;
-                }
-            }
-        }
-    }
-entry_removed:
-    free(dir_buffer);
+    unlink_file_inode(entry_to_rm.inode_number, &inode_to_rm);
+    remove_entry_from_dir(parent_inode_num, &parent_inode, file_to_rm_name, entry_to_rm.inode_number);
 
     printf("Arquivo '%s' removido com sucesso.\n", path);
     return 0;
@@ -326,8 +623,10 @@ int fs_rmdir(const char* path) {
         return -1;
     }
     
+    // Um link simbólico para um diretório não é seguido: rmdir o trata como "não é um diretório".
     Inode target_inode;
-    if (find_inode_by_path(path, &target_inode) < 0) {
+    int target_inode_num = resolve_path(path, 0, &target_inode);
+    if (target_inode_num < 0) {
         fprintf(stderr, "rmdir: %s: Diretorio nao encontrado.\n", path);
         return -1;
     }
@@ -336,16 +635,25 @@ int fs_rmdir(const char* path) {
         return -1;
     }
 
-    Superblock sb = fs_get_superblock_info();
-    DirEntry* dir_buffer = (DirEntry*) malloc(sb.block_size);
-    disk_read_block(target_inode.direct_blocks[0], dir_buffer);
-    int entry_count = 0;
-    for (unsigned int i = 0; i < sb.block_size / sizeof(DirEntry); i++) {
-        if (dir_buffer[i].name[0] != '\0') {
-            entry_count++;
+    DirHint* hint = dir_hint_get(target_inode_num);
+    unsigned int entry_count = 0;
+    if (hint) {
+        entry_count = hint->entry_count;
+    } else {
+        unsigned int slots = 0;
+        DirEntry* entries = read_dir_entries(&target_inode, &slots);
+        if (!entries) {
+            fprintf(stderr, "rmdir: %s: Erro ao ler o diretorio.\n", path);
+            return -1;
         }
+        unsigned int first_free = 12 * (fs_get_superblock_info().block_size / sizeof(DirEntry));
+        for (unsigned int i = 0; i < slots; i++) {
+            if (entries[i].name[0] != '\0') entry_count++;
+            else if (first_free > i) first_free = i;
+        }
+        free(entries);
+        if (count_inode_blocks(&target_inode) == 1) dir_hint_set(target_inode_num, entry_count, first_free);
     }
-    free(dir_buffer);
     if (entry_count > 2) {
         fprintf(stderr, "rmdir: %s: O diretorio nao esta vazio.\n", path);
         return -1;
@@ -359,21 +667,36 @@ int fs_rmdir(const char* path) {
     if (dir_name == path_copy) { parent_path = "/"; dir_name++; }
     else { *dir_name = '\0'; dir_name++; parent_path = path_copy; }
     
+    // "/a/", "/a/." e "/a/.." não nomeiam uma entrada no pai: remover por eles apagaria a entrada errada.
+    if (dir_name[0] == '\0' || strcmp(dir_name, ".") == 0 || strcmp(dir_name, "..") == 0) {
+        fprintf(stderr, "rmdir: Nao e possivel remover '%s'.\n", path);
+        return -1;
+    }
+
     Inode parent_inode;
     int parent_inode_num = find_inode_by_path(parent_path, &parent_inode);
     DirEntry entry;
-    find_entry_in_dir(parent_inode_num, dir_name, &entry);
+    if (parent_inode_num < 0 || find_entry_in_dir(parent_inode_num, dir_name, &entry) != 0
+        || entry.inode_number != (unsigned int) target_inode_num) {
+        fprintf(stderr, "rmdir: %s: Diretorio nao encontrado.\n", path);
+        return -1;
+    }
 
-    if (g_verbose_mode) printf("Liberando bloco de dados %d e i-node %d para %s\n", target_inode.direct_blocks[0], entry.inode_number, path);
-    fs_free_block(target_inode.direct_blocks[0]);
-    fs_free_inode(entry.inode_number);
+    if (g_verbose_mode) printf("Liberando %u bloco(s) de dados e i-node %d para %s\n", count_inode_blocks(&target_inode), target_inode_num, path);
+    fs_free_blocks(target_inode.direct_blocks, 12);
+    if (target_inode.xattr_block != 0) fs_free_block(target_inode.xattr_block);
+    fs_free_inode(target_inode_num);
+    dir_hint_forget(target_inode_num);
+    remove_entry_from_dir(parent_inode_num, &parent_inode, dir_name, target_inode_num);
 
     printf("Diretorio '%s' removido com sucesso.\n", path);
     return 0;
 }
 
 /*
- * Renomeia um arquivo ou diretório dentro do mesmo diretório pai.
+ * Move ou renomeia um arquivo ou diretório, inclusive entre diretórios diferentes.
+ * Só metadados são alterados: os blocos de dados nunca são copiados.
+ * Se o destino for um diretório existente, a entrada é movida para dentro dele.
  * input:
  * old_path - O caminho original do arquivo/diretório.
  * new_path - O novo caminho para o arquivo/diretório.
@@ -397,177 +720,2797 @@ int fs_mv(const char* old_path, const char* new_path) {
     if (new_name == new_path_copy) { new_parent_path = "/"; new_name++; }
     else { *new_name = '\0'; new_name++; new_parent_path = new_path_copy; }
 
-    if (strcmp(old_parent_path, new_parent_path) != 0) {
-        fprintf(stderr, "mv: Mover entre diretorios diferentes ainda nao e suportado.\n");
+    if (old_name[0] == '\0' || strcmp(old_name, ".") == 0 || strcmp(old_name, "..") == 0) {
+        fprintf(stderr, "mv: Nao e possivel mover '%s'.\n", old_path);
         return -1;
     }
 
-    Inode parent_inode;
-    // <<< CORREÇÃO 2: A variável 'parent_inode_num' não era usada. Removida. >>>
-    find_inode_by_path(old_parent_path, &parent_inode);
-    
-    Superblock sb = fs_get_superblock_info();
-    DirEntry* dir_buffer = (DirEntry*) malloc(sb.block_size);
-    for (int i = 0; i < 12; i++) {
-        if (parent_inode.direct_blocks[i] != 0) {
-            disk_read_block(parent_inode.direct_blocks[i], dir_buffer);
-            for (unsigned int j = 0; j < sb.block_size / sizeof(DirEntry); j++) {
-                if (strcmp(dir_buffer[j].name, old_name) == 0) {
-                    strncpy(dir_buffer[j].name, new_name, MAX_FILENAME_LENGTH - 1);
-					dir_buffer[j].name[MAX_FILENAME_LENGTH -1] = '\0';
-                    disk_write_block(parent_inode.direct_blocks[i], dir_buffer);
-                    printf("'%s' renomeado para '%s'.\n", old_path, new_path);
-                    free(dir_buffer);
-                    return 0;
-                }
-            }
+    Inode old_parent_inode;
+    int old_parent_num = find_inode_by_path(old_parent_path, &old_parent_inode);
+    DirEntry source_entry;
+    if (old_parent_num < 0 || find_entry_in_dir(old_parent_num, old_name, &source_entry) != 0) {
+        fprintf(stderr, "mv: Nao foi possivel encontrar o arquivo de origem '%s'.\n", old_path);
+        return -1;
+    }
+    Inode source_inode;
+    fs_read_inode(source_entry.inode_number, &source_inode);
+
+    Inode new_parent_inode;
+    int new_parent_num = find_inode_by_path(new_parent_path, &new_parent_inode);
+    if (new_parent_num < 0 || new_parent_inode.mode != 1) {
+        fprintf(stderr, "mv: %s: Diretorio de destino nao encontrado.\n", new_parent_path);
+        return -1;
+    }
+
+    // "mv /a /dir" move 'a' para dentro de '/dir' quando o destino já é um diretório.
+    DirEntry target_entry;
+    if (new_name[0] == '\0') {
+        new_name = old_name;
+    } else if (find_entry_in_dir(new_parent_num, new_name, &target_entry) == 0) {
+        if (target_entry.inode_number == source_entry.inode_number) return 0;
+        Inode target_inode;
+        fs_read_inode(target_entry.inode_number, &target_inode);
+        if (target_inode.mode != 1) {
+            fprintf(stderr, "mv: '%s': Arquivo ja existe.\n", new_path);
+            return -1;
         }
+        new_parent_num = target_entry.inode_number;
+        new_parent_inode = target_inode;
+        new_name = old_name;
+    }
+    if (find_entry_in_dir(new_parent_num, new_name, &target_entry) == 0) {
+        if (target_entry.inode_number == source_entry.inode_number) return 0;
+        fprintf(stderr, "mv: '%s': Arquivo ou diretorio ja existe.\n", new_path);
+        return -1;
     }
-    
-    free(dir_buffer);
-    fprintf(stderr, "mv: Nao foi possivel encontrar o arquivo de origem '%s'.\n", old_path);
-    return -1;
-}
 
-/*
- * Verifica se um caminho corresponde a um diretório válido.
- * input:
- * path - O caminho a ser verificado.
- * output:
- * 0 se for um diretório, -1 caso contrário.
- */
-int fs_check_path_is_dir(const char* path) {
-    Inode target_inode;
-    if (find_inode_by_path(path, &target_inode) < 0) {
-        fprintf(stderr, "cd: %s: Arquivo ou diretorio nao encontrado\n", path);
+    if (strlen(new_name) >= MAX_FILENAME_LENGTH) {
+        fprintf(stderr, "mv: Nome '%s' muito longo.\n", new_name);
         return -1;
     }
-    if (target_inode.mode != 1) {
-        fprintf(stderr, "cd: %s: Nao e um diretorio\n", path);
+
+    if (old_parent_num == new_parent_num) {
+        if (update_entry_in_dir(old_parent_num, &old_parent_inode, old_name, new_name, source_entry.inode_number) != 0) {
+            fprintf(stderr, "mv: Nao foi possivel renomear '%s'.\n", old_path);
+            return -1;
+        }
+        fs_touch_inode(old_parent_num, time(NULL), 0);
+        printf("'%s' renomeado para '%s'.\n", old_path, new_path);
+        return 0;
+    }
+
+    if (source_inode.mode == 1 && is_descendant_dir(new_parent_num, source_entry.inode_number)) {
+        fprintf(stderr, "mv: Nao e possivel mover '%s' para dentro de si mesmo.\n", old_path);
         return -1;
     }
-    return 0;
-}
 
+    // A nova entrada é criada antes de a antiga ser apagada: uma interrupção no meio deixa
+    // o i-node com dois nomes, nunca com nenhum.
+    if (add_entry_to_dir(new_parent_num, new_name, source_entry.inode_number) != 0) {
+        fprintf(stderr, "mv: O diretorio de destino esta cheio.\n");
+        return -1;
+    }
+    int retargeted = source_inode.mode == 1;
+    if ((retargeted && update_entry_in_dir(source_entry.inode_number, &source_inode, "..", "..", new_parent_num) != 0) ||
+        update_entry_in_dir(old_parent_num, &old_parent_inode, old_name, "", 0) != 0) {
+        // Desfaz o que já foi feito: o item continua só no diretório de origem.
+        fprintf(stderr, "mv: Nao foi possivel mover '%s'.\n", old_path);
+        if (retargeted) update_entry_in_dir(source_entry.inode_number, &source_inode, "..", "..", old_parent_num);
+        fs_read_inode(new_parent_num, &new_parent_inode);
+        remove_entry_from_dir(new_parent_num, &new_parent_inode, new_name, source_entry.inode_number);
+        return -1;
+    }
+    fs_touch_inode(old_parent_num, time(NULL), 0);
 
-// --- IMPLEMENTAÇÃO DAS FUNÇÕES AUXILIARES (ESTÁTICAS) ---
+    if (g_verbose_mode) printf("Entrada do i-node %u movida do diretorio %d para o diretorio %d\n", source_entry.inode_number, old_parent_num, new_parent_num);
+    printf("'%s' movido para '%s'.\n", old_path, new_path);
+    return 0;
+}
 
 /*
- * Navega por um caminho absoluto para encontrar o i-node do arquivo/diretório final.
+ * Remove recursivamente um arquivo ou diretório e tudo o que estiver abaixo dele.
+ * A árvore é percorrida por número de i-node (sem resolver caminhos) e todos os blocos
+ * e i-nodes são liberados em um único lote por bitmap. Arquivos com outros links físicos
+ * perdem só os nomes que estavam na árvore.
  * input:
- * path - O caminho absoluto a ser percorrido.
- * result_inode - Ponteiro para a struct Inode onde o resultado será armazenado.
+ * path - O caminho do arquivo/diretório a ser removido.
  * output:
- * O número do i-node encontrado, ou -1 em caso de erro.
+ * 0 em caso de sucesso, -1 em caso de erro.
  */
-static int find_inode_by_path(const char* path, Inode* result_inode) {
+int fs_rm_recursive(const char* path) {
     if (strcmp(path, "/") == 0) {
-        fs_read_inode(0, result_inode);
-        return 0;
+        fprintf(stderr, "rm: Nao e possivel remover o diretorio raiz.\n");
+        return -1;
     }
 
     char path_copy[1024];
     strncpy(path_copy, path, 1023);
     path_copy[1023] = '\0';
+    char* name = strrchr(path_copy, '/');
+    char* parent_path;
+    if (name == path_copy) { parent_path = "/"; name++; }
+    else { *name = '\0'; name++; parent_path = path_copy; }
 
-    Inode current_inode;
-    int current_inode_num = 0;
-    fs_read_inode(current_inode_num, &current_inode);
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        fprintf(stderr, "rm: '.' e '..' nao podem ser removidos.\n");
+        return -1;
+    }
 
-    char* token = strtok(path_copy, "/");
-    while (token != NULL) {
-        DirEntry entry;
-        if (find_entry_in_dir(current_inode_num, token, &entry) != 0) {
-            return -1;
+    Inode parent_inode;
+    int parent_inode_num = find_inode_by_path(parent_path, &parent_inode);
+    DirEntry entry;
+    if (parent_inode_num < 0 || find_entry_in_dir(parent_inode_num, name, &entry) != 0) {
+        fprintf(stderr, "rm: %s: Arquivo ou diretorio nao encontrado.\n", path);
+        return -1;
+    }
+    Inode target_inode;
+    fs_read_inode(entry.inode_number, &target_inode);
+
+    NumberList inodes = {0}, blocks = {0}, xattr_blocks = {0}, linked = {0};
+    if (collect_tree(entry.inode_number, &target_inode, &inodes, &blocks, &xattr_blocks, &linked) != 0) {
+        fprintf(stderr, "rm: %s: Erro ao ler a arvore; nada foi removido.\n", path);
+        free(inodes.items);
+        free(blocks.items);
+        free(xattr_blocks.items);
+        free(linked.items);
+        return -1;
+    }
+
+    // A entrada some antes da liberação: uma interrupção no meio vaza espaço, mas não deixa
+    // entradas apontando para i-nodes livres.
+    remove_entry_from_dir(parent_inode_num, &parent_inode, name, entry.inode_number);
+    for (unsigned int i = 0; i < inodes.count; i++) {
+        if (ops_g->pending_writes) drop_pending_write(inodes.items[i]);
+        close_handles_for_inode(inodes.items[i]);
+        dir_hint_forget(inodes.items[i]);
+    }
+    fs_free_blocks(blocks.items, blocks.count);
+    fs_free_blocks(xattr_blocks.items, xattr_blocks.count);
+    fs_free_inodes(inodes.items, inodes.count);
+
+    // Um por vez: o mesmo i-node aparece uma vez para cada nome que tinha na árvore.
+    unsigned int freed_inodes = inodes.count, freed_blocks = blocks.count + xattr_blocks.count;
+    for (unsigned int i = 0; i < linked.count; i++) {
+        Inode linked_inode;
+        fs_read_inode(linked.items[i], &linked_inode);
+        if (unlink_file_inode(linked.items[i], &linked_inode)) {
+            freed_inodes++;
+            freed_blocks += count_inode_blocks(&linked_inode) + (linked_inode.xattr_block != 0);
         }
-        
-        current_inode_num = entry.inode_number;
-        fs_read_inode(current_inode_num, &current_inode);
-        
-        token = strtok(NULL, "/");
     }
 
-    *result_inode = current_inode;
-    return current_inode_num;
+    printf("'%s' removido (%u i-node(s), %u bloco(s) liberados).\n", path, freed_inodes, freed_blocks);
+    free(inodes.items);
+    free(blocks.items);
+    free(xattr_blocks.items);
+    free(linked.items);
+    return 0;
 }
 
 /*
- * Procura por uma entrada com um nome específico dentro de um diretório.
+ * Copia um arquivo ou, com 'recursive', um diretório inteiro.
+ * Todos os i-nodes e blocos da cópia são alocados em um único lote (blocos contíguos quando
+ * possível) e cada bloco de diretório da cópia é escrito uma única vez, já completo.
+ * Se o destino for um diretório existente, a cópia é criada dentro dele.
  * input:
- * dir_inode_num - O número do i-node do diretório onde a busca será feita.
- * name - O nome da entrada a ser procurada.
- * result_entry - Ponteiro para a struct DirEntry onde o resultado será armazenado.
+ * src_path - O caminho de origem.
+ * dst_path - O caminho de destino.
+ * recursive - 1 para permitir a cópia de diretórios.
  * output:
- * 0 se a entrada for encontrada, -1 caso contrário.
+ * 0 em caso de sucesso, -1 em caso de erro.
  */
-static int find_entry_in_dir(int dir_inode_num, const char* name, DirEntry* result_entry) {
-    Inode dir_inode;
-    fs_read_inode(dir_inode_num, &dir_inode);
+int fs_cp(const char* src_path, const char* dst_path, int recursive) {
+    // A origem precisa estar no disco: grava antes os arquivos com alocação adiada.
+    flush_pending_writes();
+
+    Inode src_inode;
+    int src_inode_num = find_inode_by_path(src_path, &src_inode);
+    if (src_inode_num < 0) {
+        fprintf(stderr, "cp: %s: Arquivo ou diretorio nao encontrado.\n", src_path);
+        return -1;
+    }
+    if (src_inode.mode == 1 && !recursive) {
+        fprintf(stderr, "cp: -r nao especificado; omitindo o diretorio '%s'.\n", src_path);
+        return -1;
+    }
+    const char* src_name = strrchr(src_path, '/');
+    src_name = src_name ? src_name + 1 : src_path;
+    if (src_inode_num == 0 || src_name[0] == '\0' || strcmp(src_name, ".") == 0 || strcmp(src_name, "..") == 0) {
+        fprintf(stderr, "cp: Nao e possivel copiar '%s'.\n", src_path);
+        return -1;
+    }
 
-    Superblock sb = fs_get_superblock_info();
-    DirEntry* dir_entries_buffer = (DirEntry*) malloc(sb.block_size);
-    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+    char dst_path_copy[1024];
+    strncpy(dst_path_copy, dst_path, 1023);
+    dst_path_copy[1023] = '\0';
+    char* dst_name = strrchr(dst_path_copy, '/');
+    char* dst_parent_path;
+    if (dst_name == dst_path_copy) { dst_parent_path = "/"; dst_name++; }
+    else { *dst_name = '\0'; dst_name++; dst_parent_path = dst_path_copy; }
+
+    Inode dst_parent_inode;
+    int dst_parent_num = find_inode_by_path(dst_parent_path, &dst_parent_inode);
+    if (dst_parent_num < 0 || dst_parent_inode.mode != 1) {
+        fprintf(stderr, "cp: %s: Diretorio de destino nao encontrado.\n", dst_parent_path);
+        return -1;
+    }
 
-    for (int i = 0; i < 12; i++) {
-        if (dir_inode.direct_blocks[i] == 0) continue;
+    // "cp /a /dir" cria '/dir/a' quando o destino já é um diretório.
+    const char* target_name = dst_name;
+    DirEntry existing;
+    if (dst_name[0] == '\0') {
+        target_name = src_name;
+    } else if (find_entry_in_dir(dst_parent_num, dst_name, &existing) == 0) {
+        InodeHeader existing_header;
+        fs_read_inode_header(existing.inode_number, &existing_header);
+        if (existing_header.mode != 1) {
+            fprintf(stderr, "cp: '%s': Arquivo ja existe.\n", dst_path);
+            return -1;
+        }
+        dst_parent_num = existing.inode_number;
+        target_name = src_name;
+    }
+    if (find_entry_in_dir(dst_parent_num, target_name, &existing) == 0) {
+        fprintf(stderr, "cp: '%s': Arquivo ou diretorio ja existe.\n", dst_path);
+        return -1;
+    }
+    if (strlen(target_name) >= MAX_FILENAME_LENGTH) {
+        fprintf(stderr, "cp: Nome '%s' muito longo.\n", target_name);
+        return -1;
+    }
+    if (src_inode.mode == 1 && is_descendant_dir(dst_parent_num, src_inode_num)) {
+        fprintf(stderr, "cp: Nao e possivel copiar '%s' para dentro de si mesmo.\n", src_path);
+        return -1;
+    }
 
-        disk_read_block(dir_inode.direct_blocks[i], dir_entries_buffer);
+    NumberList src_inodes = {0}, src_blocks = {0};
+    if (collect_tree(src_inode_num, &src_inode, &src_inodes, &src_blocks, NULL, NULL) != 0) {
+        fprintf(stderr, "cp: %s: Erro ao ler a arvore de origem.\n", src_path);
+        free(src_inodes.items);
+        free(src_blocks.items);
+        return -1;
+    }
 
-        for (unsigned int j = 0; j < entries_per_block; j++) {
-            if (dir_entries_buffer[j].name[0] != '\0' && strcmp(dir_entries_buffer[j].name, name) == 0) {
-                *result_entry = dir_entries_buffer[j];
-                free(dir_entries_buffer);
-                return 0;
-            }
+    unsigned int* new_inodes = (unsigned int*) malloc(src_inodes.count * sizeof(unsigned int));
+    unsigned int* new_blocks = (unsigned int*) malloc((src_blocks.count > 0 ? src_blocks.count : 1) * sizeof(unsigned int));
+    int result = -1;
+    if (fs_alloc_inodes(src_inodes.count, new_inodes) != 0) {
+        fprintf(stderr, "cp: Nao ha i-nodes livres suficientes.\n");
+    } else if (fs_alloc_extent(src_blocks.count, new_blocks) != 0) {
+        fprintf(stderr, "cp: Nao ha espaco livre no disco.\n");
+        fs_free_inodes(new_inodes, src_inodes.count);
+    } else {
+        CopyCursor cursor = { new_inodes, 0, new_blocks, 0 };
+        int new_inode_num = copy_tree((unsigned int) src_inode_num, &src_inode, dst_parent_num, &cursor);
+        if (new_inode_num < 0 || add_entry_to_dir(dst_parent_num, target_name, new_inode_num) != 0) {
+            fprintf(stderr, "cp: Erro ao copiar '%s' (erro de leitura ou diretorio de destino cheio).\n", src_path);
+            fs_free_blocks(new_blocks, src_blocks.count);
+            fs_free_inodes(new_inodes, src_inodes.count);
+        } else {
+            printf("'%s' copiado para '%s' (%u i-node(s), %u bloco(s)).\n", src_path, dst_path, src_inodes.count, src_blocks.count);
+            result = 0;
         }
     }
 
-    free(dir_entries_buffer);
-    return -1;
+    free(new_inodes);
+    free(new_blocks);
+    free(src_inodes.items);
+    free(src_blocks.items);
+    return result;
 }
 
 /*
- * Adiciona uma nova entrada de diretório a um diretório pai.
+ * Mostra o espaço ocupado (em KiB) por um arquivo ou por cada diretório de uma árvore.
  * input:
- * parent_inode_num - O número do i-node do diretório pai.
- * new_entry_name - O nome da nova entrada.
- * new_inode_num - O número do i-node da nova entrada.
+ * path - O caminho do arquivo/diretório.
  * output:
- * 0 em caso de sucesso, -1 se o diretório pai estiver cheio.
+ * 0 em caso de sucesso, -1 em caso de erro.
  */
-static int add_entry_to_dir(int parent_inode_num, const char* new_entry_name, int new_inode_num) {
-    Inode parent_inode;
-    fs_read_inode(parent_inode_num, &parent_inode);
-    
-    Superblock sb = fs_get_superblock_info();
-    DirEntry* dir_entries_buffer = (DirEntry*) malloc(sb.block_size);
-    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+int fs_du(const char* path) {
+    // Arquivos com alocação adiada ainda não ocupam blocos: grava-os para o total ser real.
+    flush_pending_writes();
 
-    for (int i = 0; i < 12; i++) {
-        unsigned int block_num = parent_inode.direct_blocks[i];
-        if (block_num == 0) {
-            // Lógica para alocar um novo bloco para o diretório se necessário iria aqui.
-            // Para este projeto, assumimos que o primeiro bloco tem espaço.
-            continue;
+    Inode target_inode;
+    if (find_inode_by_path(path, &target_inode) < 0) {
+        fprintf(stderr, "du: nao foi possivel acessar '%s': Arquivo ou diretorio nao encontrado\n", path);
+        return -1;
+    }
+    du_tree(path, &target_inode);
+    return 0;
+}
+
+/*
+ * Desfragmenta o sistema de arquivos: cada arquivo espalhado em vários trechos é regravado em
+ * uma sequência contígua de blocos livres e os ponteiros do i-node são atualizados. Com
+ * FS_DEFRAG_COMPACT, os arquivos também são movidos para o primeiro espaço livre que os comporte
+ * antes da posição atual (juntando o espaço livre no fim do disco) e os i-nodes de números altos
+ * passam para os números livres mais baixos, encolhendo a parte usada da tabela de i-nodes.
+ * input:
+ * flags - Combinação de FS_DEFRAG_COMPACT e FS_DEFRAG_DRY_RUN.
+ * report - Recebe a fragmentação e a vazão de leitura antes e depois.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro de leitura ou escrita.
+ */
+int fs_defrag(int flags, FsDefragReport* report) {
+    memset(report, 0, sizeof(FsDefragReport));
+    // Arquivos com alocação adiada ainda não têm blocos: grava-os para medi-los também.
+    flush_pending_writes();
+
+    Inode root;
+    fs_read_inode(0, &root);
+    DefragList list = {0};
+    if (collect_defrag_items(0, 0, &root, &list) != 0) {
+        free(list.items);
+        return -1;
+    }
+    measure_fragmentation(&list, &report->files, &report->extents_before, &report->fragmented_before);
+    report->read_mib_per_s_before = measure_read_rate(&list);
+
+    int result = 0;
+    if (!(flags & FS_DEFRAG_DRY_RUN)) {
+        // Em ordem de posição no disco: cada arquivo só ocupa espaço que os anteriores deixaram.
+        qsort(list.items, list.count, sizeof(DefragItem), compare_items_by_first_block);
+        for (unsigned int i = 0; i < list.count && result == 0; i++) {
+            unsigned int blocks = count_inode_blocks(&list.items[i].inode);
+            int moved = relocate_item(&list.items[i], flags & FS_DEFRAG_COMPACT);
+            if (moved < 0) result = -1;
+            else if (moved) { report->files_moved++; report->blocks_moved += blocks; }
         }
 
-        disk_read_block(block_num, dir_entries_buffer);
-        for (unsigned int j = 0; j < entries_per_block; j++) {
-            if (dir_entries_buffer[j].name[0] == '\0') {
-                strncpy(dir_entries_buffer[j].name, new_entry_name, MAX_FILENAME_LENGTH - 1);
-                dir_entries_buffer[j].name[MAX_FILENAME_LENGTH - 1] = '\0';
-                dir_entries_buffer[j].inode_number = new_inode_num;
-                
-                disk_write_block(block_num, dir_entries_buffer);
-                free(dir_entries_buffer);
-
-                parent_inode.modification_time = time(NULL);
-                fs_write_inode(parent_inode_num, &parent_inode);
-                return 0;
+        if (result == 0 && (flags & FS_DEFRAG_COMPACT)) {
+            // Do maior número para o menor: cada i-node vai para o menor número livre, se for menor.
+            qsort(list.items, list.count, sizeof(DefragItem), compare_items_by_inode_desc);
+            for (unsigned int i = 0; i < list.count && result == 0; i++) {
+                DefragItem* item = &list.items[i];
+                // Arquivos com vários links físicos ficam: só a entrada do diretório pai seria atualizada.
+                if (item->inode_num == 0 || is_inode_open(item->inode_num) ||
+                    (item->inode.mode != 1 && item->inode.link_count > 1)) continue;
+                int new_num = fs_alloc_inode();
+                if (new_num < 0) break;
+                if ((unsigned int) new_num > item->inode_num) {
+                    fs_free_inode(new_num);
+                    break;
+                }
+                if (move_inode(&list, item, (unsigned int) new_num) != 0) result = -1;
+                else report->inodes_moved++;
             }
         }
     }
 
-    free(dir_entries_buffer);
-    return -1;
+    unsigned int files_after;
+    measure_fragmentation(&list, &files_after, &report->extents_after, &report->fragmented_after);
+    report->read_mib_per_s_after = (flags & FS_DEFRAG_DRY_RUN) ? report->read_mib_per_s_before : measure_read_rate(&list);
+    free(list.items);
+    return result;
+}
+
+/*
+ * Um passo da desfragmentação em segundo plano: examina até DEFRAG_STEP_INODES i-nodes a partir
+ * do cursor e regrava em blocos contíguos o primeiro arquivo fragmentado que couber em uma
+ * sequência livre. O cursor avança mesmo quando nada pode ser movido, então cada passo custa pouco
+ * e uma passada pela tabela sempre termina. Feito para ser chamado quando o sistema está ocioso.
+ * input: nenhum.
+ * output:
+ * 1 se a passada continua, 0 se ela chegou ao fim da tabela de i-nodes, -1 em caso de erro.
+ */
+int fs_defrag_step() {
+    // Só os blocos importam aqui: os pendentes são alocados, mas nada precisa ficar durável.
+    flush_pending_writes();
+    unsigned int total_inodes = fs_get_superblock_info().total_inodes;
+    if (ops_g->defrag_cursor >= total_inodes) ops_g->defrag_cursor = 0;
+
+    unsigned int inode_nums[DEFRAG_STEP_INODES];
+    Inode inodes[DEFRAG_STEP_INODES];
+    int count = fs_used_inodes(ops_g->defrag_cursor, DEFRAG_STEP_INODES, inode_nums);
+    if (count < 0) return -1;
+    fs_read_inodes(inode_nums, (unsigned int) count, inodes);
+    ops_g->defrag_cursor += DEFRAG_STEP_INODES;
+
+    for (int i = 0; i < count; i++) {
+        if (count_extents(&inodes[i]) <= 1) continue;
+        DefragItem item = { inode_nums[i], 0, inodes[i] };
+        int moved = relocate_item(&item, 0);
+        if (moved < 0) return -1;
+        if (moved > 0) {
+            ops_g->defrag_cursor = inode_nums[i] + 1;
+            break;
+        }
+    }
+    if (ops_g->defrag_cursor < total_inodes) return 1;
+    ops_g->defrag_cursor = 0;
+    return 0;
+}
+
+/*
+ * Encolhe a imagem: os arquivos são aproximados do início da área de dados (como em
+ * fs_defrag com FS_DEFRAG_COMPACT), os blocos que ainda sobrarem além do novo fim são movidos,
+ * um a um, para os blocos livres mais baixos, e então o total de blocos e o arquivo de imagem
+ * são reduzidos (fs_resize).
+ * input:
+ * spare_blocks - Blocos livres a manter depois dos dados, para escritas futuras.
+ * old_total - Recebe o total de blocos antes.
+ * new_total - Recebe o total de blocos depois.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro.
+ */
+int fs_shrink(unsigned int spare_blocks, unsigned int* old_total, unsigned int* new_total) {
+    flush_pending_writes();
+    Superblock sb = fs_get_superblock_info();
+    *old_total = *new_total = sb.total_blocks;
+
+    Inode root;
+    fs_read_inode(0, &root);
+    DefragList list = {0};
+    if (collect_defrag_items(0, 0, &root, &list) != 0) {
+        free(list.items);
+        return -1;
+    }
+
+    int result = 0;
+    unsigned long long used = 0;
+    for (unsigned int i = 0; i < list.count; i++) {
+        used += count_inode_blocks(&list.items[i].inode) + (list.items[i].inode.xattr_block != 0);
+    }
+    unsigned long long target = sb.data_blocks_start_block + used + spare_blocks;
+    if (target < sb.total_blocks) {
+        qsort(list.items, list.count, sizeof(DefragItem), compare_items_by_first_block);
+        for (unsigned int i = 0; i < list.count && result == 0; i++) {
+            if (relocate_item(&list.items[i], 1) < 0) result = -1;
+        }
+        for (unsigned int i = 0; i < list.count && result == 0; i++) {
+            result = relocate_tail_blocks(&list.items[i], (unsigned int) target);
+        }
+        if (result == 0) result = fs_resize((unsigned int) target);
+        if (result == 0) *new_total = (unsigned int) target;
+    }
+    free(list.items);
+    return result;
+}
+
+/*
+ * Abre um arquivo e retorna um handle para fs_fread, fs_fwrite, fs_fseek, fs_ftruncate e fs_fclose.
+ * input:
+ * path - O caminho do arquivo.
+ * flags - Combinação de FS_O_READ, FS_O_WRITE, FS_O_CREATE, FS_O_TRUNC e FS_O_APPEND.
+ * output:
+ * O handle (>= 0) em caso de sucesso, -1 em caso de erro.
+ */
+int fs_fopen(const char* path, int flags) {
+    if (!(flags & (FS_O_READ | FS_O_WRITE))) {
+        fprintf(stderr, "open: %s: Modo de abertura invalido.\n", path);
+        return -1;
+    }
+
+    Inode inode;
+    int inode_num = find_inode_by_path(path, &inode);
+    if (inode_num < 0) {
+        if (!(flags & FS_O_CREATE)) {
+            fprintf(stderr, "open: %s: Arquivo nao encontrado.\n", path);
+            return -1;
+        }
+        inode_num = create_empty_file(path, &inode);
+        if (inode_num < 0) return -1;
+    } else if (flush_inode_if_pending(inode_num) == 1) {
+        fs_read_inode(inode_num, &inode);
+    }
+
+    if (inode.mode != 0) {
+        fprintf(stderr, "open: %s: Nao e um arquivo.\n", path);
+        return -1;
+    }
+    if ((flags & FS_O_WRITE) && (inode.flags & INODE_FLAG_COMPRESSED)) {
+        fprintf(stderr, "open: %s: Arquivos comprimidos so podem ser abertos para leitura.\n", path);
+        return -1;
+    }
+
+    int fd = -1;
+    for (int i = 0; i < MAX_OPEN_FILES && fd < 0; i++) {
+        if (!ops_g->open_files[i].in_use) fd = i;
+    }
+    if (fd < 0) {
+        fprintf(stderr, "open: Limite de %d arquivos abertos atingido.\n", MAX_OPEN_FILES);
+        return -1;
+    }
+
+    if ((flags & FS_O_WRITE) && (flags & FS_O_TRUNC) && truncate_inode(inode_num, &inode, 0) != 0) {
+        return -1;
+    }
+
+    ops_g->open_files[fd].in_use = 1;
+    ops_g->open_files[fd].inode_num = inode_num;
+    ops_g->open_files[fd].flags = flags;
+    ops_g->open_files[fd].offset = 0;
+    if (g_verbose_mode) printf("   [Verbose] Handle %d aberto para o i-node %d.\n", fd, inode_num);
+    return fd;
+}
+
+/*
+ * Lê bytes de um arquivo aberto a partir da posição atual do handle.
+ * input:
+ * fd - O handle retornado por fs_fopen.
+ * buffer - Onde os bytes lidos serão armazenados.
+ * count - Quantidade máxima de bytes a ler.
+ * output:
+ * A quantidade de bytes lidos (0 no fim do arquivo), ou -1 em caso de erro.
+ */
+int fs_fread(int fd, void* buffer, unsigned int count) {
+    OpenFile* file = get_open_file(fd, FS_O_READ);
+    if (!file) return -1;
+
+    Inode inode;
+    fs_read_inode(file->inode_num, &inode);
+    if (file->offset >= inode.size_in_bytes) return 0;
+    if (count > inode.size_in_bytes - file->offset) count = inode.size_in_bytes - file->offset;
+    if (count == 0) return 0;
+
+    int bytes_read = (inode.flags & INODE_FLAG_COMPRESSED)
+        ? read_compressed_range(&inode, file->offset, (unsigned char*) buffer, count)
+        : read_raw_range(&inode, file->offset, (unsigned char*) buffer, count);
+    if (bytes_read > 0) {
+        file->offset += bytes_read;
+        touch_access_time(file->inode_num, &inode);
+    }
+    return bytes_read;
+}
+
+/*
+ * Escreve bytes em um arquivo aberto a partir da posição atual do handle (ou do fim, com FS_O_APPEND).
+ * Só os blocos cobertos pela escrita são tocados; blocos que faltam até a posição escrita
+ * são alocados de uma vez e preenchidos com zeros.
+ * input:
+ * fd - O handle retornado por fs_fopen.
+ * buffer - Os bytes a escrever.
+ * count - Quantidade de bytes.
+ * output:
+ * A quantidade de bytes escritos (menor que 'count' se o arquivo atingir o tamanho máximo),
+ * ou -1 em caso de erro.
+ */
+int fs_fwrite(int fd, const void* buffer, unsigned int count) {
+    OpenFile* file = get_open_file(fd, FS_O_WRITE);
+    if (!file) return -1;
+
+    Superblock sb = fs_get_superblock_info();
+    unsigned int max_size = 12 * sb.block_size;
+    Inode inode;
+    fs_read_inode(file->inode_num, &inode);
+    if (file->flags & FS_O_APPEND) file->offset = inode.size_in_bytes;
+    if (count == 0) return 0;
+    if (file->offset >= max_size) {
+        fprintf(stderr, "write: Arquivo atingiu o tamanho maximo (%u bytes).\n", max_size);
+        return -1;
+    }
+    if (count > max_size - file->offset) count = max_size - file->offset;
+
+    unsigned int start = file->offset;
+    unsigned int end = start + count;
+    unsigned char fresh[12];
+    if (allocate_missing_blocks(&inode, (end - 1) / sb.block_size, fresh) != 0) return -1;
+
+    const unsigned char* data = (const unsigned char*) buffer;
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
+    int result = 0;
+
+    // Blocos inteiramente sobrescritos são gravados direto do buffer do chamador, sem ler os
+    // antigos, num único pedido (paralelo num volume distribuído).
+    unsigned int first_full = (start + sb.block_size - 1) / sb.block_size;
+    unsigned int end_full = end / sb.block_size;
+    if (first_full < end_full &&
+        disk_write_blocks(inode.direct_blocks + first_full, end_full - first_full, data + (first_full * sb.block_size - start)) != 0) result = -1;
+
+    for (unsigned int i = 0; i <= (end - 1) / sb.block_size && result == 0; i++) {
+        unsigned int block_start = i * sb.block_size;
+        unsigned int block_end = block_start + sb.block_size;
+        if (i >= first_full && i < end_full) continue;
+        if (block_end <= start || block_start >= end) {
+            // Bloco fora da escrita: só precisa ser gravado se acabou de ser alocado (lacuna).
+            if (fresh[i]) {
+                memset(block_buffer, 0, sb.block_size);
+                if (disk_write_block(inode.direct_blocks[i], block_buffer) != 0) result = -1;
+            }
+            continue;
+        }
+
+        unsigned int from = start > block_start ? start : block_start;
+        unsigned int to = end < block_end ? end : block_end;
+        if (fresh[i]) memset(block_buffer, 0, sb.block_size);
+        else if (disk_read_block(inode.direct_blocks[i], block_buffer) != 0) { result = -1; break; }
+        memcpy(block_buffer + (from - block_start), data + (from - start), to - from);
+        if (disk_write_block(inode.direct_blocks[i], block_buffer) != 0) result = -1;
+    }
+    fs_put_block_buffer(block_buffer);
+
+    if (end > inode.size_in_bytes) inode.size_in_bytes = end;
+    inode.modification_time = time(NULL);
+    fs_write_inode(file->inode_num, &inode);
+    if (result != 0) {
+        fprintf(stderr, "write: Erro de E/S ao gravar no arquivo.\n");
+        return -1;
+    }
+    file->offset = end;
+    return (int) count;
+}
+
+/*
+ * Move a posição de um handle.
+ * input:
+ * fd - O handle retornado por fs_fopen.
+ * offset - O deslocamento.
+ * whence - FS_SEEK_SET, FS_SEEK_CUR ou FS_SEEK_END.
+ * output:
+ * A nova posição, ou -1 em caso de erro.
+ */
+long fs_fseek(int fd, long offset, int whence) {
+    OpenFile* file = get_open_file(fd, 0);
+    if (!file) return -1;
+
+    long base = 0;
+    if (whence == FS_SEEK_CUR) {
+        base = file->offset;
+    } else if (whence == FS_SEEK_END) {
+        InodeHeader header;
+        fs_read_inode_header(file->inode_num, &header);
+        base = header.size_in_bytes;
+    } else if (whence != FS_SEEK_SET) {
+        fprintf(stderr, "seek: Origem invalida.\n");
+        return -1;
+    }
+    if (base + offset < 0 || base + offset > 0xFFFFFFFFL) {
+        fprintf(stderr, "seek: Posicao invalida.\n");
+        return -1;
+    }
+    file->offset = (unsigned int) (base + offset);
+    return file->offset;
+}
+
+/*
+ * Muda o tamanho de um arquivo aberto para escrita. Ao encolher, os blocos além do novo
+ * tamanho são liberados; ao crescer, os novos bytes são zeros.
+ * input:
+ * fd - O handle retornado por fs_fopen.
+ * size - O novo tamanho em bytes.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro.
+ */
+int fs_ftruncate(int fd, unsigned int size) {
+    OpenFile* file = get_open_file(fd, FS_O_WRITE);
+    if (!file) return -1;
+    Inode inode;
+    fs_read_inode(file->inode_num, &inode);
+    return truncate_inode(file->inode_num, &inode, size);
+}
+
+/*
+ * Fecha um handle.
+ * input:
+ * fd - O handle retornado por fs_fopen.
+ * output:
+ * 0 em caso de sucesso, -1 se o handle for inválido.
+ */
+int fs_fclose(int fd) {
+    OpenFile* file = get_open_file(fd, 0);
+    if (!file) return -1;
+    file->in_use = 0;
+    return 0;
+}
+
+/*
+ * Obtém o i-node de um caminho (para consultas de atributos, como o getattr do FUSE).
+ * input:
+ * path - O caminho absoluto.
+ * inode - Recebe o i-node.
+ * output:
+ * O número do i-node, ou -1 se o caminho não existir.
+ */
+int fs_stat(const char* path, Inode* inode) {
+    int inode_num = find_inode_by_path(path, inode);
+    if (inode_num >= 0) apply_pending_layout(inode_num, inode);
+    return inode_num;
+}
+
+/*
+ * Obtém o número do i-node de um caminho (seguindo os links simbólicos), para quem vai ler o
+ * i-node de outra forma, como os atributos estendidos. Com a resolução na cache, nenhum bloco é lido.
+ * input:
+ * path - O caminho absoluto.
+ * output:
+ * O número do i-node, ou -1 se o caminho não existir.
+ */
+int fs_lookup(const char* path) {
+    return resolve_path(path, 1, NULL);
+}
+
+/*
+ * Como fs_stat, mas sem seguir um link simbólico no último componente (o getattr do FUSE).
+ * input:
+ * path - O caminho absoluto.
+ * inode - Recebe o i-node (o do próprio link, se for um).
+ * output:
+ * O número do i-node, ou -1 se o caminho não existir.
+ */
+int fs_lstat(const char* path, Inode* inode) {
+    int inode_num = resolve_path(path, 0, inode);
+    if (inode_num >= 0 && inode) apply_pending_layout(inode_num, inode);
+    return inode_num;
+}
+
+/*
+ * Cria um link físico: um novo nome para um arquivo existente, que passa a ter mais um link.
+ * Como o link(2) do Linux, um link simbólico em 'existing_path' não é seguido.
+ * input:
+ * existing_path - O caminho do arquivo existente.
+ * new_path - O novo nome.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro.
+ */
+int fs_link(const char* existing_path, const char* new_path) {
+    Inode inode;
+    int inode_num = resolve_path(existing_path, 0, &inode);
+    if (inode_num < 0) {
+        fprintf(stderr, "ln: %s: Arquivo nao encontrado.\n", existing_path);
+        return -1;
+    }
+    if (inode.mode == 1) {
+        fprintf(stderr, "ln: %s: Links fisicos para diretorios nao sao permitidos.\n", existing_path);
+        return -1;
+    }
+
+    char path_copy[1024];
+    strncpy(path_copy, new_path, 1023);
+    path_copy[1023] = '\0';
+    char* name = strrchr(path_copy, '/');
+    char* parent_path;
+    if (name == path_copy) { parent_path = "/"; name++; }
+    else { *name = '\0'; name++; parent_path = path_copy; }
+
+    Inode parent_inode;
+    int parent_inode_num = find_inode_by_path(parent_path, &parent_inode);
+    DirEntry existing;
+    if (parent_inode_num < 0 || parent_inode.mode != 1) {
+        fprintf(stderr, "ln: %s: Diretorio de destino nao encontrado.\n", parent_path);
+        return -1;
+    }
+    if (name[0] == '\0' || strlen(name) >= MAX_FILENAME_LENGTH) {
+        fprintf(stderr, "ln: Nome invalido '%s'.\n", name);
+        return -1;
+    }
+    if (find_entry_in_dir_inode(parent_inode_num, &parent_inode, name, &existing) == 0) {
+        fprintf(stderr, "ln: '%s': Arquivo ou diretorio ja existe.\n", new_path);
+        return -1;
+    }
+    if (add_entry_to_dir(parent_inode_num, name, inode_num) != 0) {
+        fprintf(stderr, "ln: O diretorio de destino esta cheio.\n");
+        return -1;
+    }
+
+    inode.link_count++;
+    fs_write_inode(inode_num, &inode);
+    printf("Link '%s' criado para '%s' (%u links).\n", new_path, existing_path, inode.link_count);
+    return 0;
+}
+
+/*
+ * Cria um link simbólico. O alvo é guardado como texto, sem ser verificado (pode ser relativo
+ * ao diretório do link ou nem existir). Alvos que cabem na área do slot do i-node ficam nela
+ * (link rápido: resolvê-lo não lê nenhum bloco além do i-node); os demais ocupam um bloco.
+ * input:
+ * target - O alvo do link.
+ * link_path - O caminho do novo link.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro.
+ */
+int fs_symlink(const char* target, const char* link_path) {
+    Superblock sb = fs_get_superblock_info();
+    size_t target_length = strlen(target);
+    if (target_length == 0 || target_length >= 1024) {
+        fprintf(stderr, "ln: Alvo de link simbolico invalido.\n");
+        return -1;
+    }
+
+    char path_copy[1024];
+    strncpy(path_copy, link_path, 1023);
+    path_copy[1023] = '\0';
+    char* name = strrchr(path_copy, '/');
+    char* parent_path;
+    if (name == path_copy) { parent_path = "/"; name++; }
+    else { *name = '\0'; name++; parent_path = path_copy; }
+
+    Inode parent_inode;
+    int parent_inode_num = find_inode_by_path(parent_path, &parent_inode);
+    DirEntry existing;
+    if (parent_inode_num < 0 || parent_inode.mode != 1) {
+        fprintf(stderr, "ln: %s: Diretorio de destino nao encontrado.\n", parent_path);
+        return -1;
+    }
+    if (name[0] == '\0' || strlen(name) >= MAX_FILENAME_LENGTH) {
+        fprintf(stderr, "ln: Nome invalido '%s'.\n", name);
+        return -1;
+    }
+    if (find_entry_in_dir_inode(parent_inode_num, &parent_inode, name, &existing) == 0) {
+        fprintf(stderr, "ln: '%s': Arquivo ou diretorio ja existe.\n", link_path);
+        return -1;
+    }
+
+    int inode_num = fs_alloc_inode();
+    if (inode_num < 0) {
+        fprintf(stderr, "ln: Nao ha i-nodes livres.\n");
+        return -1;
+    }
+    Inode inode;
+    memset(&inode, 0, sizeof(Inode));
+    inode.mode = 2; // 2 = link simbólico
+    inode.link_count = 1;
+    inode.size_in_bytes = (unsigned int) target_length;
+    time_t now = time(NULL);
+    inode.creation_time = now;
+    inode.modification_time = now;
+    inode.last_access_time = now;
+
+    unsigned int inline_capacity = sb.inode_version != FS_INODE_VERSION_LEGACY &&
+                                   sb.inode_size >= FS_INODE_SLOT_SIZE + FS_INODE_INLINE_XATTR_SIZE ? FS_INODE_INLINE_XATTR_SIZE : 0;
+    if (target_length <= inline_capacity) {
+        unsigned char inline_area[FS_INODE_INLINE_XATTR_SIZE] = {0};
+        memcpy(inline_area, target, target_length);
+        inode.flags = INODE_FLAG_INLINE_DATA;
+        fs_write_inode_inline(inode_num, &inode, inline_area);
+    } else {
+        int block_num = fs_alloc_block();
+        if (block_num < 0) {
+            fprintf(stderr, "ln: Nao ha espaco livre no disco.\n");
+            fs_free_inode(inode_num);
+            return -1;
+        }
+        unsigned char* block = (unsigned char*) fs_get_block_buffer();
+        memset(block, 0, sb.block_size);
+        memcpy(block, target, target_length);
+        disk_write_block(block_num, block);
+        fs_put_block_buffer(block);
+        inode.direct_blocks[0] = block_num;
+        fs_write_inode(inode_num, &inode);
+    }
+
+    if (add_entry_to_dir(parent_inode_num, name, inode_num) != 0) {
+        fprintf(stderr, "ln: O diretorio de destino esta cheio.\n");
+        release_file_inode(inode_num, &inode);
+        return -1;
+    }
+    printf("Link simbolico '%s' -> '%s' criado%s.\n", link_path, target, inode.flags & INODE_FLAG_INLINE_DATA ? " (no i-node)" : "");
+    return 0;
+}
+
+/*
+ * Lê o alvo de um link simbólico (o último componente do caminho não é seguido).
+ * input:
+ * path - O caminho do link.
+ * buffer - Recebe o alvo, terminado em '\0' (truncado se não couber).
+ * size - O tamanho do buffer.
+ * output:
+ * O tamanho do alvo, ou -1 se o caminho não existir ou não for um link simbólico.
+ */
+int fs_readlink(const char* path, char* buffer, unsigned int size) {
+    int inode_num = resolve_path(path, 0, NULL);
+    if (inode_num < 0) return -1;
+    Inode inode;
+    unsigned char inline_area[FS_INODE_INLINE_XATTR_SIZE];
+    fs_read_inode_inline((unsigned int) inode_num, &inode, inline_area);
+    if (inode.mode != 2) return -1;
+    return read_symlink_target(&inode, inline_area, buffer, size);
+}
+
+/*
+ * Chama 'callback' para cada entrada de um diretório (exceto "." e ".."), já com o i-node
+ * da entrada; os i-nodes são lidos em lote.
+ * input:
+ * path - O caminho do diretório.
+ * callback - Função chamada para cada entrada; se retornar diferente de 0, a listagem para.
+ * context - Ponteiro repassado ao callback.
+ * output:
+ * 0 em caso de sucesso, -1 se o caminho não for um diretório legível.
+ */
+int fs_list_dir(const char* path, int (*callback)(const char* name, unsigned int inode_num, const Inode* inode, void* context), void* context) {
+    int dd = fs_opendir(path, FS_READDIR_PLUS);
+    if (dd < 0) return -1;
+
+    FsDirEntry batch[READDIR_BATCH];
+    int count, stop = 0;
+    while (!stop && (count = fs_readdir(dd, batch, READDIR_BATCH)) > 0) {
+        for (int i = 0; i < count && !stop; i++) {
+            if (strcmp(batch[i].name, ".") == 0 || strcmp(batch[i].name, "..") == 0) continue;
+            stop = callback(batch[i].name, batch[i].inode_num, &batch[i].inode, context) != 0;
+        }
+    }
+    fs_closedir(dd);
+    return 0;
+}
+
+/*
+ * Abre um diretório para leitura com fs_readdir.
+ * input:
+ * path - O caminho do diretório.
+ * flags - FS_READDIR_PLUS para receber também os i-nodes das entradas, ou 0.
+ * output:
+ * O descritor do diretório (>= 0), ou -1 se o caminho não for um diretório legível ou a tabela estiver cheia.
+ */
+int fs_opendir(const char* path, int flags) {
+    Inode dir_inode;
+    if (find_inode_by_path(path, &dir_inode) < 0 || dir_inode.mode != 1) return -1;
+    return open_dir_inode(&dir_inode, flags);
+}
+
+/*
+ * Lê o próximo lote de entradas de um diretório aberto, incluindo "." e "..".
+ * Com FS_READDIR_PLUS, os i-nodes do lote são lidos juntos, uma vez por bloco da tabela de i-nodes.
+ * input:
+ * dd - O descritor retornado por fs_opendir.
+ * entries - Vetor que recebe as entradas.
+ * max_entries - Capacidade do vetor.
+ * output:
+ * O número de entradas lidas (0 no fim do diretório), ou -1 se o descritor for inválido.
+ */
+int fs_readdir(int dd, FsDirEntry* entries, unsigned int max_entries) {
+    if (dd < 0 || dd >= MAX_OPEN_DIRS || !ops_g->open_dirs[dd].in_use) return -1;
+    OpenDir* dir = &ops_g->open_dirs[dd];
+
+    unsigned int count = 0;
+    while (count < max_entries && dir->position < dir->entry_count) {
+        const DirEntry* entry = &dir->entries[dir->position++];
+        if (entry->name[0] == '\0') continue;
+        memcpy(entries[count].name, entry->name, MAX_FILENAME_LENGTH);
+        entries[count].name[MAX_FILENAME_LENGTH - 1] = '\0';
+        entries[count].inode_num = entry->inode_number;
+        count++;
+    }
+
+    if (dir->flags & FS_READDIR_PLUS) {
+        // Os i-nodes são lidos em grupos de até READDIR_BATCH, com vetores na pilha.
+        unsigned int inode_nums[READDIR_BATCH];
+        Inode inodes[READDIR_BATCH];
+        for (unsigned int first = 0; first < count; first += READDIR_BATCH) {
+            unsigned int group = count - first < READDIR_BATCH ? count - first : READDIR_BATCH;
+            for (unsigned int i = 0; i < group; i++) inode_nums[i] = entries[first + i].inode_num;
+            fs_read_inodes(inode_nums, group, inodes);
+            for (unsigned int i = 0; i < group; i++) {
+                entries[first + i].inode = inodes[i];
+                apply_pending_layout(inode_nums[i], &entries[first + i].inode);
+            }
+        }
+    }
+    return (int) count;
+}
+
+/*
+ * Fecha um diretório aberto por fs_opendir.
+ * input:
+ * dd - O descritor do diretório.
+ * output:
+ * 0 em caso de sucesso, -1 se o descritor for inválido.
+ */
+int fs_closedir(int dd) {
+    if (dd < 0 || dd >= MAX_OPEN_DIRS || !ops_g->open_dirs[dd].in_use) return -1;
+    ops_g->open_dirs[dd].in_use = 0;
+    ops_g->open_dirs[dd].entry_count = 0;
+    ops_g->open_dirs[dd].position = 0;
+    return 0;
+}
+
+/*
+ * Verifica se um caminho corresponde a um diretório válido.
+ * input:
+ * path - O caminho a ser verificado.
+ * output:
+ * 0 se for um diretório, -1 caso contrário.
+ */
+int fs_check_path_is_dir(const char* path) {
+    Inode target_inode;
+    if (find_inode_by_path(path, &target_inode) < 0) {
+        fprintf(stderr, "cd: %s: Arquivo ou diretorio nao encontrado\n", path);
+        return -1;
+    }
+    if (target_inode.mode != 1) {
+        fprintf(stderr, "cd: %s: Nao e um diretorio\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Cria o estado das operações de um novo sistema de arquivos (sem arquivos abertos nem dicas).
+ * input: nenhum.
+ * output: O estado, ou NULL se faltar memória.
+ */
+OpsState* ops_state_create() {
+    return (OpsState*) calloc(1, sizeof(OpsState));
+}
+
+/*
+ * Libera o estado das operações. As escritas pendentes devem ter sido gravadas (fs_sync) antes;
+ * as que restarem são descartadas.
+ * input:
+ * state - O estado (NULL e o estado padrão são ignorados).
+ * output: nenhum.
+ */
+void ops_state_destroy(OpsState* state) {
+    if (!state || state == &default_ops) return;
+    if (ops_g == state) ops_g = &default_ops;
+    while (state->pending_writes) {
+        PendingWrite* next = state->pending_writes->next;
+        free(state->pending_writes->data);
+        free(state->pending_writes);
+        state->pending_writes = next;
+    }
+    for (int dd = 0; dd < MAX_OPEN_DIRS; dd++) free(state->open_dirs[dd].entries);
+    free(state->ls_entries);
+    free(state->transfer);
+    free(state->extent_stored);
+    free(state->extent_raw);
+    free(state);
+}
+
+/*
+ * Seleciona o estado usado pelas próximas chamadas deste módulo na thread atual.
+ * input:
+ * state - O estado, ou NULL para o estado padrão.
+ * output: nenhum.
+ */
+void ops_state_select(OpsState* state) {
+    ops_g = state ? state : &default_ops;
+}
+
+
+// --- IMPLEMENTAÇÃO DAS FUNÇÕES AUXILIARES (ESTÁTICAS) ---
+
+/*
+ * Navega por um caminho absoluto para encontrar o i-node do arquivo/diretório final,
+ * seguindo os links simbólicos.
+ * input:
+ * path - O caminho absoluto a ser percorrido.
+ * result_inode - Ponteiro para a struct Inode onde o resultado será armazenado.
+ * output:
+ * O número do i-node encontrado, ou -1 em caso de erro.
+ */
+static int find_inode_by_path(const char* path, Inode* result_inode) {
+    return resolve_path(path, 1, result_inode);
+}
+
+/*
+ * Resolve um caminho absoluto, componente por componente. Cada i-node do caminho é lido uma
+ * única vez (com a área do slot, onde fica o alvo de um link rápido) e serve tanto para saber
+ * se é um link quanto para procurar o próximo componente. Um link é substituído pelo seu alvo
+ * na frente do que falta resolver; alvos relativos partem do diretório que contém o link.
+ * Resoluções bem-sucedidas ficam na cache de caminhos.
+ * input:
+ * path - O caminho absoluto.
+ * follow_last - 1 para seguir também um link no último componente.
+ * result_inode - Recebe o i-node final (pode ser NULL).
+ * output:
+ * O número do i-node, ou -1 se algum componente não existir, não for um diretório, ou se
+ * houver mais de MAX_SYMLINK_FOLLOWS links no caminho (um ciclo).
+ */
+static int resolve_path(const char* path, int follow_last, Inode* result_inode) {
+    PathCacheEntry* cached = path_cache_get(path, follow_last);
+    if (cached) {
+        if (result_inode) fs_read_inode(cached->inode_num, result_inode);
+        return (int) cached->inode_num;
+    }
+
+    char pending[2048];
+    if (snprintf(pending, sizeof(pending), "%s", path) >= (int) sizeof(pending)) return -1;
+    unsigned int current = 0;
+    Inode current_inode;
+    fs_read_inode(0, &current_inode);
+    unsigned int follows = 0;
+    size_t position = 0;
+
+    while (1) {
+        while (pending[position] == '/') position++;
+        if (pending[position] == '\0') break;
+        size_t length = strcspn(pending + position, "/");
+        if (length >= MAX_FILENAME_LENGTH) return -1;
+        char name[MAX_FILENAME_LENGTH];
+        memcpy(name, pending + position, length);
+        name[length] = '\0';
+        position += length;
+        int last = pending[position + strspn(pending + position, "/")] == '\0';
+
+        DirEntry entry;
+        if (find_entry_in_dir_inode((int) current, &current_inode, name, &entry) != 0) return -1;
+        Inode next_inode;
+        unsigned char inline_area[FS_INODE_INLINE_XATTR_SIZE];
+        fs_read_inode_inline(entry.inode_number, &next_inode, inline_area);
+
+        if (next_inode.mode == 2 && (!last || follow_last)) {
+            if (++follows > MAX_SYMLINK_FOLLOWS) {
+                fprintf(stderr, "%s: Muitos niveis de links simbolicos.\n", path);
+                return -1;
+            }
+            char target[1024], expanded[sizeof(pending)];
+            if (read_symlink_target(&next_inode, inline_area, target, sizeof(target)) < 0) return -1;
+            int expanded_length = snprintf(expanded, sizeof(expanded), "%s/%s", target, pending + position);
+            if (expanded_length < 0 || expanded_length >= (int) sizeof(expanded)) return -1;
+            memcpy(pending, expanded, (size_t) expanded_length + 1);
+            position = 0;
+            if (target[0] == '/') {
+                current = 0;
+                fs_read_inode(0, &current_inode);
+            }
+            continue;
+        }
+        current = entry.inode_number;
+        current_inode = next_inode;
+    }
+
+    path_cache_set(path, follow_last, current);
+    if (result_inode) *result_inode = current_inode;
+    return (int) current;
+}
+
+/*
+ * Procura por uma entrada com um nome específico dentro de um diretório.
+ * input:
+ * dir_inode_num - O número do i-node do diretório onde a busca será feita.
+ * name - O nome da entrada a ser procurada.
+ * result_entry - Ponteiro para a struct DirEntry onde o resultado será armazenado.
+ * output:
+ * 0 se a entrada for encontrada, -1 caso contrário (ou se o i-node não for um diretório).
+ */
+static int find_entry_in_dir(int dir_inode_num, const char* name, DirEntry* result_entry) {
+    Inode dir_inode;
+    fs_read_inode(dir_inode_num, &dir_inode);
+    return find_entry_in_dir_inode(dir_inode_num, &dir_inode, name, result_entry);
+}
+
+/*
+ * Como find_entry_in_dir, com o i-node do diretório já lido.
+ * input:
+ * dir_inode_num - O número do i-node do diretório.
+ * dir_inode - O i-node do diretório.
+ * name - O nome da entrada a ser procurada.
+ * result_entry - Recebe a entrada encontrada.
+ * output:
+ * 0 se a entrada for encontrada, -1 caso contrário (ou se o i-node não for um diretório).
+ */
+static int find_entry_in_dir_inode(int dir_inode_num, const Inode* dir_inode, const char* name, DirEntry* result_entry) {
+    if (dir_inode->mode != 1) return -1;
+
+    Superblock sb = fs_get_superblock_info();
+    DirEntry* dir_entries_buffer = (DirEntry*) fs_get_block_buffer();
+    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+
+    for (int i = 0; i < 12; i++) {
+        if (dir_inode->direct_blocks[i] == 0) continue;
+
+        if (disk_read_block(dir_inode->direct_blocks[i], dir_entries_buffer) != 0) break;
+
+        for (unsigned int j = 0; j < entries_per_block; j++) {
+            if (dir_entries_buffer[j].name[0] != '\0' && strcmp(dir_entries_buffer[j].name, name) == 0) {
+                *result_entry = dir_entries_buffer[j];
+                ops_g->last_lookup.valid = 1;
+                ops_g->last_lookup.dir_inode_num = dir_inode_num;
+                ops_g->last_lookup.inode_num = dir_entries_buffer[j].inode_number;
+                ops_g->last_lookup.position = i * entries_per_block + j;
+                fs_put_block_buffer(dir_entries_buffer);
+                return 0;
+            }
+        }
+    }
+
+    fs_put_block_buffer(dir_entries_buffer);
+    return -1;
+}
+
+/*
+ * Remove de um diretório a entrada com um nome, que aponta para um i-node (com links físicos,
+ * o mesmo i-node pode ter outras entradas no diretório).
+ * Se a entrada acabou de ser encontrada por find_entry_in_dir, só o bloco dela é lido.
+ * input:
+ * parent_inode_num - O número do i-node do diretório pai.
+ * parent_inode - O i-node do diretório pai.
+ * name - O nome da entrada.
+ * inode_num - O número do i-node cuja entrada será apagada.
+ * output:
+ * 0 em caso de sucesso, -1 se a entrada não for encontrada.
+ */
+static int remove_entry_from_dir(int parent_inode_num, const Inode* parent_inode, const char* name, unsigned int inode_num) {
+    Superblock sb = fs_get_superblock_info();
+    DirEntry* dir_buffer = (DirEntry*) fs_get_block_buffer();
+    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+
+    int first_block = 0, last_block = 11;
+    unsigned int first_slot = 0;
+    if (ops_g->last_lookup.valid && ops_g->last_lookup.dir_inode_num == (unsigned int) parent_inode_num &&
+        ops_g->last_lookup.inode_num == inode_num && ops_g->last_lookup.position < 12 * entries_per_block) {
+        first_block = last_block = ops_g->last_lookup.position / entries_per_block;
+        first_slot = ops_g->last_lookup.position % entries_per_block;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        for (int i = first_block; i <= last_block; i++) {
+            if (parent_inode->direct_blocks[i] == 0) continue;
+            if (disk_read_block(parent_inode->direct_blocks[i], dir_buffer) != 0) continue;
+            for (unsigned int j = (i == first_block ? first_slot : 0); j < entries_per_block; j++) {
+                // "." e ".." nunca são removidos, mesmo que apontem para o mesmo i-node.
+                if (dir_buffer[j].name[0] == '\0' || strcmp(dir_buffer[j].name, ".") == 0 ||
+                    strcmp(dir_buffer[j].name, "..") == 0) continue;
+                if (dir_buffer[j].inode_number == inode_num && strcmp(dir_buffer[j].name, name) == 0) {
+                    dir_buffer[j].name[0] = '\0';
+                    dir_buffer[j].inode_number = 0;
+                    disk_write_block(parent_inode->direct_blocks[i], dir_buffer);
+                    fs_put_block_buffer(dir_buffer);
+                    ops_g->last_lookup.valid = 0;
+                    path_cache_invalidate();
+                    dir_hint_entry_removed(parent_inode_num, i * entries_per_block + j);
+                    fs_touch_inode(parent_inode_num, time(NULL), 0);
+                    return 0;
+                }
+                if (first_block == last_block && attempt == 0) break; // A posição lembrada mudou.
+            }
+        }
+        if (first_block == 0 && last_block == 11) break;
+        first_block = 0; last_block = 11; first_slot = 0; // Dica desatualizada: percorre tudo.
+    }
+
+    fs_put_block_buffer(dir_buffer);
+    return -1;
+}
+
+/*
+ * Reescreve, no lugar, a entrada de diretório com um determinado nome.
+ * input:
+ * dir_inode_num - O número do i-node do diretório.
+ * dir_inode - O i-node do diretório.
+ * name - O nome atual da entrada.
+ * new_name - O novo nome ("" apaga a entrada).
+ * new_inode_num - O i-node para o qual a entrada passa a apontar.
+ * output:
+ * 0 em caso de sucesso, -1 se a entrada não for encontrada.
+ */
+static int update_entry_in_dir(int dir_inode_num, const Inode* dir_inode, const char* name, const char* new_name, unsigned int new_inode_num) {
+    Superblock sb = fs_get_superblock_info();
+    DirEntry* dir_buffer = (DirEntry*) fs_get_block_buffer();
+    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+
+    for (int i = 0; i < 12; i++) {
+        if (dir_inode->direct_blocks[i] == 0) continue;
+        if (disk_read_block(dir_inode->direct_blocks[i], dir_buffer) != 0) continue;
+        for (unsigned int j = 0; j < entries_per_block; j++) {
+            if (dir_buffer[j].name[0] == '\0' || strcmp(dir_buffer[j].name, name) != 0) continue;
+            snprintf(dir_buffer[j].name, MAX_FILENAME_LENGTH, "%s", new_name);
+            dir_buffer[j].inode_number = new_name[0] != '\0' ? new_inode_num : 0;
+            disk_write_block(dir_inode->direct_blocks[i], dir_buffer);
+            fs_put_block_buffer(dir_buffer);
+            ops_g->last_lookup.valid = 0;
+            path_cache_invalidate();
+            if (new_name[0] == '\0') dir_hint_entry_removed(dir_inode_num, i * entries_per_block + j);
+            return 0;
+        }
+    }
+
+    fs_put_block_buffer(dir_buffer);
+    return -1;
+}
+
+/*
+ * Verifica se um diretório é o próprio 'ancestor' ou está abaixo dele, subindo pelas entradas "..".
+ * input:
+ * dir_inode_num - O diretório de partida.
+ * ancestor_inode_num - O possível ancestral.
+ * output:
+ * 1 se for descendente (ou o mesmo diretório), 0 caso contrário.
+ */
+static int is_descendant_dir(int dir_inode_num, unsigned int ancestor_inode_num) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned int current = (unsigned int) dir_inode_num;
+    // O limite de passos protege contra ".." corrompidos formando um ciclo.
+    for (unsigned int steps = 0; steps <= sb.total_inodes; steps++) {
+        if (current == ancestor_inode_num) return 1;
+        if (current == 0) return 0;
+        DirEntry parent_entry;
+        if (find_entry_in_dir(current, "..", &parent_entry) != 0) return 0;
+        current = parent_entry.inode_number;
+    }
+    return 1;
+}
+
+/*
+ * Libera os blocos de dados e o i-node de um arquivo.
+ * input:
+ * inode_num - O número do i-node do arquivo.
+ * inode - O i-node do arquivo (com os blocos a liberar).
+ * output: nenhum.
+ */
+static void release_file_inode(int inode_num, const Inode* inode) {
+    // Arquivo ainda não gravado: basta descartar os dados em memória, nenhum bloco foi alocado.
+    drop_pending_write(inode_num);
+    close_handles_for_inode(inode_num);
+    fs_free_blocks(inode->direct_blocks, 12);
+    if (inode->xattr_block != 0) fs_free_block(inode->xattr_block);
+    fs_free_inode(inode_num);
+}
+
+/*
+ * Remove um nome de um arquivo ou link simbólico: com outros links, só o link_count diminui;
+ * no último, os blocos e o i-node são liberados.
+ * input:
+ * inode_num - O número do i-node.
+ * inode - O i-node (o link_count é atualizado).
+ * output: 1 se o i-node foi liberado, 0 se ainda tem outros nomes.
+ */
+static int unlink_file_inode(int inode_num, Inode* inode) {
+    if (inode->link_count > 1) {
+        inode->link_count--;
+        fs_write_inode(inode_num, inode);
+        return 0;
+    }
+    release_file_inode(inode_num, inode);
+    return 1;
+}
+
+/*
+ * Obtém o alvo de um link simbólico, da área do slot (link rápido) ou do seu bloco.
+ * input:
+ * inode - O i-node do link.
+ * inline_area - A área do slot, lida com fs_read_inode_inline.
+ * target - Recebe o alvo, terminado em '\0' (truncado se não couber).
+ * size - O tamanho de 'target'.
+ * output: O tamanho do alvo, ou -1 em caso de erro de leitura.
+ */
+static int read_symlink_target(const Inode* inode, const unsigned char* inline_area, char* target, unsigned int size) {
+    unsigned int length = inode->size_in_bytes;
+    unsigned int copy = length < size ? length : size - 1;
+    if (inode->flags & INODE_FLAG_INLINE_DATA) {
+        if (length > FS_INODE_INLINE_XATTR_SIZE) return -1;
+        memcpy(target, inline_area, copy);
+    } else {
+        Superblock sb = fs_get_superblock_info();
+        if (inode->direct_blocks[0] == 0 || length > sb.block_size) return -1;
+        unsigned char* block = (unsigned char*) fs_get_block_buffer();
+        if (disk_read_block(inode->direct_blocks[0], block) != 0) {
+            fs_put_block_buffer(block);
+            return -1;
+        }
+        memcpy(target, block, copy);
+        fs_put_block_buffer(block);
+    }
+    target[copy] = '\0';
+    return (int) length;
+}
+
+/*
+ * Calcula a posição da cache de resolução de um caminho (mapeamento direto pelo hash FNV-1a).
+ * input:
+ * path - O caminho.
+ * follow_last - Se o último componente é seguido.
+ * output: A posição da cache.
+ */
+static PathCacheEntry* path_cache_slot(const char* path, int follow_last) {
+    unsigned int hash = 2166136261u;
+    for (const char* c = path; *c; c++) hash = (hash ^ (unsigned char) *c) * 16777619u;
+    return &ops_g->path_cache[(hash ^ (unsigned int) follow_last) % PATH_CACHE_SLOTS];
+}
+
+/*
+ * Procura um caminho na cache de resolução.
+ * input:
+ * path - O caminho.
+ * follow_last - Se o último componente foi seguido.
+ * output: A posição da cache com a resolução, ou NULL se não estiver nela.
+ */
+static PathCacheEntry* path_cache_get(const char* path, int follow_last) {
+    PathCacheEntry* entry = path_cache_slot(path, follow_last);
+    if (!entry->valid || entry->generation != ops_g->path_generation || entry->follow_last != follow_last ||
+        strcmp(entry->path, path) != 0) return NULL;
+    return entry;
+}
+
+/*
+ * Guarda uma resolução na cache (substitui a que estiver na posição).
+ * input:
+ * path - O caminho.
+ * follow_last - Se o último componente foi seguido.
+ * inode_num - O i-node final.
+ * output: nenhum.
+ */
+static void path_cache_set(const char* path, int follow_last, unsigned int inode_num) {
+    size_t length = strlen(path);
+    if (length >= PATH_CACHE_MAX_PATH) return;
+    PathCacheEntry* entry = path_cache_slot(path, follow_last);
+    entry->valid = 1;
+    entry->generation = ops_g->path_generation;
+    entry->inode_num = inode_num;
+    entry->follow_last = follow_last;
+    memcpy(entry->path, path, length + 1);
+}
+
+/*
+ * Invalida todas as resoluções da cache. Chamada quando uma entrada de diretório é removida,
+ * renomeada ou passa a apontar para outro i-node.
+ * input: nenhum.
+ * output: nenhum.
+ */
+static void path_cache_invalidate() {
+    ops_g->path_generation++;
+}
+
+/*
+ * Registra uma leitura de um arquivo, atualizando o atime conforme RELATIME_INTERVAL.
+ * input:
+ * inode_num - O número do i-node lido.
+ * inode - O i-node, como lido (já com os tempos pendentes).
+ * output: nenhum.
+ */
+static void touch_access_time(unsigned int inode_num, const Inode* inode) {
+    time_t now = time(NULL);
+    if (inode->last_access_time > inode->modification_time && now - inode->last_access_time < RELATIME_INTERVAL) return;
+    fs_touch_inode(inode_num, 0, now);
+}
+
+/*
+ * Adiciona uma nova entrada de diretório a um diretório pai.
+ * Com a dica do diretório, a busca começa na primeira posição que pode estar livre.
+ * Se todos os blocos estiverem cheios, o diretório ganha mais um bloco (até 12).
+ * input:
+ * parent_inode_num - O número do i-node do diretório pai.
+ * new_entry_name - O nome da nova entrada.
+ * new_inode_num - O número do i-node da nova entrada.
+ * output:
+ * 0 em caso de sucesso, -1 se o diretório pai estiver cheio.
+ */
+static int add_entry_to_dir(int parent_inode_num, const char* new_entry_name, int new_inode_num) {
+    Inode parent_inode;
+    fs_read_inode(parent_inode_num, &parent_inode);
+    
+    Superblock sb = fs_get_superblock_info();
+    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+    unsigned int end_position = 12 * entries_per_block;
+    DirHint* hint = dir_hint_get(parent_inode_num);
+    unsigned int start = hint ? hint->first_free : 0;
+
+    DirEntry* dir_entries_buffer = (DirEntry*) fs_get_block_buffer();
+    unsigned int used_entries = 0; // Sem dica: entradas em uso vistas até aqui, para criar a dica.
+    for (int i = start / entries_per_block; i < 12; i++) {
+        unsigned int block_num = parent_inode.direct_blocks[i];
+        if (block_num == 0) continue;
+
+        if (disk_read_block(block_num, dir_entries_buffer) != 0) break;
+        unsigned int first_slot = (i == (int) (start / entries_per_block)) ? start % entries_per_block : 0;
+        for (unsigned int j = first_slot; j < entries_per_block; j++) {
+            if (dir_entries_buffer[j].name[0] != '\0') {
+                used_entries++;
+                continue;
+            }
+            strncpy(dir_entries_buffer[j].name, new_entry_name, MAX_FILENAME_LENGTH - 1);
+            dir_entries_buffer[j].name[MAX_FILENAME_LENGTH - 1] = '\0';
+            dir_entries_buffer[j].inode_number = new_inode_num;
+            disk_write_block(block_num, dir_entries_buffer);
+
+            // A próxima posição livre é procurada no bloco que já está na memória.
+            unsigned int next = j + 1;
+            while (next < entries_per_block && dir_entries_buffer[next].name[0] != '\0') next++;
+            if (hint) {
+                hint->entry_count++;
+                hint->first_free = i * entries_per_block + next;
+            } else if (count_inode_blocks(&parent_inode) == 1) {
+                for (unsigned int k = j; k < entries_per_block; k++) {
+                    if (dir_entries_buffer[k].name[0] != '\0') used_entries++;
+                }
+                dir_hint_set(parent_inode_num, used_entries, i * entries_per_block + next);
+            }
+            fs_put_block_buffer(dir_entries_buffer);
+
+            // Só o mtime do diretório mudou: fica pendente, sem gravar a tabela de i-nodes.
+            fs_touch_inode(parent_inode_num, time(NULL), 0);
+            return 0;
+        }
+    }
+
+    // Nenhuma posição livre: o novo bloco fica na primeira posição vazia do i-node.
+    int new_index = -1;
+    for (int i = 0; i < 12 && new_index < 0; i++) {
+        if (parent_inode.direct_blocks[i] == 0) new_index = i;
+    }
+    int new_block = new_index < 0 ? -1 : fs_alloc_block();
+    if (new_block < 0) {
+        fs_put_block_buffer(dir_entries_buffer);
+        if (hint) hint->first_free = end_position;
+        return -1;
+    }
+    memset(dir_entries_buffer, 0, sb.block_size);
+    strncpy(dir_entries_buffer[0].name, new_entry_name, MAX_FILENAME_LENGTH - 1);
+    dir_entries_buffer[0].inode_number = new_inode_num;
+    disk_write_block(new_block, dir_entries_buffer);
+    fs_put_block_buffer(dir_entries_buffer);
+    if (g_verbose_mode) printf("   [Verbose] Diretorio %d cresceu para o bloco %d.\n", parent_inode_num, new_block);
+
+    parent_inode.direct_blocks[new_index] = new_block;
+    parent_inode.size_in_bytes += sb.block_size;
+    parent_inode.modification_time = time(NULL);
+    fs_write_inode(parent_inode_num, &parent_inode);
+    if (hint) {
+        hint->entry_count++;
+        hint->first_free = new_index * entries_per_block + 1;
+    }
+    return 0;
+}
+
+/*
+ * Monta em memória os blocos que serão gravados no disco para o conteúdo de um arquivo
+ * (comprimidos por extent se a compressão estiver ligada).
+ * input:
+ * raw - O conteúdo do arquivo.
+ * file_size - O tamanho do conteúdo em bytes.
+ * inode - O i-node do novo arquivo; recebe a flag e os tamanhos dos extents.
+ * packed - Recebe o buffer com os blocos (liberado pelo chamador).
+ * block_count - Recebe a quantidade de blocos do buffer.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int pack_file_data(const unsigned char* raw, long file_size, Inode* inode, unsigned char** packed, unsigned int* block_count) {
+    Superblock sb = fs_get_superblock_info();
+    *packed = NULL;
+    if (!g_compress_mode) {
+        *block_count = (file_size + sb.block_size - 1) / sb.block_size;
+        if (*block_count > 12) {
+            fprintf(stderr, "write: Arquivo grande demais para o i-node.\n");
+            return -1;
+        }
+        // Só os blocos do arquivo ficam em memória: é isso que pending_bytes contabiliza.
+        *packed = (unsigned char*) calloc(*block_count > 0 ? *block_count : 1, sb.block_size);
+        if (file_size > 0) memcpy(*packed, raw, file_size); // Arquivo vazio: raw pode ser NULL.
+        return 0;
+    }
+
+    // O tamanho comprimido só é conhecido depois de empacotar: o buffer é reduzido no fim.
+    *packed = (unsigned char*) calloc(12, sb.block_size);
+    if (pack_compressed_data(raw, file_size, inode, *packed, block_count) != 0) {
+        free(*packed);
+        *packed = NULL;
+        return -1;
+    }
+    unsigned char* shrunk = (unsigned char*) realloc(*packed, (size_t) (*block_count > 0 ? *block_count : 1) * sb.block_size);
+    if (shrunk) *packed = shrunk;
+    return 0;
+}
+
+/*
+ * Comprime os dados em extents de COMPRESSION_EXTENT_SIZE bytes e os empacota em blocos.
+ * Cada extent é guardado sem compressão quando comprimir não economizaria blocos.
+ * input:
+ * raw - O conteúdo do arquivo.
+ * file_size - O tamanho do conteúdo em bytes.
+ * inode - O i-node do arquivo; recebe a flag e os tamanhos dos extents.
+ * packed - Buffer zerado com espaço para 12 blocos.
+ * block_count - Recebe a quantidade de blocos usados.
+ * output:
+ * 0 em caso de sucesso, -1 se o arquivo não couber no i-node.
+ */
+static int pack_compressed_data(const unsigned char* raw, long file_size, Inode* inode, unsigned char* packed, unsigned int* block_count) {
+    Superblock sb = fs_get_superblock_info();
+    int scratch_capacity = LZ_COMPRESS_BOUND(COMPRESSION_EXTENT_SIZE);
+    unsigned char* scratch_buffer = get_extent_buffers(NULL);
+    if (!scratch_buffer) return -1;
+
+    long offset = 0;
+    int extent = 0;
+    int result = 0;
+    *block_count = 0;
+    inode->flags |= INODE_FLAG_COMPRESSED;
+
+    while (offset < file_size) {
+        if (extent >= MAX_COMPRESSED_EXTENTS) {
+            result = -1;
+            break;
+        }
+
+        int raw_len = (file_size - offset > COMPRESSION_EXTENT_SIZE) ? COMPRESSION_EXTENT_SIZE : (int) (file_size - offset);
+        const unsigned char* stored = raw + offset;
+        int stored_len = raw_len;
+        int compressed_len = lz_compress(raw + offset, raw_len, scratch_buffer, scratch_capacity);
+        unsigned int raw_blocks = (raw_len + sb.block_size - 1) / sb.block_size;
+        if (compressed_len > 0 && compressed_len < raw_len &&
+            (compressed_len + sb.block_size - 1) / sb.block_size < raw_blocks) {
+            stored = scratch_buffer;
+            stored_len = compressed_len;
+        }
+
+        unsigned int stored_blocks = (stored_len + sb.block_size - 1) / sb.block_size;
+        if (*block_count + stored_blocks > 12) {
+            result = -1;
+            break;
+        }
+        memcpy(packed + *block_count * sb.block_size, stored, stored_len);
+        *block_count += stored_blocks;
+
+        if (g_verbose_mode) printf("   [Verbose] Extent %d: %d bytes -> %d bytes.\n", extent, raw_len, stored_len);
+        inode->compressed_extent_size[extent++] = (unsigned short) stored_len;
+        offset += raw_len;
+    }
+
+    if (result != 0) {
+        fprintf(stderr, "write: Arquivo grande demais para o i-node.\n");
+    }
+    return result;
+}
+
+/*
+ * Grava no disco todos os arquivos com alocação adiada, alocando seus blocos, sem esperar que
+ * as escritas se tornem duráveis (para quem só precisa dos blocos alocados, como cp e du).
+ * input: nenhum.
+ * output: 0 em caso de sucesso, -1 se algum arquivo não pôde ser gravado.
+ */
+static int flush_pending_writes() {
+    if (!ops_g->pending_writes) return 0;
+    int result = 0;
+
+    // A lista é montada de trás para frente; inverte para gravar na ordem em que os arquivos foram escritos.
+    PendingWrite* ordered = NULL;
+    while (ops_g->pending_writes) {
+        PendingWrite* pending = ops_g->pending_writes;
+        ops_g->pending_writes = pending->next;
+        pending->next = ordered;
+        ordered = pending;
+    }
+    ops_g->pending_writes = ordered;
+
+    // Todos os arquivos pendentes recebem seus blocos em uma única alocação (uma escrita por
+    // bloco de bitmap). Se não houver espaço para todos, cada arquivo tenta alocar sozinho.
+    unsigned int total_blocks = 0;
+    for (PendingWrite* pending = ops_g->pending_writes; pending; pending = pending->next) {
+        total_blocks += pending->block_count;
+    }
+    unsigned int* blocks = (unsigned int*) malloc((total_blocks > 0 ? total_blocks : 1) * sizeof(unsigned int));
+    int batched = fs_alloc_extent(total_blocks, blocks) == 0;
+
+    unsigned int next_block = 0;
+    while (ops_g->pending_writes) {
+        PendingWrite* pending = ops_g->pending_writes;
+        ops_g->pending_writes = pending->next;
+        const unsigned int* preallocated = batched ? blocks + next_block : NULL;
+        next_block += pending->block_count;
+        if (flush_pending_write(pending, preallocated) != 0) result = -1;
+    }
+    free(blocks);
+    ops_g->pending_bytes = 0;
+    return result;
+}
+
+/*
+ * Aloca os blocos de um arquivo pendente em uma única passada (contígua quando possível),
+ * grava os dados e atualiza o i-node. Libera a estrutura pendente.
+ * input:
+ * pending - O arquivo pendente (já removido da lista).
+ * preallocated - Blocos já alocados para o arquivo, ou NULL para alocar aqui.
+ * output:
+ * 0 em caso de sucesso, -1 se não houver espaço ou os dados não puderem ser gravados (o arquivo fica vazio).
+ */
+static int flush_pending_write(PendingWrite* pending, const unsigned int* preallocated) {
+    Inode inode;
+    fs_read_inode(pending->inode_num, &inode);
+
+    unsigned int blocks[12];
+    int result = 0;
+    if (preallocated) memcpy(blocks, preallocated, pending->block_count * sizeof(unsigned int));
+    else result = fs_alloc_extent(pending->block_count, blocks);
+    if (result != 0) {
+        fprintf(stderr, "write: Sem espaco em disco para gravar o i-node %u; o arquivo ficou vazio.\n", pending->inode_num);
+    } else {
+        // Blocos, tamanho e extents entram no mesmo i-node gravado depois dos dados.
+        memcpy(inode.direct_blocks, blocks, pending->block_count * sizeof(unsigned int));
+        inode.size_in_bytes = pending->size_in_bytes;
+        inode.flags |= pending->flags;
+        memcpy(inode.compressed_extent_size, pending->compressed_extent_size, sizeof(inode.compressed_extent_size));
+        if (disk_write_blocks(blocks, pending->block_count, pending->data) != 0 || fs_write_inode(pending->inode_num, &inode) != 0) {
+            // Os blocos não chegam ao i-node: voltam ao bitmap e o arquivo fica vazio.
+            fprintf(stderr, "write: Erro ao gravar os dados do i-node %u; o arquivo ficou vazio.\n", pending->inode_num);
+            fs_free_blocks(blocks, pending->block_count);
+            result = -1;
+        }
+    }
+
+    free(pending->data);
+    free(pending);
+    return result;
+}
+
+/*
+ * Grava um arquivo com alocação adiada, se ele estiver pendente.
+ * input:
+ * inode_num - O número do i-node.
+ * output:
+ * 1 se o arquivo estava pendente e foi gravado, 0 se não estava pendente, -1 em caso de erro.
+ */
+static int flush_inode_if_pending(unsigned int inode_num) {
+    PendingWrite** link = &ops_g->pending_writes;
+    while (*link) {
+        PendingWrite* pending = *link;
+        if (pending->inode_num == inode_num) {
+            *link = pending->next;
+            ops_g->pending_bytes -= (unsigned long) pending->block_count * fs_get_superblock_info().block_size;
+            return flush_pending_write(pending, NULL) == 0 ? 1 : -1;
+        }
+        link = &pending->next;
+    }
+    return 0;
+}
+
+/*
+ * Descarta os dados em memória de um arquivo pendente, sem alocar nada.
+ * input:
+ * inode_num - O número do i-node.
+ * output:
+ * 1 se havia dados pendentes, 0 caso contrário.
+ */
+static int drop_pending_write(unsigned int inode_num) {
+    PendingWrite** link = &ops_g->pending_writes;
+    while (*link) {
+        PendingWrite* pending = *link;
+        if (pending->inode_num == inode_num) {
+            *link = pending->next;
+            ops_g->pending_bytes -= (unsigned long) pending->block_count * fs_get_superblock_info().block_size;
+            free(pending->data);
+            free(pending);
+            return 1;
+        }
+        link = &pending->next;
+    }
+    return 0;
+}
+
+/*
+ * Completa um i-node lido do disco com o tamanho e a compressão de um arquivo ainda pendente,
+ * para que as consultas de atributos mostrem o arquivo como foi escrito.
+ * input:
+ * inode_num - O número do i-node.
+ * inode - O i-node lido do disco (atualizado se o arquivo estiver pendente).
+ * output: nenhum.
+ */
+static void apply_pending_layout(unsigned int inode_num, Inode* inode) {
+    for (PendingWrite* pending = ops_g->pending_writes; pending; pending = pending->next) {
+        if (pending->inode_num == inode_num) {
+            inode->size_in_bytes = pending->size_in_bytes;
+            inode->flags |= pending->flags;
+            memcpy(inode->compressed_extent_size, pending->compressed_extent_size, sizeof(inode->compressed_extent_size));
+            return;
+        }
+    }
+}
+
+/*
+ * Exibe na saída padrão o conteúdo de um arquivo gravado em extents comprimidos.
+ * input:
+ * inode - O i-node do arquivo (com INODE_FLAG_COMPRESSED).
+ * output:
+ * 0 em caso de sucesso, -1 se algum extent estiver corrompido.
+ */
+static int cat_compressed_data(const Inode* inode) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned char* raw_buffer;
+    unsigned char* block_buffer = get_extent_buffers(&raw_buffer);
+    if (!block_buffer) return -1;
+
+    long bytes_remaining = inode->size_in_bytes;
+    unsigned int block_idx = 0;
+    int result = 0;
+
+    for (int extent = 0; extent < MAX_COMPRESSED_EXTENTS && bytes_remaining > 0; extent++) {
+        int raw_len = (bytes_remaining > COMPRESSION_EXTENT_SIZE) ? COMPRESSION_EXTENT_SIZE : (int) bytes_remaining;
+        int stored_len = inode->compressed_extent_size[extent];
+        unsigned int stored_blocks = (stored_len + sb.block_size - 1) / sb.block_size;
+        if (stored_len == 0 || stored_len > raw_len || block_idx + stored_blocks > 12) {
+            result = -1;
+            break;
+        }
+
+        if (disk_read_blocks(inode->direct_blocks + block_idx, stored_blocks, block_buffer) != 0) {
+            result = -1;
+            break;
+        }
+        block_idx += stored_blocks;
+
+        if (stored_len == raw_len) {
+            fwrite(block_buffer, 1, raw_len, stdout);
+        } else {
+            if (lz_decompress(block_buffer, stored_len, raw_buffer, COMPRESSION_EXTENT_SIZE) != raw_len) {
+                result = -1;
+                break;
+            }
+            fwrite(raw_buffer, 1, raw_len, stdout);
+        }
+        bytes_remaining -= raw_len;
+    }
+
+    if (result != 0) {
+        fprintf(stderr, "cat: Extent comprimido corrompido.\n");
+    }
+    return result;
+}
+
+/*
+ * Acrescenta um número ao final de uma lista, aumentando-a se necessário.
+ * input:
+ * list - A lista.
+ * value - O número a acrescentar.
+ * output: nenhum.
+ */
+static void number_list_push(NumberList* list, unsigned int value) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->items = (unsigned int*) realloc(list->items, list->capacity * sizeof(unsigned int));
+    }
+    list->items[list->count++] = value;
+}
+
+/*
+ * Conta os blocos de dados ocupados por um i-node.
+ * input:
+ * inode - O i-node.
+ * output: A quantidade de blocos.
+ */
+static unsigned int count_inode_blocks(const Inode* inode) {
+    unsigned int count = 0;
+    for (int i = 0; i < 12; i++) {
+        if (inode->direct_blocks[i] != 0) count++;
+    }
+    return count;
+}
+
+/*
+ * Lê todos os blocos de um diretório para um único vetor de entradas.
+ * input:
+ * dir_inode - O i-node do diretório.
+ * entry_count - Recebe o número de posições lidas (inclusive as livres).
+ * output:
+ * O vetor de entradas (liberado com free), ou NULL em caso de erro de leitura.
+ */
+static DirEntry* read_dir_entries(const Inode* dir_inode, unsigned int* entry_count) {
+    DirEntry* entries = NULL;
+    size_t capacity = 0;
+    if (load_dir_entries(dir_inode, &entries, &capacity, entry_count) != 0) {
+        free(entries);
+        return NULL;
+    }
+    return entries;
+}
+
+/*
+ * Lê todos os blocos de um diretório para um vetor fornecido pelo chamador, aumentando-o
+ * só se ele não couber as entradas.
+ * input:
+ * dir_inode - O i-node do diretório.
+ * entries - O vetor (pode ser NULL; é substituído se precisar crescer).
+ * capacity - Bytes alocados em '*entries', atualizado.
+ * entry_count - Recebe o número de posições lidas (inclusive as livres).
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro de leitura.
+ */
+static int load_dir_entries(const Inode* dir_inode, DirEntry** entries, size_t* capacity, unsigned int* entry_count) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+    unsigned int block_count = count_inode_blocks(dir_inode);
+
+    size_t needed = (size_t) (block_count > 0 ? block_count : 1) * sb.block_size;
+    if (needed > *capacity) {
+        free(*entries);
+        *entries = (DirEntry*) malloc(needed);
+        *capacity = needed;
+    }
+    *entry_count = 0;
+    for (int i = 0; i < 12; i++) {
+        if (dir_inode->direct_blocks[i] == 0) continue;
+        if (disk_read_block(dir_inode->direct_blocks[i], *entries + *entry_count) != 0) return -1;
+        *entry_count += entries_per_block;
+    }
+    return 0;
+}
+
+/*
+ * Lê todos os blocos de um diretório e, em lote, os i-nodes de todos os seus filhos.
+ * Os blocos dos subdiretórios, que o chamador costuma ler em seguida, são pedidos antecipadamente.
+ * input:
+ * dir_inode - O i-node do diretório.
+ * listing - Recebe o conteúdo (liberado com free_dir_listing).
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro de leitura.
+ */
+static int load_dir_listing(const Inode* dir_inode, DirListing* listing) {
+    memset(listing, 0, sizeof(DirListing));
+    listing->entries = read_dir_entries(dir_inode, &listing->entry_count);
+    if (!listing->entries) return -1;
+
+    unsigned int* child_nums = (unsigned int*) malloc((listing->entry_count > 0 ? listing->entry_count : 1) * sizeof(unsigned int));
+    listing->child_slots = (unsigned int*) malloc((listing->entry_count > 0 ? listing->entry_count : 1) * sizeof(unsigned int));
+    for (unsigned int j = 0; j < listing->entry_count; j++) {
+        const char* name = listing->entries[j].name;
+        if (name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        listing->child_slots[listing->child_count] = j;
+        child_nums[listing->child_count++] = listing->entries[j].inode_number;
+    }
+
+    listing->child_inodes = (Inode*) malloc((listing->child_count > 0 ? listing->child_count : 1) * sizeof(Inode));
+    fs_read_inodes(child_nums, listing->child_count, listing->child_inodes);
+    free(child_nums);
+
+    for (unsigned int i = 0; i < listing->child_count; i++) {
+        if (listing->child_inodes[i].mode != 1) continue;
+        for (int k = 0; k < 12; k++) {
+            if (listing->child_inodes[i].direct_blocks[k] != 0) disk_prefetch_blocks(listing->child_inodes[i].direct_blocks[k], 1);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Libera a memória de um DirListing.
+ * input:
+ * listing - O conteúdo carregado por load_dir_listing.
+ * output: nenhum.
+ */
+static void free_dir_listing(DirListing* listing) {
+    free(listing->entries);
+    free(listing->child_slots);
+    free(listing->child_inodes);
+    memset(listing, 0, sizeof(DirListing));
+}
+
+/*
+ * Coleta, em pré-ordem, os i-nodes e blocos de uma árvore (o próprio i-node e, se for
+ * diretório, tudo o que estiver abaixo dele).
+ * input:
+ * inode_num - O número do i-node da raiz da árvore.
+ * inode - O i-node da raiz da árvore.
+ * inodes - Lista que recebe os números dos i-nodes.
+ * blocks - Lista que recebe os números dos blocos de dados.
+ * xattr_blocks - Lista que recebe os blocos de atributos estendidos (NULL para ignorá-los).
+ * linked - Lista que recebe, em vez das outras, os arquivos com mais de um link físico, uma vez
+ *          por nome (NULL para tratá-los como os demais).
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro de leitura.
+ */
+static int collect_tree(unsigned int inode_num, const Inode* inode, NumberList* inodes, NumberList* blocks, NumberList* xattr_blocks, NumberList* linked) {
+    if (linked && inode->mode != 1 && inode->link_count > 1) {
+        number_list_push(linked, inode_num);
+        return 0;
+    }
+    number_list_push(inodes, inode_num);
+    for (int i = 0; i < 12; i++) {
+        if (inode->direct_blocks[i] != 0) number_list_push(blocks, inode->direct_blocks[i]);
+    }
+    if (xattr_blocks && inode->xattr_block != 0) number_list_push(xattr_blocks, inode->xattr_block);
+    if (inode->mode != 1) return 0;
+
+    DirListing listing;
+    if (load_dir_listing(inode, &listing) != 0) return -1;
+    int result = 0;
+    for (unsigned int i = 0; i < listing.child_count && result == 0; i++) {
+        result = collect_tree(listing.entries[listing.child_slots[i]].inode_number, &listing.child_inodes[i], inodes, blocks, xattr_blocks, linked);
+    }
+    free_dir_listing(&listing);
+    return result;
+}
+
+/*
+ * Copia uma árvore usando i-nodes e blocos já alocados, consumidos na mesma pré-ordem
+ * em que collect_tree os contou. Cada nome de um arquivo com links físicos vira um arquivo
+ * separado, e os links simbólicos são copiados como links (com o mesmo alvo).
+ * input:
+ * src_inode_num - O número do i-node da raiz da árvore de origem.
+ * src_inode - O i-node da raiz da árvore de origem.
+ * new_parent_num - O i-node do diretório que receberá a cópia (para "..").
+ * cursor - Os i-nodes e blocos pré-alocados.
+ * output:
+ * O número do i-node da cópia, ou -1 em caso de erro de leitura ou escrita.
+ */
+static int copy_tree(unsigned int src_inode_num, const Inode* src_inode, unsigned int new_parent_num, CopyCursor* cursor) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+    unsigned int new_inode_num = cursor->inodes[cursor->next_inode++];
+
+    Inode new_inode = *src_inode;
+    new_inode.link_count = src_inode->mode == 1 ? 2 : 1;
+    new_inode.flags &= ~INODE_FLAG_INLINE_XATTR; // Os atributos estendidos não são copiados.
+    new_inode.xattr_block = 0;
+    time_t now = time(NULL);
+    new_inode.creation_time = now;
+    new_inode.modification_time = now;
+    new_inode.last_access_time = now;
+    for (int i = 0; i < 12; i++) {
+        if (src_inode->direct_blocks[i] != 0) new_inode.direct_blocks[i] = cursor->blocks[cursor->next_block++];
+    }
+
+    int result = 0;
+    if (src_inode->mode == 1) {
+        dir_hint_forget(new_inode_num); // O número pode ter sido de um diretório já apagado.
+        DirListing listing;
+        if (load_dir_listing(src_inode, &listing) != 0) return -1;
+        for (unsigned int i = 0; i < listing.child_count; i++) {
+            int child_num = copy_tree(listing.entries[listing.child_slots[i]].inode_number, &listing.child_inodes[i], new_inode_num, cursor);
+            if (child_num < 0) { result = -1; break; }
+            listing.entries[listing.child_slots[i]].inode_number = child_num;
+        }
+        for (unsigned int j = 0; j < listing.entry_count; j++) {
+            if (strcmp(listing.entries[j].name, ".") == 0) listing.entries[j].inode_number = new_inode_num;
+            else if (strcmp(listing.entries[j].name, "..") == 0) listing.entries[j].inode_number = new_parent_num;
+        }
+        // Cada bloco do novo diretório é escrito uma única vez, já com todas as entradas.
+        unsigned int written = 0;
+        for (int i = 0; i < 12 && result == 0; i++) {
+            if (new_inode.direct_blocks[i] == 0) continue;
+            if (disk_write_block(new_inode.direct_blocks[i], listing.entries + written * entries_per_block) != 0) result = -1;
+            written++;
+        }
+        free_dir_listing(&listing);
+    } else {
+        // O arquivo inteiro é lido e escrito em dois pedidos de vários blocos.
+        unsigned int src_blocks[12], dst_blocks[12], count = 0;
+        for (int i = 0; i < 12; i++) {
+            if (src_inode->direct_blocks[i] == 0) continue;
+            src_blocks[count] = src_inode->direct_blocks[i];
+            dst_blocks[count++] = new_inode.direct_blocks[i];
+        }
+        unsigned char* buffer = get_transfer_buffer((size_t) count * sb.block_size);
+        if (count > 0 && (!buffer || disk_read_blocks(src_blocks, count, buffer) != 0 ||
+                          disk_write_blocks(dst_blocks, count, buffer) != 0)) result = -1;
+    }
+
+    if (src_inode->flags & INODE_FLAG_INLINE_DATA) {
+        // Link simbólico rápido: o alvo está na área do slot.
+        Inode src_copy;
+        unsigned char inline_area[FS_INODE_INLINE_XATTR_SIZE];
+        fs_read_inode_inline(src_inode_num, &src_copy, inline_area);
+        fs_write_inode_inline(new_inode_num, &new_inode, inline_area);
+    } else {
+        fs_write_inode(new_inode_num, &new_inode);
+    }
+    return result == 0 ? (int) new_inode_num : -1;
+}
+
+/*
+ * Soma os blocos de uma árvore e imprime o total de cada diretório (e da raiz da árvore).
+ * input:
+ * path - O caminho da raiz da árvore (usado apenas na saída).
+ * inode - O i-node da raiz da árvore.
+ * output: A quantidade de blocos ocupados pela árvore.
+ */
+static unsigned long du_tree(const char* path, const Inode* inode) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned long blocks = count_inode_blocks(inode);
+
+    if (inode->mode == 1) {
+        DirListing listing;
+        if (load_dir_listing(inode, &listing) == 0) {
+            for (unsigned int i = 0; i < listing.child_count; i++) {
+                if (listing.child_inodes[i].mode != 1) {
+                    blocks += count_inode_blocks(&listing.child_inodes[i]);
+                    continue;
+                }
+                char child_path[1024];
+                snprintf(child_path, sizeof(child_path), "%s/%s", strcmp(path, "/") == 0 ? "" : path,
+                         listing.entries[listing.child_slots[i]].name);
+                blocks += du_tree(child_path, &listing.child_inodes[i]);
+            }
+            free_dir_listing(&listing);
+        } else {
+            fprintf(stderr, "du: %s: Erro ao ler o diretorio.\n", path);
+        }
+    }
+
+    printf("%lu\t%s\n", blocks * sb.block_size / 1024, path);
+    return blocks;
+}
+
+/*
+ * Valida um handle e o modo em que foi aberto.
+ * input:
+ * fd - O handle.
+ * required_flag - FS_O_READ ou FS_O_WRITE exigido pela operação (0 para nenhum).
+ * output:
+ * A entrada da tabela de arquivos abertos, ou NULL se o handle for inválido.
+ */
+static OpenFile* get_open_file(int fd, int required_flag) {
+    if (fd < 0 || fd >= MAX_OPEN_FILES || !ops_g->open_files[fd].in_use) {
+        fprintf(stderr, "Erro: Handle de arquivo %d invalido.\n", fd);
+        return NULL;
+    }
+    if (required_flag && !(ops_g->open_files[fd].flags & required_flag)) {
+        fprintf(stderr, "Erro: Handle %d nao foi aberto para %s.\n", fd, required_flag == FS_O_READ ? "leitura" : "escrita");
+        return NULL;
+    }
+    return &ops_g->open_files[fd];
+}
+
+/*
+ * Invalida os handles abertos para um i-node que está sendo liberado.
+ * input:
+ * inode_num - O número do i-node.
+ * output: nenhum.
+ */
+static void close_handles_for_inode(unsigned int inode_num) {
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        if (ops_g->open_files[i].in_use && ops_g->open_files[i].inode_num == inode_num) ops_g->open_files[i].in_use = 0;
+    }
+}
+
+/*
+ * Procura a dica de um diretório.
+ * input:
+ * dir_inode_num - O número do i-node do diretório.
+ * output: A dica, ou NULL se o diretório não tiver uma.
+ */
+static DirHint* dir_hint_get(unsigned int dir_inode_num) {
+    DirHint* hint = &ops_g->dir_hints[dir_inode_num % DIR_HINT_SLOTS];
+    return (hint->valid && hint->dir_inode_num == dir_inode_num) ? hint : NULL;
+}
+
+/*
+ * Registra a dica de um diretório (substituindo a que ocupava a mesma posição da tabela).
+ * input:
+ * dir_inode_num - O número do i-node do diretório.
+ * entry_count - Entradas em uso, incluindo "." e "..".
+ * first_free - Primeira posição que pode estar livre.
+ * output: nenhum.
+ */
+static void dir_hint_set(unsigned int dir_inode_num, unsigned int entry_count, unsigned int first_free) {
+    DirHint* hint = &ops_g->dir_hints[dir_inode_num % DIR_HINT_SLOTS];
+    hint->valid = 1;
+    hint->dir_inode_num = dir_inode_num;
+    hint->entry_count = entry_count;
+    hint->first_free = first_free;
+}
+
+/*
+ * Descarta a dica de um diretório (quando o i-node é liberado ou reaproveitado).
+ * input:
+ * dir_inode_num - O número do i-node.
+ * output: nenhum.
+ */
+static void dir_hint_forget(unsigned int dir_inode_num) {
+    DirHint* hint = dir_hint_get(dir_inode_num);
+    if (hint) hint->valid = 0;
+    if (ops_g->last_lookup.dir_inode_num == dir_inode_num) ops_g->last_lookup.valid = 0;
+}
+
+/*
+ * Atualiza a dica de um diretório depois que uma entrada foi apagada.
+ * input:
+ * dir_inode_num - O número do i-node do diretório.
+ * position - A posição que ficou livre.
+ * output: nenhum.
+ */
+static void dir_hint_entry_removed(unsigned int dir_inode_num, unsigned int position) {
+    DirHint* hint = dir_hint_get(dir_inode_num);
+    if (!hint) return;
+    if (hint->entry_count > 0) hint->entry_count--;
+    if (position < hint->first_free) hint->first_free = position;
+}
+
+/*
+ * Ocupa uma posição da tabela de diretórios abertos com o conteúdo de um diretório.
+ * input:
+ * dir_inode - O i-node do diretório.
+ * flags - FS_READDIR_*.
+ * output:
+ * O descritor do diretório, ou -1 se a tabela estiver cheia ou houver erro de leitura.
+ */
+static int open_dir_inode(const Inode* dir_inode, int flags) {
+    for (int dd = 0; dd < MAX_OPEN_DIRS; dd++) {
+        if (ops_g->open_dirs[dd].in_use) continue;
+        if (load_dir_entries(dir_inode, &ops_g->open_dirs[dd].entries, &ops_g->open_dirs[dd].entries_capacity,
+                             &ops_g->open_dirs[dd].entry_count) != 0) {
+            return -1;
+        }
+        ops_g->open_dirs[dd].in_use = 1;
+        ops_g->open_dirs[dd].flags = flags;
+        ops_g->open_dirs[dd].position = 0;
+        return dd;
+    }
+    fprintf(stderr, "Erro: Limite de %d diretorios abertos atingido.\n", MAX_OPEN_DIRS);
+    return -1;
+}
+
+/*
+ * Compara duas entradas pelo nome (para qsort).
+ * input:
+ * a, b - Ponteiros para FsDirEntry.
+ * output: Negativo, zero ou positivo, como strcmp.
+ */
+static int compare_dir_entries(const void* a, const void* b) {
+    return strcmp(((const FsDirEntry*) a)->name, ((const FsDirEntry*) b)->name);
+}
+
+/*
+ * Imprime uma linha da listagem do ls.
+ * input:
+ * name - O nome da entrada.
+ * inode_num - O número do i-node da entrada (para ler o alvo de um link simbólico no formato longo).
+ * inode - O i-node da entrada (usado só no formato longo).
+ * long_format - 1 para o formato do ls -l.
+ * output: nenhum.
+ */
+static void print_ls_entry(const char* name, unsigned int inode_num, const Inode* inode, int long_format) {
+    if (!long_format) {
+        printf("%s\n", name);
+        return;
+    }
+    char time_text[32] = "?";
+    // localtime_r não relê o fuso horário (e não aloca memória) a cada entrada, como localtime.
+    struct tm modified;
+    if (localtime_r(&inode->modification_time, &modified)) strftime(time_text, sizeof(time_text), "%Y-%m-%d %H:%M", &modified);
+    char target[1024] = "";
+    if (inode->mode == 2) {
+        Inode link_inode;
+        unsigned char inline_area[FS_INODE_INLINE_XATTR_SIZE];
+        fs_read_inode_inline(inode_num, &link_inode, inline_area);
+        if (read_symlink_target(&link_inode, inline_area, target, sizeof(target)) < 0) strcpy(target, "?");
+    }
+    printf("%c %3u %10u %s %s%s%s%s\n", inode->mode == 1 ? 'd' : (inode->mode == 2 ? 'l' : '-'), inode->link_count,
+           inode->size_in_bytes, time_text, name, (inode->flags & INODE_FLAG_COMPRESSED) ? " (comprimido)" : "",
+           inode->mode == 2 ? " -> " : "", target);
+}
+
+/*
+ * Cria um arquivo vazio (sem blocos) e o liga ao diretório pai.
+ * input:
+ * path - O caminho do novo arquivo.
+ * inode - Recebe o i-node criado.
+ * output:
+ * O número do i-node criado, ou -1 em caso de erro.
+ */
+static int create_empty_file(const char* path, Inode* inode) {
+    char path_copy[1024];
+    strncpy(path_copy, path, 1023);
+    path_copy[1023] = '\0';
+    char* name = strrchr(path_copy, '/');
+    char* parent_path;
+    if (name == path_copy) { parent_path = "/"; name++; }
+    else { *name = '\0'; name++; parent_path = path_copy; }
+
+    Inode parent_inode;
+    int parent_inode_num = find_inode_by_path(parent_path, &parent_inode);
+    if (parent_inode_num < 0 || parent_inode.mode != 1) {
+        fprintf(stderr, "open: Diretorio pai '%s' nao encontrado.\n", parent_path);
+        return -1;
+    }
+    if (name[0] == '\0' || strlen(name) >= MAX_FILENAME_LENGTH) {
+        fprintf(stderr, "open: Nome de arquivo invalido '%s'.\n", name);
+        return -1;
+    }
+    DirEntry existing;
+    if (find_entry_in_dir_inode(parent_inode_num, &parent_inode, name, &existing) == 0) {
+        // O nome existe, mas não resolveu: um link simbólico sem destino (ou em ciclo).
+        fprintf(stderr, "open: '%s' e um link simbolico sem destino.\n", path);
+        return -1;
+    }
+
+    int inode_num = fs_alloc_inode();
+    if (inode_num < 0) {
+        fprintf(stderr, "open: Nao ha i-nodes livres.\n");
+        return -1;
+    }
+    memset(inode, 0, sizeof(Inode));
+    inode->mode = 0;
+    inode->link_count = 1;
+    time_t now = time(NULL);
+    inode->creation_time = now;
+    inode->modification_time = now;
+    inode->last_access_time = now;
+    fs_write_inode(inode_num, inode);
+    if (add_entry_to_dir(parent_inode_num, name, inode_num) != 0) {
+        fprintf(stderr, "open: Diretorio '%s' cheio.\n", parent_path);
+        fs_free_inode(inode_num);
+        return -1;
+    }
+    return inode_num;
+}
+
+/*
+ * Garante que os blocos 0..last_index de um arquivo existam, alocando de uma vez os que faltam.
+ * O i-node é atualizado apenas em memória.
+ * input:
+ * inode - O i-node do arquivo.
+ * last_index - O último índice de bloco necessário (< 12).
+ * fresh - Vetor de 12 posições; recebe 1 para cada bloco recém-alocado (conteúdo indefinido).
+ * output:
+ * 0 em caso de sucesso, -1 se não houver espaço.
+ */
+static int allocate_missing_blocks(Inode* inode, unsigned int last_index, unsigned char* fresh) {
+    unsigned int missing = 0;
+    unsigned int new_blocks[12];
+    memset(fresh, 0, 12);
+    for (unsigned int i = 0; i <= last_index; i++) {
+        if (inode->direct_blocks[i] == 0) missing++;
+    }
+    if (missing == 0) return 0;
+    if (fs_alloc_extent(missing, new_blocks) != 0) {
+        fprintf(stderr, "write: Nao ha espaco livre no disco.\n");
+        return -1;
+    }
+    unsigned int next = 0;
+    for (unsigned int i = 0; i <= last_index; i++) {
+        if (inode->direct_blocks[i] != 0) continue;
+        inode->direct_blocks[i] = new_blocks[next++];
+        fresh[i] = 1;
+    }
+    return 0;
+}
+
+/*
+ * Muda o tamanho de um arquivo não comprimido e grava o i-node.
+ * Ao encolher, zera o final do último bloco para que um crescimento posterior leia zeros.
+ * input:
+ * inode_num - O número do i-node.
+ * inode - O i-node do arquivo (atualizado).
+ * new_size - O novo tamanho em bytes.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int truncate_inode(unsigned int inode_num, Inode* inode, unsigned int new_size) {
+    Superblock sb = fs_get_superblock_info();
+    if (inode->flags & INODE_FLAG_COMPRESSED) {
+        fprintf(stderr, "truncate: Arquivos comprimidos nao podem ser truncados.\n");
+        return -1;
+    }
+    if (new_size > 12 * sb.block_size) {
+        fprintf(stderr, "truncate: Tamanho maximo e %u bytes.\n", 12 * sb.block_size);
+        return -1;
+    }
+
+    unsigned int keep_blocks = (new_size + sb.block_size - 1) / sb.block_size;
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
+    memset(block_buffer, 0, sb.block_size);
+    int result = 0;
+    if (new_size < inode->size_in_bytes) {
+        fs_free_blocks(inode->direct_blocks + keep_blocks, 12 - keep_blocks);
+        for (unsigned int i = keep_blocks; i < 12; i++) inode->direct_blocks[i] = 0;
+        unsigned int tail = new_size % sb.block_size;
+        if (tail != 0 && inode->direct_blocks[keep_blocks - 1] != 0) {
+            unsigned int block_num = inode->direct_blocks[keep_blocks - 1];
+            if (disk_read_block(block_num, block_buffer) != 0) result = -1;
+            else {
+                memset(block_buffer + tail, 0, sb.block_size - tail);
+                if (disk_write_block(block_num, block_buffer) != 0) result = -1;
+            }
+        }
+    } else if (keep_blocks > 0) {
+        unsigned char fresh[12];
+        if (allocate_missing_blocks(inode, keep_blocks - 1, fresh) != 0) result = -1;
+        for (unsigned int i = 0; i < keep_blocks && result == 0; i++) {
+            if (fresh[i] && disk_write_block(inode->direct_blocks[i], block_buffer) != 0) result = -1;
+        }
+    }
+    fs_put_block_buffer(block_buffer);
+    if (result != 0) return -1;
+
+    inode->size_in_bytes = new_size;
+    inode->modification_time = time(NULL);
+    fs_write_inode(inode_num, inode);
+    return 0;
+}
+
+/*
+ * Lê um intervalo de um arquivo não comprimido, calculando o bloco de cada posição diretamente.
+ * input:
+ * inode - O i-node do arquivo.
+ * offset - A posição inicial.
+ * buffer - Onde os bytes serão armazenados.
+ * count - Quantidade de bytes (já limitada ao tamanho do arquivo).
+ * output:
+ * A quantidade de bytes lidos, ou -1 em caso de erro.
+ */
+static int read_raw_range(const Inode* inode, unsigned int offset, unsigned char* buffer, unsigned int count) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
+    unsigned int done = 0;
+    while (done < count) {
+        unsigned int position = offset + done;
+        unsigned int block_idx = position / sb.block_size;
+        unsigned int in_block = position % sb.block_size;
+        unsigned int chunk = sb.block_size - in_block;
+        if (chunk > count - done) chunk = count - done;
+
+        unsigned int block_num = block_idx < 12 ? inode->direct_blocks[block_idx] : 0;
+        if (block_num == 0) {
+            memset(buffer + done, 0, chunk);
+        } else if (chunk == sb.block_size) {
+            // Blocos inteiros seguidos vão direto para o buffer do chamador, num único pedido.
+            unsigned int run = 1;
+            while (block_idx + run < 12 && inode->direct_blocks[block_idx + run] != 0 &&
+                   count - done - run * sb.block_size >= sb.block_size) run++;
+            if (disk_read_blocks(inode->direct_blocks + block_idx, run, buffer + done) != 0) break;
+            chunk = run * sb.block_size;
+        } else {
+            if (disk_read_block(block_num, block_buffer) != 0) break;
+            memcpy(buffer + done, block_buffer + in_block, chunk);
+        }
+        done += chunk;
+    }
+    fs_put_block_buffer(block_buffer);
+    return (done == 0 && count > 0) ? -1 : (int) done;
+}
+
+/*
+ * Lê um intervalo de um arquivo comprimido, descomprimindo apenas os extents que o cobrem.
+ * input:
+ * inode - O i-node do arquivo.
+ * offset - A posição inicial.
+ * buffer - Onde os bytes serão armazenados.
+ * count - Quantidade de bytes (já limitada ao tamanho do arquivo).
+ * output:
+ * A quantidade de bytes lidos, ou -1 em caso de erro.
+ */
+static int read_compressed_range(const Inode* inode, unsigned int offset, unsigned char* buffer, unsigned int count) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned char* raw_buffer;
+    unsigned char* block_buffer = get_extent_buffers(&raw_buffer);
+    if (!block_buffer) return -1;
+
+    unsigned int done = 0;
+    unsigned int block_idx = 0;
+    for (unsigned int extent = 0; extent < MAX_COMPRESSED_EXTENTS && done < count; extent++) {
+        unsigned int extent_start = extent * COMPRESSION_EXTENT_SIZE;
+        unsigned int raw_len = inode->size_in_bytes - extent_start > COMPRESSION_EXTENT_SIZE
+                               ? COMPRESSION_EXTENT_SIZE : inode->size_in_bytes - extent_start;
+        unsigned int stored_len = inode->compressed_extent_size[extent];
+        unsigned int stored_blocks = (stored_len + sb.block_size - 1) / sb.block_size;
+        if (stored_len == 0 || stored_len > raw_len || block_idx + stored_blocks > 12) break;
+
+        // Extents antes do intervalo pedido são pulados sem leitura.
+        if (offset + done >= extent_start + raw_len) {
+            block_idx += stored_blocks;
+            continue;
+        }
+
+        int ok = disk_read_blocks(inode->direct_blocks + block_idx, stored_blocks, block_buffer) == 0;
+        block_idx += stored_blocks;
+        if (!ok) break;
+
+        const unsigned char* raw = block_buffer;
+        if (stored_len < raw_len) {
+            if (lz_decompress(block_buffer, stored_len, raw_buffer, COMPRESSION_EXTENT_SIZE) != (int) raw_len) break;
+            raw = raw_buffer;
+        }
+        unsigned int from = offset + done - extent_start;
+        unsigned int chunk = raw_len - from;
+        if (chunk > count - done) chunk = count - done;
+        memcpy(buffer + done, raw + from, chunk);
+        done += chunk;
+    }
+
+    if (done < count) fprintf(stderr, "read: Extent comprimido corrompido.\n");
+    return (done == 0 && count > 0) ? -1 : (int) done;
+}
+
+/*
+ * Devolve o buffer de transferência do estado atual com pelo menos 'size' bytes.
+ * O buffer é mantido entre chamadas e só cresce.
+ * input:
+ * size - O tamanho necessário.
+ * output: O buffer, ou NULL se faltar memória.
+ */
+static unsigned char* get_transfer_buffer(size_t size) {
+    if (size > ops_g->transfer_capacity) {
+        unsigned char* grown = (unsigned char*) realloc(ops_g->transfer, size);
+        if (!grown) return NULL;
+        ops_g->transfer = grown;
+        ops_g->transfer_capacity = size;
+    }
+    return ops_g->transfer;
+}
+
+/*
+ * Devolve os buffers de extent do estado atual, mantidos entre chamadas como o de transferência:
+ * um para os blocos guardados de um extent (ou a saída do compressor) e outro para o extent
+ * descomprimido. Não se misturam com o buffer de transferência, que cat e cp usam ao mesmo tempo.
+ * input:
+ * raw_buffer - Recebe o buffer do extent descomprimido (pode ser NULL).
+ * output: O buffer dos blocos guardados, ou NULL se faltar memória.
+ */
+static unsigned char* get_extent_buffers(unsigned char** raw_buffer) {
+    Superblock sb = fs_get_superblock_info();
+    size_t stored_size = (size_t) (COMPRESSION_EXTENT_SIZE + sb.block_size - 1) / sb.block_size * sb.block_size;
+    if (stored_size < LZ_COMPRESS_BOUND(COMPRESSION_EXTENT_SIZE)) stored_size = LZ_COMPRESS_BOUND(COMPRESSION_EXTENT_SIZE);
+    if (stored_size > ops_g->extent_stored_capacity) {
+        unsigned char* grown = (unsigned char*) realloc(ops_g->extent_stored, stored_size);
+        if (!grown) return NULL;
+        ops_g->extent_stored = grown;
+        ops_g->extent_stored_capacity = stored_size;
+    }
+    if (raw_buffer) {
+        if (!ops_g->extent_raw) ops_g->extent_raw = (unsigned char*) malloc(COMPRESSION_EXTENT_SIZE);
+        if (!ops_g->extent_raw) return NULL;
+        *raw_buffer = ops_g->extent_raw;
+    }
+    return ops_g->extent_stored;
+}
+
+/*
+ * Acrescenta à lista um i-node e, se for um diretório, toda a árvore abaixo dele (pré-ordem).
+ * Um arquivo com vários links físicos entra uma única vez, pelo primeiro nome encontrado.
+ * input:
+ * inode_num - O número do i-node.
+ * parent_num - O diretório que contém a entrada dele.
+ * inode - O i-node.
+ * list - A lista a preencher.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro de leitura.
+ */
+static int collect_defrag_items(unsigned int inode_num, unsigned int parent_num, const Inode* inode, DefragList* list) {
+    if (inode->mode != 1 && inode->link_count > 1) {
+        for (unsigned int i = 0; i < list->count; i++) {
+            if (list->items[i].inode_num == inode_num) return 0;
+        }
+    }
+    if (list->count == list->capacity) {
+        unsigned int capacity = list->capacity ? list->capacity * 2 : 64;
+        DefragItem* grown = (DefragItem*) realloc(list->items, capacity * sizeof(DefragItem));
+        if (!grown) return -1;
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = (DefragItem) { inode_num, parent_num, *inode };
+    if (inode->mode != 1) return 0;
+
+    DirListing listing;
+    if (load_dir_listing(inode, &listing) != 0) return -1;
+    int result = 0;
+    for (unsigned int i = 0; i < listing.child_count && result == 0; i++) {
+        result = collect_defrag_items(listing.entries[listing.child_slots[i]].inode_number, inode_num, &listing.child_inodes[i], list);
+    }
+    free_dir_listing(&listing);
+    return result;
+}
+
+/*
+ * Conta as sequências de blocos fisicamente contíguos de um i-node, na ordem do arquivo.
+ * input:
+ * inode - O i-node.
+ * output: A quantidade de extents (0 para um arquivo sem blocos).
+ */
+static unsigned int count_extents(const Inode* inode) {
+    unsigned int extents = 0, previous = 0;
+    for (int i = 0; i < 12; i++) {
+        unsigned int block_num = inode->direct_blocks[i];
+        if (block_num == 0) continue;
+        if (previous == 0 || block_num != previous + 1) extents++;
+        previous = block_num;
+    }
+    return extents;
+}
+
+/*
+ * Soma a fragmentação dos itens da lista.
+ * input:
+ * list - Os itens.
+ * files - Recebe quantos itens têm blocos.
+ * extents - Recebe o total de extents.
+ * fragmented - Recebe quantos itens têm mais de um extent.
+ * output: nenhum.
+ */
+static void measure_fragmentation(const DefragList* list, unsigned int* files, unsigned int* extents, unsigned int* fragmented) {
+    *files = *extents = *fragmented = 0;
+    for (unsigned int i = 0; i < list->count; i++) {
+        unsigned int count = count_extents(&list->items[i].inode);
+        if (count == 0) continue;
+        (*files)++;
+        *extents += count;
+        if (count > 1) (*fragmented)++;
+    }
+}
+
+/*
+ * Lê todos os blocos de todos os itens, arquivo por arquivo, com a cache do hospedeiro descartada.
+ * input:
+ * list - Os itens.
+ * output: A vazão em MiB/s (0 se não houver blocos ou a leitura falhar).
+ */
+static double measure_read_rate(const DefragList* list) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned char* buffer = get_transfer_buffer((size_t) 12 * sb.block_size);
+    if (!buffer) return 0;
+    disk_drop_cache();
+
+    struct timespec start, end;
+    unsigned long long bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned int i = 0; i < list->count; i++) {
+        unsigned int blocks[12], count = 0;
+        for (int k = 0; k < 12; k++) {
+            if (list->items[i].inode.direct_blocks[k] != 0) blocks[count++] = list->items[i].inode.direct_blocks[k];
+        }
+        if (count == 0) continue;
+        if (disk_read_blocks(blocks, count, buffer) != 0) return 0;
+        bytes += (unsigned long long) count * sb.block_size;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return bytes == 0 || seconds <= 0 ? 0 : bytes / (1024.0 * 1024.0) / seconds;
+}
+
+/*
+ * Regrava os blocos de um item em uma sequência contígua, se houver uma livre. Um item já
+ * contíguo só é movido com 'compact', e apenas para uma posição anterior à atual.
+ * Os dados são gravados antes do i-node, e os blocos antigos só são liberados depois dele.
+ * input:
+ * item - O item (o i-node em memória é atualizado).
+ * compact - 1 para também aproximar itens contíguos do início da área de dados.
+ * output:
+ * 1 se o item foi movido, 0 se ficou onde estava, -1 em caso de erro de leitura ou escrita.
+ */
+static int relocate_item(DefragItem* item, int compact) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned int old_blocks[12], new_blocks[12], count = 0;
+    for (int k = 0; k < 12; k++) {
+        if (item->inode.direct_blocks[k] != 0) old_blocks[count++] = item->inode.direct_blocks[k];
+    }
+    unsigned int extents = count_extents(&item->inode);
+    if (count == 0 || (extents == 1 && !compact)) return 0;
+    if (fs_alloc_extent(count, new_blocks) != 0) return 0;
+
+    int contiguous = new_blocks[count - 1] - new_blocks[0] == count - 1;
+    if (!contiguous || (extents == 1 && new_blocks[0] >= old_blocks[0])) {
+        fs_free_blocks(new_blocks, count);
+        return 0;
+    }
+
+    unsigned char* buffer = get_transfer_buffer((size_t) count * sb.block_size);
+    if (!buffer || disk_read_blocks(old_blocks, count, buffer) != 0 || disk_write_blocks(new_blocks, count, buffer) != 0) {
+        fs_free_blocks(new_blocks, count);
+        return -1;
+    }
+
+    Inode inode;
+    fs_read_inode(item->inode_num, &inode);
+    for (int k = 0, next = 0; k < 12; k++) {
+        if (inode.direct_blocks[k] != 0) inode.direct_blocks[k] = new_blocks[next++];
+    }
+    fs_write_inode(item->inode_num, &inode);
+    fs_free_blocks(old_blocks, count);
+    item->inode = inode;
+    if (g_verbose_mode) printf("   [Verbose] i-node %u: %u bloco(s) em %u extent(s) movidos para %u-%u.\n",
+                               item->inode_num, count, extents, new_blocks[0], new_blocks[count - 1]);
+    return 1;
+}
+
+/*
+ * Move os blocos de um item (de dados e de atributos estendidos) que estejam em 'limit' ou depois
+ * para os blocos livres mais baixos.
+ * input:
+ * item - O item (o i-node em memória é atualizado).
+ * limit - O primeiro bloco que deve ficar livre.
+ * output:
+ * 0 em caso de sucesso (ou nada a mover), -1 se faltar espaço ou houver erro de leitura ou escrita.
+ */
+static int relocate_tail_blocks(DefragItem* item, unsigned int limit) {
+    Superblock sb = fs_get_superblock_info();
+    // Os blocos de dados e, por último, o de atributos estendidos.
+    unsigned int old_blocks[13], new_blocks[13], count = 0;
+    for (int k = 0; k < 12; k++) {
+        if (item->inode.direct_blocks[k] >= limit) old_blocks[count++] = item->inode.direct_blocks[k];
+    }
+    if (item->inode.xattr_block >= limit) old_blocks[count++] = item->inode.xattr_block;
+    if (count == 0) return 0;
+    if (fs_alloc_blocks(count, new_blocks) != 0) return -1;
+
+    unsigned char* buffer = get_transfer_buffer((size_t) count * sb.block_size);
+    if (new_blocks[count - 1] >= limit || !buffer ||
+        disk_read_blocks(old_blocks, count, buffer) != 0 || disk_write_blocks(new_blocks, count, buffer) != 0) {
+        fs_free_blocks(new_blocks, count);
+        return -1;
+    }
+
+    Inode inode;
+    fs_read_inode(item->inode_num, &inode);
+    unsigned int next = 0;
+    for (int k = 0; k < 12; k++) {
+        if (inode.direct_blocks[k] >= limit) inode.direct_blocks[k] = new_blocks[next++];
+    }
+    if (inode.xattr_block >= limit) inode.xattr_block = new_blocks[next++];
+    fs_write_inode(item->inode_num, &inode);
+    fs_free_blocks(old_blocks, count);
+    item->inode = inode;
+    return 0;
+}
+
+/*
+ * Compara dois itens pelo primeiro bloco (itens sem blocos por último), para qsort.
+ */
+static int compare_items_by_first_block(const void* a, const void* b) {
+    const Inode* ia = &((const DefragItem*) a)->inode;
+    const Inode* ib = &((const DefragItem*) b)->inode;
+    unsigned int fa = 0xFFFFFFFFu, fb = 0xFFFFFFFFu;
+    for (int k = 0; k < 12; k++) {
+        if (fa == 0xFFFFFFFFu && ia->direct_blocks[k] != 0) fa = ia->direct_blocks[k];
+        if (fb == 0xFFFFFFFFu && ib->direct_blocks[k] != 0) fb = ib->direct_blocks[k];
+    }
+    return (fa > fb) - (fa < fb);
+}
+
+/*
+ * Compara dois itens pelo número do i-node, em ordem decrescente, para qsort.
+ */
+static int compare_items_by_inode_desc(const void* a, const void* b) {
+    unsigned int na = ((const DefragItem*) a)->inode_num;
+    unsigned int nb = ((const DefragItem*) b)->inode_num;
+    return (na < nb) - (na > nb);
+}
+
+/*
+ * Indica se algum handle aberto usa o i-node.
+ * input:
+ * inode_num - O número do i-node.
+ * output: 1 se estiver aberto, 0 caso contrário.
+ */
+static int is_inode_open(unsigned int inode_num) {
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        if (ops_g->open_files[i].in_use && ops_g->open_files[i].inode_num == inode_num) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Troca, em todas as entradas de um diretório, o número de i-node 'old_num' por 'new_num'.
+ * Só os blocos alterados são regravados.
+ * input:
+ * dir_inode_num - O i-node do diretório.
+ * old_num, new_num - Os números antigo e novo.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro de leitura.
+ */
+static int retarget_dir_entries(unsigned int dir_inode_num, unsigned int old_num, unsigned int new_num) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+    Inode dir_inode;
+    fs_read_inode(dir_inode_num, &dir_inode);
+    DirEntry* entries = (DirEntry*) fs_get_block_buffer();
+    int result = 0;
+    for (int i = 0; i < 12 && result == 0; i++) {
+        if (dir_inode.direct_blocks[i] == 0) continue;
+        if (disk_read_block(dir_inode.direct_blocks[i], entries) != 0) { result = -1; break; }
+        int changed = 0;
+        for (unsigned int j = 0; j < entries_per_block; j++) {
+            if (entries[j].name[0] != '\0' && entries[j].inode_number == old_num) {
+                entries[j].inode_number = new_num;
+                changed = 1;
+            }
+        }
+        if (changed && disk_write_block(dir_inode.direct_blocks[i], entries) != 0) result = -1;
+        if (changed) path_cache_invalidate();
+    }
+    fs_put_block_buffer(entries);
+    return result;
+}
+
+/*
+ * Move um i-node para outro número (já alocado) e atualiza as entradas que apontam para ele:
+ * a do diretório pai e, num diretório, o próprio "." e o ".." de cada subdiretório.
+ * input:
+ * list - Todos os itens (os que tinham o item como pai são atualizados).
+ * item - O item a mover.
+ * new_num - O novo número.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro de leitura (as duas cópias ficam alocadas; o fsck
+ * recupera a que sobrar).
+ */
+static int move_inode(DefragList* list, DefragItem* item, unsigned int new_num) {
+    unsigned int old_num = item->inode_num;
+    Inode inode;
+    unsigned char inline_area[FS_INODE_INLINE_XATTR_SIZE];
+    fs_read_inode_inline(old_num, &inode, inline_area);
+    fs_write_inode_inline(new_num, &inode, inline_area);
+
+    int result = retarget_dir_entries(item->parent_num, old_num, new_num);
+    if (result == 0 && inode.mode == 1) {
+        result = retarget_dir_entries(new_num, old_num, new_num);
+        for (unsigned int i = 0; i < list->count && result == 0; i++) {
+            if (list->items[i].parent_num != old_num || list->items[i].inode_num == old_num) continue;
+            list->items[i].parent_num = new_num;
+            if (list->items[i].inode.mode == 1) result = retarget_dir_entries(list->items[i].inode_num, old_num, new_num);
+        }
+    }
+    if (result != 0) return -1;
+
+    fs_free_inode(old_num);
+    dir_hint_forget(old_num);
+    dir_hint_forget(item->parent_num);
+    ops_g->last_lookup.valid = 0;
+    item->inode_num = new_num;
+    return 0;
 }
@@ -1,5 +1,6 @@
 #include "filesystem_core.h"
 #include "gerenciador_de_disco.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,8 +8,83 @@
 
 extern int g_verbose_mode;
 
-static Superblock sb_g;
-static int is_mounted = 0;
+#define BLOCK_POOL_CAPACITY 16
+
+// Carimbos de tempo adiados (lazytime): uma mudança que só altera o mtime ou o atime de um
+// i-node fica nesta tabela em vez de reescrever a tabela de i-nodes. Quem lê o i-node já recebe
+// os valores pendentes e quem o grava os leva junto; o resto vai para o disco em lote, um
+// bloco da tabela por vez, em fs_flush_inode_times (fs_sync, desmontagem ou tabela cheia).
+// Os tempos só avançam: vale sempre o maior entre o pendente e o do i-node. Uma queda perde
+// no máximo os carimbos pendentes.
+#define LAZY_TIME_SLOTS 64
+
+typedef struct {
+    unsigned int inode_num;
+    time_t modification_time; // 0 = nenhuma alteração pendente.
+    time_t last_access_time;
+} LazyTime;
+
+// Estado do sistema de arquivos montado. Cada contexto (fs_context.h) tem o seu; as funções
+// deste módulo usam o estado selecionado na thread que as chama.
+struct CoreState {
+    Superblock sb;
+    int is_mounted;
+    int discard_online; // fs_free_blocks devolve ao hospedeiro o espaço dos blocos liberados.
+
+    // Buffers reaproveitados entre operações, para que uma operação em regime não chame malloc:
+    // uma pilha de buffers de um bloco livres (fs_get_block_buffer), a área do lote de bitmap
+    // (só um lote fica aberto por vez) e o vetor de pedidos de fs_read_inodes. As áreas só
+    // crescem e são devolvidas em fs_release_buffers.
+    void* block_pool[BLOCK_POOL_CAPACITY];
+    unsigned int block_pool_count;
+    unsigned int block_pool_block_size;
+    void* batch_storage;
+    size_t batch_storage_capacity;
+    void* request_storage;
+    size_t request_storage_capacity;
+
+    LazyTime lazy_times[LAZY_TIME_SLOTS];
+    unsigned int lazy_time_count;
+};
+
+static CoreState default_core;
+static __thread CoreState* core_g = &default_core;
+
+// Lote de alterações em um bitmap: cada bloco do bitmap é lido sob demanda uma única vez
+// e, ao fechar o lote, cada bloco alterado é escrito uma única vez.
+typedef struct {
+    unsigned int start_block;
+    unsigned int block_count;
+    unsigned char* data;
+    unsigned char* loaded;
+    unsigned char* dirty;
+    int error; // Algum bloco do bitmap não pôde ser lido (checksum inválido): nada é gravado.
+} BitmapBatch;
+
+// Par (número do i-node, posição no pedido), ordenado para ler a tabela de i-nodes em sequência.
+typedef struct {
+    unsigned int inode_num;
+    unsigned int position;
+} InodeRequest;
+
+// --- Protótipos de Funções Auxiliares (Estáticas) ---
+static void bitmap_batch_open(BitmapBatch* batch, unsigned int start_block, unsigned int total_bits);
+static unsigned char* bitmap_batch_byte(BitmapBatch* batch, unsigned int bit);
+static int bitmap_batch_test(BitmapBatch* batch, unsigned int bit);
+static void bitmap_batch_set(BitmapBatch* batch, unsigned int bit, int value);
+static int bitmap_batch_close(BitmapBatch* batch, int commit);
+static int compare_inode_requests(const void* a, const void* b);
+static unsigned int inode_slot_size(void);
+static unsigned int inline_xattr_capacity(void);
+static void decode_inode_slot(const unsigned char* slot, Inode* inode);
+static void encode_inode_slot(unsigned char* slot, const Inode* inode);
+static int lazy_time_find(unsigned int inode_num);
+static int lazy_time_apply(const LazyTime* pending, Inode* inode);
+static void lazy_time_merge(unsigned int inode_num, Inode* inode);
+static void lazy_time_take(unsigned int inode_num, Inode* inode);
+static int compare_lazy_times(const void* a, const void* b);
+static void* reserve_storage(void** storage, size_t* capacity, size_t needed);
+static void release_state_buffers(CoreState* state);
 
 /*
  * Retorna uma cópia do superbloco atualmente carregado em memória.
@@ -16,7 +92,79 @@ static int is_mounted = 0;
  * output: A struct Superblock com os dados do sistema de arquivos.
  */
 Superblock fs_get_superblock_info() {
-    return sb_g;
+    return core_g->sb;
+}
+
+/*
+ * Empresta um buffer do tamanho de um bloco (conteúdo indefinido). Os buffers devolvidos com
+ * fs_put_block_buffer são reutilizados, então só as primeiras operações chamam malloc.
+ * input: nenhum.
+ * output: Ponteiro para o buffer.
+ */
+void* fs_get_block_buffer() {
+    if (core_g->block_pool_block_size != core_g->sb.block_size) {
+        // O tamanho do bloco mudou (outra imagem foi formatada ou montada): descarta a pilha.
+        while (core_g->block_pool_count > 0) free(core_g->block_pool[--core_g->block_pool_count]);
+        core_g->block_pool_block_size = core_g->sb.block_size;
+    }
+    if (core_g->block_pool_count > 0) return core_g->block_pool[--core_g->block_pool_count];
+    return malloc(core_g->sb.block_size);
+}
+
+/*
+ * Devolve um buffer obtido com fs_get_block_buffer.
+ * input:
+ * buffer - O buffer (NULL é ignorado).
+ * output: nenhum.
+ */
+void fs_put_block_buffer(void* buffer) {
+    if (!buffer) return;
+    if (core_g->block_pool_count < BLOCK_POOL_CAPACITY && core_g->block_pool_block_size == core_g->sb.block_size) {
+        core_g->block_pool[core_g->block_pool_count++] = buffer;
+    } else {
+        free(buffer);
+    }
+}
+
+/*
+ * Libera toda a memória reaproveitada entre operações (ao desmontar).
+ * input: nenhum.
+ * output: nenhum.
+ */
+void fs_release_buffers() {
+    release_state_buffers(core_g);
+}
+
+/*
+ * Cria o estado de um novo sistema de arquivos, ainda não montado.
+ * input: nenhum.
+ * output: O estado, ou NULL se faltar memória.
+ */
+CoreState* core_state_create() {
+    return (CoreState*) calloc(1, sizeof(CoreState));
+}
+
+/*
+ * Libera o estado de um sistema de arquivos e os buffers que ele reaproveitava.
+ * input:
+ * state - O estado (NULL e o estado padrão são ignorados).
+ * output: nenhum.
+ */
+void core_state_destroy(CoreState* state) {
+    if (!state || state == &default_core) return;
+    if (core_g == state) core_g = &default_core;
+    release_state_buffers(state);
+    free(state);
+}
+
+/*
+ * Seleciona o estado usado pelas próximas chamadas deste módulo na thread atual.
+ * input:
+ * state - O estado, ou NULL para o estado padrão.
+ * output: nenhum.
+ */
+void core_state_select(CoreState* state) {
+    core_g = state ? state : &default_core;
 }
 
 /*
@@ -24,22 +172,29 @@ Superblock fs_get_superblock_info() {
  * input:
  * inode_num - O número do i-node a ser escrito.
  * inode_data - Um ponteiro para a struct Inode contendo os dados.
- * output: nenhum.
+ * output: 0 em caso de sucesso, -1 se o bloco da tabela não puder ser lido (nada é gravado).
  */
-void fs_write_inode(unsigned int inode_num, const Inode* inode_data) {
-    if (!is_mounted) return;
+int fs_write_inode(unsigned int inode_num, const Inode* inode_data) {
+    if (!core_g->is_mounted) return -1;
     if (g_verbose_mode) printf("   [Verbose] Escrevendo i-node %u no disco...\n", inode_num);
 
-    unsigned int inodes_per_block = sb_g.block_size / sizeof(Inode);
+    unsigned int slot_size = inode_slot_size();
+    unsigned int inodes_per_block = core_g->sb.block_size / slot_size;
     unsigned int block_offset = inode_num / inodes_per_block;
-    unsigned int target_block = sb_g.inode_table_start_block + block_offset;
+    unsigned int target_block = core_g->sb.inode_table_start_block + block_offset;
     unsigned int index_in_block = inode_num % inodes_per_block;
+    Inode merged = *inode_data;
+    lazy_time_take(inode_num, &merged);
     
-    Inode* block_buffer = (Inode*) malloc(sb_g.block_size);
-    disk_read_block(target_block, block_buffer);
-    block_buffer[index_in_block] = *inode_data;
-    disk_write_block(target_block, block_buffer);
-    free(block_buffer);
+    // Um bloco que não pôde ser lido não é regravado: o checksum novo esconderia a corrupção.
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
+    int result = disk_read_block(target_block, block_buffer);
+    if (result == 0) {
+        encode_inode_slot(block_buffer + (size_t) index_in_block * slot_size, &merged);
+        result = disk_write_block(target_block, block_buffer);
+    }
+    fs_put_block_buffer(block_buffer);
+    return result;
 }
 
 /*
@@ -50,18 +205,281 @@ void fs_write_inode(unsigned int inode_num, const Inode* inode_data) {
  * output: nenhum.
  */
 void fs_read_inode(unsigned int inode_num, Inode* inode_buffer) {
-    if (!is_mounted) return;
+    if (!core_g->is_mounted) return;
     if (g_verbose_mode) printf("   [Verbose] Lendo i-node %u do disco...\n", inode_num);
     
-    unsigned int inodes_per_block = sb_g.block_size / sizeof(Inode);
+    unsigned int slot_size = inode_slot_size();
+    unsigned int inodes_per_block = core_g->sb.block_size / slot_size;
     unsigned int block_offset = inode_num / inodes_per_block;
-    unsigned int target_block = sb_g.inode_table_start_block + block_offset;
+    unsigned int target_block = core_g->sb.inode_table_start_block + block_offset;
     unsigned int index_in_block = inode_num % inodes_per_block;
     
-    Inode* block_buffer = (Inode*) malloc(sb_g.block_size);
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
+    disk_read_block(target_block, block_buffer);
+    decode_inode_slot(block_buffer + (size_t) index_in_block * slot_size, inode_buffer);
+    fs_put_block_buffer(block_buffer);
+    lazy_time_merge(inode_num, inode_buffer);
+}
+
+/*
+ * Lê só o cabeçalho de um i-node (tipo, flags, links e tamanho). Serve a quem só precisa
+ * saber se o caminho é um diretório ou qual o tamanho do arquivo: no formato atual esses
+ * campos ficam nos primeiros 16 bytes do i-node e o resto não é decodificado.
+ * input:
+ * inode_num - O número do i-node.
+ * header - Recebe o cabeçalho.
+ * output: nenhum.
+ */
+void fs_read_inode_header(unsigned int inode_num, InodeHeader* header) {
+    if (!core_g->is_mounted) return;
+
+    unsigned int slot_size = inode_slot_size();
+    unsigned int inodes_per_block = core_g->sb.block_size / slot_size;
+    unsigned int target_block = core_g->sb.inode_table_start_block + inode_num / inodes_per_block;
+
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
+    disk_read_block(target_block, block_buffer);
+    const unsigned char* slot = block_buffer + (size_t) (inode_num % inodes_per_block) * slot_size;
+    if (core_g->sb.inode_version == FS_INODE_VERSION_LEGACY) {
+        Inode inode;
+        memcpy(&inode, slot, sizeof(Inode));
+        header->mode = inode.mode;
+        header->flags = inode.flags;
+        header->link_count = inode.link_count;
+        header->size_in_bytes = inode.size_in_bytes;
+    } else {
+        const DiskInode* disk = (const DiskInode*) slot;
+        header->mode = disk->mode;
+        header->flags = disk->flags;
+        header->link_count = disk->link_count;
+        header->size_in_bytes = disk->size_in_bytes;
+    }
+    fs_put_block_buffer(block_buffer);
+}
+
+/*
+ * Converte um i-node do formato do disco (versão 1) para a struct usada em memória.
+ * input:
+ * disk - O i-node como gravado no disco.
+ * inode - Recebe o i-node convertido.
+ * output: nenhum.
+ */
+void fs_inode_from_disk(const DiskInode* disk, Inode* inode) {
+    memset(inode, 0, sizeof(Inode));
+    inode->mode = disk->mode;
+    inode->flags = disk->flags;
+    inode->link_count = disk->link_count;
+    inode->size_in_bytes = disk->size_in_bytes;
+    inode->creation_time = (time_t) disk->creation_time;
+    inode->modification_time = (time_t) disk->modification_time;
+    inode->last_access_time = (time_t) disk->last_access_time;
+    for (int i = 0; i < 12; i++) inode->direct_blocks[i] = disk->direct_blocks[i];
+    inode->single_indirect_block = disk->single_indirect_block;
+    inode->double_indirect_block = disk->double_indirect_block;
+    inode->xattr_block = disk->xattr_block;
+    for (int i = 0; i < MAX_COMPRESSED_EXTENTS; i++) inode->compressed_extent_size[i] = disk->compressed_extent_size[i];
+}
+
+/*
+ * Converte um i-node em memória para o formato do disco (versão 1).
+ * input:
+ * inode - O i-node em memória.
+ * disk - Recebe o i-node no formato do disco (bytes reservados zerados).
+ * output: nenhum.
+ */
+void fs_inode_to_disk(const Inode* inode, DiskInode* disk) {
+    memset(disk, 0, sizeof(DiskInode));
+    disk->mode = (uint16_t) inode->mode;
+    disk->flags = (uint16_t) inode->flags;
+    disk->link_count = inode->link_count;
+    disk->size_in_bytes = inode->size_in_bytes;
+    disk->creation_time = (int64_t) inode->creation_time;
+    disk->modification_time = (int64_t) inode->modification_time;
+    disk->last_access_time = (int64_t) inode->last_access_time;
+    for (int i = 0; i < 12; i++) disk->direct_blocks[i] = inode->direct_blocks[i];
+    disk->single_indirect_block = inode->single_indirect_block;
+    disk->double_indirect_block = inode->double_indirect_block;
+    disk->xattr_block = inode->xattr_block;
+    for (int i = 0; i < MAX_COMPRESSED_EXTENTS; i++) disk->compressed_extent_size[i] = inode->compressed_extent_size[i];
+}
+
+/*
+ * Lê um i-node junto com a área de atributos estendidos do seu slot (ou o alvo de um link
+ * simbólico rápido), com uma única leitura.
+ * input:
+ * inode_num - O número do i-node.
+ * inode - Recebe o i-node.
+ * inline_area - Recebe a área (FS_INODE_INLINE_XATTR_SIZE bytes; zerada se não estiver em uso).
+ * output: O tamanho da área, ou 0 se o formato do disco não tiver área no slot.
+ */
+unsigned int fs_read_inode_inline(unsigned int inode_num, Inode* inode, unsigned char* inline_area) {
+    memset(inline_area, 0, FS_INODE_INLINE_XATTR_SIZE);
+    if (!core_g->is_mounted) return 0;
+
+    unsigned int slot_size = inode_slot_size();
+    unsigned int inodes_per_block = core_g->sb.block_size / slot_size;
+    unsigned int target_block = core_g->sb.inode_table_start_block + inode_num / inodes_per_block;
+
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
     disk_read_block(target_block, block_buffer);
-    *inode_buffer = block_buffer[index_in_block];
-    free(block_buffer);
+    const unsigned char* slot = block_buffer + (size_t) (inode_num % inodes_per_block) * slot_size;
+    decode_inode_slot(slot, inode);
+    unsigned int capacity = inline_xattr_capacity();
+    if (capacity > 0 && (inode->flags & (INODE_FLAG_INLINE_XATTR | INODE_FLAG_INLINE_DATA))) memcpy(inline_area, slot + FS_INODE_SLOT_SIZE, capacity);
+    fs_put_block_buffer(block_buffer);
+    lazy_time_merge(inode_num, inode);
+    return capacity;
+}
+
+/*
+ * Grava um i-node e a área de atributos estendidos do seu slot, com uma única escrita.
+ * Sem área no formato do disco, equivale a fs_write_inode.
+ * input:
+ * inode_num - O número do i-node.
+ * inode - O i-node (com INODE_FLAG_INLINE_XATTR indicando se a área está em uso).
+ * inline_area - A área (FS_INODE_INLINE_XATTR_SIZE bytes).
+ * output: 0 em caso de sucesso, -1 se o bloco da tabela não puder ser lido (nada é gravado).
+ */
+int fs_write_inode_inline(unsigned int inode_num, const Inode* inode, const unsigned char* inline_area) {
+    unsigned int capacity = core_g->is_mounted ? inline_xattr_capacity() : 0;
+    if (capacity == 0) return fs_write_inode(inode_num, inode);
+
+    unsigned int slot_size = inode_slot_size();
+    unsigned int inodes_per_block = core_g->sb.block_size / slot_size;
+    unsigned int target_block = core_g->sb.inode_table_start_block + inode_num / inodes_per_block;
+    Inode merged = *inode;
+    lazy_time_take(inode_num, &merged);
+
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
+    int result = disk_read_block(target_block, block_buffer);
+    if (result == 0) {
+        unsigned char* slot = block_buffer + (size_t) (inode_num % inodes_per_block) * slot_size;
+        encode_inode_slot(slot, &merged);
+        memcpy(slot + FS_INODE_SLOT_SIZE, inline_area, capacity);
+        result = disk_write_block(target_block, block_buffer);
+    }
+    fs_put_block_buffer(block_buffer);
+    return result;
+}
+
+/*
+ * Lê vários i-nodes de uma vez. Os blocos da tabela de i-nodes envolvidos são pedidos
+ * antecipadamente ao sistema operacional e cada um é lido uma única vez.
+ * input:
+ * inode_nums - Os números dos i-nodes a serem lidos.
+ * count - Quantidade de i-nodes.
+ * inodes - Vetor que recebe os i-nodes, na mesma ordem de 'inode_nums'.
+ * output: nenhum.
+ */
+void fs_read_inodes(const unsigned int* inode_nums, unsigned int count, Inode* inodes) {
+    if (!core_g->is_mounted || count == 0) return;
+
+    unsigned int slot_size = inode_slot_size();
+    unsigned int inodes_per_block = core_g->sb.block_size / slot_size;
+    InodeRequest* requests = (InodeRequest*) reserve_storage(&core_g->request_storage, &core_g->request_storage_capacity,
+                                                             count * sizeof(InodeRequest));
+    for (unsigned int i = 0; i < count; i++) {
+        requests[i].inode_num = inode_nums[i];
+        requests[i].position = i;
+    }
+    qsort(requests, count, sizeof(InodeRequest), compare_inode_requests);
+
+    unsigned int first_block = requests[0].inode_num / inodes_per_block;
+    unsigned int last_block = requests[count - 1].inode_num / inodes_per_block;
+    disk_prefetch_blocks(core_g->sb.inode_table_start_block + first_block, last_block - first_block + 1);
+
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
+    int loaded = 0;
+    unsigned int loaded_block = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int block_offset = requests[i].inode_num / inodes_per_block;
+        if (!loaded || block_offset != loaded_block) {
+            if (g_verbose_mode) printf("   [Verbose] Lendo bloco %u da tabela de i-nodes...\n", block_offset);
+            disk_read_block(core_g->sb.inode_table_start_block + block_offset, block_buffer);
+            loaded = 1;
+            loaded_block = block_offset;
+        }
+        decode_inode_slot(block_buffer + (size_t) (requests[i].inode_num % inodes_per_block) * slot_size,
+                          &inodes[requests[i].position]);
+        lazy_time_merge(requests[i].inode_num, &inodes[requests[i].position]);
+    }
+
+    fs_put_block_buffer(block_buffer);
+}
+
+/*
+ * Registra novos carimbos de tempo de um i-node sem gravá-lo (veja LazyTime). Se a tabela de
+ * pendências estiver cheia, ela é gravada antes.
+ * input:
+ * inode_num - O número do i-node.
+ * modification_time - O novo mtime (0 = mantém).
+ * last_access_time - O novo atime (0 = mantém).
+ * output: nenhum.
+ */
+void fs_touch_inode(unsigned int inode_num, time_t modification_time, time_t last_access_time) {
+    if (!core_g->is_mounted || inode_num >= core_g->sb.total_inodes) return;
+
+    int index = lazy_time_find(inode_num);
+    if (index < 0) {
+        if (core_g->lazy_time_count == LAZY_TIME_SLOTS) fs_flush_inode_times();
+        index = (int) core_g->lazy_time_count++;
+        core_g->lazy_times[index].inode_num = inode_num;
+        core_g->lazy_times[index].modification_time = 0;
+        core_g->lazy_times[index].last_access_time = 0;
+    }
+    LazyTime* pending = &core_g->lazy_times[index];
+    if (modification_time > pending->modification_time) pending->modification_time = modification_time;
+    if (last_access_time > pending->last_access_time) pending->last_access_time = last_access_time;
+}
+
+/*
+ * Grava todos os carimbos de tempo pendentes. As pendências são ordenadas por i-node e cada
+ * bloco da tabela de i-nodes envolvido é lido e escrito uma única vez (e só se algo mudou).
+ * input: nenhum.
+ * output: 0 em caso de sucesso, -1 se algum bloco não pôde ser lido ou gravado.
+ */
+int fs_flush_inode_times() {
+    unsigned int count = core_g->lazy_time_count;
+    if (!core_g->is_mounted || count == 0) return 0;
+
+    LazyTime* pending = core_g->lazy_times;
+    qsort(pending, count, sizeof(LazyTime), compare_lazy_times);
+    unsigned int slot_size = inode_slot_size();
+    unsigned int inodes_per_block = core_g->sb.block_size / slot_size;
+
+    int result = 0;
+    unsigned int blocks_written = 0;
+    unsigned char* block_buffer = (unsigned char*) fs_get_block_buffer();
+    unsigned int i = 0;
+    while (i < count) {
+        unsigned int block_offset = pending[i].inode_num / inodes_per_block;
+        unsigned int target_block = core_g->sb.inode_table_start_block + block_offset;
+        unsigned int end = i;
+        while (end < count && pending[end].inode_num / inodes_per_block == block_offset) end++;
+        if (disk_read_block(target_block, block_buffer) != 0) {
+            result = -1;
+            i = end;
+            continue;
+        }
+
+        int changed = 0;
+        for (; i < end; i++) {
+            unsigned char* slot = block_buffer + (size_t) (pending[i].inode_num % inodes_per_block) * slot_size;
+            Inode inode;
+            decode_inode_slot(slot, &inode);
+            if (!lazy_time_apply(&pending[i], &inode)) continue;
+            encode_inode_slot(slot, &inode);
+            changed = 1;
+        }
+        if (!changed) continue;
+        if (disk_write_block(target_block, block_buffer) != 0) result = -1;
+        blocks_written++;
+    }
+    fs_put_block_buffer(block_buffer);
+
+    if (g_verbose_mode) printf("   [Verbose] Carimbos de tempo de %u i-node(s) gravados em %u bloco(s) da tabela.\n", count, blocks_written);
+    core_g->lazy_time_count = 0;
+    return result;
 }
 
 /*
@@ -70,13 +488,14 @@ void fs_read_inode(unsigned int inode_num, Inode* inode_buffer) {
  * output: 0 em caso de sucesso, -1 em caso de erro.
  */
 int fs_mount() {
-    if(is_mounted) return 0;
+    if(core_g->is_mounted) return 0;
     
     if (disk_mount() != 0) {
         return -1;
     }
 
-    unsigned int temp_block_size = 4096;
+    // O tamanho do bloco ainda é desconhecido: lê só o superbloco, no início do bloco 0.
+    unsigned int temp_block_size = sizeof(Superblock);
     char* temp_buffer = (char*) malloc(temp_block_size);
     
     disk_set_block_size(temp_block_size);
@@ -87,17 +506,38 @@ int fs_mount() {
         return -1;
     }
 
-    memcpy(&sb_g, temp_buffer, sizeof(Superblock));
+    memcpy(&core_g->sb, temp_buffer, sizeof(Superblock));
     free(temp_buffer);
 
-    if (sb_g.magic_number != MAGIC_NUMBER) {
+    if (core_g->sb.magic_number != MAGIC_NUMBER) {
         fprintf(stderr, "Erro: Magic number invalido! O disco pode nao estar formatado ou esta corrompido.\n");
         disk_unmount();
         return -1;
     }
+    if (core_g->sb.block_size < FS_MIN_BLOCK_SIZE || core_g->sb.block_size > FS_MAX_BLOCK_SIZE) {
+        fprintf(stderr, "Erro: Tamanho de bloco invalido no superbloco (%u bytes).\n", core_g->sb.block_size);
+        disk_unmount();
+        return -1;
+    }
+    // Imagens anteriores ao campo têm zeros aqui: i-nodes gravados como a struct Inode crua.
+    if (core_g->sb.inode_version > FS_INODE_VERSION ||
+        (core_g->sb.inode_version != FS_INODE_VERSION_LEGACY && core_g->sb.inode_size != FS_INODE_SLOT_SIZE &&
+         core_g->sb.inode_size != FS_INODE_SLOT_SIZE + FS_INODE_INLINE_XATTR_SIZE)) {
+        fprintf(stderr, "Erro: Formato de i-node nao suportado (versao %u, %u bytes).\n", core_g->sb.inode_version, core_g->sb.inode_size);
+        disk_unmount();
+        return -1;
+    }
     
-    disk_set_block_size(sb_g.block_size);
-    is_mounted = 1;
+    disk_set_block_size(core_g->sb.block_size);
+    if (core_g->sb.checksum_blocks > 0 &&
+        disk_enable_checksums(core_g->sb.checksum_start_block, core_g->sb.checksum_blocks, core_g->sb.total_blocks,
+                              offsetof(Superblock, checksums_pending)) != 0) {
+        fprintf(stderr, "Erro: Falha ao carregar a area de checksums.\n");
+        disk_unmount();
+        return -1;
+    }
+    core_g->lazy_time_count = 0;
+    core_g->is_mounted = 1;
     printf("Sistema de arquivos montado com sucesso.\n");
     return 0;
 }
@@ -106,39 +546,78 @@ int fs_mount() {
  * Formata o disco, inicializando o superbloco, bitmaps, tabela de i-nodes e diretório raiz.
  * input:
  * disk_size - O tamanho total do disco em bytes.
- * block_size - O tamanho de cada bloco em bytes.
- * output: nenhum.
+ * block_size - O tamanho de cada bloco em bytes (potência de 2 entre FS_MIN_BLOCK_SIZE e FS_MAX_BLOCK_SIZE).
+ * bytes_per_inode - Quantos bytes do disco para cada i-node (define o total de i-nodes).
+ * output: 0 em caso de sucesso, -1 se a geometria for inválida ou o disco não puder ser criado.
  */
-void fs_format(unsigned int disk_size, unsigned int block_size) {
+int fs_format(unsigned int disk_size, unsigned int block_size, unsigned int bytes_per_inode) {
+    if (block_size < FS_MIN_BLOCK_SIZE || block_size > FS_MAX_BLOCK_SIZE || (block_size & (block_size - 1)) != 0) {
+        fprintf(stderr, "Erro: Tamanho de bloco %u invalido (use uma potencia de 2 entre %d e %d).\n",
+                block_size, FS_MIN_BLOCK_SIZE, FS_MAX_BLOCK_SIZE);
+        return -1;
+    }
+    if (bytes_per_inode == 0 || disk_size / bytes_per_inode == 0) {
+        fprintf(stderr, "Erro: Proporcao de %u bytes por i-node invalida para um disco de %u bytes.\n", bytes_per_inode, disk_size);
+        return -1;
+    }
+
+    unsigned int total_blocks = disk_size / block_size;
+    unsigned int total_inodes = disk_size / bytes_per_inode;
+    unsigned int inode_bitmap_blocks = ((total_inodes + 7) / 8 + block_size - 1) / block_size;
+    unsigned int block_bitmap_blocks = ((total_blocks + 7) / 8 + block_size - 1) / block_size;
+    unsigned int inode_size = FS_INODE_SLOT_SIZE + FS_INODE_INLINE_XATTR_SIZE;
+    unsigned int inode_table_blocks = ((unsigned long long) total_inodes * inode_size + block_size - 1) / block_size;
+    unsigned int checksum_blocks = ((unsigned long long) total_blocks * sizeof(unsigned int) + block_size - 1) / block_size;
+    unsigned int metadata_blocks = 1 + inode_bitmap_blocks + block_bitmap_blocks + inode_table_blocks + checksum_blocks;
+    if (metadata_blocks >= total_blocks) {
+        fprintf(stderr, "Erro: Disco pequeno demais: os metadados ocupariam %u de %u blocos.\n", metadata_blocks, total_blocks);
+        return -1;
+    }
+
     printf("Iniciando a formatação lógica do sistema de arquivos...\n");
 
-    disk_format(disk_size, block_size);
+    if (disk_format(disk_size, block_size) != 0) return -1;
     
-    if(fs_mount() != 0) {
+    // O superbloco ainda não existe, então o disco é montado diretamente (sem fs_mount).
+    if(disk_mount() != 0) {
          fprintf(stderr, "Erro crítico: não foi possível montar o disco para formatação.\n");
-         return;
+         return -1;
     }
+    disk_set_block_size(block_size);
+    core_g->is_mounted = 1;
+    core_g->lazy_time_count = 0;
 
-    unsigned int total_blocks = disk_size / block_size;
-    unsigned int total_inodes = total_blocks / 4; 
-    unsigned int inode_bitmap_blocks = (total_inodes / 8 + block_size - 1) / block_size;
-    unsigned int block_bitmap_blocks = (total_blocks / 8 + block_size - 1) / block_size;
-    unsigned int inode_table_blocks = (total_inodes * sizeof(Inode) + block_size - 1) / block_size;
-
-    sb_g.magic_number = MAGIC_NUMBER;
-    sb_g.total_blocks = total_blocks;
-    sb_g.total_inodes = total_inodes;
-    sb_g.block_size = block_size;
-    sb_g.inode_bitmap_start_block = 1;
-    sb_g.block_bitmap_start_block = sb_g.inode_bitmap_start_block + inode_bitmap_blocks;
-    sb_g.inode_table_start_block = sb_g.block_bitmap_start_block + block_bitmap_blocks;
-    sb_g.data_blocks_start_block = sb_g.inode_table_start_block + inode_table_blocks;
+    core_g->sb.magic_number = MAGIC_NUMBER;
+    core_g->sb.total_blocks = total_blocks;
+    core_g->sb.total_inodes = total_inodes;
+    core_g->sb.block_size = block_size;
+    core_g->sb.inode_bitmap_start_block = 1;
+    core_g->sb.block_bitmap_start_block = core_g->sb.inode_bitmap_start_block + inode_bitmap_blocks;
+    core_g->sb.inode_table_start_block = core_g->sb.block_bitmap_start_block + block_bitmap_blocks;
+    core_g->sb.checksum_start_block = core_g->sb.inode_table_start_block + inode_table_blocks;
+    core_g->sb.checksum_blocks = checksum_blocks;
+    core_g->sb.data_blocks_start_block = core_g->sb.checksum_start_block + checksum_blocks;
+    core_g->sb.inode_version = FS_INODE_VERSION;
+    core_g->sb.inode_size = inode_size;
+    core_g->sb.checksums_pending = 0;
     
-    disk_write_block(0, &sb_g);
+    char* zero_buffer = (char*) calloc(block_size, 1);
+    memcpy(zero_buffer, &core_g->sb, sizeof(Superblock));
+    disk_write_block(0, zero_buffer);
+    memset(zero_buffer, 0, sizeof(Superblock));
     if (g_verbose_mode) printf("   [Verbose] Superbloco gravado no disco.\n");
 
-    char* zero_buffer = (char*) calloc(block_size, 1);
-    for (unsigned int i = 1; i < sb_g.data_blocks_start_block; i++) {
+    // A partir daqui toda escrita de metadados e dados registra o checksum do bloco.
+    if (disk_enable_checksums(core_g->sb.checksum_start_block, core_g->sb.checksum_blocks, core_g->sb.total_blocks,
+                              offsetof(Superblock, checksums_pending)) != 0) {
+        fprintf(stderr, "Erro: Falha ao ativar a area de checksums.\n");
+        free(zero_buffer);
+        core_g->is_mounted = 0;
+        disk_unmount();
+        return -1;
+    }
+
+    for (unsigned int i = 1; i < core_g->sb.data_blocks_start_block; i++) {
         disk_write_block(i, zero_buffer);
     }
     free(zero_buffer);
@@ -150,12 +629,14 @@ void fs_format(unsigned int disk_size, unsigned int block_size) {
     int root_data_block_num = fs_alloc_block();
     
     Inode root_inode;
+    memset(&root_inode, 0, sizeof(Inode));
     root_inode.mode = 1; 
     root_inode.link_count = 2;
     root_inode.size_in_bytes = block_size;
-    root_inode.creation_time = time(NULL);
-    root_inode.modification_time = time(NULL);
-    root_inode.last_access_time = time(NULL);
+    time_t now = time(NULL);
+    root_inode.creation_time = now;
+    root_inode.modification_time = now;
+    root_inode.last_access_time = now;
     root_inode.direct_blocks[0] = root_data_block_num;
     for(int i = 1; i < 12; i++) root_inode.direct_blocks[i] = 0;
     root_inode.single_indirect_block = 0;
@@ -174,7 +655,8 @@ void fs_format(unsigned int disk_size, unsigned int block_size) {
     printf("Diretorio raiz criado com sucesso no i-node %d e bloco de dados %u.\n", root_inode_num, root_data_block_num);
     
     disk_unmount(); 
-    is_mounted = 0;
+    core_g->is_mounted = 0;
+    return 0;
 }
 
 /*
@@ -183,35 +665,40 @@ void fs_format(unsigned int disk_size, unsigned int block_size) {
  * output: O número do i-node alocado, ou -1 em caso de falha.
  */
 int fs_alloc_inode() {
-    if (!is_mounted) return -1;
-    if (g_verbose_mode) printf("   [Verbose] Procurando i-node livre no bitmap...\n");
-
-    unsigned char* bitmap_buffer = (unsigned char*) malloc(sb_g.block_size);
-    unsigned int inodes_per_block = sb_g.block_size * 8;
-    unsigned int total_bitmap_blocks = (sb_g.total_inodes + inodes_per_block -1) / inodes_per_block;
-
-    for (unsigned int block_idx = 0; block_idx < total_bitmap_blocks; block_idx++) {
-        unsigned int current_block = sb_g.inode_bitmap_start_block + block_idx;
-        disk_read_block(current_block, bitmap_buffer);
-
-        for (unsigned int byte_idx = 0; byte_idx < sb_g.block_size; byte_idx++) {
-            if (bitmap_buffer[byte_idx] != 0xFF) {
-                for (int bit_idx = 0; bit_idx < 8; bit_idx++) {
-                    if (!(bitmap_buffer[byte_idx] & (1 << (7 - bit_idx)))) {
-                        bitmap_buffer[byte_idx] |= (1 << (7 - bit_idx));
-                        disk_write_block(current_block, bitmap_buffer);
-                        int inode_num = (block_idx * inodes_per_block) + (byte_idx * 8) + bit_idx;
-                        free(bitmap_buffer);
-                        if (g_verbose_mode) printf("   [Verbose] I-node %d alocado.\n", inode_num);
-                        return inode_num;
-                    }
-                }
-            }
-        }
+    unsigned int inode_num;
+    if (fs_alloc_inodes(1, &inode_num) != 0) return -1;
+    return inode_num;
+}
+
+/*
+ * Aloca 'count' i-nodes (os primeiros livres).
+ * Cada bloco de bitmap envolvido é lido e escrito uma única vez.
+ * input:
+ * count - Quantidade de i-nodes a alocar.
+ * inode_nums - Vetor que recebe os números dos i-nodes alocados, em ordem crescente.
+ * output: 0 em caso de sucesso, -1 se não houver i-nodes livres suficientes (nada é alocado).
+ */
+int fs_alloc_inodes(unsigned int count, unsigned int* inode_nums) {
+    if (!core_g->is_mounted) return -1;
+    if (count == 0) return 0;
+    if (g_verbose_mode) printf("   [Verbose] Procurando %u i-node(s) livre(s) no bitmap...\n", count);
+
+    BitmapBatch batch;
+    bitmap_batch_open(&batch, core_g->sb.inode_bitmap_start_block, core_g->sb.total_inodes);
+
+    unsigned int found = 0;
+    for (unsigned int inode_num = 0; inode_num < core_g->sb.total_inodes && found < count; inode_num++) {
+        if (!bitmap_batch_test(&batch, inode_num)) inode_nums[found++] = inode_num;
+    }
+    if (found < count) {
+        bitmap_batch_close(&batch, 0);
+        return -1;
     }
 
-    free(bitmap_buffer);
-    return -1;
+    for (unsigned int i = 0; i < count; i++) bitmap_batch_set(&batch, inode_nums[i], 1);
+    if (bitmap_batch_close(&batch, 1) != 0) return -1;
+    if (g_verbose_mode) printf("   [Verbose] %u i-node(s) alocado(s) a partir do i-node %u.\n", count, inode_nums[0]);
+    return 0;
 }
 
 /*
@@ -220,32 +707,87 @@ int fs_alloc_inode() {
  * output: O número do bloco alocado, ou -1 em caso de falha.
  */
 int fs_alloc_block() {
-    if (!is_mounted) return -1;
-    if (g_verbose_mode) printf("   [Verbose] Procurando bloco de dados livre no bitmap...\n");
+    unsigned int block_num;
+    if (fs_alloc_blocks(1, &block_num) != 0) return -1;
+    return block_num;
+}
 
-    unsigned char* bitmap_buffer = (unsigned char*) malloc(sb_g.block_size);
-    unsigned int bits_per_block = sb_g.block_size * 8;
-    
-    for (unsigned int block_num = sb_g.data_blocks_start_block; block_num < sb_g.total_blocks; block_num++) {
-        unsigned int block_idx_in_bitmap = block_num / bits_per_block;
-        unsigned int byte_idx_in_bitmap = (block_num % bits_per_block) / 8;
-        unsigned int bit_idx_in_byte = block_num % 8;
-
-        unsigned int current_bitmap_block = sb_g.block_bitmap_start_block + block_idx_in_bitmap;
-        
-        disk_read_block(current_bitmap_block, bitmap_buffer);
-        
-        if (!(bitmap_buffer[byte_idx_in_bitmap] & (1 << (7 - bit_idx_in_byte)))) {
-            bitmap_buffer[byte_idx_in_bitmap] |= (1 << (7 - bit_idx_in_byte));
-            disk_write_block(current_bitmap_block, bitmap_buffer);
-            free(bitmap_buffer);
-            if (g_verbose_mode) printf("   [Verbose] Bloco de dados %d alocado.\n", block_num);
-            return block_num;
+/*
+ * Aloca 'count' blocos de dados (os primeiros livres, não necessariamente contíguos).
+ * Cada bloco de bitmap envolvido é lido e escrito uma única vez.
+ * input:
+ * count - Quantidade de blocos a alocar.
+ * blocks - Vetor que recebe os números dos blocos alocados, em ordem crescente.
+ * output: 0 em caso de sucesso, -1 se não houver blocos livres suficientes (nada é alocado).
+ */
+int fs_alloc_blocks(unsigned int count, unsigned int* blocks) {
+    if (!core_g->is_mounted) return -1;
+    if (count == 0) return 0;
+    if (g_verbose_mode) printf("   [Verbose] Procurando %u bloco(s) de dados livre(s) no bitmap...\n", count);
+
+    BitmapBatch batch;
+    bitmap_batch_open(&batch, core_g->sb.block_bitmap_start_block, core_g->sb.total_blocks);
+
+    unsigned int found = 0;
+    for (unsigned int block_num = core_g->sb.data_blocks_start_block; block_num < core_g->sb.total_blocks && found < count; block_num++) {
+        if (!bitmap_batch_test(&batch, block_num)) blocks[found++] = block_num;
+    }
+    if (found < count) {
+        bitmap_batch_close(&batch, 0);
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < count; i++) bitmap_batch_set(&batch, blocks[i], 1);
+    if (bitmap_batch_close(&batch, 1) != 0) return -1;
+    if (g_verbose_mode) printf("   [Verbose] %u bloco(s) de dados alocado(s) a partir do bloco %u.\n", count, blocks[0]);
+    return 0;
+}
+
+/*
+ * Aloca 'count' blocos de dados de uma só vez, preferindo a primeira sequência contígua livre.
+ * Se não houver sequência contígua, usa os primeiros blocos livres encontrados.
+ * Cada bloco de bitmap envolvido é lido e escrito uma única vez.
+ * input:
+ * count - Quantidade de blocos a alocar.
+ * blocks - Vetor que recebe os números dos blocos alocados, em ordem crescente.
+ * output: 0 em caso de sucesso, -1 se não houver blocos livres suficientes (nada é alocado).
+ */
+int fs_alloc_extent(unsigned int count, unsigned int* blocks) {
+    if (!core_g->is_mounted) return -1;
+    if (count == 0) return 0;
+
+    BitmapBatch batch;
+    bitmap_batch_open(&batch, core_g->sb.block_bitmap_start_block, core_g->sb.total_blocks);
+
+    unsigned int run_start = 0, run_length = 0;
+    for (unsigned int block_num = core_g->sb.data_blocks_start_block; block_num < core_g->sb.total_blocks && run_length < count; block_num++) {
+        if (bitmap_batch_test(&batch, block_num)) {
+            run_length = 0;
+        } else {
+            if (run_length == 0) run_start = block_num;
+            run_length++;
         }
     }
 
-    free(bitmap_buffer);
-    return -1;
+    unsigned int found = 0;
+    if (run_length == count) {
+        for (unsigned int i = 0; i < count; i++) blocks[found++] = run_start + i;
+    } else {
+        // Disco fragmentado: aceita os primeiros blocos livres, mesmo espalhados.
+        for (unsigned int block_num = core_g->sb.data_blocks_start_block; block_num < core_g->sb.total_blocks && found < count; block_num++) {
+            if (!bitmap_batch_test(&batch, block_num)) blocks[found++] = block_num;
+        }
+    }
+    if (found < count) {
+        bitmap_batch_close(&batch, 0);
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < count; i++) bitmap_batch_set(&batch, blocks[i], 1);
+    if (bitmap_batch_close(&batch, 1) != 0) return -1;
+    if (g_verbose_mode) printf("   [Verbose] %u blocos de dados alocados a partir do bloco %u%s.\n",
+                               count, blocks[0], run_length == count ? " (contiguos)" : "");
+    return 0;
 }
 
 /*
@@ -255,23 +797,51 @@ int fs_alloc_block() {
  * output: nenhum.
  */
 void fs_free_inode(int inode_num) {
-    if (!is_mounted || inode_num < 0 || (unsigned int)inode_num >= sb_g.total_inodes) return;
-    if (g_verbose_mode) printf("   [Verbose] Liberando i-node %d no bitmap...\n", inode_num);
-
-    unsigned char* bitmap_buffer = (unsigned char*) malloc(sb_g.block_size);
-    unsigned int bits_per_block = sb_g.block_size * 8;
-    
-    unsigned int block_idx_in_bitmap = inode_num / bits_per_block;
-    unsigned int byte_idx_in_bitmap = (inode_num % bits_per_block) / 8;
-    unsigned int bit_idx_in_byte = inode_num % 8;
+    if (inode_num < 0) return;
+    unsigned int inode = (unsigned int) inode_num;
+    fs_free_inodes(&inode, 1);
+}
 
-    unsigned int target_bitmap_block = sb_g.inode_bitmap_start_block + block_idx_in_bitmap;
+/*
+ * Libera vários i-nodes de uma vez.
+ * Cada bloco de bitmap envolvido é lido e escrito uma única vez.
+ * input:
+ * inode_nums - Os números dos i-nodes a liberar (entradas fora da tabela são ignoradas).
+ * count - Quantidade de entradas em 'inode_nums'.
+ * output: nenhum.
+ */
+void fs_free_inodes(const unsigned int* inode_nums, unsigned int count) {
+    if (!core_g->is_mounted || count == 0) return;
 
-    disk_read_block(target_bitmap_block, bitmap_buffer);
-    bitmap_buffer[byte_idx_in_bitmap] &= ~(1 << (7 - bit_idx_in_byte));
-    disk_write_block(target_bitmap_block, bitmap_buffer);
+    BitmapBatch batch;
+    bitmap_batch_open(&batch, core_g->sb.inode_bitmap_start_block, core_g->sb.total_inodes);
+    for (unsigned int i = 0; i < count; i++) {
+        if (inode_nums[i] >= core_g->sb.total_inodes) continue;
+        if (g_verbose_mode) printf("   [Verbose] Liberando i-node %u no bitmap...\n", inode_nums[i]);
+        bitmap_batch_set(&batch, inode_nums[i], 0);
+        int pending = lazy_time_find(inode_nums[i]);
+        if (pending >= 0) core_g->lazy_times[pending] = core_g->lazy_times[--core_g->lazy_time_count];
+    }
+    bitmap_batch_close(&batch, 1);
+}
 
-    free(bitmap_buffer);
+/*
+ * Lista os i-nodes em uso em um intervalo de números, lendo só os blocos do bitmap envolvidos.
+ * input:
+ * first - O primeiro i-node do intervalo.
+ * range - Quantos i-nodes examinar (o intervalo é cortado no fim da tabela).
+ * inode_nums - Vetor com espaço para 'range' números, que recebe os i-nodes em uso, em ordem.
+ * output: A quantidade de i-nodes em uso, ou -1 se o bitmap não puder ser lido.
+ */
+int fs_used_inodes(unsigned int first, unsigned int range, unsigned int* inode_nums) {
+    if (!core_g->is_mounted) return -1;
+    BitmapBatch batch;
+    bitmap_batch_open(&batch, core_g->sb.inode_bitmap_start_block, core_g->sb.total_inodes);
+    int count = 0;
+    for (unsigned int inode_num = first; inode_num < core_g->sb.total_inodes && inode_num - first < range; inode_num++) {
+        if (bitmap_batch_test(&batch, inode_num)) inode_nums[count++] = inode_num;
+    }
+    return bitmap_batch_close(&batch, 0) == 0 ? count : -1;
 }
 
 /*
@@ -281,22 +851,384 @@ void fs_free_inode(int inode_num) {
  * output: nenhum.
  */
 void fs_free_block(int block_num) {
-    if (!is_mounted || block_num < 0 || (unsigned int)block_num >= sb_g.total_blocks) return;
-    if (g_verbose_mode) printf("   [Verbose] Liberando bloco de dados %d no bitmap...\n", block_num);
+    if (block_num < 0) return;
+    unsigned int block = (unsigned int) block_num;
+    fs_free_blocks(&block, 1);
+}
 
-    unsigned char* bitmap_buffer = (unsigned char*) malloc(sb_g.block_size);
-    unsigned int bits_per_block = sb_g.block_size * 8;
-    
-    unsigned int block_idx_in_bitmap = block_num / bits_per_block;
-    // <<< CORREÇÃO 1: A variável se chamava byte_idx_in_block, mas foi usada como byte_idx_in_bitmap. Corrigido. >>>
-    unsigned int byte_idx_in_bitmap = (block_num % bits_per_block) / 8; 
-    unsigned int bit_idx_in_byte = block_num % 8;
+/*
+ * Libera vários blocos de dados de uma vez.
+ * Cada bloco de bitmap envolvido é lido e escrito uma única vez.
+ * input:
+ * blocks - Os números dos blocos a liberar (entradas 0 ou fora do disco são ignoradas).
+ * count - Quantidade de entradas em 'blocks'.
+ * output: nenhum.
+ */
+void fs_free_blocks(const unsigned int* blocks, unsigned int count) {
+    if (!core_g->is_mounted || count == 0) return;
+
+    BitmapBatch batch;
+    bitmap_batch_open(&batch, core_g->sb.block_bitmap_start_block, core_g->sb.total_blocks);
+    for (unsigned int i = 0; i < count; i++) {
+        if (blocks[i] < core_g->sb.data_blocks_start_block || blocks[i] >= core_g->sb.total_blocks) continue;
+        if (g_verbose_mode) printf("   [Verbose] Liberando bloco de dados %u no bitmap...\n", blocks[i]);
+        bitmap_batch_set(&batch, blocks[i], 0);
+    }
+    if (bitmap_batch_close(&batch, 1) != 0) return;
+
+    if (!core_g->discard_online) return;
+    // Blocos consecutivos na lista (o caso comum: os blocos de um arquivo) viram um único pedido.
+    unsigned int run_start = 0, run_length = 0;
+    for (unsigned int i = 0; i <= count; i++) {
+        int valid = i < count && blocks[i] >= core_g->sb.data_blocks_start_block && blocks[i] < core_g->sb.total_blocks;
+        if (valid && run_length > 0 && blocks[i] == run_start + run_length) {
+            run_length++;
+            continue;
+        }
+        if (run_length > 0) disk_discard_blocks(run_start, run_length);
+        run_start = valid ? blocks[i] : 0;
+        run_length = valid ? 1 : 0;
+    }
+}
+
+/*
+ * Liga ou desliga o descarte imediato: com ele, os blocos liberados são devolvidos ao sistema
+ * hospedeiro (disk_discard_blocks) assim que saem do bitmap.
+ * input:
+ * enabled - 1 para ligar, 0 para desligar.
+ * output: nenhum.
+ */
+void fs_set_online_discard(int enabled) {
+    core_g->discard_online = enabled;
+}
+
+/*
+ * Devolve ao sistema hospedeiro o espaço de todos os blocos de dados livres, em lote: o bitmap
+ * é percorrido uma vez e cada sequência de blocos livres vira um único pedido de descarte.
+ * input:
+ * ranges - Recebe a quantidade de sequências descartadas.
+ * blocks - Recebe a quantidade de blocos descartados.
+ * output: 0 em caso de sucesso, -1 se o sistema hospedeiro não suportar o descarte.
+ */
+int fs_trim(unsigned int* ranges, unsigned int* blocks) {
+    *ranges = *blocks = 0;
+    if (!core_g->is_mounted) return -1;
+
+    BitmapBatch batch;
+    bitmap_batch_open(&batch, core_g->sb.block_bitmap_start_block, core_g->sb.total_blocks);
+    int result = 0;
+    unsigned int run_start = 0, run_length = 0;
+    for (unsigned int block_num = core_g->sb.data_blocks_start_block; block_num <= core_g->sb.total_blocks && result == 0 && !batch.error; block_num++) {
+        if (block_num < core_g->sb.total_blocks && !bitmap_batch_test(&batch, block_num)) {
+            if (run_length == 0) run_start = block_num;
+            run_length++;
+            continue;
+        }
+        if (run_length == 0) continue;
+        if (disk_discard_blocks(run_start, run_length) != 0) result = -1;
+        (*ranges)++;
+        *blocks += run_length;
+        run_length = 0;
+    }
+    if (bitmap_batch_close(&batch, 0) != 0) result = -1;
+    return result;
+}
+
+/*
+ * Reduz o sistema de arquivos para 'total_blocks' blocos e encolhe o arquivo de imagem.
+ * Todos os blocos a partir do novo fim precisam estar livres (veja fs_shrink, que os esvazia).
+ * As áreas de metadados mantêm o tamanho da formatação.
+ * input:
+ * total_blocks - O novo total de blocos.
+ * output: 0 em caso de sucesso, -1 se algum bloco além do novo fim estiver em uso.
+ */
+int fs_resize(unsigned int total_blocks) {
+    if (!core_g->is_mounted || total_blocks <= core_g->sb.data_blocks_start_block || total_blocks > core_g->sb.total_blocks) return -1;
+
+    BitmapBatch batch;
+    bitmap_batch_open(&batch, core_g->sb.block_bitmap_start_block, core_g->sb.total_blocks);
+    unsigned int in_use = 0;
+    for (unsigned int block_num = total_blocks; block_num < core_g->sb.total_blocks; block_num++) {
+        if (bitmap_batch_test(&batch, block_num)) in_use++;
+    }
+    if (bitmap_batch_close(&batch, 0) != 0) return -1;
+    if (in_use > 0) {
+        fprintf(stderr, "Erro: %u bloco(s) alem do novo fim ainda estao marcados como usados.\n", in_use);
+        return -1;
+    }
+
+    unsigned char* buffer = (unsigned char*) fs_get_block_buffer();
+    if (disk_read_block(0, buffer) != 0) {
+        fs_put_block_buffer(buffer);
+        return -1;
+    }
+    core_g->sb.total_blocks = total_blocks;
+    // Só o total muda: a marca de checksums pendentes no bloco 0 é do gerenciador de disco.
+    ((Superblock*) buffer)->total_blocks = total_blocks;
+    int result = disk_write_block(0, buffer);
+    fs_put_block_buffer(buffer);
+    if (result == 0) result = disk_truncate(total_blocks);
+    return result;
+}
+
+
+// --- IMPLEMENTAÇÃO DAS FUNÇÕES AUXILIARES (ESTÁTICAS) ---
+
+/*
+ * Inicia um lote de alterações sobre um bitmap do disco (nada é lido ainda).
+ * A memória do lote é a mesma em todas as chamadas: só um lote pode estar aberto por vez.
+ * input:
+ * batch - O lote a inicializar.
+ * start_block - O primeiro bloco do bitmap no disco.
+ * total_bits - Quantidade de bits do bitmap.
+ * output: nenhum.
+ */
+static void bitmap_batch_open(BitmapBatch* batch, unsigned int start_block, unsigned int total_bits) {
+    unsigned int bits_per_block = core_g->sb.block_size * 8;
+    batch->start_block = start_block;
+    batch->block_count = (total_bits + bits_per_block - 1) / bits_per_block;
+    size_t data_size = (size_t) batch->block_count * core_g->sb.block_size;
+    batch->data = (unsigned char*) reserve_storage(&core_g->batch_storage, &core_g->batch_storage_capacity,
+                                                   data_size + 2 * (size_t) batch->block_count);
+    batch->loaded = batch->data + data_size;
+    batch->dirty = batch->loaded + batch->block_count;
+    batch->error = 0;
+    memset(batch->loaded, 0, 2 * (size_t) batch->block_count);
+}
+
+/*
+ * Retorna o byte do bitmap que contém um bit, lendo o bloco correspondente se necessário.
+ * input:
+ * batch - O lote.
+ * bit - O número do bit.
+ * output: Ponteiro para o byte.
+ */
+static unsigned char* bitmap_batch_byte(BitmapBatch* batch, unsigned int bit) {
+    unsigned int bits_per_block = core_g->sb.block_size * 8;
+    unsigned int block_idx = bit / bits_per_block;
+    if (!batch->loaded[block_idx]) {
+        if (disk_read_block(batch->start_block + block_idx, batch->data + block_idx * core_g->sb.block_size) != 0) batch->error = 1;
+        batch->loaded[block_idx] = 1;
+    }
+    return batch->data + bit / 8;
+}
+
+/*
+ * Indica se um bit do bitmap está ligado.
+ * input:
+ * batch - O lote.
+ * bit - O número do bit.
+ * output: 1 se ligado, 0 caso contrário.
+ */
+static int bitmap_batch_test(BitmapBatch* batch, unsigned int bit) {
+    return (*bitmap_batch_byte(batch, bit) >> (7 - bit % 8)) & 1;
+}
+
+/*
+ * Liga ou desliga um bit do bitmap (a escrita no disco ocorre em bitmap_batch_close).
+ * input:
+ * batch - O lote.
+ * bit - O número do bit.
+ * value - 1 para ligar, 0 para desligar.
+ * output: nenhum.
+ */
+static void bitmap_batch_set(BitmapBatch* batch, unsigned int bit, int value) {
+    unsigned char* byte = bitmap_batch_byte(batch, bit);
+    if (value) *byte |= (1 << (7 - bit % 8));
+    else *byte &= ~(1 << (7 - bit % 8));
+    batch->dirty[bit / (core_g->sb.block_size * 8)] = 1;
+}
+
+/*
+ * Encerra um lote, escrevendo (uma vez) cada bloco de bitmap alterado. Se algum bloco do bitmap
+ * não pôde ser lido, nada é gravado: regravar o bloco recalcularia o checksum sobre a corrupção.
+ * input:
+ * batch - O lote.
+ * commit - 1 para gravar as alterações, 0 para descartá-las.
+ * output: 0 em caso de sucesso, -1 se o bitmap não pôde ser lido ou gravado.
+ */
+static int bitmap_batch_close(BitmapBatch* batch, int commit) {
+    if (batch->error) {
+        fprintf(stderr, "Erro: bitmap ilegivel no bloco %u; nada foi alterado.\n", batch->start_block);
+        return -1;
+    }
+    int result = 0;
+    for (unsigned int i = 0; commit && i < batch->block_count; i++) {
+        if (batch->dirty[i] && disk_write_block(batch->start_block + i, batch->data + i * core_g->sb.block_size) != 0) result = -1;
+    }
+    return result;
+}
+
+/*
+ * Compara dois pedidos de leitura de i-node pelo número do i-node (para qsort).
+ * input:
+ * a, b - Ponteiros para os InodeRequest comparados.
+ * output: Negativo, zero ou positivo, como strcmp.
+ */
+static int compare_inode_requests(const void* a, const void* b) {
+    unsigned int x = ((const InodeRequest*) a)->inode_num;
+    unsigned int y = ((const InodeRequest*) b)->inode_num;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Retorna quantos bytes cada i-node ocupa na tabela do disco montado.
+ * input: nenhum.
+ * output: O tamanho do slot de i-node.
+ */
+static unsigned int inode_slot_size(void) {
+    return core_g->sb.inode_version == FS_INODE_VERSION_LEGACY ? (unsigned int) sizeof(Inode) : core_g->sb.inode_size;
+}
+
+/*
+ * Retorna quantos bytes de atributos estendidos cabem no slot de cada i-node do disco montado.
+ * input: nenhum.
+ * output: FS_INODE_INLINE_XATTR_SIZE em slots de 256 bytes, 0 nos demais formatos.
+ */
+static unsigned int inline_xattr_capacity(void) {
+    if (core_g->sb.inode_version == FS_INODE_VERSION_LEGACY) return 0;
+    return core_g->sb.inode_size >= FS_INODE_SLOT_SIZE + FS_INODE_INLINE_XATTR_SIZE ? FS_INODE_INLINE_XATTR_SIZE : 0;
+}
+
+/*
+ * Decodifica um slot da tabela de i-nodes conforme a versão do formato do disco montado.
+ * input:
+ * slot - Os bytes do i-node dentro do bloco lido.
+ * inode - Recebe o i-node em memória.
+ * output: nenhum.
+ */
+static void decode_inode_slot(const unsigned char* slot, Inode* inode) {
+    if (core_g->sb.inode_version == FS_INODE_VERSION_LEGACY) {
+        memcpy(inode, slot, sizeof(Inode));
+        inode->xattr_block = 0; // Preenchimento da struct nas imagens antigas: pode ter lixo.
+    } else {
+        DiskInode disk;
+        memcpy(&disk, slot, sizeof(DiskInode));
+        fs_inode_from_disk(&disk, inode);
+    }
+}
+
+/*
+ * Codifica um i-node no seu slot da tabela conforme a versão do formato do disco montado.
+ * No formato atual só o DiskInode é reescrito; a área de atributos do slot não é tocada.
+ * input:
+ * slot - Os bytes do i-node dentro do bloco lido.
+ * inode - O i-node em memória.
+ * output: nenhum.
+ */
+static void encode_inode_slot(unsigned char* slot, const Inode* inode) {
+    if (core_g->sb.inode_version == FS_INODE_VERSION_LEGACY) {
+        memcpy(slot, inode, sizeof(Inode));
+    } else {
+        DiskInode disk;
+        fs_inode_to_disk(inode, &disk);
+        memcpy(slot, &disk, sizeof(DiskInode));
+    }
+}
+
+/*
+ * Procura as pendências de carimbos de tempo de um i-node.
+ * input:
+ * inode_num - O número do i-node.
+ * output: A posição em lazy_times, ou -1 se não houver pendência.
+ */
+static int lazy_time_find(unsigned int inode_num) {
+    for (unsigned int i = 0; i < core_g->lazy_time_count; i++) {
+        if (core_g->lazy_times[i].inode_num == inode_num) return (int) i;
+    }
+    return -1;
+}
+
+/*
+ * Aplica a um i-node os carimbos pendentes mais recentes que os dele.
+ * input:
+ * pending - As pendências.
+ * inode - O i-node (atualizado).
+ * output: 1 se algum tempo mudou, 0 caso contrário.
+ */
+static int lazy_time_apply(const LazyTime* pending, Inode* inode) {
+    int changed = 0;
+    if (pending->modification_time > inode->modification_time) {
+        inode->modification_time = pending->modification_time;
+        changed = 1;
+    }
+    if (pending->last_access_time > inode->last_access_time) {
+        inode->last_access_time = pending->last_access_time;
+        changed = 1;
+    }
+    return changed;
+}
+
+/*
+ * Completa um i-node recém-lido com os carimbos pendentes, que continuam pendentes.
+ * input:
+ * inode_num - O número do i-node.
+ * inode - O i-node (atualizado).
+ * output: nenhum.
+ */
+static void lazy_time_merge(unsigned int inode_num, Inode* inode) {
+    if (core_g->lazy_time_count == 0) return;
+    int index = lazy_time_find(inode_num);
+    if (index >= 0) lazy_time_apply(&core_g->lazy_times[index], inode);
+}
 
-    unsigned int target_bitmap_block = sb_g.block_bitmap_start_block + block_idx_in_bitmap;
+/*
+ * Completa um i-node que vai ser gravado com os carimbos pendentes e os retira da tabela.
+ * input:
+ * inode_num - O número do i-node.
+ * inode - O i-node (atualizado).
+ * output: nenhum.
+ */
+static void lazy_time_take(unsigned int inode_num, Inode* inode) {
+    if (core_g->lazy_time_count == 0) return;
+    int index = lazy_time_find(inode_num);
+    if (index < 0) return;
+    lazy_time_apply(&core_g->lazy_times[index], inode);
+    core_g->lazy_times[index] = core_g->lazy_times[--core_g->lazy_time_count];
+}
 
-    disk_read_block(target_bitmap_block, bitmap_buffer);
-    bitmap_buffer[byte_idx_in_bitmap] &= ~(1 << (7 - bit_idx_in_byte));
-    disk_write_block(target_bitmap_block, bitmap_buffer);
+/*
+ * Compara duas pendências de carimbos de tempo pelo número do i-node (para qsort).
+ * input:
+ * a, b - Ponteiros para os LazyTime comparados.
+ * output: Negativo, zero ou positivo, como strcmp.
+ */
+static int compare_lazy_times(const void* a, const void* b) {
+    unsigned int x = ((const LazyTime*) a)->inode_num;
+    unsigned int y = ((const LazyTime*) b)->inode_num;
+    return (x > y) - (x < y);
+}
 
-    free(bitmap_buffer);
+/*
+ * Garante que uma área reaproveitada tenha pelo menos 'needed' bytes, aumentando-a se preciso.
+ * input:
+ * storage - A área (pode ser substituída por uma maior).
+ * capacity - O tamanho atual da área, atualizado.
+ * needed - O tamanho necessário.
+ * output: Ponteiro para a área.
+ */
+static void* reserve_storage(void** storage, size_t* capacity, size_t needed) {
+    if (needed > *capacity) {
+        size_t new_capacity = *capacity > 0 ? *capacity : 256;
+        while (new_capacity < needed) new_capacity *= 2;
+        free(*storage);
+        *storage = malloc(new_capacity);
+        *capacity = new_capacity;
+    }
+    return *storage;
+}
+
+/*
+ * Libera os buffers reaproveitados de um estado.
+ * input:
+ * state - O estado.
+ * output: nenhum.
+ */
+static void release_state_buffers(CoreState* state) {
+    while (state->block_pool_count > 0) free(state->block_pool[--state->block_pool_count]);
+    free(state->batch_storage);
+    free(state->request_storage);
+    state->batch_storage = NULL;
+    state->request_storage = NULL;
+    state->batch_storage_capacity = state->request_storage_capacity = 0;
 }
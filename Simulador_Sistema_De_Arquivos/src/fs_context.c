@@ -0,0 +1,81 @@
+#include "fs_context.h"
+#include "filesystem_core.h"
+#include "file_operations.h"
+#include "gerenciador_de_disco.h"
+#include <stdlib.h>
+
+struct FsContext {
+    DiskState* disk;
+    CoreState* core;
+    OpsState* ops;
+};
+
+// Contexto selecionado em cada thread (NULL = contexto padrão).
+static __thread FsContext* current_context = NULL;
+
+/*
+ * Cria um contexto para uma imagem. Nada é aberto ainda: selecione o contexto e use
+ * fs_format e/ou fs_mount normalmente.
+ * input:
+ * disk_path - O caminho do arquivo de disco no sistema hospedeiro.
+ * output: O contexto, ou NULL se faltar memória.
+ */
+FsContext* fs_context_create(const char* disk_path) {
+    FsContext* context = (FsContext*) calloc(1, sizeof(FsContext));
+    if (!context) return NULL;
+    context->disk = disk_state_create(disk_path);
+    context->core = core_state_create();
+    context->ops = ops_state_create();
+    if (!context->disk || !context->core || !context->ops) {
+        disk_state_destroy(context->disk);
+        core_state_destroy(context->core);
+        ops_state_destroy(context->ops);
+        free(context);
+        return NULL;
+    }
+    return context;
+}
+
+/*
+ * Seleciona o contexto usado pelas próximas chamadas ao núcleo na thread atual.
+ * input:
+ * context - O contexto, ou NULL para o contexto padrão.
+ * output: O contexto selecionado antes (para restaurá-lo depois).
+ */
+FsContext* fs_context_select(FsContext* context) {
+    FsContext* previous = current_context;
+    current_context = context;
+    disk_state_select(context ? context->disk : NULL);
+    core_state_select(context ? context->core : NULL);
+    ops_state_select(context ? context->ops : NULL);
+    return previous;
+}
+
+/*
+ * Retorna o contexto selecionado na thread atual.
+ * input: nenhum.
+ * output: O contexto, ou NULL se for o padrão.
+ */
+FsContext* fs_context_current() {
+    return current_context;
+}
+
+/*
+ * Grava o que estiver pendente, desmonta a imagem e libera o contexto. Se ele estava
+ * selecionado nesta thread, o contexto padrão passa a ser usado.
+ * input:
+ * context - O contexto (NULL é ignorado).
+ * output: nenhum.
+ */
+void fs_context_destroy(FsContext* context) {
+    if (!context) return;
+    FsContext* previous = fs_context_select(context);
+    fs_sync();
+    disk_unmount();
+    fs_context_select(previous == context ? NULL : previous);
+
+    ops_state_destroy(context->ops);
+    core_state_destroy(context->core);
+    disk_state_destroy(context->disk);
+    free(context);
+}
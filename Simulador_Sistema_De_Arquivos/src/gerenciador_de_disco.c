@@ -1,10 +1,111 @@
+#define _GNU_SOURCE // fallocate (FALLOC_FL_PUNCH_HOLE)
 #include "gerenciador_de_disco.h"
+#include "crc32c.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-#define DISK_PATH "dados/meu_so.disk"
+// Um trecho contíguo de E/S em um membro de volume distribuído.
+typedef struct {
+    unsigned int member;
+    off_t offset;
+    unsigned char* data;
+    size_t length;
+} IoSegment;
 
-static FILE* disk_file = NULL;
-static unsigned int block_size_g = 0; 
+struct IoDispatcher;
+
+// Argumento de cada thread do despachante: o membro que ela atende.
+typedef struct {
+    struct IoDispatcher* dispatcher;
+    unsigned int member;
+} IoWorker;
+
+// Despachante de E/S paralela: uma thread por membro. Cada pedido de vários blocos vira uma
+// lista de trechos; cada thread executa os trechos do seu membro e o chamador espera todas.
+typedef struct IoDispatcher {
+    pthread_t threads[DISK_MAX_MEMBERS];
+    IoWorker workers[DISK_MAX_MEMBERS];
+    unsigned int thread_count;
+    const int* fds;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    unsigned long generation; // Incrementado a cada pedido.
+    unsigned int busy;        // Threads que ainda não terminaram o pedido atual.
+    int write;
+    const IoSegment* segments;
+    unsigned int segment_count;
+    int error;
+    int shutdown;
+} IoDispatcher;
+
+// Estado de uma imagem aberta. Cada contexto de sistema de arquivos (fs_context.h) tem o seu;
+// as funções deste módulo usam o estado selecionado na thread que as chama.
+struct DiskState {
+    FILE* file;
+    unsigned int block_size;
+    char path[1024];
+    DiskStats stats;
+    int is_open;
+
+    // Volume distribuído: os blocos ficam em faixas de 'stripe_size' bytes, distribuídas em
+    // rodízio entre os membros. Com member_count 0, a imagem é o próprio arquivo 'path'.
+    unsigned int member_count;
+    unsigned int stripe_size;
+    unsigned int stripe_blocks; // Blocos por faixa, recalculado a cada disk_set_block_size.
+    char member_paths[DISK_MAX_MEMBERS][1024];
+    int member_fds[DISK_MAX_MEMBERS];
+    IoDispatcher* dispatcher;
+    IoSegment* segments;        // Área reaproveitada para montar os trechos de um pedido.
+    unsigned int segment_capacity;
+
+    // Tabela de checksums (um CRC32C por bloco), mantida em memória e gravada na área de checksums a cada disk_sync.
+    // Um valor 0 significa "bloco ainda sem checksum" e não é verificado.
+    // Um bloco verificado com sucesso não é verificado de novo até ser reescrito (checksum_trusted).
+    unsigned int* checksum_table;
+    unsigned char* checksum_dirty;
+    unsigned char* checksum_trusted;
+    unsigned int checksum_start;
+    unsigned int checksum_blocks;
+    unsigned int checksum_total;
+
+    // Marca "checksums pendentes" (um unsigned int no bloco 0, em checksum_flag_offset): ligada e
+    // levada ao disco antes da primeira escrita depois de um disk_sync, desligada pelo disk_sync
+    // seguinte depois de gravar a área de checksums. Uma divergência com a marca desligada é
+    // corrupção; com ela ligada, é uma queda antes do sync, e a montagem recalcula o checksum.
+    unsigned char* block_zero; // Cópia do bloco 0 (o superbloco), regravada com a marca.
+    unsigned int checksum_flag_offset;
+    int checksums_marked;
+
+    DiskWriteHook write_hook;
+    void* write_hook_context;
+};
+
+// Estado usado por quem nunca seleciona outro (o simulador, as ferramentas e toda thread nova).
+static DiskState default_disk = { .path = DISK_DEFAULT_PATH };
+static __thread DiskState* disk_g = &default_disk;
+
+static int disk_flush_checksums();
+static int disk_flush_data();
+static int set_checksum_flag(unsigned int value);
+static int recover_checksums();
+static int load_volume_manifest();
+static int create_backing_file(const char* path, unsigned long long size);
+static void map_block(unsigned int block_num, unsigned int* member, off_t* offset);
+static int member_io(int write, int fd, unsigned char* data, size_t length, off_t offset);
+static void* dispatcher_thread(void* arg);
+static IoDispatcher* dispatcher_start(const int* fds, unsigned int count);
+static void dispatcher_stop(IoDispatcher* dispatcher);
+static int transfer_blocks(int write, const unsigned int* block_nums, unsigned int count, unsigned char* buffer);
+static int verify_block_read(unsigned int block_num, const void* buffer);
+static void note_block_written(unsigned int block_num, const void* buffer);
+static int punch_hole(int fd, off_t offset, off_t length);
 
 /*
  * Formata o arquivo de disco virtual, criando-o e alocando seu tamanho.
@@ -15,23 +116,36 @@ static unsigned int block_size_g = 0;
  * 0 em caso de sucesso, -1 em caso de erro.
  */
 int disk_format(unsigned int disk_size, unsigned int block_size) {
-    FILE* file = fopen(DISK_PATH, "wb"); 
-    if (!file) {
-        perror("Erro ao criar o arquivo de disco");
+    if (disk_g->member_count == 0) {
+        if (create_backing_file(disk_g->path, disk_size) != 0) return -1;
+        disk_g->block_size = block_size;
+        return 0;
+    }
+
+    if (disk_g->stripe_size < block_size || disk_g->stripe_size % block_size != 0) {
+        fprintf(stderr, "Erro: A faixa (%u bytes) deve ser um multiplo do bloco (%u bytes).\n", disk_g->stripe_size, block_size);
         return -1;
     }
-    if (fseek(file, disk_size - 1, SEEK_SET) != 0) {
-        perror("Erro ao posicionar no final do disco para formatação");
-        fclose(file);
+    FILE* manifest = fopen(disk_g->path, "w");
+    if (!manifest) {
+        perror("Erro ao criar a descricao do volume");
         return -1;
     }
-    if (fwrite("\0", 1, 1, file) != 1) {
-        perror("Erro ao escrever o byte nulo para alocar espaço");
-        fclose(file);
+    fprintf(manifest, "%s\nfaixa %u\n", DISK_VOLUME_HEADER, disk_g->stripe_size);
+    for (unsigned int m = 0; m < disk_g->member_count; m++) fprintf(manifest, "membro %s\n", disk_g->member_paths[m]);
+    if (fclose(manifest) != 0) {
+        perror("Erro ao gravar a descricao do volume");
         return -1;
     }
-    fclose(file);
-    block_size_g = block_size;
+
+    // Cada membro recebe o mesmo número de faixas, o suficiente para cobrir todos os blocos.
+    unsigned int stripe_blocks = disk_g->stripe_size / block_size;
+    unsigned long long total_stripes = ((unsigned long long) disk_size / block_size + stripe_blocks - 1) / stripe_blocks;
+    unsigned long long stripes_per_member = (total_stripes + disk_g->member_count - 1) / disk_g->member_count;
+    for (unsigned int m = 0; m < disk_g->member_count; m++) {
+        if (create_backing_file(disk_g->member_paths[m], stripes_per_member * disk_g->stripe_size) != 0) return -1;
+    }
+    disk_set_block_size(block_size);
     return 0;
 }
 
@@ -41,14 +155,32 @@ int disk_format(unsigned int disk_size, unsigned int block_size) {
  * output: 0 em caso de sucesso, -1 se o arquivo não puder ser aberto.
  */
 int disk_mount() {
-    if (disk_file) {
+    if (disk_g->is_open) {
         return 0;
     }
-    disk_file = fopen(DISK_PATH, "r+b"); 
-    if (!disk_file) {
-        perror("Erro ao montar o disco");
-        return -1;
+    int volume = load_volume_manifest();
+    if (volume < 0) return -1;
+    if (!volume) {
+        disk_g->file = fopen(disk_g->path, "r+b"); 
+        if (!disk_g->file) {
+            perror("Erro ao montar o disco");
+            return -1;
+        }
+        disk_g->is_open = 1;
+        return 0;
     }
+
+    for (unsigned int m = 0; m < disk_g->member_count; m++) {
+        disk_g->member_fds[m] = open(disk_g->member_paths[m], O_RDWR);
+        if (disk_g->member_fds[m] < 0) {
+            fprintf(stderr, "Erro ao abrir o membro '%s' do volume: %s\n", disk_g->member_paths[m], strerror(errno));
+            while (m > 0) close(disk_g->member_fds[--m]);
+            return -1;
+        }
+    }
+    if (disk_g->member_count > 1) disk_g->dispatcher = dispatcher_start(disk_g->member_fds, disk_g->member_count);
+    if (disk_g->block_size > 0) disk_set_block_size(disk_g->block_size);
+    disk_g->is_open = 1;
     return 0;
 }
 
@@ -58,10 +190,31 @@ int disk_mount() {
  * output: 0.
  */
 int disk_unmount() {
-    if (disk_file) {
-        fclose(disk_file);
-        disk_file = NULL;
+    if (disk_g->checksum_table) {
+        disk_sync(); // Grava os checksums e desliga a marca.
+        free(disk_g->checksum_table);
+        free(disk_g->checksum_dirty);
+        free(disk_g->checksum_trusted);
+        free(disk_g->block_zero);
+        disk_g->checksum_table = NULL;
+        disk_g->checksum_dirty = NULL;
+        disk_g->checksum_trusted = NULL;
+        disk_g->block_zero = NULL;
+        disk_g->checksums_marked = 0;
+    }
+    if (disk_g->file) {
+        fclose(disk_g->file);
+        disk_g->file = NULL;
+    }
+    if (disk_g->is_open && disk_g->member_count > 0) {
+        dispatcher_stop(disk_g->dispatcher);
+        disk_g->dispatcher = NULL;
+        for (unsigned int m = 0; m < disk_g->member_count; m++) close(disk_g->member_fds[m]);
     }
+    free(disk_g->segments);
+    disk_g->segments = NULL;
+    disk_g->segment_capacity = 0;
+    disk_g->is_open = 0;
     return 0;
 }
 
@@ -72,7 +225,305 @@ int disk_unmount() {
  * output: nenhum.
  */
 void disk_set_block_size(unsigned int block_size) {
-    block_size_g = block_size;
+    disk_g->block_size = block_size;
+    if (disk_g->stripe_size > 0 && block_size > 0) {
+        disk_g->stripe_blocks = disk_g->stripe_size >= block_size ? disk_g->stripe_size / block_size : 1;
+    }
+}
+
+/*
+ * Faz o próximo disk_format criar um volume distribuído: 'path' passa a ser a descrição do
+ * volume (um arquivo de texto) e os blocos são espalhados pelos membros em faixas.
+ * input:
+ * member_paths - Os caminhos dos arquivos membros (de preferência em discos diferentes).
+ * count - Quantidade de membros (0 volta ao modo de imagem única).
+ * stripe_size - Tamanho da faixa em bytes (múltiplo do tamanho do bloco).
+ * output: 0 em caso de sucesso, -1 se os parâmetros forem inválidos.
+ */
+int disk_set_members(const char* const* member_paths, unsigned int count, unsigned int stripe_size) {
+    if (count > DISK_MAX_MEMBERS || (count > 0 && stripe_size == 0)) return -1;
+    for (unsigned int m = 0; m < count; m++) {
+        if (strlen(member_paths[m]) >= sizeof(disk_g->member_paths[m])) return -1;
+        strcpy(disk_g->member_paths[m], member_paths[m]);
+    }
+    disk_g->member_count = count;
+    disk_g->stripe_size = count > 0 ? stripe_size : 0;
+    return 0;
+}
+
+/*
+ * Indica se um arquivo é a descrição de um volume distribuído.
+ * input:
+ * path - O caminho do arquivo.
+ * output: 1 se for um volume, 0 caso contrário.
+ */
+int disk_is_volume(const char* path) {
+    char header[sizeof(DISK_VOLUME_HEADER)] = {0};
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
+    size_t length = fread(header, 1, sizeof(header) - 1, file);
+    fclose(file);
+    return length == sizeof(header) - 1 && strcmp(header, DISK_VOLUME_HEADER) == 0;
+}
+
+/*
+ * Define o caminho do arquivo de imagem usado por disk_format e disk_mount.
+ * input:
+ * path - O caminho do arquivo de disco no sistema hospedeiro.
+ * output: nenhum.
+ */
+void disk_set_path(const char* path) {
+    strncpy(disk_g->path, path, sizeof(disk_g->path) - 1);
+    disk_g->path[sizeof(disk_g->path) - 1] = '\0';
+}
+
+/*
+ * Copia os contadores de E/S acumulados desde a última chamada a disk_reset_stats.
+ * input:
+ * stats - Ponteiro para a struct DiskStats que receberá os contadores.
+ * output: nenhum.
+ */
+void disk_get_stats(DiskStats* stats) {
+    *stats = disk_g->stats;
+}
+
+/*
+ * Zera os contadores de E/S.
+ * input: nenhum.
+ * output: nenhum.
+ */
+void disk_reset_stats() {
+    memset(&disk_g->stats, 0, sizeof(disk_g->stats));
+}
+
+/*
+ * Retorna o caminho da imagem do estado selecionado.
+ * input: nenhum.
+ * output: O caminho do arquivo de disco.
+ */
+const char* disk_get_path() {
+    return disk_g->path;
+}
+
+/*
+ * Cria o estado de uma nova imagem, ainda não montada.
+ * input:
+ * path - O caminho do arquivo de disco no sistema hospedeiro.
+ * output: O estado, ou NULL se faltar memória.
+ */
+DiskState* disk_state_create(const char* path) {
+    DiskState* state = (DiskState*) calloc(1, sizeof(DiskState));
+    if (!state) return NULL;
+    strncpy(state->path, path, sizeof(state->path) - 1);
+    return state;
+}
+
+/*
+ * Libera o estado de uma imagem. Ela deve ter sido desmontada (disk_unmount) antes.
+ * input:
+ * state - O estado (NULL e o estado padrão são ignorados).
+ * output: nenhum.
+ */
+void disk_state_destroy(DiskState* state) {
+    if (!state || state == &default_disk) return;
+    if (disk_g == state) disk_g = &default_disk;
+    free(state);
+}
+
+/*
+ * Seleciona o estado usado pelas próximas chamadas deste módulo na thread atual.
+ * input:
+ * state - O estado, ou NULL para o estado padrão.
+ * output: nenhum.
+ */
+void disk_state_select(DiskState* state) {
+    disk_g = state ? state : &default_disk;
+}
+
+/*
+ * Instala (ou remove, com NULL) o observador das escritas da imagem selecionada.
+ * input:
+ * hook - A função chamada a cada bloco escrito ou descartado.
+ * context - Repassado a 'hook'.
+ * output: nenhum.
+ */
+void disk_set_write_hook(DiskWriteHook hook, void* context) {
+    disk_g->write_hook = hook;
+    disk_g->write_hook_context = context;
+}
+
+/*
+ * Indica se um bloco é coberto pela tabela de checksums.
+ * O superbloco e a própria área de checksums ficam de fora.
+ * input:
+ * block_num - O número do bloco.
+ * output: 1 se o bloco tem checksum, 0 caso contrário.
+ */
+static int disk_block_has_checksum(unsigned int block_num) {
+    if (!disk_g->checksum_table || block_num == 0 || block_num >= disk_g->checksum_total) return 0;
+    return block_num < disk_g->checksum_start || block_num >= disk_g->checksum_start + disk_g->checksum_blocks;
+}
+
+/*
+ * Calcula o checksum armazenado para o conteúdo de um bloco (nunca 0, que indica ausência).
+ * input:
+ * buffer - O conteúdo do bloco.
+ * output: O checksum do bloco.
+ */
+static unsigned int disk_block_checksum(const void* buffer) {
+    unsigned int crc = crc32c(buffer, disk_g->block_size);
+    return crc ? crc : 1;
+}
+
+/*
+ * Ativa os checksums por bloco, carregando a tabela gravada na área de checksums. Se a marca de
+ * checksums pendentes estiver ligada (a imagem não passou por um disk_sync depois das últimas
+ * escritas), os checksums que divergem são recalculados antes de qualquer leitura.
+ * input:
+ * checksum_start_block - O primeiro bloco da área de checksums.
+ * checksum_blocks - Quantidade de blocos da área.
+ * total_blocks - Total de blocos do disco.
+ * flag_offset - Posição, no bloco 0, do unsigned int com a marca de checksums pendentes.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+int disk_enable_checksums(unsigned int checksum_start_block, unsigned int checksum_blocks, unsigned int total_blocks,
+                          unsigned int flag_offset) {
+    if (!disk_g->is_open || disk_g->block_size == 0) return -1;
+    unsigned int entries_per_block = disk_g->block_size / sizeof(unsigned int);
+    if (checksum_blocks * entries_per_block < total_blocks || flag_offset + sizeof(unsigned int) > disk_g->block_size) return -1;
+
+    unsigned int* table = (unsigned int*) calloc(checksum_blocks, disk_g->block_size);
+    unsigned char* dirty = (unsigned char*) calloc(checksum_blocks, 1);
+    unsigned char* trusted = (unsigned char*) calloc(total_blocks, 1);
+    unsigned char* block_zero = (unsigned char*) malloc(disk_g->block_size);
+    int result = table && dirty && trusted && block_zero ? 0 : -1;
+
+    // A tabela ainda não está ativa, então estas leituras não são verificadas.
+    if (result == 0 && disk_read_block(0, block_zero) != 0) result = -1;
+    for (unsigned int i = 0; result == 0 && i < checksum_blocks; i++) {
+        if (disk_read_block(checksum_start_block + i, table + i * entries_per_block) != 0) result = -1;
+    }
+    if (result != 0) {
+        free(table);
+        free(dirty);
+        free(trusted);
+        free(block_zero);
+        return -1;
+    }
+
+    disk_g->checksum_start = checksum_start_block;
+    disk_g->checksum_blocks = checksum_blocks;
+    disk_g->checksum_total = total_blocks;
+    disk_g->block_zero = block_zero;
+    disk_g->checksum_flag_offset = flag_offset;
+    unsigned int flag;
+    memcpy(&flag, block_zero + flag_offset, sizeof(flag));
+    disk_g->checksums_marked = flag != 0;
+    disk_g->checksum_dirty = dirty;
+    disk_g->checksum_trusted = trusted;
+    if (disk_g->checksums_marked && recover_checksums(table) != 0) {
+        free(table);
+        free(dirty);
+        free(trusted);
+        free(block_zero);
+        disk_g->checksum_dirty = NULL;
+        disk_g->checksum_trusted = NULL;
+        disk_g->block_zero = NULL;
+        disk_g->checksums_marked = 0;
+        return -1;
+    }
+    disk_g->checksum_table = table;
+    return disk_g->checksums_marked ? disk_sync() : 0;
+}
+
+/*
+ * Grava no disco os blocos da área de checksums que foram alterados.
+ * input: nenhum.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int disk_flush_checksums() {
+    unsigned int entries_per_block = disk_g->block_size / sizeof(unsigned int);
+    int result = 0;
+    for (unsigned int i = 0; i < disk_g->checksum_blocks; i++) {
+        if (!disk_g->checksum_dirty[i]) continue;
+        if (disk_write_block(disk_g->checksum_start + i, disk_g->checksum_table + i * entries_per_block) != 0) {
+            result = -1;
+            continue;
+        }
+        disk_g->checksum_dirty[i] = 0;
+    }
+    return result;
+}
+
+/*
+ * Esvazia o buffer do stdio e espera o sistema operacional gravar os dados da imagem (ou de
+ * cada membro do volume) no disco.
+ * input: nenhum.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int disk_flush_data() {
+    int result = 0;
+    if (disk_g->member_count == 0) {
+        if (fflush(disk_g->file) != 0 || fdatasync(fileno(disk_g->file)) != 0) {
+            perror("Erro ao sincronizar o disco");
+            return -1;
+        }
+    } else {
+        for (unsigned int m = 0; m < disk_g->member_count; m++) {
+            if (fdatasync(disk_g->member_fds[m]) != 0) result = -1;
+        }
+        if (result != 0) perror("Erro ao sincronizar o volume");
+    }
+    if (result == 0 && disk_g->write_hook) disk_g->write_hook(DISK_WRITE_BARRIER, NULL, disk_g->write_hook_context);
+    return result;
+}
+
+/*
+ * Liga ou desliga a marca de checksums pendentes no bloco 0. Ligar só acontece uma vez entre dois
+ * disk_sync e espera a marca chegar ao disco, para que nenhuma escrita coberta por checksum a
+ * ultrapasse.
+ * input:
+ * value - 1 para ligar, 0 para desligar.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int set_checksum_flag(unsigned int value) {
+    if (disk_g->checksums_marked == (value != 0)) return 0;
+    memcpy(disk_g->block_zero + disk_g->checksum_flag_offset, &value, sizeof(value));
+    if (disk_write_block(0, disk_g->block_zero) != 0) return -1;
+    if (value && disk_flush_data() != 0) return -1;
+    disk_g->checksums_marked = value != 0;
+    return 0;
+}
+
+/*
+ * Confere todos os blocos com checksum contra a tabela e recalcula os que divergem. Usada na
+ * montagem de uma imagem com a marca de checksums pendentes ligada, antes de a tabela ser ativada.
+ * input:
+ * table - A tabela carregada da área de checksums (corrigida aqui).
+ * output: 0 em caso de sucesso, -1 se algum bloco não puder ser lido.
+ */
+static int recover_checksums(unsigned int* table) {
+    unsigned int entries_per_block = disk_g->block_size / sizeof(unsigned int);
+    unsigned char* block = (unsigned char*) malloc(disk_g->block_size);
+    unsigned int recomputed = 0;
+    int result = block ? 0 : -1;
+    for (unsigned int b = 1; result == 0 && b < disk_g->checksum_total; b++) {
+        if (table[b] == 0 || (b >= disk_g->checksum_start && b < disk_g->checksum_start + disk_g->checksum_blocks)) continue;
+        if (disk_read_block(b, block) != 0) {
+            result = -1;
+            break;
+        }
+        unsigned int checksum = disk_block_checksum(block);
+        if (checksum == table[b]) continue;
+        table[b] = checksum;
+        disk_g->checksum_dirty[b / entries_per_block] = 1;
+        recomputed++;
+    }
+    free(block);
+    if (recomputed > 0) {
+        fprintf(stderr, "Aviso: a imagem nao foi sincronizada antes de fechar; %u checksum(s) recalculado(s).\n", recomputed);
+    }
+    return result;
 }
 
 /*
@@ -83,19 +534,29 @@ void disk_set_block_size(unsigned int block_size) {
  * output: 0 em caso de sucesso, -1 em caso de erro.
  */
 int disk_read_block(unsigned int block_num, void* buffer) {
-    if (!disk_file || block_size_g == 0) return -1;
-    long offset = block_num * block_size_g;
-    if (fseek(disk_file, offset, SEEK_SET) != 0) {
-        perror("Erro de fseek na leitura");
-        return -1;
-    }
-    if (fread(buffer, block_size_g, 1, disk_file) != 1) {
-        if (!feof(disk_file)) {
-            perror("Erro de fread");
+    if (!disk_g->is_open || disk_g->block_size == 0) return -1;
+    if (disk_g->member_count > 0) {
+        unsigned int member;
+        off_t offset;
+        map_block(block_num, &member, &offset);
+        if (member_io(0, disk_g->member_fds[member], (unsigned char*) buffer, disk_g->block_size, offset) != 0) {
+            perror("Erro de leitura no membro do volume");
             return -1;
         }
+    } else {
+        long offset = block_num * disk_g->block_size;
+        if (fseek(disk_g->file, offset, SEEK_SET) != 0) {
+            perror("Erro de fseek na leitura");
+            return -1;
+        }
+        if (fread(buffer, disk_g->block_size, 1, disk_g->file) != 1) {
+            if (!feof(disk_g->file)) {
+                perror("Erro de fread");
+                return -1;
+            }
+        }
     }
-    return 0;
+    return verify_block_read(block_num, buffer);
 }
 
 /*
@@ -106,15 +567,527 @@ int disk_read_block(unsigned int block_num, void* buffer) {
  * output: 0 em caso de sucesso, -1 em caso de erro.
  */
 int disk_write_block(unsigned int block_num, const void* buffer) {
-    if (!disk_file || block_size_g == 0) return -1;
-    long offset = block_num * block_size_g;
-    if (fseek(disk_file, offset, SEEK_SET) != 0) {
-        perror("Erro de fseek na escrita");
+    if (!disk_g->is_open || disk_g->block_size == 0) return -1;
+    if (disk_block_has_checksum(block_num) && set_checksum_flag(1) != 0) return -1;
+    if (disk_g->member_count > 0) {
+        unsigned int member;
+        off_t offset;
+        map_block(block_num, &member, &offset);
+        if (member_io(1, disk_g->member_fds[member], (unsigned char*) buffer, disk_g->block_size, offset) != 0) {
+            perror("Erro de escrita no membro do volume");
+            return -1;
+        }
+    } else {
+        long offset = block_num * disk_g->block_size;
+        if (fseek(disk_g->file, offset, SEEK_SET) != 0) {
+            perror("Erro de fseek na escrita");
+            return -1;
+        }
+        if (fwrite(buffer, disk_g->block_size, 1, disk_g->file) != 1) {
+            perror("Erro de fwrite");
+            return -1;
+        }
+    }
+    // O superbloco pode ser regravado pelo núcleo (fs_resize): a cópia com a marca acompanha.
+    if (block_num == 0 && disk_g->block_zero && buffer != disk_g->block_zero) memcpy(disk_g->block_zero, buffer, disk_g->block_size);
+    note_block_written(block_num, buffer);
+    return 0;
+}
+
+/*
+ * Torna duráveis as escritas feitas até aqui, junto com os blocos alterados da área de
+ * checksums. Só depois que tudo chegou ao disco do hospedeiro a marca de checksums pendentes é
+ * desligada; essa última escrita não precisa de espera própria: se ela se perder, a próxima
+ * montagem apenas confere os checksums de novo.
+ * input: nenhum.
+ * output: 0 em caso de sucesso (ou se nada estiver montado), -1 em caso de erro.
+ */
+int disk_sync() {
+    if (!disk_g->is_open) return 0;
+    int result = disk_g->checksum_table ? disk_flush_checksums() : 0;
+    if (disk_flush_data() != 0) return -1;
+    if (result == 0 && disk_g->checksums_marked && set_checksum_flag(0) != 0) result = -1;
+    return result;
+}
+
+/*
+ * Grava no disco do hospedeiro o que estiver em buffer e pede que a cache de páginas da imagem
+ * seja descartada, para que as próximas leituras meçam o acesso real ao disco.
+ * input: nenhum.
+ * output: nenhum.
+ */
+void disk_drop_cache() {
+    if (!disk_g->is_open) return;
+    if (disk_g->member_count == 0) {
+        fflush(disk_g->file);
+        fdatasync(fileno(disk_g->file));
+        posix_fadvise(fileno(disk_g->file), 0, 0, POSIX_FADV_DONTNEED);
+        return;
+    }
+    for (unsigned int m = 0; m < disk_g->member_count; m++) {
+        fdatasync(disk_g->member_fds[m]);
+        posix_fadvise(disk_g->member_fds[m], 0, 0, POSIX_FADV_DONTNEED);
+    }
+}
+
+/*
+ * Devolve ao sistema hospedeiro o espaço de uma sequência de blocos livres (fallocate com
+ * PUNCH_HOLE): o arquivo de imagem mantém o tamanho, mas os blocos deixam de ocupar disco e
+ * passam a ser lidos como zeros. Os checksums desses blocos são apagados.
+ * input:
+ * start_block - O primeiro bloco.
+ * count - Quantidade de blocos.
+ * output: 0 em caso de sucesso, -1 se o sistema hospedeiro não suportar a operação.
+ */
+int disk_discard_blocks(unsigned int start_block, unsigned int count) {
+    if (!disk_g->is_open || disk_g->block_size == 0 || count == 0) return -1;
+    if (disk_g->checksum_table && set_checksum_flag(1) != 0) return -1;
+    for (unsigned int b = start_block; b < start_block + count; b++) {
+        if (disk_g->write_hook) disk_g->write_hook(b, NULL, disk_g->write_hook_context);
+        if (!disk_block_has_checksum(b)) continue;
+        disk_g->checksum_table[b] = 0;
+        disk_g->checksum_trusted[b] = 0;
+        disk_g->checksum_dirty[b / (disk_g->block_size / sizeof(unsigned int))] = 1;
+    }
+
+    if (disk_g->member_count == 0) {
+        fflush(disk_g->file); // Escritas ainda no buffer do stdio preencheriam o buraco de novo.
+        return punch_hole(fileno(disk_g->file), (off_t) start_block * disk_g->block_size, (off_t) count * disk_g->block_size);
+    }
+    int result = 0;
+    while (count > 0) {
+        unsigned int chunk = disk_g->stripe_blocks - start_block % disk_g->stripe_blocks;
+        if (chunk > count) chunk = count;
+        unsigned int member;
+        off_t offset;
+        map_block(start_block, &member, &offset);
+        if (punch_hole(disk_g->member_fds[member], offset, (off_t) chunk * disk_g->block_size) != 0) result = -1;
+        start_block += chunk;
+        count -= chunk;
+    }
+    return result;
+}
+
+/*
+ * Ajusta o tamanho do arquivo de imagem (ou dos membros do volume) para 'total_blocks' blocos.
+ * input:
+ * total_blocks - O novo total de blocos.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+int disk_truncate(unsigned int total_blocks) {
+    if (!disk_g->is_open || disk_g->block_size == 0) return -1;
+    if (disk_g->member_count == 0) {
+        fflush(disk_g->file);
+        return ftruncate(fileno(disk_g->file), (off_t) total_blocks * disk_g->block_size);
+    }
+    // Como em disk_format: todos os membros com o mesmo número de faixas.
+    unsigned long long total_stripes = ((unsigned long long) total_blocks + disk_g->stripe_blocks - 1) / disk_g->stripe_blocks;
+    unsigned long long stripes_per_member = (total_stripes + disk_g->member_count - 1) / disk_g->member_count;
+    off_t member_size = (off_t) (stripes_per_member * disk_g->stripe_blocks * disk_g->block_size);
+    for (unsigned int m = 0; m < disk_g->member_count; m++) {
+        if (ftruncate(disk_g->member_fds[m], member_size) != 0) return -1;
+    }
+    return 0;
+}
+
+/*
+ * Informa quanto espaço a imagem (ou a soma dos membros do volume) ocupa de fato no disco do
+ * hospedeiro, sem contar os buracos de arquivos esparsos.
+ * input: nenhum.
+ * output: O espaço em bytes (0 se o disco não estiver montado).
+ */
+unsigned long long disk_allocated_bytes() {
+    if (!disk_g->is_open) return 0;
+    struct stat st;
+    if (disk_g->member_count == 0) {
+        fflush(disk_g->file);
+        return fstat(fileno(disk_g->file), &st) == 0 ? (unsigned long long) st.st_blocks * 512 : 0;
+    }
+    unsigned long long total = 0;
+    for (unsigned int m = 0; m < disk_g->member_count; m++) {
+        if (fstat(disk_g->member_fds[m], &st) == 0) total += (unsigned long long) st.st_blocks * 512;
+    }
+    return total;
+}
+
+/*
+ * Lê vários blocos para um buffer contíguo (o bloco i vai para buffer + i * tamanho do bloco).
+ * Em um volume distribuído, os membros envolvidos são lidos em paralelo.
+ * input:
+ * block_nums - Os números dos blocos.
+ * count - Quantidade de blocos.
+ * buffer - Onde os blocos serão armazenados.
+ * output: 0 em caso de sucesso, -1 se algum bloco não puder ser lido.
+ */
+int disk_read_blocks(const unsigned int* block_nums, unsigned int count, void* buffer) {
+    if (!disk_g->is_open || disk_g->block_size == 0) return -1;
+    unsigned char* data = (unsigned char*) buffer;
+    if (!disk_g->dispatcher) {
+        int result = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            if (disk_read_block(block_nums[i], data + (size_t) i * disk_g->block_size) != 0) result = -1;
+        }
+        return result;
+    }
+    if (transfer_blocks(0, block_nums, count, data) != 0) {
+        fprintf(stderr, "Erro de leitura no volume distribuido.\n");
+        return -1;
+    }
+    int result = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (verify_block_read(block_nums[i], data + (size_t) i * disk_g->block_size) != 0) result = -1;
+    }
+    return result;
+}
+
+/*
+ * Escreve vários blocos a partir de um buffer contíguo (o bloco i vem de buffer + i * tamanho
+ * do bloco). Em um volume distribuído, os membros envolvidos são escritos em paralelo.
+ * input:
+ * block_nums - Os números dos blocos.
+ * count - Quantidade de blocos.
+ * buffer - Os dados.
+ * output: 0 em caso de sucesso, -1 se algum bloco não puder ser escrito.
+ */
+int disk_write_blocks(const unsigned int* block_nums, unsigned int count, const void* buffer) {
+    if (!disk_g->is_open || disk_g->block_size == 0) return -1;
+    const unsigned char* data = (const unsigned char*) buffer;
+    if (!disk_g->dispatcher) {
+        int result = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            if (disk_write_block(block_nums[i], data + (size_t) i * disk_g->block_size) != 0) result = -1;
+        }
+        return result;
+    }
+    if (disk_g->checksum_table && set_checksum_flag(1) != 0) return -1;
+    if (transfer_blocks(1, block_nums, count, (unsigned char*) data) != 0) {
+        fprintf(stderr, "Erro de escrita no volume distribuido.\n");
+        return -1;
+    }
+    for (unsigned int i = 0; i < count; i++) note_block_written(block_nums[i], data + (size_t) i * disk_g->block_size);
+    return 0;
+}
+
+/*
+ * Avisa o sistema operacional de que uma sequência de blocos será lida em breve,
+ * para que a leitura antecipada ocorra enquanto o chamador ainda processa outros dados.
+ * input:
+ * start_block - O primeiro bloco da sequência.
+ * count - Quantidade de blocos.
+ * output: nenhum.
+ */
+void disk_prefetch_blocks(unsigned int start_block, unsigned int count) {
+    if (!disk_g->is_open || disk_g->block_size == 0 || count == 0) return;
+    if (disk_g->member_count == 0) {
+        posix_fadvise(fileno(disk_g->file), (off_t) start_block * disk_g->block_size, (off_t) count * disk_g->block_size, POSIX_FADV_WILLNEED);
+        return;
+    }
+    // Em um volume, o pedido é repartido nas faixas, cada uma contígua em um membro.
+    while (count > 0) {
+        unsigned int chunk = disk_g->stripe_blocks - start_block % disk_g->stripe_blocks;
+        if (chunk > count) chunk = count;
+        unsigned int member;
+        off_t offset;
+        map_block(start_block, &member, &offset);
+        posix_fadvise(disk_g->member_fds[member], offset, (off_t) chunk * disk_g->block_size, POSIX_FADV_WILLNEED);
+        start_block += chunk;
+        count -= chunk;
+    }
+}
+
+/*
+ * Confere o checksum de um bloco recém-lido e atualiza os contadores de leitura.
+ * input:
+ * block_num - O número do bloco.
+ * buffer - O conteúdo lido.
+ * output: 0 em caso de sucesso, -1 se o checksum não conferir.
+ */
+static int verify_block_read(unsigned int block_num, const void* buffer) {
+    disk_g->stats.reads++;
+    disk_g->stats.bytes_read += disk_g->block_size;
+
+    if (disk_block_has_checksum(block_num) && disk_g->checksum_table[block_num] != 0 && !disk_g->checksum_trusted[block_num]) {
+        disk_g->stats.checksums_verified++;
+        if (disk_block_checksum(buffer) != disk_g->checksum_table[block_num]) {
+            disk_g->stats.checksum_errors++;
+            fprintf(stderr, "Erro: checksum invalido no bloco %u.\n", block_num);
+            return -1;
+        }
+        disk_g->checksum_trusted[block_num] = 1;
+    }
+    return 0;
+}
+
+/*
+ * Registra o checksum de um bloco recém-escrito e atualiza os contadores de escrita.
+ * input:
+ * block_num - O número do bloco.
+ * buffer - O conteúdo escrito.
+ * output: nenhum.
+ */
+static void note_block_written(unsigned int block_num, const void* buffer) {
+    disk_g->stats.writes++;
+    disk_g->stats.bytes_written += disk_g->block_size;
+    if (disk_g->write_hook) disk_g->write_hook(block_num, buffer, disk_g->write_hook_context);
+
+    if (disk_block_has_checksum(block_num)) {
+        unsigned int entries_per_block = disk_g->block_size / sizeof(unsigned int);
+        disk_g->checksum_table[block_num] = disk_block_checksum(buffer);
+        disk_g->checksum_trusted[block_num] = 0;
+        disk_g->checksum_dirty[block_num / entries_per_block] = 1;
+    }
+}
+
+/*
+ * Cria um arquivo de apoio com o tamanho pedido (esparso: só o último byte é escrito).
+ * input:
+ * path - O caminho do arquivo.
+ * size - O tamanho em bytes.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int create_backing_file(const char* path, unsigned long long size) {
+    FILE* file = fopen(path, "wb"); 
+    if (!file) {
+        perror("Erro ao criar o arquivo de disco");
         return -1;
     }
-    if (fwrite(buffer, block_size_g, 1, disk_file) != 1) {
-        perror("Erro de fwrite");
+    if (fseeko(file, (off_t) size - 1, SEEK_SET) != 0) {
+        perror("Erro ao posicionar no final do disco para formatação");
+        fclose(file);
+        return -1;
+    }
+    if (fwrite("\0", 1, 1, file) != 1) {
+        perror("Erro ao escrever o byte nulo para alocar espaço");
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    return 0;
+}
+
+/*
+ * Lê a descrição de volume distribuído em 'path', se o arquivo for uma.
+ * Formato (texto): a linha DISK_VOLUME_HEADER, "faixa <bytes>" e uma linha "membro <caminho>"
+ * por membro, na ordem do rodízio.
+ * input: nenhum.
+ * output: 1 se for um volume (membros carregados), 0 se for uma imagem comum, -1 se a descrição for inválida.
+ */
+static int load_volume_manifest() {
+    disk_g->member_count = 0;
+    disk_g->stripe_size = 0;
+    if (!disk_is_volume(disk_g->path)) return 0;
+
+    FILE* manifest = fopen(disk_g->path, "r");
+    if (!manifest) return 0;
+    char line[1100];
+    unsigned int stripe_size = 0, count = 0;
+    int valid = 1;
+    while (fgets(line, sizeof(line), manifest)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strncmp(line, "faixa ", 6) == 0) {
+            stripe_size = (unsigned int) strtoul(line + 6, NULL, 10);
+        } else if (strncmp(line, "membro ", 7) == 0) {
+            if (count == DISK_MAX_MEMBERS || strlen(line + 7) >= sizeof(disk_g->member_paths[0])) { valid = 0; break; }
+            strcpy(disk_g->member_paths[count++], line + 7);
+        }
+    }
+    fclose(manifest);
+    if (!valid || count == 0 || stripe_size == 0) {
+        fprintf(stderr, "Erro: Descricao de volume invalida em '%s'.\n", disk_g->path);
         return -1;
     }
+    disk_g->member_count = count;
+    disk_g->stripe_size = stripe_size;
+    return 1;
+}
+
+/*
+ * Calcula em qual membro, e em que posição dele, fica um bloco do volume.
+ * input:
+ * block_num - O número do bloco.
+ * member - Recebe o índice do membro.
+ * offset - Recebe a posição em bytes dentro do membro.
+ * output: nenhum.
+ */
+static void map_block(unsigned int block_num, unsigned int* member, off_t* offset) {
+    unsigned int stripe = block_num / disk_g->stripe_blocks;
+    *member = stripe % disk_g->member_count;
+    *offset = ((off_t) (stripe / disk_g->member_count) * disk_g->stripe_blocks + block_num % disk_g->stripe_blocks) * disk_g->block_size;
+}
+
+/*
+ * Lê ou escreve um trecho inteiro de um membro. Ler além do fim do arquivo devolve zeros.
+ * input:
+ * write - 1 para escrever, 0 para ler.
+ * fd - O descritor do membro.
+ * data - Os dados (ou onde armazená-los).
+ * length - Quantidade de bytes.
+ * offset - Posição no membro.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int member_io(int write, int fd, unsigned char* data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t done = write ? pwrite(fd, data, length, offset) : pread(fd, data, length, offset);
+        if (done < 0 && errno == EINTR) continue;
+        if (done < 0) return -1;
+        if (done == 0) {
+            if (write) return -1;
+            memset(data, 0, length);
+            return 0;
+        }
+        data += done;
+        length -= (size_t) done;
+        offset += done;
+    }
     return 0;
 }
+
+/*
+ * Laço de uma thread do despachante: espera um pedido, executa os trechos do seu membro e avisa.
+ * input:
+ * arg - O IoWorker da thread.
+ * output: NULL.
+ */
+static void* dispatcher_thread(void* arg) {
+    IoWorker* worker = (IoWorker*) arg;
+    IoDispatcher* dispatcher = worker->dispatcher;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    for (;;) {
+        while (dispatcher->generation == seen && !dispatcher->shutdown) pthread_cond_wait(&dispatcher->work_ready, &dispatcher->lock);
+        if (dispatcher->shutdown) break;
+        seen = dispatcher->generation;
+        const IoSegment* segments = dispatcher->segments;
+        unsigned int segment_count = dispatcher->segment_count;
+        int write = dispatcher->write;
+        pthread_mutex_unlock(&dispatcher->lock);
+
+        int error = 0;
+        for (unsigned int i = 0; i < segment_count; i++) {
+            if (segments[i].member != worker->member) continue;
+            if (member_io(write, dispatcher->fds[worker->member], segments[i].data, segments[i].length, segments[i].offset) != 0) error = 1;
+        }
+
+        pthread_mutex_lock(&dispatcher->lock);
+        if (error) dispatcher->error = 1;
+        if (--dispatcher->busy == 0) pthread_cond_signal(&dispatcher->work_done);
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+    return NULL;
+}
+
+/*
+ * Inicia o despachante com uma thread por membro.
+ * input:
+ * fds - Os descritores dos membros (devem continuar válidos até dispatcher_stop).
+ * count - Quantidade de membros.
+ * output: O despachante, ou NULL se as threads não puderem ser criadas (a E/S segue sequencial).
+ */
+static IoDispatcher* dispatcher_start(const int* fds, unsigned int count) {
+    IoDispatcher* dispatcher = (IoDispatcher*) calloc(1, sizeof(IoDispatcher));
+    if (!dispatcher) return NULL;
+    dispatcher->fds = fds;
+    pthread_mutex_init(&dispatcher->lock, NULL);
+    pthread_cond_init(&dispatcher->work_ready, NULL);
+    pthread_cond_init(&dispatcher->work_done, NULL);
+    for (unsigned int m = 0; m < count; m++) {
+        dispatcher->workers[m].dispatcher = dispatcher;
+        dispatcher->workers[m].member = m;
+        if (pthread_create(&dispatcher->threads[m], NULL, dispatcher_thread, &dispatcher->workers[m]) != 0) {
+            dispatcher_stop(dispatcher);
+            return NULL;
+        }
+        dispatcher->thread_count++;
+    }
+    return dispatcher;
+}
+
+/*
+ * Encerra as threads do despachante e o libera.
+ * input:
+ * dispatcher - O despachante (NULL é ignorado).
+ * output: nenhum.
+ */
+static void dispatcher_stop(IoDispatcher* dispatcher) {
+    if (!dispatcher) return;
+    pthread_mutex_lock(&dispatcher->lock);
+    dispatcher->shutdown = 1;
+    pthread_cond_broadcast(&dispatcher->work_ready);
+    pthread_mutex_unlock(&dispatcher->lock);
+    for (unsigned int m = 0; m < dispatcher->thread_count; m++) pthread_join(dispatcher->threads[m], NULL);
+    pthread_mutex_destroy(&dispatcher->lock);
+    pthread_cond_destroy(&dispatcher->work_ready);
+    pthread_cond_destroy(&dispatcher->work_done);
+    free(dispatcher);
+}
+
+/*
+ * Executa um pedido de vários blocos em um volume: agrupa os blocos em trechos contíguos por
+ * membro e, se mais de um membro estiver envolvido, entrega os trechos às threads do despachante.
+ * Checksums e contadores ficam a cargo do chamador.
+ * input:
+ * write - 1 para escrever, 0 para ler.
+ * block_nums - Os números dos blocos.
+ * count - Quantidade de blocos.
+ * buffer - O buffer contíguo com (ou para) os blocos.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int transfer_blocks(int write, const unsigned int* block_nums, unsigned int count, unsigned char* buffer) {
+    if (count > disk_g->segment_capacity) {
+        free(disk_g->segments);
+        disk_g->segments = (IoSegment*) malloc(count * sizeof(IoSegment));
+        disk_g->segment_capacity = disk_g->segments ? count : 0;
+        if (!disk_g->segments) return -1;
+    }
+
+    unsigned int segment_count = 0;
+    unsigned int members_used = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int member;
+        off_t offset;
+        map_block(block_nums[i], &member, &offset);
+        unsigned char* data = buffer + (size_t) i * disk_g->block_size;
+        IoSegment* last = segment_count > 0 ? &disk_g->segments[segment_count - 1] : NULL;
+        if (last && last->member == member && last->offset + (off_t) last->length == offset && last->data + last->length == data) {
+            last->length += disk_g->block_size;
+            continue;
+        }
+        members_used |= 1u << member;
+        disk_g->segments[segment_count++] = (IoSegment) { member, offset, data, disk_g->block_size };
+    }
+
+    if ((members_used & (members_used - 1)) == 0) {
+        // Um único membro: não vale acordar as threads.
+        for (unsigned int i = 0; i < segment_count; i++) {
+            const IoSegment* segment = &disk_g->segments[i];
+            if (member_io(write, disk_g->member_fds[segment->member], segment->data, segment->length, segment->offset) != 0) return -1;
+        }
+        return 0;
+    }
+
+    IoDispatcher* dispatcher = disk_g->dispatcher;
+    pthread_mutex_lock(&dispatcher->lock);
+    dispatcher->write = write;
+    dispatcher->segments = disk_g->segments;
+    dispatcher->segment_count = segment_count;
+    dispatcher->error = 0;
+    dispatcher->busy = dispatcher->thread_count;
+    dispatcher->generation++;
+    pthread_cond_broadcast(&dispatcher->work_ready);
+    while (dispatcher->busy > 0) pthread_cond_wait(&dispatcher->work_done, &dispatcher->lock);
+    int error = dispatcher->error;
+    pthread_mutex_unlock(&dispatcher->lock);
+    return error ? -1 : 0;
+}
+
+/*
+ * Libera no sistema hospedeiro um trecho de um arquivo, sem mudar o tamanho dele.
+ * input:
+ * fd - O descritor do arquivo.
+ * offset, length - O trecho em bytes.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int punch_hole(int fd, off_t offset, off_t length) {
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length);
+}
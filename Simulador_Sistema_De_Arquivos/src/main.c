@@ -1,47 +1,112 @@
+#define _POSIX_C_SOURCE 200112L
+#include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include "filesystem_core.h"
 #include "file_operations.h"
 #include "gerenciador_de_disco.h"
+#include "crc32c.h"
+#include "server.h"
+#include "archive.h"
+#include "xattr.h"
 
-#define DISK_PATH "dados/meu_so.disk"
 #define DISK_SIZE (10 * 1024 * 1024)
 #define BLOCK_SIZE 4096
+#define BYTES_PER_INODE (4 * BLOCK_SIZE)
 
 // Flag global para o modo verboso, acessível por outros módulos via 'extern'.
 int g_verbose_mode = 0;
 
+// Flag global de compressão: quando ligada, 'write' grava os dados em extents comprimidos.
+int g_compress_mode = 0;
+
 // Armazena o caminho do diretório de trabalho atual.
 static char current_working_directory[1024];
 
+// Comandos do shell; a ordem segue command_names.
+typedef enum {
+    CMD_UNKNOWN = 0, CMD_LS, CMD_MKDIR, CMD_CD, CMD_WRITE, CMD_CAT, CMD_RM, CMD_RMDIR, CMD_MV, CMD_CP,
+    CMD_APPEND, CMD_TRUNCATE, CMD_DU, CMD_VERBOSE, CMD_COMPRESS, CMD_SYNC, CMD_STATS, CMD_DEFRAG,
+    CMD_DISCARD, CMD_FSTRIM, CMD_SHRINK, CMD_IMPORT, CMD_EXPORT, CMD_SETXATTR, CMD_GETXATTR,
+    CMD_LISTXATTR, CMD_RMXATTR, CMD_LN, CMD_READLINK, CMD_EXIT
+} CommandId;
+
+static const char* const command_names[] = {
+    "", "ls", "mkdir", "cd", "write", "cat", "rm", "rmdir", "mv", "cp",
+    "append", "truncate", "du", "verbose", "compress", "sync", "stats", "defrag",
+    "discard", "fstrim", "shrink", "import", "export", "setxattr", "getxattr",
+    "listxattr", "rmxattr", "ln", "readlink", "exit"
+};
+
+// Tamanho da tabela de despacho (potência de 2); command_hash não tem colisões entre os nomes acima.
+#define COMMAND_TABLE_SIZE 128
+#define MAX_COMMAND_ARGS 3
+
+// Uma linha de comando já separada em palavras.
+typedef struct {
+    CommandId id;
+    const char* name;                    // Nome digitado (para a mensagem de comando desconhecido).
+    int num_args;                        // Número de palavras, incluindo o comando.
+    const char* args[MAX_COMMAND_ARGS];  // Argumentos ("" quando ausentes).
+    const char* rest;                    // Texto do append: o restante da linha após o nome do arquivo.
+    const char* line;                    // Linha original no script mapeado (para o eco).
+    int line_length;
+} ParsedCommand;
+
 void run_shell(FILE* input_stream);
+int run_script(const char* script_path, int quiet);
 void ensure_data_directory_exists();
 void build_full_path(const char* path, char* full_path_buffer);
+void print_stats();
+void append_line(const char* path, const char* text);
+void truncate_file(const char* path, const char* size_text);
+void defrag(const char* option);
+void trim_free_space();
+void shrink_image(const char* spare_text);
+void print_archive_stats(const char* action, const ArchiveStats* stats);
+void print_xattr(const char* path, const char* name);
+int print_xattr_entry(const char* name, const void* value, unsigned int size, void* context);
 
 /*
  * Ponto de entrada principal do programa.
  * input:
  * argc - Número de argumentos da linha de comando.
- * argv - Vetor de strings com os argumentos.
+ * argv - Vetor de strings com os argumentos ([-d imagem] seguido de [-q] [arquivo_de_script] ou --servidor [-b] [socket]).
  * output:
  * 0 em caso de sucesso, 1 em caso de erro.
  */
 int main(int argc, char* argv[]) {
-    if (argc > 2) {
-        fprintf(stderr, "Uso: %s [arquivo_de_script]\n", argv[0]);
+    // "-d imagem" escolhe outra imagem; os demais argumentos vêm depois.
+    const char* image_path = DISK_DEFAULT_PATH;
+    if (argc >= 3 && strcmp(argv[1], "-d") == 0) {
+        image_path = argv[2];
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
+    int server_mode = argc >= 2 && strcmp(argv[1], "--servidor") == 0;
+    int background_defrag = server_mode && argc >= 3 && strcmp(argv[2], "-b") == 0; // Desfragmentação em segundo plano.
+    int quiet_mode = argc >= 2 && strcmp(argv[1], "-q") == 0;
+    const char* script_path = (!server_mode && argc > 1 + quiet_mode) ? argv[1 + quiet_mode] : NULL;
+    if (argc > (server_mode ? 3 + background_defrag : 2 + quiet_mode)) {
+        fprintf(stderr, "Uso: %s [-d imagem] [-q] [arquivo_de_script]\n       %s [-d imagem] --servidor [-b] [socket]\n", argv[0], argv[0]);
         return 1;
     }
 
     ensure_data_directory_exists();
+    disk_set_path(image_path);
 
-    if (access(DISK_PATH, F_OK) != 0) {
+    if (access(image_path, F_OK) != 0) {
         printf("Arquivo de disco nao encontrado. Formatando um novo...\n");
-        fs_format(DISK_SIZE, BLOCK_SIZE);
+        fs_format(DISK_SIZE, BLOCK_SIZE, BYTES_PER_INODE);
         printf("Formatacao concluida.\n\n");
     }
 
@@ -54,25 +119,32 @@ int main(int argc, char* argv[]) {
     
     strcpy(current_working_directory, "/");
 
-    FILE* input_stream = stdin;
-    if (argc == 2) {
-        printf("Executando em Modo em Lote a partir de '%s'...\n", argv[1]);
-        input_stream = fopen(argv[1], "r");
-        if (input_stream == NULL) {
+    if (server_mode) {
+        // As mensagens das operações iriam para stdout a cada pedido; o servidor só registra erros.
+        fflush(stdout);
+        if (!freopen("/dev/null", "w", stdout)) perror("Nao foi possivel redirecionar a saida");
+        int result = server_run(argc == 3 + background_defrag ? argv[2 + background_defrag] : SERVER_SOCKET_PATH, background_defrag);
+        fs_sync();
+        disk_unmount();
+        fs_release_buffers();
+        return result == 0 ? 0 : 1;
+    }
+
+    if (script_path) {
+        printf("Executando em Modo em Lote a partir de '%s'...\n", script_path);
+        if (run_script(script_path, quiet_mode) != 0) {
             perror("Nao foi possivel abrir o arquivo de script");
             disk_unmount();
             return 1;
         }
-    }
-
-    run_shell(input_stream);
-
-    if (input_stream != stdin) {
-        fclose(input_stream);
+    } else {
+        run_shell(stdin);
     }
 
     printf("\n--- Desmontando o Sistema de Arquivos ---\n");
+    fs_sync();
     disk_unmount();
+    fs_release_buffers();
 
     return 0;
 }
@@ -97,103 +169,548 @@ void ensure_data_directory_exists() {
  * output: nenhum (modifica o buffer passado como argumento).
  */
 void build_full_path(const char* path, char* full_path_buffer) {
+    // Os buffers de caminho do shell têm 1024 bytes; caminhos maiores são truncados.
+    int length;
     if (path[0] == '/') {
-        strcpy(full_path_buffer, path);
+        length = snprintf(full_path_buffer, 1024, "%s", path);
     } else {
         if (strcmp(current_working_directory, "/") == 0) {
-            sprintf(full_path_buffer, "/%s", path);
+            length = snprintf(full_path_buffer, 1024, "/%s", path);
         } else {
-            sprintf(full_path_buffer, "%s/%s", current_working_directory, path);
+            length = snprintf(full_path_buffer, 1024, "%s/%s", current_working_directory, path);
         }
     }
+    if (length >= 1024) {
+        fprintf(stderr, "Caminho muito longo: '%s'\n", path);
+    }
+}
+
+/*
+ * Exibe os contadores de E/S do gerenciador de disco.
+ * input: nenhum.
+ * output: nenhum.
+ */
+void print_stats() {
+    DiskStats stats;
+    disk_get_stats(&stats);
+    printf("Leituras de bloco: %lu (%llu bytes)\n", stats.reads, stats.bytes_read);
+    printf("Escritas de bloco: %lu (%llu bytes)\n", stats.writes, stats.bytes_written);
+    printf("Checksums verificados: %lu, erros de checksum: %lu (CRC32C %s)\n",
+           stats.checksums_verified, stats.checksum_errors, crc32c_implementation());
 }
 
 /*
- * Executa o loop principal do shell, lendo e processando comandos.
+ * Acrescenta uma linha de texto ao final de um arquivo (criando-o se necessário).
+ * Só o último bloco do arquivo é lido e reescrito.
  * input:
- * input_stream - O fluxo de entrada de onde os comandos serão lidos (stdin ou um arquivo).
+ * path - O caminho do arquivo.
+ * text - O texto (sem a quebra de linha).
  * output: nenhum.
  */
-void run_shell(FILE* input_stream) {
-    char line_buffer[1024];
-    char command[100];
-    char arg1[512], arg2[512];
+void append_line(const char* path, const char* text) {
+    int fd = fs_fopen(path, FS_O_WRITE | FS_O_CREATE | FS_O_APPEND);
+    if (fd < 0) return;
+    size_t length = strlen(text);
+    char stack_line[256];
+    char* line = length + 1 <= sizeof(stack_line) ? stack_line : (char*) malloc(length + 1);
+    memcpy(line, text, length);
+    line[length] = '\n';
+    if (fs_fwrite(fd, line, length + 1) == (int) (length + 1)) {
+        printf("%zu bytes acrescentados a '%s'.\n", length + 1, path);
+    }
+    if (line != stack_line) free(line);
+    fs_fclose(fd);
+}
 
-    if (input_stream == stdin) {
-        printf("Bem-vindo ao simulador de Sistema de Arquivos!\n");
-        printf("Comandos: ls, mkdir, cd, write, cat, rm, rmdir, mv, verbose, exit\n\n");
+/*
+ * Muda o tamanho de um arquivo (liberando ou acrescentando zeros no final).
+ * input:
+ * path - O caminho do arquivo.
+ * size_text - O novo tamanho em bytes, como texto.
+ * output: nenhum.
+ */
+void truncate_file(const char* path, const char* size_text) {
+    char* end = NULL;
+    unsigned long size = strtoul(size_text, &end, 10);
+    if (end == size_text || *end != '\0') {
+        fprintf(stderr, "truncate: Tamanho invalido '%s'.\n", size_text);
+        return;
     }
+    int fd = fs_fopen(path, FS_O_WRITE);
+    if (fd < 0) return;
+    if (fs_ftruncate(fd, (unsigned int) size) == 0) {
+        printf("'%s' agora tem %lu bytes.\n", path, size);
+    }
+    fs_fclose(fd);
+}
 
-    while (1) {
-        if (input_stream == stdin) {
-            printf("meu_fs:%s$ ", current_working_directory);
-        }
-        
-        if (fgets(line_buffer, sizeof(line_buffer), input_stream) == NULL) {
-            break;
+/*
+ * Desfragmenta o sistema de arquivos e mostra a fragmentação e a vazão de leitura antes e depois.
+ * input:
+ * option - "" (só arquivos fragmentados), "-c" (também compacta dados e i-nodes) ou "-n" (só mede).
+ * output: nenhum.
+ */
+void defrag(const char* option) {
+    int flags;
+    if (option[0] == '\0') flags = 0;
+    else if (strcmp(option, "-c") == 0) flags = FS_DEFRAG_COMPACT;
+    else if (strcmp(option, "-n") == 0) flags = FS_DEFRAG_DRY_RUN;
+    else { fprintf(stderr, "Uso: defrag [-c|-n]\n"); return; }
+
+    FsDefragReport report;
+    int result = fs_defrag(flags, &report);
+    printf("Antes:  %u arquivo(s), %u extent(s), %u fragmentado(s), leitura a %.1f MiB/s\n",
+           report.files, report.extents_before, report.fragmented_before, report.read_mib_per_s_before);
+    if (flags & FS_DEFRAG_DRY_RUN) return;
+    printf("Depois: %u arquivo(s), %u extent(s), %u fragmentado(s), leitura a %.1f MiB/s\n",
+           report.files, report.extents_after, report.fragmented_after, report.read_mib_per_s_after);
+    printf("Movidos: %u arquivo(s) (%u bloco(s)), %u i-node(s).\n", report.files_moved, report.blocks_moved, report.inodes_moved);
+    if (result != 0) fprintf(stderr, "defrag: Erro de leitura ou escrita; a desfragmentacao parou no meio.\n");
+}
+
+/*
+ * Devolve ao sistema hospedeiro o espaço de todos os blocos livres (fstrim).
+ * input: nenhum.
+ * output: nenhum.
+ */
+void trim_free_space() {
+    unsigned long long before = disk_allocated_bytes();
+    unsigned int ranges, blocks;
+    if (fs_trim(&ranges, &blocks) != 0) {
+        fprintf(stderr, "fstrim: O sistema hospedeiro nao suporta o descarte de blocos.\n");
+        return;
+    }
+    printf("%u bloco(s) livre(s) descartado(s) em %u trecho(s).\n", blocks, ranges);
+    printf("Espaco ocupado pela imagem: %llu KiB -> %llu KiB\n", before / 1024, disk_allocated_bytes() / 1024);
+}
+
+/*
+ * Encolhe a imagem até os dados em uso, mais uma folga opcional de blocos livres.
+ * input:
+ * spare_text - Quantidade de blocos livres a manter, em texto.
+ * output: nenhum.
+ */
+void shrink_image(const char* spare_text) {
+    char* end = NULL;
+    unsigned long spare = strtoul(spare_text, &end, 10);
+    if (end == spare_text || *end != '\0' || spare > 0xFFFFFFFFul) {
+        fprintf(stderr, "Uso: shrink [blocos_livres]\n");
+        return;
+    }
+    unsigned long long before = disk_allocated_bytes();
+    unsigned int old_total, new_total;
+    if (fs_shrink((unsigned int) spare, &old_total, &new_total) != 0) {
+        fprintf(stderr, "shrink: Nao foi possivel encolher a imagem.\n");
+        return;
+    }
+    Superblock sb = fs_get_superblock_info();
+    printf("Imagem com %u bloco(s) (antes %u): %llu KiB -> %llu KiB logicos.\n", new_total, old_total,
+           (unsigned long long) old_total * sb.block_size / 1024, (unsigned long long) new_total * sb.block_size / 1024);
+    printf("Espaco ocupado pela imagem: %llu KiB -> %llu KiB\n", before / 1024, disk_allocated_bytes() / 1024);
+}
+
+/*
+ * Mostra os totais de uma importação ou exportação e a vazão obtida.
+ * input:
+ * action - "importado(s)" ou "exportado(s)".
+ * stats - Os totais.
+ * output: nenhum.
+ */
+void print_archive_stats(const char* action, const ArchiveStats* stats) {
+    double mib = stats->bytes / (1024.0 * 1024.0);
+    printf("%u arquivo(s) e %u diretorio(s) %s, %.1f MiB em %.2f s (%.1f MiB/s).\n", stats->files, stats->dirs, action,
+           mib, stats->seconds, stats->seconds > 0 ? mib / stats->seconds : 0);
+    if (stats->skipped > 0) printf("%u entrada(s) ignorada(s).\n", stats->skipped);
+}
+
+/*
+ * Mostra o valor de um atributo estendido.
+ * input:
+ * path - O caminho completo do arquivo.
+ * name - O nome do atributo.
+ * output: nenhum.
+ */
+void print_xattr(const char* path, const char* name) {
+    char value[0x10000];
+    int size = fs_getxattr(path, name, value, sizeof(value));
+    if (size < 0) {
+        fprintf(stderr, "getxattr: Atributo '%s' nao encontrado em '%s'.\n", name, path);
+        return;
+    }
+    printf("%.*s\n", size, value);
+}
+
+/*
+ * Callback de fs_listxattr que mostra um atributo como "nome=valor".
+ * input:
+ * name - O nome do atributo.
+ * value, size - O valor.
+ * context - Não usado.
+ * output: 0, para continuar a listagem.
+ */
+int print_xattr_entry(const char* name, const void* value, unsigned int size, void* context) {
+    (void) context;
+    printf("%s=%.*s\n", name, (int) size, (const char*) value);
+    return 0;
+}
+
+/*
+ * Calcula o índice de um nome de comando na tabela de despacho.
+ * input:
+ * name - O nome do comando (com pelo menos um caractere).
+ * output: O índice na tabela (0 a COMMAND_TABLE_SIZE - 1).
+ */
+static unsigned int command_hash(const char* name) {
+    size_t length = strlen(name);
+    return (unsigned int) (length + 2 * (unsigned char) name[0] + 10 * (unsigned char) name[1] +
+                           15 * (unsigned char) name[length - 1]) & (COMMAND_TABLE_SIZE - 1);
+}
+
+/*
+ * Identifica um comando pelo nome com uma consulta à tabela hash perfeita.
+ * input:
+ * name - O nome digitado.
+ * output: O identificador do comando, ou CMD_UNKNOWN.
+ */
+static CommandId lookup_command(const char* name) {
+    static CommandId table[COMMAND_TABLE_SIZE];
+    static int table_ready = 0;
+    if (!table_ready) {
+        // Os nomes não colidem nesta função hash; uma colisão seria um erro ao adicionar um comando.
+        for (unsigned int i = 1; i < sizeof(command_names) / sizeof(command_names[0]); i++) {
+            table[command_hash(command_names[i])] = (CommandId) i;
         }
-        if (input_stream != stdin) {
-            printf("Executando: %s", line_buffer);
+        table_ready = 1;
+    }
+    CommandId id = table[command_hash(name)];
+    return (id != CMD_UNKNOWN && strcmp(command_names[id], name) == 0) ? id : CMD_UNKNOWN;
+}
+
+/*
+ * Separa uma linha em comando e argumentos, copiando as palavras para um buffer.
+ * O buffer precisa de pelo menos 2 * (tamanho da linha + 1) bytes livres.
+ * input:
+ * line - O início da linha.
+ * end - O fim da linha (exclusivo, sem a quebra de linha).
+ * pool - Ponteiro para a posição livre do buffer; é avançado pelo que foi usado.
+ * parsed - O comando resultante.
+ * output: O número de palavras lidas (no máximo 4), como o retorno de sscanf.
+ */
+static int tokenize_line(const char* line, const char* end, char** pool, ParsedCommand* parsed) {
+    const char* words[4];
+    parsed->num_args = 0;
+    parsed->rest = "";
+    for (int i = 0; i < MAX_COMMAND_ARGS; i++) parsed->args[i] = "";
+
+    const char* cursor = line;
+    while (parsed->num_args < 4) {
+        while (cursor < end && isspace((unsigned char) *cursor)) cursor++;
+        if (cursor == end) break;
+        const char* word_start = cursor;
+        while (cursor < end && !isspace((unsigned char) *cursor)) cursor++;
+        size_t length = (size_t) (cursor - word_start);
+        memcpy(*pool, word_start, length);
+        (*pool)[length] = '\0';
+        words[parsed->num_args++] = *pool;
+        *pool += length + 1;
+        // O texto do append é o restante da linha após o nome do arquivo, com espaços.
+        if (parsed->num_args == 2 && strcmp(words[0], "append") == 0) {
+            const char* rest = cursor;
+            while (rest < end && isspace((unsigned char) *rest)) rest++;
+            memcpy(*pool, rest, (size_t) (end - rest));
+            (*pool)[end - rest] = '\0';
+            parsed->rest = *pool;
+            *pool += (end - rest) + 1;
         }
-        line_buffer[strcspn(line_buffer, "\n")] = 0;
+    }
 
-        arg1[0] = '\0';
-        arg2[0] = '\0';
-        int num_args = sscanf(line_buffer, "%s %s %s", command, arg1, arg2);
+    if (parsed->num_args == 0) return 0;
+    parsed->name = words[0];
+    parsed->id = lookup_command(words[0]);
+    for (int i = 1; i < parsed->num_args; i++) parsed->args[i - 1] = words[i];
+    return parsed->num_args;
+}
 
-        if (num_args <= 0) continue;
+/*
+ * Executa um comando já separado em palavras.
+ * input:
+ * parsed - O comando.
+ * output: 1 se o comando pede para encerrar o shell, 0 caso contrário.
+ */
+static int execute_command(const ParsedCommand* parsed) {
+    int num_args = parsed->num_args;
+    const char* arg1 = parsed->args[0];
+    const char* arg2 = parsed->args[1];
+    const char* arg3 = parsed->args[2];
+    char path[1024];
 
-        if (strcmp(command, "exit") == 0) {
-            break;
-        } else if (strcmp(command, "ls") == 0) {
-            char path[1024];
-            build_full_path(num_args < 2 ? "." : arg1, path);
-            fs_ls(path);
-        } else if (strcmp(command, "mkdir") == 0) {
-            if (num_args < 2) { fprintf(stderr, "mkdir: operando faltando\n"); }
-            else { char path[1024]; build_full_path(arg1, path); fs_mkdir(path); }
-        } else if (strcmp(command, "cd") == 0) {
-            if (num_args < 2) { fprintf(stderr, "cd: operando faltando\n"); }
-            else { 
-                char path[1024]; 
-                build_full_path(arg1, path); 
-                if (fs_check_path_is_dir(path) == 0) {
-                    strcpy(current_working_directory, path);
-                    if (strlen(current_working_directory) > 1 && current_working_directory[strlen(current_working_directory) - 1] == '/') {
-                        current_working_directory[strlen(current_working_directory) - 1] = '\0';
-                    }
+    switch (parsed->id) {
+    case CMD_EXIT:
+        return 1;
+    case CMD_LS: {
+        int long_format = num_args >= 2 && strcmp(arg1, "-l") == 0;
+        build_full_path(num_args < 2 + long_format ? "." : parsed->args[long_format], path);
+        fs_ls(path, long_format);
+        break;
+    }
+    case CMD_MKDIR:
+        if (num_args < 2) { fprintf(stderr, "mkdir: operando faltando\n"); }
+        else { build_full_path(arg1, path); fs_mkdir(path); }
+        break;
+    case CMD_CD:
+        if (num_args < 2) { fprintf(stderr, "cd: operando faltando\n"); }
+        else {
+            build_full_path(arg1, path);
+            if (fs_check_path_is_dir(path) == 0) {
+                strcpy(current_working_directory, path);
+                if (strlen(current_working_directory) > 1 && current_working_directory[strlen(current_working_directory) - 1] == '/') {
+                    current_working_directory[strlen(current_working_directory) - 1] = '\0';
                 }
             }
-        } else if (strcmp(command, "write") == 0) {
-            if (num_args < 3) { fprintf(stderr, "Uso: write <arq_simulado> <arq_real>\n"); }
-            else { char path[1024]; build_full_path(arg1, path); fs_write(path, arg2); }
-        } else if (strcmp(command, "cat") == 0) {
-            if (num_args < 2) { fprintf(stderr, "cat: operando faltando\n"); }
-            else { char path[1024]; build_full_path(arg1, path); fs_cat(path); }
-        } else if (strcmp(command, "rm") == 0) {
-            if (num_args < 2) { fprintf(stderr, "rm: operando faltando\n"); }
-            else { char path[1024]; build_full_path(arg1, path); fs_rm(path); }
-        } else if (strcmp(command, "rmdir") == 0) {
-            if (num_args < 2) { fprintf(stderr, "rmdir: operando faltando\n"); }
-            else { char path[1024]; build_full_path(arg1, path); fs_rmdir(path); }
-        } else if (strcmp(command, "mv") == 0) {
-            if (num_args < 3) { fprintf(stderr, "Uso: mv <origem> <destino>\n"); }
-            else { 
-                char old_p[1024], new_p[1024]; 
-                build_full_path(arg1, old_p);
-                build_full_path(arg2, new_p);
-                fs_mv(old_p, new_p);
-            }
-        } else if (strcmp(command, "verbose") == 0) {
-            if (num_args < 2) { fprintf(stderr, "Uso: verbose <on|off>\n"); }
-            else {
-                if (strcmp(arg1, "on") == 0) { g_verbose_mode = 1; printf("Modo verboso ativado.\n"); }
-                else if (strcmp(arg1, "off") == 0) { g_verbose_mode = 0; printf("Modo verboso desativado.\n"); }
-                else { fprintf(stderr, "Uso: verbose <on|off>\n"); }
-            }
         }
+        break;
+    case CMD_WRITE:
+        if (num_args < 3) { fprintf(stderr, "Uso: write <arq_simulado> <arq_real>\n"); }
+        else { build_full_path(arg1, path); fs_write(path, arg2); }
+        break;
+    case CMD_CAT:
+        if (num_args < 2) { fprintf(stderr, "cat: operando faltando\n"); }
+        else { build_full_path(arg1, path); fs_cat(path); }
+        break;
+    case CMD_RM: {
+        int recursive = num_args >= 2 && strcmp(arg1, "-r") == 0;
+        if (num_args < 2 + recursive) { fprintf(stderr, "rm: operando faltando\n"); }
+        else if (recursive) { build_full_path(arg2, path); fs_rm_recursive(path); }
+        else { build_full_path(arg1, path); fs_rm(path); }
+        break;
+    }
+    case CMD_RMDIR:
+        if (num_args < 2) { fprintf(stderr, "rmdir: operando faltando\n"); }
+        else { build_full_path(arg1, path); fs_rmdir(path); }
+        break;
+    case CMD_MV:
+        if (num_args < 3) { fprintf(stderr, "Uso: mv <origem> <destino>\n"); }
+        else {
+            char new_p[1024];
+            build_full_path(arg1, path);
+            build_full_path(arg2, new_p);
+            fs_mv(path, new_p);
+        }
+        break;
+    case CMD_CP: {
+        int recursive = num_args >= 2 && strcmp(arg1, "-r") == 0;
+        if (num_args < 3 + recursive) { fprintf(stderr, "Uso: cp [-r] <origem> <destino>\n"); }
+        else {
+            char dst_p[1024];
+            build_full_path(recursive ? arg2 : arg1, path);
+            build_full_path(recursive ? arg3 : arg2, dst_p);
+            fs_cp(path, dst_p, recursive);
+        }
+        break;
+    }
+    case CMD_APPEND:
+        if (num_args < 3 || parsed->rest[0] == '\0') { fprintf(stderr, "Uso: append <arquivo> <texto>\n"); }
+        else { build_full_path(arg1, path); append_line(path, parsed->rest); }
+        break;
+    case CMD_TRUNCATE:
+        if (num_args < 3) { fprintf(stderr, "Uso: truncate <arquivo> <tamanho>\n"); }
+        else { build_full_path(arg1, path); truncate_file(path, arg2); }
+        break;
+    case CMD_DU:
+        build_full_path(num_args < 2 ? "." : arg1, path);
+        fs_du(path);
+        break;
+    case CMD_VERBOSE:
+        if (num_args >= 2 && strcmp(arg1, "on") == 0) { g_verbose_mode = 1; printf("Modo verboso ativado.\n"); }
+        else if (num_args >= 2 && strcmp(arg1, "off") == 0) { g_verbose_mode = 0; printf("Modo verboso desativado.\n"); }
+        else { fprintf(stderr, "Uso: verbose <on|off>\n"); }
+        break;
+    case CMD_COMPRESS:
+        if (num_args >= 2 && strcmp(arg1, "on") == 0) { g_compress_mode = 1; printf("Compressao ativada.\n"); }
+        else if (num_args >= 2 && strcmp(arg1, "off") == 0) { g_compress_mode = 0; printf("Compressao desativada.\n"); }
+        else { fprintf(stderr, "Uso: compress <on|off>\n"); }
+        break;
+    case CMD_SYNC:
+        if (fs_sync() == 0) printf("Dados pendentes gravados no disco.\n");
+        break;
+    case CMD_DEFRAG:
+        defrag(num_args >= 2 ? arg1 : "");
+        break;
+    case CMD_DISCARD:
+        if (num_args >= 2 && strcmp(arg1, "on") == 0) { fs_set_online_discard(1); printf("Descarte imediato ativado.\n"); }
+        else if (num_args >= 2 && strcmp(arg1, "off") == 0) { fs_set_online_discard(0); printf("Descarte imediato desativado.\n"); }
+        else { fprintf(stderr, "Uso: discard <on|off>\n"); }
+        break;
+    case CMD_FSTRIM:
+        trim_free_space();
+        break;
+    case CMD_SHRINK:
+        shrink_image(num_args >= 2 ? arg1 : "0");
+        break;
+    case CMD_IMPORT: {
+        ArchiveStats stats;
+        if (num_args < 3) { fprintf(stderr, "Uso: import <dir_real> <dir_simulado>\n"); }
+        else {
+            build_full_path(arg2, path);
+            if (archive_import(arg1, path, &stats) == 0) print_archive_stats("importado(s)", &stats);
+        }
+        break;
+    }
+    case CMD_EXPORT: {
+        ArchiveStats stats;
+        if (num_args < 3) { fprintf(stderr, "Uso: export <dir_simulado> <dir_real|arquivo.tar>\n"); }
+        else {
+            build_full_path(arg1, path);
+            if (archive_export(path, arg2, &stats) == 0) print_archive_stats("exportado(s)", &stats);
+        }
+        break;
+    }
+    case CMD_SETXATTR:
+        if (num_args < 4) { fprintf(stderr, "Uso: setxattr <arquivo> <nome> <valor>\n"); }
+        else {
+            build_full_path(arg1, path);
+            fs_setxattr(path, arg2, arg3, (unsigned int) strlen(arg3));
+        }
+        break;
+    case CMD_GETXATTR:
+        if (num_args < 3) { fprintf(stderr, "Uso: getxattr <arquivo> <nome>\n"); }
+        else {
+            build_full_path(arg1, path);
+            print_xattr(path, arg2);
+        }
+        break;
+    case CMD_LISTXATTR:
+        if (num_args < 2) { fprintf(stderr, "Uso: listxattr <arquivo>\n"); }
+        else {
+            build_full_path(arg1, path);
+            if (fs_listxattr(path, print_xattr_entry, NULL) != 0) fprintf(stderr, "listxattr: '%s' nao encontrado.\n", path);
+        }
+        break;
+    case CMD_RMXATTR:
+        if (num_args < 3) { fprintf(stderr, "Uso: rmxattr <arquivo> <nome>\n"); }
+        else {
+            build_full_path(arg1, path);
+            if (fs_removexattr(path, arg2) != 0) fprintf(stderr, "rmxattr: Atributo '%s' nao encontrado em '%s'.\n", arg2, path);
+        }
+        break;
+    case CMD_LN:
+        if (num_args >= 4 && strcmp(arg1, "-s") == 0) {
+            // O alvo de um link simbólico é guardado como foi digitado (pode ser relativo ao link).
+            build_full_path(arg3, path);
+            fs_symlink(arg2, path);
+        } else if (num_args == 3 && strcmp(arg1, "-s") != 0) {
+            char target_path[1024];
+            build_full_path(arg1, target_path);
+            build_full_path(arg2, path);
+            fs_link(target_path, path);
+        } else {
+            fprintf(stderr, "Uso: ln [-s] <alvo> <link>\n");
+        }
+        break;
+    case CMD_READLINK: {
+        char target[1024];
+        if (num_args < 2) { fprintf(stderr, "Uso: readlink <link>\n"); }
         else {
-            fprintf(stderr, "Comando desconhecido: '%s'\n", command);
+            build_full_path(arg1, path);
+            if (fs_readlink(path, target, sizeof(target)) < 0) fprintf(stderr, "readlink: '%s' nao e um link simbolico.\n", path);
+            else printf("%s\n", target);
         }
+        break;
     }
+    case CMD_STATS:
+        if (num_args >= 2 && strcmp(arg1, "reset") == 0) { disk_reset_stats(); printf("Estatisticas zeradas.\n"); }
+        else { print_stats(); }
+        break;
+    default:
+        fprintf(stderr, "Comando desconhecido: '%s'\n", parsed->name);
+        break;
+    }
+    return 0;
+}
+
+/*
+ * Executa o loop principal do shell interativo, lendo e processando comandos.
+ * input:
+ * input_stream - O fluxo de entrada de onde os comandos serão lidos.
+ * output: nenhum.
+ */
+void run_shell(FILE* input_stream) {
+    char line_buffer[1024];
+    char pool[2 * sizeof(line_buffer)];
+    ParsedCommand parsed;
+
+    printf("Bem-vindo ao simulador de Sistema de Arquivos!\n");
+    printf("Comandos: ls [-l], mkdir, cd, write, cat, rm [-r], rmdir, mv, cp [-r], du, append, truncate, verbose, compress, stats, sync, defrag [-c|-n], discard, fstrim, shrink, import, export, setxattr, getxattr, listxattr, rmxattr, ln [-s], readlink, exit\n\n");
+
+    while (1) {
+        printf("meu_fs:%s$ ", current_working_directory);
+        if (fgets(line_buffer, sizeof(line_buffer), input_stream) == NULL) {
+            break;
+        }
+        char* pool_cursor = pool;
+        if (tokenize_line(line_buffer, line_buffer + strcspn(line_buffer, "\n"), &pool_cursor, &parsed) <= 0) continue;
+        if (execute_command(&parsed)) break;
+    }
+}
+
+/*
+ * Executa um script em lote. O arquivo é mapeado na memória e separado em comandos
+ * numa única passada; depois os comandos são despachados em sequência.
+ * input:
+ * script_path - O caminho do script.
+ * quiet - 1 para não ecoar cada comando ("Executando: ...").
+ * output: 0 em caso de sucesso, -1 se o script não puder ser lido.
+ */
+int run_script(const char* script_path, int quiet) {
+    int fd = open(script_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    size_t size = (size_t) st.st_size;
+    const char* text = "";
+    if (size > 0) {
+        void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        posix_madvise(mapped, size, POSIX_MADV_SEQUENTIAL);
+        text = (const char*) mapped;
+    }
+    close(fd);
+
+    // Cada linha usa no máximo 2 * (tamanho + 1) bytes do buffer de palavras (ver tokenize_line).
+    char* pool = (char*) malloc(2 * size + 2);
+    char* pool_cursor = pool;
+    ParsedCommand* commands = NULL;
+    size_t command_count = 0, command_capacity = 0;
+
+    const char* end = text + size;
+    for (const char* line = text; line < end; ) {
+        const char* line_end = memchr(line, '\n', (size_t) (end - line));
+        if (!line_end) line_end = end;
+        if (command_count == command_capacity) {
+            command_capacity = command_capacity ? command_capacity * 2 : 256;
+            commands = (ParsedCommand*) realloc(commands, command_capacity * sizeof(ParsedCommand));
+        }
+        ParsedCommand* parsed = &commands[command_count];
+        if (tokenize_line(line, line_end, &pool_cursor, parsed) > 0) {
+            parsed->line = line;
+            parsed->line_length = (int) (line_end - line);
+            command_count++;
+        }
+        line = line_end + 1;
+    }
+
+    for (size_t i = 0; i < command_count; i++) {
+        if (!quiet) printf("Executando: %.*s\n", commands[i].line_length, commands[i].line);
+        if (execute_command(&commands[i])) break;
+    }
+
+    free(commands);
+    free(pool);
+    if (size > 0) munmap((void*) text, size);
+    return 0;
 }
@@ -0,0 +1,530 @@
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+#include "filesystem_core.h"
+#include "file_operations.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern int g_verbose_mode;
+
+#define SERVER_MAX_EVENTS 64
+#define SERVER_READ_CHUNK 65536
+// Enquanto um cliente tiver mais que isso esperando para ser enviado, seus pedidos seguintes
+// não são processados (contrapressão para clientes que enviam sem ler as respostas).
+#define SERVER_MAX_PENDING_OUTPUT (4 * 1024 * 1024)
+// Limite dos pedidos recebidos e ainda não processados de um cliente: cabe sempre um pedido
+// completo do maior tamanho. Cheio o buffer (ou com a saída acima do limite), o socket deixa de
+// ser lido e o próprio kernel passa a segurar o cliente.
+#define SERVER_MAX_PENDING_INPUT (2 * PROTOCOL_MAX_PAYLOAD)
+// Com a desfragmentação em segundo plano, um passo roda depois deste tempo sem nenhum evento.
+#define SERVER_IDLE_MS 200
+
+// Estado de uma conexão: bytes recebidos ainda não processados e respostas ainda não enviadas.
+typedef struct {
+    int fd;
+    unsigned char* in;
+    size_t in_length;
+    size_t in_capacity;
+    unsigned char* out;
+    size_t out_length;
+    size_t out_capacity;
+    size_t out_sent;
+    int eof;                       // O cliente fechou o envio; só faltam as respostas.
+    unsigned int registered_events; // Eventos atualmente registrados no epoll.
+} Client;
+
+// Cursor de leitura dos dados de um pedido.
+typedef struct {
+    const unsigned char* data;
+    unsigned int remaining;
+    int ok;
+} PayloadReader;
+
+// Contexto de OP_LIST: a resposta é montada direto no buffer de saída do cliente.
+typedef struct {
+    Client* client;
+} ListContext;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+// --- Protótipos de Funções Auxiliares (Estáticas) ---
+static void handle_stop_signal(int signal_number);
+static int set_nonblocking(int fd);
+static void buffer_reserve(unsigned char** buffer, size_t* capacity, size_t needed);
+static void client_append(Client* client, const void* data, size_t length);
+static void client_free(Client* client);
+static int client_read(Client* client);
+static int client_flush(Client* client);
+static void client_process(Client* client);
+static void update_interest(int epoll_fd, Client* client);
+static void handle_request(Client* client, const RequestHeader* header, const unsigned char* payload);
+static unsigned int read_u32(PayloadReader* reader);
+static unsigned char read_u8(PayloadReader* reader);
+static void read_path(PayloadReader* reader, char* path);
+static int list_callback(const char* name, unsigned int inode_num, const Inode* inode, void* context);
+static void fill_protocol_stat(unsigned int inode_num, const Inode* inode, ProtocolStat* stat);
+
+/*
+ * Executa o servidor: aceita conexões no socket Unix e atende os pedidos com um laço epoll,
+ * mantendo o sistema de arquivos montado entre os pedidos. Retorna ao receber SIGINT ou SIGTERM.
+ * Com 'background_defrag', cada intervalo ocioso dá um passo da desfragmentação (fs_defrag_step)
+ * até uma passada pela tabela de i-nodes terminar; um novo evento de cliente começa outra.
+ * input:
+ * socket_path - O caminho do socket Unix a criar.
+ * background_defrag - 1 para desfragmentar em segundo plano.
+ * output:
+ * 0 em caso de encerramento normal, -1 em caso de erro.
+ */
+int server_run(const char* socket_path, int background_defrag) {
+    struct sockaddr_un address;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "servidor: Caminho do socket muito longo.\n");
+        return -1;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("servidor: socket");
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listen_fd, 64) != 0) {
+        perror("servidor: bind/listen");
+        close(listen_fd);
+        return -1;
+    }
+    set_nonblocking(listen_fd);
+
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL; // NULL identifica o socket de escuta
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "Servidor aguardando conexoes em '%s'.\n", socket_path);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    int defrag_pending = background_defrag;
+    while (!stop_requested) {
+        int count = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, defrag_pending ? SERVER_IDLE_MS : -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("servidor: epoll_wait");
+            break;
+        }
+        if (count == 0) {
+            if (fs_defrag_step() <= 0) defrag_pending = 0;
+            continue;
+        }
+        if (background_defrag) defrag_pending = 1;
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                int client_fd;
+                while ((client_fd = accept(listen_fd, NULL, NULL)) >= 0) {
+                    set_nonblocking(client_fd);
+                    Client* client = (Client*) calloc(1, sizeof(Client));
+                    client->fd = client_fd;
+                    client->registered_events = EPOLLIN;
+                    struct epoll_event client_event;
+                    memset(&client_event, 0, sizeof(client_event));
+                    client_event.events = EPOLLIN;
+                    client_event.data.ptr = client;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &client_event);
+                    if (g_verbose_mode) fprintf(stderr, "   [Verbose] Cliente conectado (fd %d).\n", client_fd);
+                }
+                continue;
+            }
+
+            Client* client = (Client*) events[i].data.ptr;
+            int failed = 0;
+            if (!client->eof && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                if (client_read(client) != 0) client->eof = 1;
+            }
+            // Processa todos os pedidos completos recebidos (vários, com pipelining) e envia as
+            // respostas de uma vez. Com a contrapressão, pedidos podem ficar no buffer até o envio.
+            size_t previous_in_length;
+            do {
+                previous_in_length = client->in_length;
+                client_process(client);
+                if (client_flush(client) != 0) failed = 1;
+            } while (!failed && client->out_length == 0 && client->in_length > 0 && client->in_length != previous_in_length);
+
+            int finished = client->eof && client->out_length == client->out_sent;
+            if (failed || finished) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+                if (g_verbose_mode) fprintf(stderr, "   [Verbose] Cliente desconectado (fd %d).\n", client->fd);
+                client_free(client);
+            } else {
+                update_interest(epoll_fd, client);
+            }
+        }
+    }
+
+    fprintf(stderr, "Servidor encerrando.\n");
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(socket_path);
+    return 0;
+}
+
+
+// --- IMPLEMENTAÇÃO DAS FUNÇÕES AUXILIARES (ESTÁTICAS) ---
+
+/*
+ * Pede o encerramento do laço do servidor (tratador de SIGINT/SIGTERM).
+ * input:
+ * signal_number - O sinal recebido.
+ * output: nenhum.
+ */
+static void handle_stop_signal(int signal_number) {
+    (void) signal_number;
+    stop_requested = 1;
+}
+
+/*
+ * Coloca um descritor em modo não bloqueante.
+ * input:
+ * fd - O descritor.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/*
+ * Garante que um buffer dinâmico comporte 'needed' bytes.
+ * input:
+ * buffer - O buffer (pode ser realocado).
+ * capacity - A capacidade atual (atualizada).
+ * needed - A capacidade mínima.
+ * output: nenhum.
+ */
+static void buffer_reserve(unsigned char** buffer, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) return;
+    size_t new_capacity = *capacity ? *capacity : 4096;
+    while (new_capacity < needed) new_capacity *= 2;
+    *buffer = (unsigned char*) realloc(*buffer, new_capacity);
+    *capacity = new_capacity;
+}
+
+/*
+ * Acrescenta bytes ao buffer de saída de um cliente.
+ * input:
+ * client - O cliente.
+ * data - Os bytes.
+ * length - Quantidade de bytes.
+ * output: nenhum.
+ */
+static void client_append(Client* client, const void* data, size_t length) {
+    buffer_reserve(&client->out, &client->out_capacity, client->out_length + length);
+    memcpy(client->out + client->out_length, data, length);
+    client->out_length += length;
+}
+
+/*
+ * Fecha a conexão e libera o estado de um cliente.
+ * input:
+ * client - O cliente.
+ * output: nenhum.
+ */
+static void client_free(Client* client) {
+    close(client->fd);
+    free(client->in);
+    free(client->out);
+    free(client);
+}
+
+/*
+ * Lê o que estiver disponível no socket de um cliente, até SERVER_MAX_PENDING_INPUT bytes pendentes.
+ * input:
+ * client - O cliente.
+ * output: 0 se a conexão continua aberta, -1 se foi fechada ou falhou.
+ */
+static int client_read(Client* client) {
+    while (client->in_length < SERVER_MAX_PENDING_INPUT) {
+        size_t chunk = SERVER_MAX_PENDING_INPUT - client->in_length;
+        if (chunk > SERVER_READ_CHUNK) chunk = SERVER_READ_CHUNK;
+        buffer_reserve(&client->in, &client->in_capacity, client->in_length + chunk);
+        ssize_t received = read(client->fd, client->in + client->in_length, chunk);
+        if (received > 0) {
+            client->in_length += received;
+            continue;
+        }
+        if (received == 0) return -1;
+        if (errno == EINTR) continue;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    return 0;
+}
+
+/*
+ * Envia o que for possível do buffer de saída de um cliente.
+ * input:
+ * client - O cliente.
+ * output: 0 em caso de sucesso (mesmo que parcial), -1 se a conexão falhou.
+ */
+static int client_flush(Client* client) {
+    while (client->out_sent < client->out_length) {
+        ssize_t sent = write(client->fd, client->out + client->out_sent, client->out_length - client->out_sent);
+        if (sent > 0) {
+            client->out_sent += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return -1;
+    }
+    client->out_length = 0;
+    client->out_sent = 0;
+    return 0;
+}
+
+/*
+ * Atende, em ordem, todos os pedidos completos do buffer de entrada de um cliente.
+ * input:
+ * client - O cliente.
+ * output: nenhum.
+ */
+static void client_process(Client* client) {
+    size_t position = 0;
+    while (client->in_length - position >= sizeof(RequestHeader) &&
+           client->out_length - client->out_sent < SERVER_MAX_PENDING_OUTPUT) {
+        RequestHeader header;
+        memcpy(&header, client->in + position, sizeof(RequestHeader));
+        if (header.length > PROTOCOL_MAX_PAYLOAD) {
+            // Pedido inválido: responde com erro e descarta o restante do buffer.
+            ResponseHeader response = { 0, header.request_id, -1 };
+            client_append(client, &response, sizeof(response));
+            position = client->in_length;
+            break;
+        }
+        if (client->in_length - position < sizeof(RequestHeader) + header.length) break;
+
+        handle_request(client, &header, client->in + position + sizeof(RequestHeader));
+        position += sizeof(RequestHeader) + header.length;
+    }
+
+    memmove(client->in, client->in + position, client->in_length - position);
+    client->in_length -= position;
+}
+
+/*
+ * Registra no epoll o interesse em leitura (até o cliente fechar o envio, e só enquanto os
+ * buffers de entrada e de saída estiverem abaixo dos limites) e em escrita (somente quando há
+ * respostas pendentes).
+ * input:
+ * epoll_fd - O descritor do epoll.
+ * client - O cliente.
+ * output: nenhum.
+ */
+static void update_interest(int epoll_fd, Client* client) {
+    int readable = !client->eof && client->in_length < SERVER_MAX_PENDING_INPUT &&
+                   client->out_length - client->out_sent < SERVER_MAX_PENDING_OUTPUT;
+    unsigned int wanted = (readable ? EPOLLIN : 0) | (client->out_sent < client->out_length ? EPOLLOUT : 0);
+    if (wanted == client->registered_events) return;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = wanted;
+    event.data.ptr = client;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+    client->registered_events = wanted;
+}
+
+/*
+ * Executa um pedido e acrescenta a resposta ao buffer de saída do cliente.
+ * input:
+ * client - O cliente.
+ * header - O cabeçalho do pedido.
+ * payload - Os dados do pedido (header->length bytes).
+ * output: nenhum.
+ */
+static void handle_request(Client* client, const RequestHeader* header, const unsigned char* payload) {
+    PayloadReader reader = { payload, header->length, 1 };
+    char path[1024], second_path[1024];
+    ResponseHeader response = { 0, header->request_id, 0 };
+
+    // O cabeçalho da resposta é reservado agora e preenchido quando o tamanho dos dados for conhecido.
+    size_t header_position = client->out_length;
+    client_append(client, &response, sizeof(response));
+
+    if (header->opcode != OP_SYNC) read_path(&reader, path);
+    switch (header->opcode) {
+        case OP_STAT: {
+            Inode inode;
+            int inode_num = reader.ok ? fs_stat(path, &inode) : -1;
+            if (inode_num < 0) { response.status = -1; break; }
+            ProtocolStat stat;
+            fill_protocol_stat(inode_num, &inode, &stat);
+            client_append(client, &stat, sizeof(stat));
+            break;
+        }
+        case OP_LIST: {
+            ListContext context = { client };
+            if (!reader.ok || fs_list_dir(path, list_callback, &context) != 0) response.status = -1;
+            break;
+        }
+        case OP_READ: {
+            unsigned int offset = read_u32(&reader);
+            unsigned int count = read_u32(&reader);
+            if (count > PROTOCOL_MAX_PAYLOAD) count = PROTOCOL_MAX_PAYLOAD;
+            int fd = reader.ok ? fs_fopen(path, FS_O_READ) : -1;
+            if (fd < 0) { response.status = -1; break; }
+            buffer_reserve(&client->out, &client->out_capacity, client->out_length + count);
+            int bytes_read = fs_fseek(fd, offset, FS_SEEK_SET) < 0 ? -1 : fs_fread(fd, client->out + client->out_length, count);
+            fs_fclose(fd);
+            if (bytes_read < 0) response.status = -1;
+            else client->out_length += bytes_read;
+            break;
+        }
+        case OP_WRITE: {
+            unsigned char flags = read_u8(&reader);
+            unsigned int offset = read_u32(&reader);
+            int open_flags = FS_O_WRITE | FS_O_CREATE | ((flags & OP_WRITE_TRUNCATE) ? FS_O_TRUNC : 0);
+            int fd = reader.ok ? fs_fopen(path, open_flags) : -1;
+            if (fd < 0) { response.status = -1; break; }
+            int written = fs_fseek(fd, offset, FS_SEEK_SET) < 0 ? -1 : fs_fwrite(fd, reader.data, reader.remaining);
+            fs_fclose(fd);
+            if (written < 0) { response.status = -1; break; }
+            unsigned int written_count = written;
+            client_append(client, &written_count, sizeof(written_count));
+            break;
+        }
+        case OP_TRUNCATE: {
+            unsigned int size = read_u32(&reader);
+            int fd = reader.ok ? fs_fopen(path, FS_O_WRITE) : -1;
+            if (fd < 0 || fs_ftruncate(fd, size) != 0) response.status = -1;
+            if (fd >= 0) fs_fclose(fd);
+            break;
+        }
+        case OP_MKDIR:
+            response.status = reader.ok && fs_mkdir(path) == 0 ? 0 : -1;
+            break;
+        case OP_RM: {
+            unsigned char flags = read_u8(&reader);
+            if (!reader.ok) response.status = -1;
+            else response.status = ((flags & OP_RM_RECURSIVE) ? fs_rm_recursive(path) : fs_rm(path)) == 0 ? 0 : -1;
+            break;
+        }
+        case OP_RMDIR:
+            response.status = reader.ok && fs_rmdir(path) == 0 ? 0 : -1;
+            break;
+        case OP_MV:
+            read_path(&reader, second_path);
+            response.status = reader.ok && fs_mv(path, second_path) == 0 ? 0 : -1;
+            break;
+        case OP_SYNC:
+            response.status = fs_sync() == 0 ? 0 : -1;
+            break;
+        default:
+            response.status = -1;
+            break;
+    }
+
+    // Em caso de erro, descarta qualquer dado parcial acrescentado depois do cabeçalho.
+    if (response.status != 0) client->out_length = header_position + sizeof(response);
+    response.length = client->out_length - header_position - sizeof(response);
+    memcpy(client->out + header_position, &response, sizeof(response));
+}
+
+/*
+ * Lê um unsigned int dos dados do pedido.
+ * input:
+ * reader - O cursor (marcado como inválido se os dados acabarem).
+ * output: O valor lido, ou 0.
+ */
+static unsigned int read_u32(PayloadReader* reader) {
+    unsigned int value = 0;
+    if (reader->remaining < sizeof(value)) { reader->ok = 0; return 0; }
+    memcpy(&value, reader->data, sizeof(value));
+    reader->data += sizeof(value);
+    reader->remaining -= sizeof(value);
+    return value;
+}
+
+/*
+ * Lê um byte dos dados do pedido.
+ * input:
+ * reader - O cursor (marcado como inválido se os dados acabarem).
+ * output: O valor lido, ou 0.
+ */
+static unsigned char read_u8(PayloadReader* reader) {
+    if (reader->remaining < 1) { reader->ok = 0; return 0; }
+    reader->remaining--;
+    return *reader->data++;
+}
+
+/*
+ * Lê um caminho (unsigned short com o tamanho, seguido dos bytes) dos dados do pedido.
+ * input:
+ * reader - O cursor (marcado como inválido se os dados acabarem ou o caminho for longo demais).
+ * path - Buffer de 1024 bytes que recebe o caminho terminado em '\0'.
+ * output: nenhum.
+ */
+static void read_path(PayloadReader* reader, char* path) {
+    unsigned short length = 0;
+    path[0] = '\0';
+    if (reader->remaining < sizeof(length)) { reader->ok = 0; return; }
+    memcpy(&length, reader->data, sizeof(length));
+    if (length >= 1024 || reader->remaining - sizeof(length) < length) { reader->ok = 0; return; }
+    memcpy(path, reader->data + sizeof(length), length);
+    path[length] = '\0';
+    reader->data += sizeof(length) + length;
+    reader->remaining -= sizeof(length) + length;
+    if (path[0] != '/') reader->ok = 0; // O servidor não tem diretório atual: só caminhos absolutos.
+}
+
+/*
+ * Acrescenta uma entrada de diretório à resposta de OP_LIST.
+ * input:
+ * name, inode_num, inode - A entrada.
+ * context - O ListContext.
+ * output: 0 (continua a listagem).
+ */
+static int list_callback(const char* name, unsigned int inode_num, const Inode* inode, void* context) {
+    ListContext* list = (ListContext*) context;
+    ProtocolStat stat;
+    fill_protocol_stat(inode_num, inode, &stat);
+    unsigned char length = (unsigned char) strlen(name);
+    client_append(list->client, &stat, sizeof(stat));
+    client_append(list->client, &length, 1);
+    client_append(list->client, name, length);
+    return 0;
+}
+
+/*
+ * Converte um i-node para o formato de atributos do protocolo.
+ * input:
+ * inode_num - O número do i-node.
+ * inode - O i-node.
+ * stat - A estrutura a preencher.
+ * output: nenhum.
+ */
+static void fill_protocol_stat(unsigned int inode_num, const Inode* inode, ProtocolStat* stat) {
+    memset(stat, 0, sizeof(ProtocolStat));
+    stat->inode_num = inode_num;
+    stat->mode = inode->mode;
+    stat->link_count = inode->link_count;
+    stat->size_in_bytes = inode->size_in_bytes;
+    stat->modification_time = (long long) inode->modification_time;
+}
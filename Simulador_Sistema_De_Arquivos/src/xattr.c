@@ -0,0 +1,354 @@
+#include "xattr.h"
+#include "filesystem_core.h"
+#include "file_operations.h"
+#include "gerenciador_de_disco.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Um i-node com as suas áreas de atributos carregadas.
+typedef struct {
+    int inode_num;
+    Inode inode;
+    unsigned char inline_area[FS_INODE_INLINE_XATTR_SIZE];
+    unsigned int inline_capacity;
+    unsigned char* block;          // Conteúdo do bloco de atributos (NULL se não foi lido ou não existe).
+    unsigned int block_capacity;   // Bytes de entradas no bloco (sem o número mágico).
+} XattrTarget;
+
+// --- Protótipos de Funções Auxiliares (Estáticas) ---
+static int load_target(const char* path, XattrTarget* target);
+static int load_block(XattrTarget* target);
+static void release_target(XattrTarget* target);
+static int store_target(XattrTarget* target, int block_changed);
+static unsigned char* block_entries(const XattrTarget* target);
+static unsigned char* area_find(unsigned char* area, unsigned int capacity, const char* name, size_t name_length, XattrEntryHeader* header);
+static unsigned int area_used(const unsigned char* area, unsigned int capacity);
+static int area_remove(unsigned char* area, unsigned int capacity, const char* name, size_t name_length);
+static int area_append(unsigned char* area, unsigned int capacity, const char* name, size_t name_length, const void* value, unsigned int size);
+
+
+/*
+ * Define (cria ou substitui) um atributo estendido. O atributo fica no slot do i-node se couber
+ * e, senão, no bloco de atributos do i-node, alocado na primeira vez.
+ * input:
+ * path - O caminho do arquivo ou diretório.
+ * name - O nome do atributo (de 1 a XATTR_NAME_MAX bytes).
+ * value - O valor.
+ * size - O tamanho do valor em bytes.
+ * output:
+ * 0 em caso de sucesso, -1 em caso de erro (nada é alterado).
+ */
+int fs_setxattr(const char* path, const char* name, const void* value, unsigned int size) {
+    size_t name_length = strlen(name);
+    Superblock sb = fs_get_superblock_info();
+    if (sb.inode_version == FS_INODE_VERSION_LEGACY) {
+        fprintf(stderr, "setxattr: O formato desta imagem nao suporta atributos estendidos.\n");
+        return -1;
+    }
+    if (name_length == 0 || name_length > XATTR_NAME_MAX ||
+        sizeof(unsigned int) + sizeof(XattrEntryHeader) + name_length + size > sb.block_size || size > 0xFFFF) {
+        fprintf(stderr, "setxattr: Nome ou valor grande demais para '%s'.\n", name);
+        return -1;
+    }
+
+    XattrTarget target;
+    if (load_target(path, &target) != 0) {
+        fprintf(stderr, "setxattr: '%s' nao encontrado.\n", path);
+        return -1;
+    }
+    if (target.inode.xattr_block != 0 && load_block(&target) != 0) {
+        release_target(&target);
+        return -1;
+    }
+
+    area_remove(target.inline_area, target.inline_capacity, name, name_length);
+    int block_changed = target.block && area_remove(block_entries(&target), target.block_capacity, name, name_length);
+    if (area_append(target.inline_area, target.inline_capacity, name, name_length, value, size) != 0) {
+        int new_block = 0;
+        if (!target.block) {
+            int block_num = fs_alloc_block();
+            if (block_num < 0) {
+                fprintf(stderr, "setxattr: Nao ha espaco livre no disco.\n");
+                release_target(&target);
+                return -1;
+            }
+            target.block = (unsigned char*) fs_get_block_buffer();
+            memset(target.block, 0, sb.block_size);
+            unsigned int magic = XATTR_BLOCK_MAGIC;
+            memcpy(target.block, &magic, sizeof(magic));
+            target.block_capacity = sb.block_size - sizeof(magic);
+            target.inode.xattr_block = (unsigned int) block_num;
+            new_block = 1;
+        }
+        if (area_append(block_entries(&target), target.block_capacity, name, name_length, value, size) != 0) {
+            fprintf(stderr, "setxattr: Nao ha espaco para mais atributos em '%s'.\n", path);
+            if (new_block) fs_free_block(target.inode.xattr_block);
+            release_target(&target);
+            return -1;
+        }
+        block_changed = 1;
+    }
+
+    int result = store_target(&target, block_changed);
+    release_target(&target);
+    return result;
+}
+
+/*
+ * Lê o valor de um atributo estendido. Além da leitura do i-node, só lê o bloco de atributos
+ * se o atributo não estiver no slot.
+ * input:
+ * path - O caminho do arquivo ou diretório.
+ * name - O nome do atributo.
+ * value - Recebe até 'capacity' bytes do valor (pode ser NULL com 'capacity' 0, para saber o tamanho).
+ * capacity - O tamanho do buffer.
+ * output:
+ * O tamanho do valor em bytes, ou -1 se o caminho ou o atributo não existirem.
+ */
+int fs_getxattr(const char* path, const char* name, void* value, unsigned int capacity) {
+    XattrTarget target;
+    if (load_target(path, &target) != 0) return -1;
+
+    size_t name_length = strlen(name);
+    XattrEntryHeader header;
+    unsigned char* entry = area_find(target.inline_area, target.inline_capacity, name, name_length, &header);
+    if (!entry && target.inode.xattr_block != 0 && load_block(&target) == 0) {
+        entry = area_find(block_entries(&target), target.block_capacity, name, name_length, &header);
+    }
+    int result = -1;
+    if (entry) {
+        unsigned int copy = header.value_length < capacity ? header.value_length : capacity;
+        if (copy > 0) memcpy(value, entry + sizeof(XattrEntryHeader) + header.name_length, copy);
+        result = header.value_length;
+    }
+    release_target(&target);
+    return result;
+}
+
+/*
+ * Chama 'callback' para cada atributo estendido de um arquivo ou diretório (primeiro os do
+ * slot do i-node, depois os do bloco).
+ * input:
+ * path - O caminho do arquivo ou diretório.
+ * callback - Recebe o nome (terminado em '\0'), o valor e o tamanho; se retornar diferente de 0, a listagem para.
+ * context - Ponteiro repassado ao callback.
+ * output:
+ * 0 em caso de sucesso, -1 se o caminho não existir ou o bloco de atributos não puder ser lido.
+ */
+int fs_listxattr(const char* path, int (*callback)(const char* name, const void* value, unsigned int size, void* context), void* context) {
+    XattrTarget target;
+    if (load_target(path, &target) != 0) return -1;
+    if (target.inode.xattr_block != 0 && load_block(&target) != 0) {
+        release_target(&target);
+        return -1;
+    }
+
+    unsigned char* areas[2] = { target.inline_area, target.block ? block_entries(&target) : NULL };
+    unsigned int capacities[2] = { target.inline_capacity, target.block ? target.block_capacity : 0 };
+    int stop = 0;
+    for (int a = 0; a < 2 && !stop; a++) {
+        unsigned int offset = 0, end = area_used(areas[a], capacities[a]);
+        while (offset < end && !stop) {
+            XattrEntryHeader header;
+            memcpy(&header, areas[a] + offset, sizeof(header));
+            char name[XATTR_NAME_MAX + 1];
+            memcpy(name, areas[a] + offset + sizeof(header), header.name_length);
+            name[header.name_length] = '\0';
+            stop = callback(name, areas[a] + offset + sizeof(header) + header.name_length, header.value_length, context) != 0;
+            offset += sizeof(header) + header.name_length + header.value_length;
+        }
+    }
+    release_target(&target);
+    return 0;
+}
+
+/*
+ * Remove um atributo estendido. O bloco de atributos é liberado quando fica vazio.
+ * input:
+ * path - O caminho do arquivo ou diretório.
+ * name - O nome do atributo.
+ * output:
+ * 0 em caso de sucesso, -1 se o caminho ou o atributo não existirem.
+ */
+int fs_removexattr(const char* path, const char* name) {
+    XattrTarget target;
+    if (load_target(path, &target) != 0) return -1;
+
+    size_t name_length = strlen(name);
+    int result = -1;
+    if (area_remove(target.inline_area, target.inline_capacity, name, name_length)) {
+        result = store_target(&target, 0);
+    } else if (target.inode.xattr_block != 0 && load_block(&target) == 0 &&
+               area_remove(block_entries(&target), target.block_capacity, name, name_length)) {
+        result = store_target(&target, 1);
+    }
+    release_target(&target);
+    return result;
+}
+
+
+// --- IMPLEMENTAÇÃO DAS FUNÇÕES AUXILIARES (ESTÁTICAS) ---
+
+/*
+ * Localiza um caminho e lê o seu i-node junto com a área de atributos do slot.
+ * input:
+ * path - O caminho.
+ * target - Recebe o i-node e a área (o bloco não é lido).
+ * output: 0 em caso de sucesso, -1 se o caminho não existir.
+ */
+static int load_target(const char* path, XattrTarget* target) {
+    target->block = NULL;
+    target->block_capacity = 0;
+    target->inode_num = fs_lookup(path);
+    if (target->inode_num < 0) return -1;
+    target->inline_capacity = fs_read_inode_inline((unsigned int) target->inode_num, &target->inode, target->inline_area);
+    return 0;
+}
+
+/*
+ * Lê o bloco de atributos do i-node (que precisa existir).
+ * input:
+ * target - O i-node carregado por load_target.
+ * output: 0 em caso de sucesso, -1 se a leitura falhar ou o bloco não for de atributos.
+ */
+static int load_block(XattrTarget* target) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned int magic = 0;
+    target->block = (unsigned char*) fs_get_block_buffer();
+    if (target->inode.xattr_block < sb.data_blocks_start_block || target->inode.xattr_block >= sb.total_blocks ||
+        disk_read_block(target->inode.xattr_block, target->block) != 0 ||
+        (memcpy(&magic, target->block, sizeof(magic)), magic != XATTR_BLOCK_MAGIC)) {
+        fprintf(stderr, "xattr: Bloco de atributos %u do i-node %d invalido.\n", target->inode.xattr_block, target->inode_num);
+        fs_put_block_buffer(target->block);
+        target->block = NULL;
+        return -1;
+    }
+    target->block_capacity = sb.block_size - sizeof(magic);
+    return 0;
+}
+
+/*
+ * Devolve o buffer do bloco de atributos, se houver.
+ * input:
+ * target - O i-node carregado.
+ * output: nenhum.
+ */
+static void release_target(XattrTarget* target) {
+    if (target->block) fs_put_block_buffer(target->block);
+    target->block = NULL;
+}
+
+/*
+ * Grava as áreas alteradas: primeiro o bloco, depois o i-node com o slot. Um bloco que ficou
+ * vazio é desligado do i-node e só então liberado.
+ * input:
+ * target - O i-node com as áreas já alteradas.
+ * block_changed - 1 se o bloco foi alterado.
+ * output: 0 em caso de sucesso, -1 se a gravação do bloco falhar.
+ */
+static int store_target(XattrTarget* target, int block_changed) {
+    unsigned int freed_block = 0;
+    if (target->block && block_changed) {
+        if (area_used(block_entries(target), target->block_capacity) == 0) {
+            freed_block = target->inode.xattr_block;
+            target->inode.xattr_block = 0;
+        } else if (disk_write_block(target->inode.xattr_block, target->block) != 0) {
+            return -1;
+        }
+    }
+
+    if (area_used(target->inline_area, target->inline_capacity) > 0) target->inode.flags |= INODE_FLAG_INLINE_XATTR;
+    else target->inode.flags &= ~INODE_FLAG_INLINE_XATTR;
+    fs_write_inode_inline((unsigned int) target->inode_num, &target->inode, target->inline_area);
+    if (freed_block != 0) fs_free_block(freed_block);
+    return 0;
+}
+
+/*
+ * Retorna o início das entradas no bloco de atributos (depois do número mágico).
+ * input:
+ * target - O i-node com o bloco carregado.
+ * output: Ponteiro para as entradas.
+ */
+static unsigned char* block_entries(const XattrTarget* target) {
+    return target->block + sizeof(unsigned int);
+}
+
+/*
+ * Procura um atributo em uma área.
+ * input:
+ * area, capacity - A área e o seu tamanho.
+ * name, name_length - O nome procurado.
+ * header - Recebe o cabeçalho da entrada encontrada.
+ * output: Ponteiro para a entrada (no cabeçalho), ou NULL se não houver.
+ */
+static unsigned char* area_find(unsigned char* area, unsigned int capacity, const char* name, size_t name_length, XattrEntryHeader* header) {
+    unsigned int offset = 0, end = area_used(area, capacity);
+    while (offset < end) {
+        memcpy(header, area + offset, sizeof(XattrEntryHeader));
+        if (header->name_length == name_length && memcmp(area + offset + sizeof(XattrEntryHeader), name, name_length) == 0) {
+            return area + offset;
+        }
+        offset += sizeof(XattrEntryHeader) + header->name_length + header->value_length;
+    }
+    return NULL;
+}
+
+/*
+ * Calcula quantos bytes de uma área estão ocupados por entradas válidas. Uma entrada que
+ * ultrapassaria o fim da área encerra a contagem.
+ * input:
+ * area, capacity - A área e o seu tamanho.
+ * output: O fim da última entrada.
+ */
+static unsigned int area_used(const unsigned char* area, unsigned int capacity) {
+    unsigned int offset = 0;
+    while (offset + sizeof(XattrEntryHeader) <= capacity) {
+        XattrEntryHeader header;
+        memcpy(&header, area + offset, sizeof(header));
+        unsigned int length = sizeof(header) + header.name_length + header.value_length;
+        if (header.name_length == 0 || offset + length > capacity) break;
+        offset += length;
+    }
+    return offset;
+}
+
+/*
+ * Remove um atributo de uma área, aproximando as entradas seguintes e zerando o fim.
+ * input:
+ * area, capacity - A área e o seu tamanho.
+ * name, name_length - O nome do atributo.
+ * output: 1 se o atributo foi removido, 0 se não estava na área.
+ */
+static int area_remove(unsigned char* area, unsigned int capacity, const char* name, size_t name_length) {
+    XattrEntryHeader header;
+    unsigned char* entry = area_find(area, capacity, name, name_length, &header);
+    if (!entry) return 0;
+    unsigned int end = area_used(area, capacity);
+    unsigned int length = sizeof(header) + header.name_length + header.value_length;
+    unsigned int after = end - (unsigned int) (entry - area) - length;
+    memmove(entry, entry + length, after);
+    memset(area + end - length, 0, length);
+    return 1;
+}
+
+/*
+ * Acrescenta um atributo ao fim de uma área.
+ * input:
+ * area, capacity - A área e o seu tamanho.
+ * name, name_length - O nome do atributo.
+ * value, size - O valor.
+ * output: 0 em caso de sucesso, -1 se não couber.
+ */
+static int area_append(unsigned char* area, unsigned int capacity, const char* name, size_t name_length, const void* value, unsigned int size) {
+    unsigned int end = area_used(area, capacity);
+    size_t length = sizeof(XattrEntryHeader) + name_length + size;
+    if (capacity == 0 || end + length > capacity) return -1;
+
+    XattrEntryHeader header = { (unsigned char) name_length, 0, (unsigned short) size };
+    memcpy(area + end, &header, sizeof(header));
+    memcpy(area + end + sizeof(header), name, name_length);
+    if (size > 0) memcpy(area + end + sizeof(header) + name_length, value, size);
+    return 0;
+}
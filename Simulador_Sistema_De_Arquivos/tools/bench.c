@@ -0,0 +1,279 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "filesystem_core.h"
+#include "file_operations.h"
+#include "gerenciador_de_disco.h"
+#include "crc32c.h"
+#include "fs_context.h"
+
+#define BENCH_DISK_PATH "dados/bench.disk"
+#define BENCH_INPUT_PATH "dados/bench_entrada.txt"
+#define BENCH_DISK_SIZE (10 * 1024 * 1024)
+#define BENCH_BLOCK_SIZE 4096
+#define BENCH_BYTES_PER_INODE (16 * 1024)
+#define BENCH_MAX_FILE_SIZE (40 * 1024)
+#define BENCH_FILE_COUNT 50
+#define BENCH_CRC_ROUNDS 16384
+#define BENCH_MAX_JOBS 16
+
+int g_verbose_mode = 0;
+int g_compress_mode = 0;
+
+// Saída real do benchmark; stdout é redirecionado para /dev/null durante as medições.
+static FILE* report = NULL;
+
+// Geometria da rodada: o arquivo de teste precisa caber nos 12 blocos diretos do i-node.
+static unsigned int block_size = BENCH_BLOCK_SIZE;
+static unsigned int file_size = BENCH_MAX_FILE_SIZE;
+
+// Uma imagem da rodada paralela: cada thread usa o próprio contexto de sistema de arquivos.
+typedef struct {
+    pthread_t thread;
+    int index;
+    int ok;
+    double write_time;
+    double read_time;
+} ParallelJob;
+
+/*
+ * Retorna o tempo monotônico atual em segundos.
+ * input: nenhum.
+ * output: O tempo em segundos.
+ */
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Gera um arquivo de texto sintético (palavras repetidas em ordem pseudoaleatória).
+ * input:
+ * path - O caminho do arquivo a ser criado no sistema hospedeiro.
+ * size - O tamanho do arquivo em bytes.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int generate_text_file(const char* path, long size) {
+    static const char* words[] = {
+        "sistema", "arquivo", "bloco", "diretorio", "inode", "disco", "dados", "leitura",
+        "escrita", "superbloco", "bitmap", "tabela", "caminho", "montagem", "processo", "memoria"
+    };
+    FILE* file = fopen(path, "wb");
+    if (!file) return -1;
+
+    unsigned int seed = 12345;
+    long written = 0;
+    while (written < size) {
+        seed = seed * 1103515245u + 12345u;
+        const char* word = words[(seed >> 16) % 16];
+        long len = (long) strlen(word);
+        if (written + len + 1 > size) len = size - written - 1;
+        if (len > 0) fwrite(word, 1, len, file);
+        fputc(((seed >> 8) % 12 == 0) ? '\n' : ' ', file);
+        written += len + 1;
+    }
+    fclose(file);
+    return 0;
+}
+
+/*
+ * Executa uma rodada de escrita e leitura de BENCH_FILE_COUNT arquivos e imprime os resultados.
+ * input:
+ * compress - 1 para gravar com compressão, 0 sem.
+ * output: nenhum.
+ */
+static void run_round(int compress) {
+    char path[64];
+    DiskStats write_stats, read_stats;
+    double total_mb = (double) file_size * BENCH_FILE_COUNT / (1024.0 * 1024.0);
+
+    g_compress_mode = compress;
+
+    disk_reset_stats();
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_FILE_COUNT; i++) {
+        sprintf(path, "/arquivo_%d", i);
+        fs_write(path, BENCH_INPUT_PATH);
+    }
+    fs_sync();
+    double write_time = now_seconds() - start;
+    disk_get_stats(&write_stats);
+
+    disk_reset_stats();
+    start = now_seconds();
+    for (int i = 0; i < BENCH_FILE_COUNT; i++) {
+        sprintf(path, "/arquivo_%d", i);
+        fs_cat(path);
+    }
+    fflush(stdout);
+    double read_time = now_seconds() - start;
+    disk_get_stats(&read_stats);
+
+    for (int i = 0; i < BENCH_FILE_COUNT; i++) {
+        sprintf(path, "/arquivo_%d", i);
+        fs_rm(path);
+    }
+
+    fprintf(report, "%-12s %10.1f %10.1f %14lu %16llu\n", compress ? "comprimido" : "normal",
+            total_mb / write_time, total_mb / read_time, write_stats.writes, write_stats.bytes_written);
+}
+
+/*
+ * Thread da rodada paralela: formata e monta a própria imagem, grava, lê e remove
+ * BENCH_FILE_COUNT arquivos sem compressão e desmonta.
+ * input:
+ * arg - O ParallelJob da thread.
+ * output: NULL.
+ */
+static void* parallel_job(void* arg) {
+    ParallelJob* job = (ParallelJob*) arg;
+    char path[64];
+    snprintf(path, sizeof(path), "dados/bench_%d.disk", job->index);
+
+    FsContext* context = fs_context_create(path);
+    if (!context) return NULL;
+    fs_context_select(context);
+    if (fs_format(BENCH_DISK_SIZE, block_size, BENCH_BYTES_PER_INODE) == 0 && fs_mount() == 0) {
+        double start = now_seconds();
+        for (int i = 0; i < BENCH_FILE_COUNT; i++) {
+            snprintf(path, sizeof(path), "/arquivo_%d", i);
+            fs_write(path, BENCH_INPUT_PATH);
+        }
+        fs_sync();
+        job->write_time = now_seconds() - start;
+
+        start = now_seconds();
+        for (int i = 0; i < BENCH_FILE_COUNT; i++) {
+            snprintf(path, sizeof(path), "/arquivo_%d", i);
+            fs_cat(path);
+        }
+        job->read_time = now_seconds() - start;
+        job->ok = 1;
+    }
+    fs_context_destroy(context);
+    snprintf(path, sizeof(path), "dados/bench_%d.disk", job->index);
+    remove(path);
+    return NULL;
+}
+
+/*
+ * Roda a carga sem compressão em 'jobs' imagens ao mesmo tempo, uma thread por imagem,
+ * e imprime a vazão somada.
+ * input:
+ * jobs - Quantidade de imagens (e de threads).
+ * output: nenhum.
+ */
+static void run_parallel_round(int jobs) {
+    ParallelJob job_list[BENCH_MAX_JOBS];
+    g_compress_mode = 0;
+    for (int j = 0; j < jobs; j++) {
+        memset(&job_list[j], 0, sizeof(ParallelJob));
+        job_list[j].index = j;
+        if (pthread_create(&job_list[j].thread, NULL, parallel_job, &job_list[j]) != 0) jobs = j;
+    }
+
+    double write_time = 0, read_time = 0;
+    int ok = 1;
+    for (int j = 0; j < jobs; j++) {
+        pthread_join(job_list[j].thread, NULL);
+        if (!job_list[j].ok) ok = 0;
+        if (job_list[j].write_time > write_time) write_time = job_list[j].write_time;
+        if (job_list[j].read_time > read_time) read_time = job_list[j].read_time;
+    }
+    if (!ok || jobs == 0) {
+        fprintf(report, "Rodada paralela: nao foi possivel montar as imagens.\n");
+        return;
+    }
+
+    char label[32];
+    snprintf(label, sizeof(label), "%d imagens", jobs);
+    double total_mb = (double) file_size * BENCH_FILE_COUNT * jobs / (1024.0 * 1024.0);
+    fprintf(report, "%-12s %10.1f %10.1f\n", label, total_mb / write_time, total_mb / read_time);
+}
+
+/*
+ * Mede o custo do CRC32C por bloco, pago em cada disk_read_block e disk_write_block.
+ * input: nenhum.
+ * output: nenhum.
+ */
+static void run_checksum_round() {
+    unsigned char* block = (unsigned char*) malloc(block_size);
+    for (unsigned int i = 0; i < block_size; i++) block[i] = (unsigned char) (i * 31);
+
+    unsigned int sink = 0;
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_CRC_ROUNDS; i++) {
+        block[0] = (unsigned char) i;
+        sink += crc32c(block, block_size);
+    }
+    double elapsed = now_seconds() - start;
+
+    fprintf(report, "CRC32C (%s): %.0f MB/s, %.0f ns por bloco (resultado %08x)\n", crc32c_implementation(),
+            (double) block_size * BENCH_CRC_ROUNDS / (1024.0 * 1024.0) / elapsed,
+            elapsed * 1e9 / BENCH_CRC_ROUNDS, sink);
+    free(block);
+}
+
+/*
+ * Ponto de entrada do benchmark de compressão.
+ * Uso: bench [-j imagens] [tamanho_do_bloco]
+ * input:
+ * argc, argv - Os argumentos da linha de comando.
+ * output: 0 em caso de sucesso, 1 em caso de erro.
+ */
+int main(int argc, char* argv[]) {
+    int jobs = 0;
+    if (argc >= 3 && strcmp(argv[1], "-j") == 0) {
+        jobs = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc > 2 || jobs < 0 || jobs > BENCH_MAX_JOBS) {
+        fprintf(stderr, "Uso: %s [-j imagens (ate %d)] [tamanho_do_bloco]\n", argv[0], BENCH_MAX_JOBS);
+        return 1;
+    }
+    if (argc == 2) block_size = (unsigned int) strtoul(argv[1], NULL, 10);
+    if (file_size > 12 * block_size) file_size = 12 * block_size;
+
+    struct stat st = {0};
+    if (stat("dados", &st) == -1) {
+        mkdir("dados", 0700);
+    }
+    if (generate_text_file(BENCH_INPUT_PATH, file_size) != 0) {
+        perror("Nao foi possivel gerar o arquivo de entrada");
+        return 1;
+    }
+
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout)) {
+        perror("Nao foi possivel redirecionar a saida");
+        return 1;
+    }
+
+    disk_set_path(BENCH_DISK_PATH);
+    if (fs_format(BENCH_DISK_SIZE, block_size, BENCH_BYTES_PER_INODE) != 0 || fs_mount() != 0) {
+        fprintf(report, "Nao foi possivel montar o disco de benchmark.\n");
+        return 1;
+    }
+
+    fprintf(report, "%d arquivos de texto de %u KiB, blocos de %u bytes\n",
+            BENCH_FILE_COUNT, file_size / 1024, block_size);
+    fprintf(report, "%-12s %10s %10s %14s %16s\n", "modo", "MB/s esc.", "MB/s leit.", "blocos escritos", "bytes escritos");
+    run_round(0);
+    run_round(1);
+    if (jobs > 0) run_parallel_round(jobs);
+    run_checksum_round();
+
+    disk_unmount();
+    remove(BENCH_DISK_PATH);
+    remove(BENCH_INPUT_PATH);
+    fclose(report);
+    return 0;
+}
@@ -0,0 +1,313 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+// Pedidos montados e ainda não respondidos; as respostas chegam na mesma ordem.
+typedef struct {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+static ByteBuffer requests;
+static unsigned char* opcodes = NULL; // opcode de cada pedido, para interpretar a resposta
+static unsigned int request_count = 0;
+static unsigned int opcode_capacity = 0;
+static int quiet = 0;
+
+/*
+ * Retorna o tempo monotônico atual em segundos.
+ * input: nenhum.
+ * output: O tempo em segundos.
+ */
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Acrescenta bytes a um buffer dinâmico.
+ * input:
+ * buffer - O buffer.
+ * data - Os bytes.
+ * length - Quantidade de bytes.
+ * output: nenhum.
+ */
+static void buffer_append(ByteBuffer* buffer, const void* data, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (buffer->length + length > buffer->capacity) buffer->capacity *= 2;
+        buffer->data = (unsigned char*) realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+/*
+ * Acrescenta um caminho (tamanho + bytes) aos dados de um pedido.
+ * input:
+ * payload - Os dados do pedido.
+ * path - O caminho.
+ * output: nenhum.
+ */
+static void payload_path(ByteBuffer* payload, const char* path) {
+    unsigned short length = (unsigned short) strlen(path);
+    buffer_append(payload, &length, sizeof(length));
+    buffer_append(payload, path, length);
+}
+
+/*
+ * Enfileira um pedido para envio.
+ * input:
+ * opcode - A operação.
+ * payload - Os dados do pedido.
+ * output: nenhum.
+ */
+static void queue_request(unsigned char opcode, const ByteBuffer* payload) {
+    RequestHeader header;
+    memset(&header, 0, sizeof(header));
+    header.length = payload->length;
+    header.request_id = request_count;
+    header.opcode = opcode;
+    buffer_append(&requests, &header, sizeof(header));
+    buffer_append(&requests, payload->data, payload->length);
+
+    if (request_count == opcode_capacity) {
+        opcode_capacity = opcode_capacity ? opcode_capacity * 2 : 256;
+        opcodes = (unsigned char*) realloc(opcodes, opcode_capacity);
+    }
+    opcodes[request_count++] = opcode;
+}
+
+/*
+ * Converte uma linha de comando (mesma sintaxe do shell) em um pedido.
+ * input:
+ * line - A linha.
+ * output: 0 em caso de sucesso, -1 se o comando for inválido.
+ */
+static int parse_command(const char* line) {
+    char command[100], arg1[512], arg2[512], arg3[512];
+    arg1[0] = arg2[0] = arg3[0] = '\0';
+    int num_args = sscanf(line, "%99s %511s %511s %511s", command, arg1, arg2, arg3);
+    if (num_args <= 0) return 0;
+
+    ByteBuffer payload = { NULL, 0, 0 };
+    int result = 0;
+    if (strcmp(command, "sync") == 0) {
+        queue_request(OP_SYNC, &payload);
+    } else if (num_args < 2) {
+        result = -1;
+    } else if (strcmp(command, "stat") == 0 || strcmp(command, "ls") == 0 ||
+               strcmp(command, "mkdir") == 0 || strcmp(command, "rmdir") == 0) {
+        payload_path(&payload, arg1);
+        unsigned char opcode = command[0] == 's' ? OP_STAT : command[0] == 'l' ? OP_LIST : command[1] == 'k' ? OP_MKDIR : OP_RMDIR;
+        queue_request(opcode, &payload);
+    } else if (strcmp(command, "cat") == 0) {
+        unsigned int offset = 0, count = PROTOCOL_MAX_PAYLOAD;
+        payload_path(&payload, arg1);
+        buffer_append(&payload, &offset, sizeof(offset));
+        buffer_append(&payload, &count, sizeof(count));
+        queue_request(OP_READ, &payload);
+    } else if (strcmp(command, "rm") == 0) {
+        unsigned char flags = strcmp(arg1, "-r") == 0 ? OP_RM_RECURSIVE : 0;
+        if (flags && num_args < 3) result = -1;
+        else {
+            payload_path(&payload, flags ? arg2 : arg1);
+            buffer_append(&payload, &flags, 1);
+            queue_request(OP_RM, &payload);
+        }
+    } else if (strcmp(command, "mv") == 0 && num_args >= 3) {
+        payload_path(&payload, arg1);
+        payload_path(&payload, arg2);
+        queue_request(OP_MV, &payload);
+    } else if (strcmp(command, "truncate") == 0 && num_args >= 3) {
+        unsigned int size = (unsigned int) strtoul(arg2, NULL, 10);
+        payload_path(&payload, arg1);
+        buffer_append(&payload, &size, sizeof(size));
+        queue_request(OP_TRUNCATE, &payload);
+    } else if (strcmp(command, "write") == 0 && num_args >= 3) {
+        FILE* real_file = fopen(arg2, "rb");
+        if (!real_file) {
+            perror("Nao foi possivel abrir o arquivo real");
+            return -1;
+        }
+        unsigned char flags = OP_WRITE_TRUNCATE;
+        unsigned int offset = 0;
+        payload_path(&payload, arg1);
+        buffer_append(&payload, &flags, 1);
+        buffer_append(&payload, &offset, sizeof(offset));
+        unsigned char chunk[8192];
+        size_t length;
+        while ((length = fread(chunk, 1, sizeof(chunk), real_file)) > 0) buffer_append(&payload, chunk, length);
+        fclose(real_file);
+        queue_request(OP_WRITE, &payload);
+    } else {
+        result = -1;
+    }
+    free(payload.data);
+    if (result != 0) fprintf(stderr, "Comando invalido: %s\n", line);
+    return result;
+}
+
+/*
+ * Imprime o resultado de uma resposta.
+ * input:
+ * opcode - A operação do pedido.
+ * response - O cabeçalho da resposta.
+ * data - Os dados da resposta.
+ * output: nenhum.
+ */
+static void print_response(unsigned char opcode, const ResponseHeader* response, const unsigned char* data) {
+    if (quiet) return;
+    if (response->status != 0) {
+        printf("[%u] erro\n", response->request_id);
+        return;
+    }
+    if (opcode == OP_STAT && response->length >= sizeof(ProtocolStat)) {
+        ProtocolStat stat;
+        memcpy(&stat, data, sizeof(stat));
+        printf("[%u] i-node %u, %s, %u bytes, %u link(s)\n", response->request_id, stat.inode_num,
+               stat.mode == 1 ? "diretorio" : "arquivo", stat.size_in_bytes, stat.link_count);
+    } else if (opcode == OP_LIST) {
+        printf("[%u] listagem:\n", response->request_id);
+        unsigned int position = 0;
+        while (position + sizeof(ProtocolStat) + 1 <= response->length) {
+            ProtocolStat stat;
+            memcpy(&stat, data + position, sizeof(stat));
+            unsigned char length = data[position + sizeof(stat)];
+            printf("  %-28.*s %s %u\n", length, (const char*) data + position + sizeof(stat) + 1,
+                   stat.mode == 1 ? "d" : "-", stat.size_in_bytes);
+            position += sizeof(stat) + 1 + length;
+        }
+    } else if (opcode == OP_READ) {
+        fwrite(data, 1, response->length, stdout);
+    } else if (opcode == OP_WRITE && response->length >= sizeof(unsigned int)) {
+        unsigned int written;
+        memcpy(&written, data, sizeof(written));
+        printf("[%u] %u bytes escritos\n", response->request_id, written);
+    } else {
+        printf("[%u] ok\n", response->request_id);
+    }
+}
+
+/*
+ * Ponto de entrada do cliente do modo servidor. Lê comandos (um por linha) de um script ou da
+ * entrada padrão, envia todos em pipeline e imprime as respostas.
+ * Uso: client [-s socket] [-n repeticoes] [script]
+ * input:
+ * argc, argv - Os argumentos da linha de comando.
+ * output: 0 se todos os pedidos tiveram sucesso, 1 caso contrário.
+ */
+int main(int argc, char* argv[]) {
+    const char* socket_path = SERVER_SOCKET_PATH;
+    const char* script_path = NULL;
+    long repetitions = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) socket_path = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) repetitions = atol(argv[++i]);
+        else if (!script_path && argv[i][0] != '-') script_path = argv[i];
+        else {
+            fprintf(stderr, "Uso: %s [-s socket] [-n repeticoes] [script]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (repetitions < 1) repetitions = 1;
+    quiet = repetitions > 1;
+
+    FILE* input = script_path ? fopen(script_path, "r") : stdin;
+    if (!input) {
+        perror("Nao foi possivel abrir o script");
+        return 1;
+    }
+    char line[1024];
+    ByteBuffer script = { NULL, 0, 0 };
+    while (fgets(line, sizeof(line), input)) buffer_append(&script, line, strlen(line));
+    if (input != stdin) fclose(input);
+    buffer_append(&script, "", 1);
+
+    for (long r = 0; r < repetitions; r++) {
+        char* cursor = (char*) script.data;
+        while (*cursor) {
+            size_t length = strcspn(cursor, "\n");
+            char saved = cursor[length];
+            cursor[length] = '\0';
+            parse_command(cursor);
+            cursor[length] = saved;
+            cursor += length + (saved ? 1 : 0);
+        }
+    }
+    free(script.data);
+    if (request_count == 0) return 0;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        perror("Nao foi possivel conectar ao servidor");
+        return 1;
+    }
+
+    // Envia e recebe ao mesmo tempo: o servidor pode parar de ler se as respostas não forem consumidas.
+    ByteBuffer received = { NULL, 0, 0 };
+    size_t sent = 0, parsed = 0;
+    unsigned int responses = 0, errors = 0;
+    double start = now_seconds();
+    while (responses < request_count) {
+        struct pollfd poll_fd = { fd, POLLIN | (sent < requests.length ? POLLOUT : 0), 0 };
+        if (poll(&poll_fd, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (poll_fd.revents & POLLOUT) {
+            ssize_t written = write(fd, requests.data + sent, requests.length - sent);
+            if (written < 0 && errno != EINTR && errno != EAGAIN) { perror("write"); break; }
+            if (written > 0) sent += written;
+        }
+        if (poll_fd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            unsigned char chunk[65536];
+            ssize_t length = read(fd, chunk, sizeof(chunk));
+            if (length <= 0) {
+                if (length < 0 && errno == EINTR) continue;
+                fprintf(stderr, "Conexao encerrada pelo servidor.\n");
+                break;
+            }
+            buffer_append(&received, chunk, length);
+            while (received.length - parsed >= sizeof(ResponseHeader)) {
+                ResponseHeader response;
+                memcpy(&response, received.data + parsed, sizeof(response));
+                if (received.length - parsed < sizeof(response) + response.length) break;
+                if (response.status != 0) errors++;
+                print_response(opcodes[responses], &response, received.data + parsed + sizeof(response));
+                parsed += sizeof(response) + response.length;
+                responses++;
+            }
+            memmove(received.data, received.data + parsed, received.length - parsed);
+            received.length -= parsed;
+            parsed = 0;
+        }
+    }
+    double elapsed = now_seconds() - start;
+    close(fd);
+
+    if (quiet) {
+        printf("%u pedidos em %.3f s (%.0f pedidos/s), %u erro(s)\n", responses, elapsed,
+               elapsed > 0 ? responses / elapsed : 0.0, errors);
+    }
+    free(received.data);
+    free(requests.data);
+    free(opcodes);
+    return (responses == request_count && errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,719 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "crc32c.h"
+#include "filesystem_core.h"
+#include "file_operations.h"
+#include "gerenciador_de_disco.h"
+#include "fs_context.h"
+#include "xattr.h"
+
+// Simulador de quedas: roda uma carga fixa registrando cada bloco escrito (disk_set_write_hook)
+// e depois reconstrói a imagem como ela estaria se o processo tivesse morrido após cada prefixo
+// dessas escritas (ou, com -r, após subconjuntos aleatórios delas, como numa cache que reordena
+// as escritas, mas nunca para antes de um fdatasync já concluído). Uma imagem com a marca de
+// checksums pendentes é montada antes, como na próxima inicialização, para recalculá-los. Depois
+// cada imagem passa pelo fsck e, se estiver íntegra (ou depois de reparada), é montada de novo e
+// lida por inteiro; nos prefixos que terminam em um sync, a árvore lida tem de ser igual à da
+// carga naquele ponto. Um checksum desatualizado sem a marca conta como falha: o núcleo recusaria
+// ler o bloco.
+
+#define CRASH_DISK_PATH "dados/crash.disk"
+#define CRASH_REPLAY_PATH "dados/crash_replay.disk"
+#define CRASH_FAILURE_PATH "dados/crash_falha.disk"
+#define CRASH_DISK_SIZE (1024 * 1024)
+#define CRASH_BLOCK_SIZE 1024
+#define CRASH_BYTES_PER_INODE 4096
+#define CRASH_MANY_FILES 40 // Passa de um bloco de entradas (32 com blocos de 1 KiB).
+#define CRASH_MAX_EXAMPLES 10
+
+// Códigos de saída do fsck usados na classificação (veja tools/fsck.c).
+#define FSCK_EXIT_OK 0
+#define FSCK_EXIT_CORRECTED 1
+
+int g_verbose_mode = 0;
+int g_compress_mode = 0;
+
+// Saída real do teste; stdout é redirecionado para /dev/null durante a carga e as remontagens.
+static FILE* report = NULL;
+
+// Operações da carga.
+enum {
+    STEP_MKDIR,
+    STEP_WRITE,      // Cria o arquivo com 'size' bytes (conteúdo determinístico).
+    STEP_WRITE_MANY, // Cria CRASH_MANY_FILES arquivos pequenos no diretório.
+    STEP_APPEND,
+    STEP_TRUNCATE,
+    STEP_SETXATTR,
+    STEP_LINK,
+    STEP_SYMLINK,
+    STEP_MV,
+    STEP_CP_TREE,
+    STEP_RM,
+    STEP_RM_TREE,
+    STEP_RMDIR,
+    STEP_SYNC
+};
+
+typedef struct {
+    int op;
+    const char* label;
+    const char* path;
+    const char* other; // Destino (mv, cp, ln) ou nome do atributo.
+    unsigned int size;
+} WorkloadStep;
+
+static const WorkloadStep workload[] = {
+    { STEP_MKDIR,      "mkdir /a",                 "/a",              NULL,        0 },
+    { STEP_MKDIR,      "mkdir /a/b",               "/a/b",            NULL,        0 },
+    { STEP_WRITE,      "write /a/vazio.txt",       "/a/vazio.txt",    NULL,        0 },
+    { STEP_WRITE,      "write /a/pequeno.txt",     "/a/pequeno.txt",  NULL,        300 },
+    { STEP_WRITE,      "write /a/b/medio.txt",     "/a/b/medio.txt",  NULL,        5000 },
+    { STEP_WRITE,      "write /grande.txt",        "/grande.txt",     NULL,        11000 },
+    { STEP_SYNC,       "sync",                     NULL,              NULL,        0 },
+    { STEP_APPEND,     "append /a/pequeno.txt",    "/a/pequeno.txt",  NULL,        2000 },
+    { STEP_SETXATTR,   "setxattr /a/b/medio.txt",  "/a/b/medio.txt",  "user.tag",  40 },
+    { STEP_SETXATTR,   "setxattr /grande.txt",     "/grande.txt",     "user.big",  300 },
+    { STEP_LINK,       "ln /a/b/medio.txt",        "/a/b/medio.txt",  "/a/elo.txt", 0 },
+    { STEP_SYMLINK,    "ln -s /grande.txt",        "/grande.txt",     "/atalho",   0 },
+    { STEP_MV,         "mv /a/b /b",               "/a/b",            "/b",        0 },
+    { STEP_TRUNCATE,   "truncate /grande.txt",     "/grande.txt",     NULL,        3000 },
+    { STEP_CP_TREE,    "cp -r /b /copia",          "/b",              "/copia",    0 },
+    { STEP_RM,         "rm /a/pequeno.txt",        "/a/pequeno.txt",  NULL,        0 },
+    { STEP_RM,         "rm /a/elo.txt",            "/a/elo.txt",      NULL,        0 },
+    { STEP_MKDIR,      "mkdir /muitos",            "/muitos",         NULL,        0 },
+    { STEP_WRITE_MANY, "write /muitos/*",          "/muitos",         NULL,        200 },
+    { STEP_SYNC,       "sync",                     NULL,              NULL,        0 },
+    { STEP_RM_TREE,    "rm -r /muitos",            "/muitos",         NULL,        0 },
+    { STEP_RM,         "rm /b/medio.txt",          "/b/medio.txt",    NULL,        0 },
+    { STEP_RMDIR,      "rmdir /b",                 "/b",              NULL,        0 },
+    { STEP_SYNC,       "sync",                     NULL,              NULL,        0 },
+};
+
+#define WORKLOAD_STEPS (sizeof(workload) / sizeof(workload[0]))
+
+// Todas as escritas de bloco da carga, na ordem em que chegaram ao gerenciador de disco.
+typedef struct {
+    unsigned int block_size;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int* block_nums;
+    unsigned char* data;    // count blocos.
+    unsigned char* discard; // 1 se a escrita foi um descarte (o bloco passa a valer zeros).
+    // Índice da primeira escrita de cada passo; o último passo é a desmontagem.
+    unsigned int step_start[WORKLOAD_STEPS + 1];
+    // Quantas escritas já eram duráveis a cada fdatasync (DISK_WRITE_BARRIER), em ordem crescente.
+    unsigned int* barriers;
+    unsigned int barrier_count;
+    unsigned int barrier_capacity;
+} CrashLog;
+
+// Árvore lida de uma imagem, uma linha por entrada (tipo, caminho e tamanho e CRC32C do conteúdo
+// ou alvo do link), para comparar a imagem reconstruída com a carga.
+typedef struct {
+    char* text;
+    size_t length;
+    size_t capacity;
+} TreeText;
+
+// Como uma imagem reconstruída ficou.
+enum {
+    RESULT_CONSISTENT,
+    RESULT_REPAIRABLE,      // O fsck -r corrige a estrutura; os checksums estavam em dia.
+    RESULT_STALE_CHECKSUMS, // Blocos com checksum antigo sem a marca de pendentes (falha).
+    RESULT_DIVERGENT,       // Íntegra, mas sem o conteúdo que o último sync tornou durável.
+    RESULT_CORRUPT,
+    RESULT_KINDS
+};
+
+static const char* result_names[RESULT_KINDS] = {
+    "consistente", "reparavel pelo fsck -r", "checksums desatualizados", "diferente do sincronizado", "corrompida"
+};
+
+// Lista de caminhos coletados ao listar um diretório na remontagem.
+typedef struct {
+    char (*names)[MAX_FILENAME_LENGTH];
+    unsigned char* modes;
+    unsigned int count;
+    unsigned int capacity;
+} NameList;
+
+// --- Protótipos de Funções Auxiliares (Estáticas) ---
+static void record_write(unsigned int block_num, const void* data, void* context);
+static void fill_pattern(unsigned char* buffer, unsigned int size, unsigned int seed);
+static int run_step(const WorkloadStep* step);
+static int load_file(const char* path, unsigned char** data, size_t* size);
+static int save_file(const char* path, const unsigned char* data, size_t size);
+static unsigned int random_next(unsigned int* state);
+static unsigned int count_stale_checksums(const unsigned char* image, size_t image_size);
+static unsigned int last_barrier(const CrashLog* log, unsigned int applied);
+static int run_fsck(const char* fsck_path, const char* image, int repair);
+static int collect_name(const char* name, unsigned int inode_num, const Inode* inode, void* context);
+static void tree_text_append(TreeText* tree, const char* line);
+static int read_tree(const char* path, TreeText* tree);
+static int remount_and_read(const char* image, TreeText* tree);
+static int classify(const char* fsck_path, unsigned int stale_checksums, int checksums_pending, const char* expected);
+static const char* step_of_write(const CrashLog* log, unsigned int applied);
+
+/*
+ * Ponto de entrada do simulador de quedas.
+ * Uso: crashtest [-r tentativas] [-s semente] [-f fsck]
+ * -r troca os prefixos por 'tentativas' subconjuntos aleatórios (reprodutíveis com a mesma semente).
+ * input:
+ * argc, argv - Os argumentos da linha de comando.
+ * output: 0 se nenhuma imagem ficou corrompida, diferente do sincronizado ou com checksums desatualizados, 1 caso contrário.
+ */
+int main(int argc, char* argv[]) {
+    unsigned int trials = 0;
+    unsigned int seed = 1;
+    char fsck_path[1024] = "./fsck";
+    const char* slash = strrchr(argv[0], '/');
+    if (slash) snprintf(fsck_path, sizeof(fsck_path), "%.*sfsck", (int) (slash - argv[0] + 1), argv[0]);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            trials = (unsigned int) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = (unsigned int) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            snprintf(fsck_path, sizeof(fsck_path), "%s", argv[++i]);
+        } else {
+            fprintf(stderr, "Uso: %s [-r tentativas] [-s semente] [-f fsck]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (access(fsck_path, X_OK) != 0) {
+        fprintf(stderr, "Erro: fsck nao encontrado em '%s' (rode 'make fsck' ou use -f).\n", fsck_path);
+        return 1;
+    }
+
+    struct stat st = {0};
+    if (stat("dados", &st) == -1) {
+        mkdir("dados", 0700);
+    }
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout)) {
+        perror("Nao foi possivel redirecionar a saida");
+        return 1;
+    }
+
+    // Gravação: imagem nova, cópia dela como base e a carga com todas as escritas registradas.
+    CrashLog log;
+    memset(&log, 0, sizeof(log));
+    log.block_size = CRASH_BLOCK_SIZE;
+    unsigned char* base = NULL;
+    size_t image_size = 0;
+    FsContext* context = fs_context_create(CRASH_DISK_PATH);
+    if (!context) return 1;
+    fs_context_select(context);
+    if (fs_format(CRASH_DISK_SIZE, CRASH_BLOCK_SIZE, CRASH_BYTES_PER_INODE) != 0 ||
+        load_file(CRASH_DISK_PATH, &base, &image_size) != 0 || fs_mount() != 0) {
+        fprintf(report, "Nao foi possivel preparar a imagem de teste.\n");
+        fs_context_destroy(context);
+        return 1;
+    }
+
+    // A árvore esperada é lida logo depois de cada sync e no fim da carga (que a desmontagem
+    // apenas sincroniza); as leituras também passam pelo registro.
+    TreeText expected[WORKLOAD_STEPS + 1];
+    memset(expected, 0, sizeof(expected));
+    disk_set_write_hook(record_write, &log);
+    unsigned int failed_steps = 0;
+    for (unsigned int s = 0; s < WORKLOAD_STEPS; s++) {
+        log.step_start[s] = log.count;
+        if (run_step(&workload[s]) != 0) {
+            fprintf(report, "Passo '%s' falhou durante a gravacao.\n", workload[s].label);
+            failed_steps++;
+        }
+        if (workload[s].op == STEP_SYNC && read_tree("/", &expected[s]) != 0) failed_steps++;
+    }
+    if (read_tree("/", &expected[WORKLOAD_STEPS]) != 0) failed_steps++;
+    log.step_start[WORKLOAD_STEPS] = log.count;
+    fs_context_destroy(context); // fs_sync e a área de checksums também entram no registro.
+    if (!log.block_nums) {
+        fprintf(report, "Nenhuma escrita registrada.\n");
+        return 1;
+    }
+
+    fprintf(report, "Carga: %u passos, %u escritas de bloco (blocos de %u bytes).\n",
+            (unsigned int) WORKLOAD_STEPS, log.count, log.block_size);
+    if (trials == 0) fprintf(report, "Verificando os %u prefixos das escritas...\n", log.count + 1);
+    else fprintf(report, "Verificando %u subconjuntos aleatorios (semente %u)...\n", trials, seed);
+
+    // Reprodução: cada ponto de queda vira uma imagem, verificada do zero. Os avisos da montagem
+    // (checksums recalculados, blocos ilegíveis) também saem do relatório.
+    if (!freopen("/dev/null", "w", stderr)) {
+        perror("Nao foi possivel redirecionar a saida de erros");
+        return 1;
+    }
+    unsigned int totals[RESULT_KINDS] = {0};
+    unsigned int examples = 0;
+    unsigned int recovered = 0;
+    unsigned int compared = 0;
+    int saved_failure = 0;
+    unsigned char* image = (unsigned char*) malloc(image_size);
+    unsigned int points = trials > 0 ? trials : log.count + 1;
+    for (unsigned int p = 0; p < points; p++) {
+        unsigned int applied = trials > 0 ? 1 + random_next(&seed) % log.count : p;
+        unsigned int durable = last_barrier(&log, applied);
+        unsigned int kept = 0;
+        memcpy(image, base, image_size);
+        for (unsigned int i = 0; i < applied; i++) {
+            // No modo aleatório a última escrita e as anteriores ao último fdatasync sempre entram;
+            // as demais, com chance de 1/2.
+            if (trials > 0 && i >= durable && i + 1 < applied && random_next(&seed) % 2 == 0) continue;
+            size_t offset = (size_t) log.block_nums[i] * log.block_size;
+            if (offset + log.block_size > image_size) continue;
+            if (log.discard[i]) memset(image + offset, 0, log.block_size);
+            else memcpy(image + offset, log.data + (size_t) i * log.block_size, log.block_size);
+            kept++;
+        }
+        if (save_file(CRASH_REPLAY_PATH, image, image_size) != 0) {
+            fprintf(report, "Nao foi possivel gravar '%s'.\n", CRASH_REPLAY_PATH);
+            break;
+        }
+
+        // Só um prefixo que termina exatamente no fim de um sync tem conteúdo conhecido.
+        const char* expected_tree = NULL;
+        for (unsigned int s = 0; trials == 0 && s <= WORKLOAD_STEPS; s++) {
+            int sync_point = s == WORKLOAD_STEPS ? applied == log.count : workload[s].op == STEP_SYNC && applied == log.step_start[s + 1];
+            if (sync_point) expected_tree = expected[s].text;
+        }
+        if (expected_tree) compared++;
+        Superblock sb;
+        memcpy(&sb, image, sizeof(Superblock));
+        if (sb.checksums_pending) recovered++;
+        int result = classify(fsck_path, count_stale_checksums(image, image_size), sb.checksums_pending != 0, expected_tree);
+        totals[result]++;
+        if (result == RESULT_CONSISTENT) continue;
+        if (result >= RESULT_STALE_CHECKSUMS && !saved_failure) {
+            save_file(CRASH_FAILURE_PATH, image, image_size);
+            saved_failure = 1;
+        }
+        if (examples++ < CRASH_MAX_EXAMPLES) {
+            if (trials > 0) {
+                fprintf(report, "  %u de %u escritas (queda durante '%s'): %s\n", kept, applied,
+                        step_of_write(&log, applied), result_names[result]);
+            } else {
+                fprintf(report, "  prefixo %u (queda durante '%s'): %s\n", applied,
+                        step_of_write(&log, applied), result_names[result]);
+            }
+        }
+    }
+    if (examples > CRASH_MAX_EXAMPLES) fprintf(report, "  ... e mais %u.\n", examples - CRASH_MAX_EXAMPLES);
+
+    for (int r = 0; r < RESULT_KINDS; r++) fprintf(report, "%-26s %u\n", result_names[r], totals[r]);
+    fprintf(report, "(%u imagem(ns) com checksums pendentes, recalculados na montagem; %u conferida(s) com a arvore sincronizada)\n",
+            recovered, compared);
+    if (saved_failure) fprintf(report, "Primeira imagem com falha salva em '%s'.\n", CRASH_FAILURE_PATH);
+
+    free(image);
+    free(base);
+    free(log.block_nums);
+    free(log.data);
+    free(log.discard);
+    free(log.barriers);
+    for (unsigned int s = 0; s <= WORKLOAD_STEPS; s++) free(expected[s].text);
+    remove(CRASH_REPLAY_PATH);
+    remove(CRASH_DISK_PATH);
+    fclose(report);
+    return (failed_steps > 0 || totals[RESULT_CORRUPT] > 0 || totals[RESULT_DIVERGENT] > 0 || totals[RESULT_STALE_CHECKSUMS] > 0) ? 1 : 0;
+}
+
+
+// --- IMPLEMENTAÇÃO DAS FUNÇÕES AUXILIARES (ESTÁTICAS) ---
+
+/*
+ * Observador das escritas: guarda uma cópia de cada bloco escrito ou descartado e a posição de
+ * cada fdatasync.
+ * input:
+ * block_num - O bloco, ou DISK_WRITE_BARRIER.
+ * data - O conteúdo escrito, ou NULL para um descarte (ou barreira).
+ * context - O CrashLog.
+ * output: nenhum.
+ */
+static void record_write(unsigned int block_num, const void* data, void* context) {
+    CrashLog* log = (CrashLog*) context;
+    if (block_num == DISK_WRITE_BARRIER) {
+        if (log->barrier_count == log->barrier_capacity) {
+            log->barrier_capacity = log->barrier_capacity ? log->barrier_capacity * 2 : 16;
+            log->barriers = (unsigned int*) realloc(log->barriers, log->barrier_capacity * sizeof(unsigned int));
+        }
+        log->barriers[log->barrier_count++] = log->count;
+        return;
+    }
+    if (log->count == log->capacity) {
+        log->capacity = log->capacity ? log->capacity * 2 : 256;
+        log->block_nums = (unsigned int*) realloc(log->block_nums, log->capacity * sizeof(unsigned int));
+        log->data = (unsigned char*) realloc(log->data, (size_t) log->capacity * log->block_size);
+        log->discard = (unsigned char*) realloc(log->discard, log->capacity);
+    }
+    log->block_nums[log->count] = block_num;
+    log->discard[log->count] = data == NULL;
+    if (data) memcpy(log->data + (size_t) log->count * log->block_size, data, log->block_size);
+    log->count++;
+}
+
+/*
+ * Preenche um buffer com bytes determinísticos (a mesma semente gera sempre o mesmo conteúdo).
+ * input:
+ * buffer - O buffer.
+ * size - Quantidade de bytes.
+ * seed - A semente.
+ * output: nenhum.
+ */
+static void fill_pattern(unsigned char* buffer, unsigned int size, unsigned int seed) {
+    for (unsigned int i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        buffer[i] = (unsigned char) ('a' + (seed >> 16) % 26);
+    }
+}
+
+/*
+ * Executa um passo da carga no sistema de arquivos montado.
+ * input:
+ * step - O passo.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int run_step(const WorkloadStep* step) {
+    unsigned char* data = (unsigned char*) malloc(step->size > 0 ? step->size : 1);
+    fill_pattern(data, step->size, step->size + (unsigned int) strlen(step->label));
+    int result = 0;
+    int fd;
+    char path[256];
+
+    switch (step->op) {
+    case STEP_MKDIR:
+        result = fs_mkdir(step->path);
+        break;
+    case STEP_WRITE:
+        result = fs_write_buffer(step->path, data, step->size, NULL);
+        break;
+    case STEP_WRITE_MANY:
+        for (unsigned int i = 0; i < CRASH_MANY_FILES && result == 0; i++) {
+            snprintf(path, sizeof(path), "%s/arquivo_%u.txt", step->path, i);
+            result = fs_write_buffer(path, data, step->size, NULL);
+        }
+        break;
+    case STEP_APPEND:
+        fd = fs_fopen(step->path, FS_O_WRITE | FS_O_APPEND);
+        result = fd < 0 || fs_fwrite(fd, data, step->size) != (int) step->size ? -1 : 0;
+        if (fd >= 0) fs_fclose(fd);
+        break;
+    case STEP_TRUNCATE:
+        fd = fs_fopen(step->path, FS_O_WRITE);
+        result = fd < 0 ? -1 : fs_ftruncate(fd, step->size);
+        if (fd >= 0) fs_fclose(fd);
+        break;
+    case STEP_SETXATTR:
+        result = fs_setxattr(step->path, step->other, data, step->size);
+        break;
+    case STEP_LINK:
+        result = fs_link(step->path, step->other);
+        break;
+    case STEP_SYMLINK:
+        result = fs_symlink(step->path, step->other);
+        break;
+    case STEP_MV:
+        result = fs_mv(step->path, step->other);
+        break;
+    case STEP_CP_TREE:
+        result = fs_cp(step->path, step->other, 1);
+        break;
+    case STEP_RM:
+        result = fs_rm(step->path);
+        break;
+    case STEP_RM_TREE:
+        result = fs_rm_recursive(step->path);
+        break;
+    case STEP_RMDIR:
+        result = fs_rmdir(step->path);
+        break;
+    case STEP_SYNC:
+        result = fs_sync();
+        break;
+    }
+    free(data);
+    return result < 0 ? -1 : 0;
+}
+
+/*
+ * Lê um arquivo do sistema hospedeiro inteiro para a memória.
+ * input:
+ * path - O caminho do arquivo.
+ * data - Recebe o conteúdo (alocado; libere com free).
+ * size - Recebe o tamanho.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int load_file(const char* path, unsigned char** data, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return -1;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *data = length > 0 ? (unsigned char*) malloc((size_t) length) : NULL;
+    int result = *data && fread(*data, (size_t) length, 1, file) == 1 ? 0 : -1;
+    fclose(file);
+    *size = (size_t) length;
+    return result;
+}
+
+/*
+ * Grava um buffer como um arquivo do sistema hospedeiro (substituindo o anterior).
+ * input:
+ * path - O caminho do arquivo.
+ * data - O conteúdo.
+ * size - O tamanho.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int save_file(const char* path, const unsigned char* data, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return -1;
+    int result = fwrite(data, size, 1, file) == 1 ? 0 : -1;
+    if (fclose(file) != 0) result = -1;
+    return result;
+}
+
+/*
+ * Gerador pseudoaleatório (xorshift32) dos subconjuntos do modo -r.
+ * input:
+ * state - O estado (nunca 0), atualizado.
+ * output: O próximo número.
+ */
+static unsigned int random_next(unsigned int* state) {
+    unsigned int x = *state ? *state : 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/*
+ * Conta os blocos da imagem reconstruída cujo CRC32C não bate com a área de checksums gravada
+ * nela (mesma regra do fsck: entrada 0 é bloco nunca escrito, e um CRC 0 é gravado como 1).
+ * input:
+ * image - A imagem em memória.
+ * image_size - O tamanho da imagem.
+ * output: A quantidade de blocos com checksum desatualizado.
+ */
+static unsigned int count_stale_checksums(const unsigned char* image, size_t image_size) {
+    Superblock sb;
+    memcpy(&sb, image, sizeof(Superblock));
+    if (sb.checksum_blocks == 0 || (size_t) sb.total_blocks * sb.block_size > image_size) return 0;
+
+    const unsigned int* table = (const unsigned int*) (image + (size_t) sb.checksum_start_block * sb.block_size);
+    unsigned int checksum_end = sb.checksum_start_block + sb.checksum_blocks;
+    unsigned int stale = 0;
+    for (unsigned int b = 1; b < sb.total_blocks; b++) {
+        if (b >= sb.checksum_start_block && b < checksum_end) continue;
+        if (table[b] == 0) continue;
+        unsigned int crc = crc32c(image + (size_t) b * sb.block_size, sb.block_size);
+        if ((crc ? crc : 1) != table[b]) stale++;
+    }
+    return stale;
+}
+
+/*
+ * Quantas das primeiras escritas já eram duráveis antes da escrita número 'applied'.
+ * input:
+ * log - O registro das escritas.
+ * applied - Quantas escritas chegaram ao disco antes da queda.
+ * output: A posição do último fdatasync concluído até ali (0 se nenhum).
+ */
+static unsigned int last_barrier(const CrashLog* log, unsigned int applied) {
+    unsigned int durable = 0;
+    for (unsigned int b = 0; b < log->barrier_count && log->barriers[b] <= applied; b++) durable = log->barriers[b];
+    return durable;
+}
+
+/*
+ * Roda o fsck sobre uma imagem, com a saída descartada.
+ * input:
+ * fsck_path - O executável do fsck.
+ * image - A imagem.
+ * repair - 1 para reparar o que for possível (-r).
+ * output: O código de saída do fsck, ou -1 se ele não pôde ser executado.
+ */
+static int run_fsck(const char* fsck_path, const char* image, int repair) {
+    char* args[8];
+    int count = 0;
+    args[count++] = (char*) fsck_path;
+    args[count++] = "-j";
+    args[count++] = "1";
+    if (repair) args[count++] = "-r";
+    args[count++] = (char*) image;
+    args[count] = NULL;
+
+    fflush(report);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        execv(fsck_path, args);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+}
+
+/*
+ * Callback de fs_list_dir: guarda o nome e o tipo de cada entrada.
+ * input:
+ * name - O nome da entrada.
+ * inode_num - O número do i-node (não usado).
+ * inode - O i-node da entrada.
+ * context - A NameList.
+ * output: 0 (continua a listagem).
+ */
+static int collect_name(const char* name, unsigned int inode_num, const Inode* inode, void* context) {
+    (void) inode_num;
+    NameList* list = (NameList*) context;
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->names = realloc(list->names, list->capacity * sizeof(*list->names));
+        list->modes = (unsigned char*) realloc(list->modes, list->capacity);
+    }
+    snprintf(list->names[list->count], MAX_FILENAME_LENGTH, "%s", name);
+    list->modes[list->count] = (unsigned char) inode->mode;
+    list->count++;
+    return 0;
+}
+
+/*
+ * Acrescenta uma linha ao texto de uma árvore.
+ * input:
+ * tree - O texto.
+ * line - A linha (sem o '\n').
+ * output: nenhum.
+ */
+static void tree_text_append(TreeText* tree, const char* line) {
+    size_t length = strlen(line);
+    if (tree->length + length + 2 > tree->capacity) {
+        tree->capacity = (tree->length + length + 2) * 2;
+        tree->text = (char*) realloc(tree->text, tree->capacity);
+    }
+    memcpy(tree->text + tree->length, line, length);
+    tree->length += length;
+    tree->text[tree->length++] = '\n';
+    tree->text[tree->length] = '\0';
+}
+
+/*
+ * Percorre uma árvore do sistema montado lendo o conteúdo de todos os arquivos e o alvo de
+ * todos os links simbólicos, e descreve cada entrada em 'tree'.
+ * input:
+ * path - O diretório.
+ * tree - Recebe uma linha por entrada.
+ * output: 0 se tudo pôde ser lido, -1 caso contrário.
+ */
+static int read_tree(const char* path, TreeText* tree) {
+    NameList list = { NULL, NULL, 0, 0 };
+    if (fs_list_dir(path, collect_name, &list) != 0) return -1;
+
+    int result = 0;
+    unsigned char buffer[12 * CRASH_BLOCK_SIZE];
+    char line[1024 + 256 + 16];
+    for (unsigned int i = 0; i < list.count && result == 0; i++) {
+        char child[1024];
+        snprintf(child, sizeof(child), "%s/%s", strcmp(path, "/") == 0 ? "" : path, list.names[i]);
+        if (list.modes[i] == 1) {
+            snprintf(line, sizeof(line), "d %s", child);
+            tree_text_append(tree, line);
+            result = read_tree(child, tree);
+        } else if (list.modes[i] == 2) {
+            char target[256];
+            if (fs_readlink(child, target, sizeof(target)) < 0) result = -1;
+            snprintf(line, sizeof(line), "l %s -> %s", child, result == 0 ? target : "?");
+            tree_text_append(tree, line);
+        } else {
+            int fd = fs_fopen(child, FS_O_READ);
+            int count = fd < 0 ? -1 : 1;
+            unsigned int size = 0;
+            while (count > 0 && size < sizeof(buffer)) {
+                count = fs_fread(fd, buffer + size, sizeof(buffer) - size);
+                if (count > 0) size += (unsigned int) count;
+            }
+            if (count < 0) result = -1;
+            if (fd >= 0) fs_fclose(fd);
+            snprintf(line, sizeof(line), "f %s %u %08x", child, size, crc32c(buffer, size));
+            tree_text_append(tree, line);
+        }
+    }
+    free(list.names);
+    free(list.modes);
+    return result;
+}
+
+/*
+ * Monta uma imagem em um contexto novo e lê a árvore inteira.
+ * input:
+ * image - A imagem.
+ * tree - Recebe a descrição da árvore, ou NULL para só montar e desmontar (o que recalcula
+ * os checksums pendentes).
+ * output: 0 em caso de sucesso, -1 se a montagem ou alguma leitura falhou.
+ */
+static int remount_and_read(const char* image, TreeText* tree) {
+    FsContext* context = fs_context_create(image);
+    if (!context) return -1;
+    FsContext* previous = fs_context_select(context);
+    int result = fs_mount();
+    if (result == 0 && tree) result = read_tree("/", tree);
+    fs_context_destroy(context);
+    fs_context_select(previous);
+    return result;
+}
+
+/*
+ * Classifica a imagem reconstruída (CRASH_REPLAY_PATH). Uma imagem que o fsck acusa é reparada
+ * com -r; ela só não é corrompida se o reparo der conta e a árvore puder ser lida em seguida.
+ * input:
+ * fsck_path - O executável do fsck.
+ * stale_checksums - Blocos com checksum desatualizado na imagem (count_stale_checksums).
+ * checksums_pending - 1 se a imagem tem a marca de checksums pendentes (recalculados na montagem).
+ * expected - A árvore que o último sync tornou durável, ou NULL se o ponto de queda não é um sync.
+ * output: Um dos RESULT_*.
+ */
+static int classify(const char* fsck_path, unsigned int stale_checksums, int checksums_pending, const char* expected) {
+    // Sem a marca, um checksum desatualizado não é recalculado por ninguém: o bloco fica ilegível.
+    // Com ela, a imagem é montada uma vez antes, como na próxima inicialização do sistema.
+    if (stale_checksums > 0 && !checksums_pending) return RESULT_STALE_CHECKSUMS;
+    if (checksums_pending) remount_and_read(CRASH_REPLAY_PATH, NULL);
+
+    int result = RESULT_CONSISTENT;
+    if (run_fsck(fsck_path, CRASH_REPLAY_PATH, 0) != FSCK_EXIT_OK) {
+        if (run_fsck(fsck_path, CRASH_REPLAY_PATH, 1) != FSCK_EXIT_CORRECTED) return RESULT_CORRUPT;
+        result = RESULT_REPAIRABLE;
+    }
+    TreeText tree = { NULL, 0, 0 };
+    if (remount_and_read(CRASH_REPLAY_PATH, &tree) != 0) result = RESULT_CORRUPT;
+    else if (expected && (!tree.text || strcmp(tree.text, expected) != 0)) result = RESULT_DIVERGENT;
+    free(tree.text);
+    return result;
+}
+
+/*
+ * Descobre durante qual passo da carga uma queda aconteceu.
+ * input:
+ * log - O registro das escritas.
+ * applied - Quantas escritas chegaram ao disco antes da queda.
+ * output: O nome do passo.
+ */
+static const char* step_of_write(const CrashLog* log, unsigned int applied) {
+    if (applied == 0) return "antes da primeira escrita";
+    for (unsigned int s = 0; s < WORKLOAD_STEPS; s++) {
+        if (applied <= log->step_start[s + 1]) return workload[s].label;
+    }
+    return "desmontagem";
+}
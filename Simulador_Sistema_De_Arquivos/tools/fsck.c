@@ -0,0 +1,591 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "filesystem_core.h"
+#include "gerenciador_de_disco.h"
+#include "crc32c.h"
+
+#define FSCK_DEFAULT_DISK DISK_DEFAULT_PATH
+#define FSCK_MAX_THREADS 64
+#define FSCK_CHUNK_BLOCKS 64
+#define FSCK_MAX_EXAMPLES 10
+
+// Códigos de saída no estilo do e2fsck.
+#define FSCK_EXIT_OK 0
+#define FSCK_EXIT_CORRECTED 1
+#define FSCK_EXIT_UNCORRECTED 4
+#define FSCK_EXIT_ERROR 8
+
+int g_verbose_mode = 0;
+int g_compress_mode = 0;
+
+// Lista dinâmica de números (i-nodes, blocos ou posições de entradas).
+typedef struct {
+    unsigned int* items;
+    unsigned int count;
+    unsigned int capacity;
+} NumberList;
+
+// Posição de uma entrada de diretório a ser corrigida: bloco, índice e valor correto (0 = apagar).
+typedef struct {
+    unsigned int block_num;
+    unsigned int index;
+    unsigned int fixed_inode;
+} EntryFix;
+
+// Faixa de trabalho de uma thread e os resultados que ela produz.
+typedef struct {
+    unsigned int start;
+    unsigned int end;
+    NumberList leaked;
+    NumberList missing;
+    NumberList duplicated;
+    NumberList bad_checksum;
+} WorkRange;
+
+// Imagem carregada em memória (somente leitura durante a verificação).
+static int image_fd = -1;
+static Superblock sb;
+static unsigned char* metadata = NULL;      // Blocos 1 .. data_blocks_start_block - 1
+static unsigned char* inode_bitmap = NULL;
+static unsigned char* block_bitmap = NULL;
+static Inode* inode_table = NULL;          // Decodificada para a struct em memória
+static unsigned int* checksum_table = NULL;
+
+// Resultado da travessia da árvore.
+static unsigned int* inode_refs = NULL;     // Quantas entradas apontam para cada i-node
+static unsigned int* block_refs = NULL;     // Quantos i-nodes alcançáveis usam cada bloco
+static EntryFix* entry_fixes = NULL;
+static unsigned int entry_fix_count = 0;
+static unsigned int entry_fix_capacity = 0;
+static NumberList link_count_fixes;
+
+static unsigned int thread_count = 1;
+
+/*
+ * Acrescenta um número a uma lista dinâmica.
+ * input:
+ * list - A lista.
+ * value - O valor a acrescentar.
+ * output: nenhum.
+ */
+static void list_push(NumberList* list, unsigned int value) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->items = (unsigned int*) realloc(list->items, list->capacity * sizeof(unsigned int));
+    }
+    list->items[list->count++] = value;
+}
+
+/*
+ * Registra uma entrada de diretório que precisa ser corrigida.
+ * input:
+ * block_num - O bloco do diretório.
+ * index - O índice da entrada no bloco.
+ * fixed_inode - O i-node correto, ou 0 para apagar a entrada.
+ * output: nenhum.
+ */
+static void add_entry_fix(unsigned int block_num, unsigned int index, unsigned int fixed_inode) {
+    if (entry_fix_count == entry_fix_capacity) {
+        entry_fix_capacity = entry_fix_capacity ? entry_fix_capacity * 2 : 16;
+        entry_fixes = (EntryFix*) realloc(entry_fixes, entry_fix_capacity * sizeof(EntryFix));
+    }
+    entry_fixes[entry_fix_count].block_num = block_num;
+    entry_fixes[entry_fix_count].index = index;
+    entry_fixes[entry_fix_count].fixed_inode = fixed_inode;
+    entry_fix_count++;
+}
+
+/*
+ * Indica se um bit está ligado em um bitmap (mesma ordem de bits do núcleo: bit 7 primeiro).
+ * input:
+ * bitmap - O bitmap.
+ * n - O número do bit.
+ * output: 1 se ligado, 0 caso contrário.
+ */
+static int bit_is_set(const unsigned char* bitmap, unsigned int n) {
+    return (bitmap[n / 8] >> (7 - n % 8)) & 1;
+}
+
+/*
+ * Lê blocos consecutivos da imagem (seguro para várias threads, usa pread).
+ * input:
+ * block_num - O primeiro bloco.
+ * count - Quantidade de blocos.
+ * buffer - O destino.
+ * output: 0 em caso de sucesso, -1 em caso de erro.
+ */
+static int read_blocks(unsigned int block_num, unsigned int count, void* buffer) {
+    size_t length = (size_t) count * sb.block_size;
+    off_t offset = (off_t) block_num * sb.block_size;
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(image_fd, (char*) buffer + done, length - done, offset + done);
+        if (n < 0) return -1;
+        if (n == 0) {
+            memset((char*) buffer + done, 0, length - done); // Final esparso do arquivo.
+            break;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/*
+ * Divide [start, end) entre as threads e executa 'fn' em paralelo.
+ * input:
+ * ranges - Vetor com thread_count faixas (preenchido pela função).
+ * start - Início do intervalo.
+ * end - Fim do intervalo (exclusivo).
+ * fn - A função executada por cada thread.
+ * output: nenhum.
+ */
+static void run_parallel(WorkRange* ranges, unsigned int start, unsigned int end, void* (*fn)(void*)) {
+    pthread_t threads[FSCK_MAX_THREADS];
+    unsigned int total = end > start ? end - start : 0;
+    unsigned int per_thread = (total + thread_count - 1) / thread_count;
+
+    for (unsigned int t = 0; t < thread_count; t++) {
+        memset(&ranges[t], 0, sizeof(WorkRange));
+        ranges[t].start = start + t * per_thread;
+        ranges[t].end = ranges[t].start + per_thread;
+        if (ranges[t].start > end) ranges[t].start = end;
+        if (ranges[t].end > end) ranges[t].end = end;
+    }
+    for (unsigned int t = 1; t < thread_count; t++) {
+        pthread_create(&threads[t], NULL, fn, &ranges[t]);
+    }
+    fn(&ranges[0]);
+    for (unsigned int t = 1; t < thread_count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+/*
+ * Junta as listas de todas as faixas em uma só.
+ * input:
+ * ranges - As faixas processadas.
+ * offset - Deslocamento (em bytes) da lista dentro de WorkRange.
+ * out - A lista de destino.
+ * output: nenhum.
+ */
+static void merge_lists(WorkRange* ranges, size_t offset, NumberList* out) {
+    for (unsigned int t = 0; t < thread_count; t++) {
+        NumberList* list = (NumberList*) ((char*) &ranges[t] + offset);
+        for (unsigned int i = 0; i < list->count; i++) list_push(out, list->items[i]);
+        free(list->items);
+    }
+}
+
+/*
+ * Thread: carrega uma faixa dos blocos de metadados para a memória.
+ * input:
+ * arg - A WorkRange (blocos relativos ao bloco 1).
+ * output: NULL.
+ */
+static void* load_metadata_worker(void* arg) {
+    WorkRange* range = (WorkRange*) arg;
+    for (unsigned int b = range->start; b < range->end; b += FSCK_CHUNK_BLOCKS) {
+        unsigned int count = range->end - b < FSCK_CHUNK_BLOCKS ? range->end - b : FSCK_CHUNK_BLOCKS;
+        if (read_blocks(b, count, metadata + (size_t) (b - 1) * sb.block_size) != 0) {
+            list_push(&range->bad_checksum, b);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Thread: verifica o CRC32C de uma faixa de blocos contra a área de checksums.
+ * input:
+ * arg - A WorkRange com a faixa de blocos.
+ * output: NULL.
+ */
+static void* verify_checksums_worker(void* arg) {
+    WorkRange* range = (WorkRange*) arg;
+    unsigned char* buffer = (unsigned char*) malloc((size_t) FSCK_CHUNK_BLOCKS * sb.block_size);
+    unsigned int checksum_end = sb.checksum_start_block + sb.checksum_blocks;
+
+    for (unsigned int b = range->start; b < range->end; b += FSCK_CHUNK_BLOCKS) {
+        unsigned int count = range->end - b < FSCK_CHUNK_BLOCKS ? range->end - b : FSCK_CHUNK_BLOCKS;
+        if (read_blocks(b, count, buffer) != 0) continue;
+        for (unsigned int i = 0; i < count; i++) {
+            unsigned int block_num = b + i;
+            if (block_num >= sb.checksum_start_block && block_num < checksum_end) continue;
+            if (checksum_table[block_num] == 0) continue;
+            unsigned int crc = crc32c(buffer + (size_t) i * sb.block_size, sb.block_size);
+            if ((crc ? crc : 1) != checksum_table[block_num]) list_push(&range->bad_checksum, block_num);
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/*
+ * Thread: compara o bitmap de i-nodes com os i-nodes alcançáveis a partir da raiz.
+ * input:
+ * arg - A WorkRange com a faixa de i-nodes.
+ * output: NULL.
+ */
+static void* check_inodes_worker(void* arg) {
+    WorkRange* range = (WorkRange*) arg;
+    for (unsigned int i = range->start; i < range->end; i++) {
+        int used = bit_is_set(inode_bitmap, i);
+        int reachable = (i == 0) || inode_refs[i] > 0;
+        if (used && !reachable) list_push(&range->leaked, i);
+        if (!used && reachable) list_push(&range->missing, i);
+    }
+    return NULL;
+}
+
+/*
+ * Thread: compara o bitmap de blocos com os blocos usados pelos i-nodes alcançáveis.
+ * input:
+ * arg - A WorkRange com a faixa de blocos de dados.
+ * output: NULL.
+ */
+static void* check_blocks_worker(void* arg) {
+    WorkRange* range = (WorkRange*) arg;
+    for (unsigned int b = range->start; b < range->end; b++) {
+        int used = bit_is_set(block_bitmap, b);
+        if (used && block_refs[b] == 0) list_push(&range->leaked, b);
+        if (!used && block_refs[b] > 0) list_push(&range->missing, b);
+        if (block_refs[b] > 1) list_push(&range->duplicated, b);
+    }
+    return NULL;
+}
+
+/*
+ * Percorre a árvore de diretórios a partir do i-node 0, contando referências a i-nodes e blocos
+ * e registrando entradas pendentes (que apontam para i-nodes livres ou inválidos).
+ * input: nenhum.
+ * output: Quantidade de problemas encontrados nas entradas de diretório.
+ */
+static unsigned int walk_tree() {
+    unsigned int problems = 0;
+    unsigned int entries_per_block = sb.block_size / sizeof(DirEntry);
+    DirEntry* entries = (DirEntry*) malloc(sb.block_size);
+    unsigned int* stack = (unsigned int*) malloc(sb.total_inodes * sizeof(unsigned int));
+    unsigned int* parent = (unsigned int*) calloc(sb.total_inodes, sizeof(unsigned int));
+    unsigned int top = 0;
+
+    stack[top++] = 0;
+    inode_refs[0] = 1;
+
+    while (top > 0) {
+        unsigned int dir = stack[--top];
+        const Inode* dir_inode = &inode_table[dir];
+
+        for (int i = 0; i < 12; i++) {
+            unsigned int block_num = dir_inode->direct_blocks[i];
+            if (block_num == 0) continue;
+            if (block_num < sb.data_blocks_start_block || block_num >= sb.total_blocks) continue;
+            if (read_blocks(block_num, 1, entries) != 0) continue;
+
+            for (unsigned int j = 0; j < entries_per_block; j++) {
+                DirEntry* entry = &entries[j];
+                if (entry->name[0] == '\0') continue;
+                entry->name[MAX_FILENAME_LENGTH - 1] = '\0';
+
+                if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
+                    unsigned int expected = (entry->name[1] == '\0' || dir == 0) ? dir : parent[dir];
+                    if (entry->inode_number != expected) {
+                        printf("Diretorio %u: entrada '%s' aponta para %u (esperado %u).\n",
+                               dir, entry->name, entry->inode_number, expected);
+                        add_entry_fix(block_num, j, expected);
+                        problems++;
+                    }
+                    continue;
+                }
+
+                unsigned int target = entry->inode_number;
+                if (target == 0 || target >= sb.total_inodes || !bit_is_set(inode_bitmap, target)) {
+                    printf("Diretorio %u: entrada pendente '%s' -> i-node %u livre ou invalido.\n",
+                           dir, entry->name, target);
+                    add_entry_fix(block_num, j, 0);
+                    problems++;
+                    continue;
+                }
+
+                if (inode_table[target].mode == 1) {
+                    if (inode_refs[target] > 0) {
+                        printf("Diretorio %u: entrada '%s' repete o diretorio %u (ja ligado em outro lugar).\n",
+                               dir, entry->name, target);
+                        add_entry_fix(block_num, j, 0);
+                        problems++;
+                        continue;
+                    }
+                    parent[target] = dir;
+                    stack[top++] = target;
+                }
+                inode_refs[target]++;
+            }
+        }
+    }
+
+    // Blocos usados por i-nodes alcançáveis e contagem de links de arquivos.
+    for (unsigned int i = 0; i < sb.total_inodes; i++) {
+        if (inode_refs[i] == 0) continue;
+        const Inode* inode = &inode_table[i];
+        for (int b = 0; b < 12; b++) {
+            unsigned int block_num = inode->direct_blocks[b];
+            if (block_num == 0) continue;
+            if (block_num < sb.data_blocks_start_block || block_num >= sb.total_blocks) {
+                printf("I-node %u: bloco %u fora da area de dados.\n", i, block_num);
+                problems++;
+                continue;
+            }
+            block_refs[block_num]++;
+        }
+        // O bloco de atributos estendidos só existe nos formatos com DiskInode.
+        if (sb.inode_version != FS_INODE_VERSION_LEGACY && inode->xattr_block != 0) {
+            if (inode->xattr_block < sb.data_blocks_start_block || inode->xattr_block >= sb.total_blocks) {
+                printf("I-node %u: bloco de atributos %u fora da area de dados.\n", i, inode->xattr_block);
+                problems++;
+            } else {
+                block_refs[inode->xattr_block]++;
+            }
+        }
+        if (inode->mode != 1 && inode->link_count != inode_refs[i]) {
+            printf("I-node %u: link_count %u, mas %u entradas apontam para ele.\n", i, inode->link_count, inode_refs[i]);
+            list_push(&link_count_fixes, i);
+            problems++;
+        }
+    }
+
+    free(entries);
+    free(stack);
+    free(parent);
+    return problems;
+}
+
+/*
+ * Imprime um resumo de uma lista de problemas (até FSCK_MAX_EXAMPLES exemplos).
+ * input:
+ * label - A descrição do problema.
+ * list - A lista de números afetados.
+ * output: nenhum.
+ */
+static void report_list(const char* label, const NumberList* list) {
+    if (list->count == 0) return;
+    printf("%s: %u", label, list->count);
+    for (unsigned int i = 0; i < list->count && i < FSCK_MAX_EXAMPLES; i++) {
+        printf("%s%u", i == 0 ? " (" : ", ", list->items[i]);
+    }
+    printf("%s\n", list->count > FSCK_MAX_EXAMPLES ? ", ...)" : ")");
+}
+
+/*
+ * Liga ou desliga um bit de um bitmap no disco montado.
+ * input:
+ * bitmap_start_block - O primeiro bloco do bitmap.
+ * n - O número do bit.
+ * value - 1 para ligar, 0 para desligar.
+ * output: nenhum.
+ */
+static void set_disk_bit(unsigned int bitmap_start_block, unsigned int n, int value) {
+    unsigned int bits_per_block = sb.block_size * 8;
+    unsigned int target_block = bitmap_start_block + n / bits_per_block;
+    unsigned char* buffer = (unsigned char*) malloc(sb.block_size);
+    disk_read_block(target_block, buffer);
+    unsigned int byte_idx = (n % bits_per_block) / 8;
+    if (value) buffer[byte_idx] |= (1 << (7 - n % 8));
+    else buffer[byte_idx] &= ~(1 << (7 - n % 8));
+    disk_write_block(target_block, buffer);
+    free(buffer);
+}
+
+/*
+ * Aplica os reparos pela camada normal do núcleo, mantendo os checksums atualizados. Com a marca
+ * de checksums pendentes ligada, a própria montagem recalcula os checksums que divergem.
+ * input:
+ * leaked_inodes, missing_inodes, leaked_blocks, missing_blocks - Os problemas encontrados.
+ * output: 0 em caso de sucesso, -1 se o disco não puder ser montado.
+ */
+static int repair(const NumberList* leaked_inodes, const NumberList* missing_inodes,
+                  const NumberList* leaked_blocks, const NumberList* missing_blocks) {
+    if (fs_mount() != 0) return -1;
+
+    DirEntry* entries = (DirEntry*) malloc(sb.block_size);
+    for (unsigned int i = 0; i < entry_fix_count; i++) {
+        disk_read_block(entry_fixes[i].block_num, entries);
+        DirEntry* entry = &entries[entry_fixes[i].index];
+        if (entry_fixes[i].fixed_inode == 0) {
+            entry->name[0] = '\0';
+            entry->inode_number = 0;
+        } else {
+            entry->inode_number = entry_fixes[i].fixed_inode;
+        }
+        disk_write_block(entry_fixes[i].block_num, entries);
+    }
+    free(entries);
+
+    for (unsigned int i = 0; i < link_count_fixes.count; i++) {
+        Inode inode;
+        fs_read_inode(link_count_fixes.items[i], &inode);
+        inode.link_count = inode_refs[link_count_fixes.items[i]];
+        fs_write_inode(link_count_fixes.items[i], &inode);
+    }
+
+    for (unsigned int i = 0; i < leaked_inodes->count; i++) fs_free_inode(leaked_inodes->items[i]);
+    for (unsigned int i = 0; i < leaked_blocks->count; i++) fs_free_block(leaked_blocks->items[i]);
+    for (unsigned int i = 0; i < missing_inodes->count; i++) set_disk_bit(sb.inode_bitmap_start_block, missing_inodes->items[i], 1);
+    for (unsigned int i = 0; i < missing_blocks->count; i++) set_disk_bit(sb.block_bitmap_start_block, missing_blocks->items[i], 1);
+
+    disk_unmount();
+    return 0;
+}
+
+/*
+ * Ponto de entrada do verificador de consistência.
+ * Uso: fsck [-r] [-j threads] [imagem]
+ * input:
+ * argc - Número de argumentos da linha de comando.
+ * argv - Vetor de strings com os argumentos.
+ * output: Código de saída no estilo do e2fsck.
+ */
+int main(int argc, char* argv[]) {
+    const char* disk_path = FSCK_DEFAULT_DISK;
+    int do_repair = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cpus > 0 ? (unsigned int) cpus : 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            do_repair = 1;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = (unsigned int) atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Uso: %s [-r] [-j threads] [imagem]\n", argv[0]);
+            return FSCK_EXIT_ERROR;
+        } else {
+            disk_path = argv[i];
+        }
+    }
+    if (thread_count < 1) thread_count = 1;
+    if (thread_count > FSCK_MAX_THREADS) thread_count = FSCK_MAX_THREADS;
+
+    // O verificador lê a imagem diretamente (pread por posição), o que não vale para volumes distribuídos.
+    if (disk_is_volume(disk_path)) {
+        fprintf(stderr, "Erro: '%s' e um volume distribuido; a verificacao so suporta imagens unicas.\n", disk_path);
+        return FSCK_EXIT_ERROR;
+    }
+    image_fd = open(disk_path, O_RDONLY);
+    if (image_fd < 0) {
+        perror("Nao foi possivel abrir a imagem");
+        return FSCK_EXIT_ERROR;
+    }
+    if (pread(image_fd, &sb, sizeof(Superblock), 0) != (ssize_t) sizeof(Superblock) || sb.magic_number != MAGIC_NUMBER) {
+        fprintf(stderr, "Erro: Magic number invalido! '%s' nao e uma imagem valida.\n", disk_path);
+        close(image_fd);
+        return FSCK_EXIT_ERROR;
+    }
+    if (sb.inode_version > FS_INODE_VERSION ||
+        (sb.inode_version != FS_INODE_VERSION_LEGACY && sb.inode_size != FS_INODE_SLOT_SIZE &&
+         sb.inode_size != FS_INODE_SLOT_SIZE + FS_INODE_INLINE_XATTR_SIZE)) {
+        fprintf(stderr, "Erro: Formato de i-node nao suportado (versao %u, %u bytes).\n", sb.inode_version, sb.inode_size);
+        close(image_fd);
+        return FSCK_EXIT_ERROR;
+    }
+    printf("Verificando '%s' (%u blocos, %u i-nodes, %u threads)...\n", disk_path, sb.total_blocks, sb.total_inodes, thread_count);
+
+    WorkRange ranges[FSCK_MAX_THREADS];
+    crc32c_implementation(); // Escolhe a implementação antes de criar as threads.
+
+    // Fase 1: metadados (bitmaps, tabela de i-nodes e checksums) lidos em paralelo.
+    metadata = (unsigned char*) malloc((size_t) (sb.data_blocks_start_block - 1) * sb.block_size);
+    run_parallel(ranges, 1, sb.data_blocks_start_block, load_metadata_worker);
+    NumberList load_errors = {0};
+    merge_lists(ranges, offsetof(WorkRange, bad_checksum), &load_errors);
+    if (load_errors.count > 0) {
+        fprintf(stderr, "Erro ao ler os metadados da imagem.\n");
+        close(image_fd);
+        return FSCK_EXIT_ERROR;
+    }
+    inode_bitmap = metadata + (size_t) (sb.inode_bitmap_start_block - 1) * sb.block_size;
+    block_bitmap = metadata + (size_t) (sb.block_bitmap_start_block - 1) * sb.block_size;
+    unsigned char* raw_inodes = metadata + (size_t) (sb.inode_table_start_block - 1) * sb.block_size;
+    if (sb.inode_version == FS_INODE_VERSION_LEGACY) {
+        inode_table = (Inode*) raw_inodes;
+    } else {
+        inode_table = (Inode*) malloc((size_t) sb.total_inodes * sizeof(Inode));
+        for (unsigned int i = 0; i < sb.total_inodes; i++) {
+            fs_inode_from_disk((const DiskInode*) (raw_inodes + (size_t) i * sb.inode_size), &inode_table[i]);
+        }
+    }
+    if (sb.checksum_blocks > 0) {
+        checksum_table = (unsigned int*) (metadata + (size_t) (sb.checksum_start_block - 1) * sb.block_size);
+    }
+
+    // Fase 2: checksums de todos os blocos, em paralelo.
+    NumberList bad_checksums = {0};
+    if (checksum_table) {
+        run_parallel(ranges, 1, sb.total_blocks, verify_checksums_worker);
+        merge_lists(ranges, offsetof(WorkRange, bad_checksum), &bad_checksums);
+    }
+
+    // Fase 3: travessia da árvore a partir da raiz.
+    inode_refs = (unsigned int*) calloc(sb.total_inodes, sizeof(unsigned int));
+    block_refs = (unsigned int*) calloc(sb.total_blocks, sizeof(unsigned int));
+    unsigned int tree_problems = walk_tree();
+
+    // Fase 4: cruzamento dos bitmaps com o que é alcançável, em paralelo.
+    NumberList leaked_inodes = {0}, missing_inodes = {0};
+    run_parallel(ranges, 0, sb.total_inodes, check_inodes_worker);
+    merge_lists(ranges, offsetof(WorkRange, leaked), &leaked_inodes);
+    merge_lists(ranges, offsetof(WorkRange, missing), &missing_inodes);
+    for (unsigned int t = 0; t < thread_count; t++) free(ranges[t].duplicated.items);
+
+    NumberList leaked_blocks = {0}, missing_blocks = {0}, duplicated_blocks = {0};
+    run_parallel(ranges, sb.data_blocks_start_block, sb.total_blocks, check_blocks_worker);
+    merge_lists(ranges, offsetof(WorkRange, leaked), &leaked_blocks);
+    merge_lists(ranges, offsetof(WorkRange, missing), &missing_blocks);
+    merge_lists(ranges, offsetof(WorkRange, duplicated), &duplicated_blocks);
+    close(image_fd);
+
+    // Com a marca de checksums pendentes ligada, a imagem caiu antes de um sync e uma divergência
+    // é um checksum que não chegou ao disco: a montagem do reparo o recalcula. Com ela desligada,
+    // a divergência é corrupção.
+    if (sb.checksums_pending) report_list("Blocos com checksum pendente (imagem nao sincronizada)", &bad_checksums);
+    else report_list("Blocos com checksum invalido", &bad_checksums);
+    report_list("I-nodes orfaos (ocupados no bitmap, inalcancaveis)", &leaked_inodes);
+    report_list("I-nodes em uso marcados como livres", &missing_inodes);
+    report_list("Blocos vazados (ocupados no bitmap, sem dono)", &leaked_blocks);
+    report_list("Blocos em uso marcados como livres", &missing_blocks);
+    report_list("Blocos usados por mais de um i-node", &duplicated_blocks);
+
+    unsigned int pending_checksums = sb.checksums_pending ? bad_checksums.count : 0;
+    unsigned int fixable = tree_problems + pending_checksums + leaked_inodes.count + missing_inodes.count +
+                           leaked_blocks.count + missing_blocks.count;
+    unsigned int unfixable = bad_checksums.count - pending_checksums + duplicated_blocks.count;
+
+    int status = FSCK_EXIT_OK;
+    if (fixable == 0 && unfixable == 0) {
+        printf("Nenhum problema encontrado.\n");
+    } else if (do_repair && fixable > 0) {
+        disk_set_path(disk_path);
+        if (repair(&leaked_inodes, &missing_inodes, &leaked_blocks, &missing_blocks) != 0) {
+            fprintf(stderr, "Erro: nao foi possivel montar a imagem para reparo.\n");
+            status = FSCK_EXIT_ERROR;
+        } else {
+            printf("%u problema(s) corrigido(s).\n", fixable);
+            status = unfixable > 0 ? FSCK_EXIT_UNCORRECTED : FSCK_EXIT_CORRECTED;
+        }
+    } else {
+        printf("%u problema(s) encontrado(s). Use -r para reparar.\n", fixable + unfixable);
+        status = FSCK_EXIT_UNCORRECTED;
+    }
+
+    if (sb.inode_version != FS_INODE_VERSION_LEGACY) free(inode_table);
+    free(metadata);
+    free(inode_refs);
+    free(block_refs);
+    free(entry_fixes);
+    return status;
+}
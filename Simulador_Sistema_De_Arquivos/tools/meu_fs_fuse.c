@@ -0,0 +1,414 @@
+#define FUSE_USE_VERSION 31
+#define _POSIX_C_SOURCE 200809L
+#include <fuse.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "filesystem_core.h"
+#include "file_operations.h"
+#include "gerenciador_de_disco.h"
+#include "xattr.h"
+
+#define DEFAULT_IMAGE_PATH DISK_DEFAULT_PATH
+
+int g_verbose_mode = 0;
+int g_compress_mode = 0;
+
+// O núcleo do sistema de arquivos usa estado global (superbloco, tabela de arquivos abertos,
+// escritas pendentes), então cada operação roda com esta trava. O FUSE continua atendendo
+// pedidos em várias threads: enquanto uma operação usa o núcleo, as outras já foram recebidas
+// e decodificadas e o kernel segue fazendo leitura antecipada e cache de páginas.
+static pthread_mutex_t fs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Contexto do preenchimento de uma listagem do readdir.
+typedef struct {
+    void* buffer;
+    fuse_fill_dir_t filler;
+} ReaddirContext;
+
+// Contexto do listxattr: os nomes são concatenados com '\0' em 'buffer' (ou só somados se size for 0).
+typedef struct {
+    char* buffer;
+    size_t size;
+    size_t used;
+} ListxattrContext;
+
+/*
+ * Converte um i-node do simulador para a struct stat do sistema hospedeiro.
+ * input:
+ * inode_num - O número do i-node.
+ * inode - O i-node.
+ * st - A struct stat a preencher.
+ * output: nenhum.
+ */
+static void inode_to_stat(unsigned int inode_num, const Inode* inode, struct stat* st) {
+    Superblock sb = fs_get_superblock_info();
+    unsigned int blocks = 0;
+    for (int i = 0; i < 12; i++) {
+        if (inode->direct_blocks[i] != 0) blocks++;
+    }
+
+    memset(st, 0, sizeof(struct stat));
+    st->st_ino = inode_num + 1; // O i-node 0 (raiz) não é um número de i-node válido para o kernel.
+    st->st_mode = inode->mode == 1 ? (S_IFDIR | 0755) : (inode->mode == 2 ? (S_IFLNK | 0777) : (S_IFREG | 0644));
+    st->st_nlink = inode->link_count;
+    st->st_uid = getuid();
+    st->st_gid = getgid();
+    st->st_size = inode->size_in_bytes;
+    st->st_blksize = sb.block_size;
+    st->st_blocks = (blkcnt_t) blocks * sb.block_size / 512;
+    st->st_atime = inode->last_access_time;
+    st->st_mtime = inode->modification_time;
+    st->st_ctime = inode->modification_time;
+}
+
+/*
+ * Entrega uma entrada de diretório ao FUSE, já com seus atributos (readdirplus).
+ * input:
+ * name, inode_num, inode - A entrada.
+ * context - O ReaddirContext.
+ * output: 0 para continuar, 1 se o buffer do FUSE encheu.
+ */
+static int readdir_callback(const char* name, unsigned int inode_num, const Inode* inode, void* context) {
+    ReaddirContext* ctx = (ReaddirContext*) context;
+    struct stat st;
+    inode_to_stat(inode_num, inode, &st);
+    return ctx->filler(ctx->buffer, name, &st, 0, FUSE_FILL_DIR_PLUS) != 0;
+}
+
+static void* meu_fs_init(struct fuse_conn_info* conn, struct fuse_config* cfg) {
+    (void) conn;
+    cfg->use_ino = 1;
+    cfg->kernel_cache = 1;
+    return NULL;
+}
+
+static void meu_fs_destroy(void* private_data) {
+    (void) private_data;
+    pthread_mutex_lock(&fs_lock);
+    fs_sync();
+    disk_unmount();
+    fs_release_buffers();
+    pthread_mutex_unlock(&fs_lock);
+}
+
+static int meu_fs_getattr(const char* path, struct stat* st, struct fuse_file_info* fi) {
+    (void) fi;
+    Inode inode;
+    pthread_mutex_lock(&fs_lock);
+    int inode_num = fs_lstat(path, &inode);
+    pthread_mutex_unlock(&fs_lock);
+    if (inode_num < 0) return -ENOENT;
+    inode_to_stat(inode_num, &inode, st);
+    return 0;
+}
+
+static int meu_fs_readdir(const char* path, void* buffer, fuse_fill_dir_t filler, off_t offset,
+                          struct fuse_file_info* fi, enum fuse_readdir_flags flags) {
+    (void) offset; (void) fi; (void) flags;
+    ReaddirContext ctx = { buffer, filler };
+    filler(buffer, ".", NULL, 0, 0);
+    filler(buffer, "..", NULL, 0, 0);
+    pthread_mutex_lock(&fs_lock);
+    int result = fs_list_dir(path, readdir_callback, &ctx);
+    pthread_mutex_unlock(&fs_lock);
+    return result == 0 ? 0 : -ENOTDIR;
+}
+
+/*
+ * Converte as flags de open(2) para as de fs_fopen.
+ * input:
+ * flags - As flags de open(2).
+ * output: As flags FS_O_* equivalentes.
+ */
+static int open_flags(int flags) {
+    int result = 0;
+    if ((flags & O_ACCMODE) == O_RDONLY || (flags & O_ACCMODE) == O_RDWR) result |= FS_O_READ;
+    if ((flags & O_ACCMODE) == O_WRONLY || (flags & O_ACCMODE) == O_RDWR) result |= FS_O_WRITE;
+    if (flags & O_TRUNC) result |= FS_O_TRUNC;
+    // O_APPEND não é repassado: o kernel já envia o deslocamento do fim do arquivo.
+    return result;
+}
+
+static int meu_fs_open(const char* path, struct fuse_file_info* fi) {
+    pthread_mutex_lock(&fs_lock);
+    Inode inode;
+    int inode_num = fs_stat(path, &inode);
+    int fd = inode_num < 0 ? -1 : fs_fopen(path, open_flags(fi->flags));
+    pthread_mutex_unlock(&fs_lock);
+    if (inode_num < 0) return -ENOENT;
+    if (inode.mode == 1) return -EISDIR;
+    if (fd < 0) return -EACCES;
+    fi->fh = fd;
+    return 0;
+}
+
+static int meu_fs_create(const char* path, mode_t mode, struct fuse_file_info* fi) {
+    (void) mode;
+    pthread_mutex_lock(&fs_lock);
+    int fd = fs_fopen(path, open_flags(fi->flags) | FS_O_CREATE);
+    pthread_mutex_unlock(&fs_lock);
+    if (fd < 0) return -EIO;
+    fi->fh = fd;
+    return 0;
+}
+
+static int meu_fs_read(const char* path, char* buffer, size_t size, off_t offset, struct fuse_file_info* fi) {
+    (void) path;
+    pthread_mutex_lock(&fs_lock);
+    int result = fs_fseek((int) fi->fh, offset, FS_SEEK_SET) < 0 ? -1 : fs_fread((int) fi->fh, buffer, size);
+    pthread_mutex_unlock(&fs_lock);
+    return result < 0 ? -EIO : result;
+}
+
+static int meu_fs_write(const char* path, const char* buffer, size_t size, off_t offset, struct fuse_file_info* fi) {
+    (void) path;
+    pthread_mutex_lock(&fs_lock);
+    int result = fs_fseek((int) fi->fh, offset, FS_SEEK_SET) < 0 ? -1 : fs_fwrite((int) fi->fh, buffer, size);
+    pthread_mutex_unlock(&fs_lock);
+    if (result < 0) return -EIO;
+    return result == 0 && size > 0 ? -EFBIG : result;
+}
+
+static int meu_fs_release(const char* path, struct fuse_file_info* fi) {
+    (void) path;
+    pthread_mutex_lock(&fs_lock);
+    fs_fclose((int) fi->fh);
+    pthread_mutex_unlock(&fs_lock);
+    return 0;
+}
+
+static int meu_fs_truncate(const char* path, off_t size, struct fuse_file_info* fi) {
+    pthread_mutex_lock(&fs_lock);
+    int result;
+    if (fi) {
+        result = fs_ftruncate((int) fi->fh, size);
+    } else {
+        int fd = fs_fopen(path, FS_O_WRITE);
+        result = fd < 0 ? -1 : fs_ftruncate(fd, size);
+        if (fd >= 0) fs_fclose(fd);
+    }
+    pthread_mutex_unlock(&fs_lock);
+    return result == 0 ? 0 : -EIO;
+}
+
+static int meu_fs_mkdir(const char* path, mode_t mode) {
+    (void) mode;
+    Inode inode;
+    pthread_mutex_lock(&fs_lock);
+    int result = fs_lstat(path, &inode) >= 0 ? -EEXIST : (fs_mkdir(path) == 0 ? 0 : -EIO);
+    pthread_mutex_unlock(&fs_lock);
+    return result;
+}
+
+static int meu_fs_unlink(const char* path) {
+    Inode inode;
+    pthread_mutex_lock(&fs_lock);
+    int result;
+    if (fs_lstat(path, &inode) < 0) result = -ENOENT;
+    else if (inode.mode == 1) result = -EISDIR;
+    else result = fs_rm(path) == 0 ? 0 : -EIO;
+    pthread_mutex_unlock(&fs_lock);
+    return result;
+}
+
+static int meu_fs_rmdir(const char* path) {
+    Inode inode;
+    pthread_mutex_lock(&fs_lock);
+    int result;
+    if (fs_lstat(path, &inode) < 0) result = -ENOENT;
+    else if (inode.mode != 1) result = -ENOTDIR;
+    else result = fs_rmdir(path) == 0 ? 0 : -ENOTEMPTY;
+    pthread_mutex_unlock(&fs_lock);
+    return result;
+}
+
+static int meu_fs_rename(const char* from, const char* to, unsigned int flags) {
+    if (flags != 0) return -EINVAL;
+    Inode source, target, parent;
+    size_t from_length = strlen(from);
+    const char* to_name = strrchr(to, '/') + 1;
+    int parent_length = to_name - to > 1 ? (int) (to_name - to - 1) : 1; // "/x" tem a raiz como pai.
+    char to_parent[1024];
+    if (parent_length >= (int) sizeof(to_parent)) return -ENAMETOOLONG;
+    snprintf(to_parent, sizeof(to_parent), "%.*s", parent_length, to);
+    pthread_mutex_lock(&fs_lock);
+    int result = 0;
+    int source_num = fs_lstat(from, &source);
+    int target_num = fs_lstat(to, &target);
+    // As condições em que fs_mv falharia são verificadas antes de o destino ser apagado.
+    if (source_num < 0) {
+        result = -ENOENT;
+    } else if (target_num == source_num) {
+        result = 1; // Dois links físicos para o mesmo arquivo: rename(2) não faz nada.
+    } else if (source_num == 0 || (strncmp(to, from, from_length) == 0 && to[from_length] == '/')) {
+        result = -EINVAL;
+    } else if (strlen(to_name) >= MAX_FILENAME_LENGTH) {
+        result = -ENAMETOOLONG;
+    } else if (fs_lstat(to_parent, &parent) < 0 || parent.mode != 1) {
+        result = -ENOENT;
+    } else if (target_num >= 0) {
+        // rename(2) substitui o destino; fs_mv moveria para dentro de um diretório existente.
+        if (target.mode == 1) result = source.mode != 1 ? -EISDIR : (fs_rmdir(to) == 0 ? 0 : -ENOTEMPTY);
+        else if (source.mode == 1) result = -ENOTDIR;
+        else result = fs_rm(to) == 0 ? 0 : -EIO;
+    }
+    if (result == 0 && fs_mv(from, to) != 0) result = -EIO;
+    pthread_mutex_unlock(&fs_lock);
+    return result > 0 ? 0 : result;
+}
+
+static int meu_fs_utimens(const char* path, const struct timespec tv[2], struct fuse_file_info* fi) {
+    (void) path; (void) tv; (void) fi;
+    return 0; // Os tempos são mantidos pelo próprio núcleo.
+}
+
+static int meu_fs_chmod(const char* path, mode_t mode, struct fuse_file_info* fi) {
+    (void) path; (void) mode; (void) fi;
+    return 0; // O formato não guarda permissões.
+}
+
+static int meu_fs_readlink(const char* path, char* buffer, size_t size) {
+    pthread_mutex_lock(&fs_lock);
+    int result = fs_readlink(path, buffer, (unsigned int) size);
+    pthread_mutex_unlock(&fs_lock);
+    return result < 0 ? -EINVAL : 0;
+}
+
+static int meu_fs_symlink(const char* target, const char* link_path) {
+    Inode inode;
+    pthread_mutex_lock(&fs_lock);
+    int result = fs_lstat(link_path, &inode) >= 0 ? -EEXIST : (fs_symlink(target, link_path) == 0 ? 0 : -EIO);
+    pthread_mutex_unlock(&fs_lock);
+    return result;
+}
+
+static int meu_fs_link(const char* existing_path, const char* new_path) {
+    Inode source, target;
+    pthread_mutex_lock(&fs_lock);
+    int result;
+    if (fs_lstat(existing_path, &source) < 0) result = -ENOENT;
+    else if (source.mode == 1) result = -EPERM;
+    else if (fs_lstat(new_path, &target) >= 0) result = -EEXIST;
+    else result = fs_link(existing_path, new_path) == 0 ? 0 : -EIO;
+    pthread_mutex_unlock(&fs_lock);
+    return result;
+}
+
+static int meu_fs_setxattr(const char* path, const char* name, const char* value, size_t size, int flags) {
+    pthread_mutex_lock(&fs_lock);
+    int result;
+    if (fs_lookup(path) < 0) result = -ENOENT;
+    else if ((flags & XATTR_CREATE) && fs_getxattr(path, name, NULL, 0) >= 0) result = -EEXIST;
+    else if ((flags & XATTR_REPLACE) && fs_getxattr(path, name, NULL, 0) < 0) result = -ENODATA;
+    else result = fs_setxattr(path, name, value, (unsigned int) size) == 0 ? 0 : -ENOSPC;
+    pthread_mutex_unlock(&fs_lock);
+    return result;
+}
+
+static int meu_fs_getxattr(const char* path, const char* name, char* value, size_t size) {
+    pthread_mutex_lock(&fs_lock);
+    int result;
+    if (fs_lookup(path) < 0) result = -ENOENT;
+    else if ((result = fs_getxattr(path, name, value, (unsigned int) size)) < 0) result = -ENODATA;
+    else if (size > 0 && (size_t) result > size) result = -ERANGE;
+    pthread_mutex_unlock(&fs_lock);
+    return result;
+}
+
+/*
+ * Callback de fs_listxattr que acrescenta um nome à lista do listxattr.
+ * input:
+ * name - O nome do atributo.
+ * value, size - O valor (não usado).
+ * context - O ListxattrContext.
+ * output: 0, para continuar a listagem.
+ */
+static int listxattr_add(const char* name, const void* value, unsigned int size, void* context) {
+    (void) value; (void) size;
+    ListxattrContext* list = (ListxattrContext*) context;
+    size_t length = strlen(name) + 1;
+    if (list->size > 0 && list->used + length <= list->size) memcpy(list->buffer + list->used, name, length);
+    list->used += length;
+    return 0;
+}
+
+static int meu_fs_listxattr(const char* path, char* list, size_t size) {
+    ListxattrContext context = { list, size, 0 };
+    pthread_mutex_lock(&fs_lock);
+    int result = fs_listxattr(path, listxattr_add, &context);
+    pthread_mutex_unlock(&fs_lock);
+    if (result != 0) return -ENOENT;
+    if (size > 0 && context.used > size) return -ERANGE;
+    return (int) context.used;
+}
+
+static int meu_fs_removexattr(const char* path, const char* name) {
+    pthread_mutex_lock(&fs_lock);
+    int result = fs_lookup(path) < 0 ? -ENOENT : (fs_removexattr(path, name) == 0 ? 0 : -ENODATA);
+    pthread_mutex_unlock(&fs_lock);
+    return result;
+}
+
+static const struct fuse_operations meu_fs_operations = {
+    .init = meu_fs_init,
+    .destroy = meu_fs_destroy,
+    .getattr = meu_fs_getattr,
+    .readdir = meu_fs_readdir,
+    .open = meu_fs_open,
+    .create = meu_fs_create,
+    .read = meu_fs_read,
+    .write = meu_fs_write,
+    .release = meu_fs_release,
+    .truncate = meu_fs_truncate,
+    .mkdir = meu_fs_mkdir,
+    .unlink = meu_fs_unlink,
+    .rmdir = meu_fs_rmdir,
+    .rename = meu_fs_rename,
+    .utimens = meu_fs_utimens,
+    .chmod = meu_fs_chmod,
+    .readlink = meu_fs_readlink,
+    .symlink = meu_fs_symlink,
+    .link = meu_fs_link,
+    .setxattr = meu_fs_setxattr,
+    .getxattr = meu_fs_getxattr,
+    .listxattr = meu_fs_listxattr,
+    .removexattr = meu_fs_removexattr,
+};
+
+/*
+ * Ponto de entrada do daemon FUSE.
+ * Uso: meu_fs_fuse [imagem] <ponto_de_montagem> [opcoes do FUSE]
+ * input:
+ * argc, argv - Os argumentos da linha de comando.
+ * output: O código de saída de fuse_main.
+ */
+int main(int argc, char* argv[]) {
+    const char* image_path = DEFAULT_IMAGE_PATH;
+    // Com dois argumentos posicionais no início, o primeiro é a imagem.
+    if (argc >= 3 && argv[1][0] != '-' && argv[2][0] != '-') {
+        image_path = argv[1];
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s [imagem] <ponto_de_montagem> [opcoes do FUSE]\n", argv[0]);
+        return 1;
+    }
+
+    disk_set_path(image_path);
+    // As mensagens do núcleo vão para stdout; o daemon só mantém os erros (stderr).
+    if (!freopen("/dev/null", "w", stdout) || fs_mount() != 0) {
+        fprintf(stderr, "Nao foi possivel montar a imagem '%s'.\n", image_path);
+        return 1;
+    }
+    return fuse_main(argc, argv, &meu_fs_operations, NULL);
+}
@@ -0,0 +1,199 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "filesystem_core.h"
+#include "gerenciador_de_disco.h"
+
+#define MKFS_DEFAULT_DISK DISK_DEFAULT_PATH
+#define MKFS_DEFAULT_SIZE (10 * 1024 * 1024)
+#define MKFS_MIN_DATA_BLOCKS 64 // O ajuste automático reduz o bloco até sobrarem pelo menos estes blocos.
+#define MKFS_MIN_INODES 16
+#define MKFS_DEFAULT_STRIPE (64 * 1024)
+
+int g_verbose_mode = 0;
+int g_compress_mode = 0;
+
+// Perfil de carga: escolhe a geometria quando -b e -i não são informados.
+typedef struct {
+    const char* name;
+    const char* description;
+    unsigned int block_size;
+    unsigned int bytes_per_inode;
+} FormatProfile;
+
+static const FormatProfile profiles[] = {
+    // Mesma geometria que o simulador usa ao criar o disco sozinho.
+    { "geral",    "uso geral",                            4096,  4 * 4096 },
+    // Blocos pequenos desperdiçam menos no último bloco de cada arquivo; um i-node a cada 4 KiB.
+    { "pequenos", "muitos arquivos pequenos",             1024,  4 * 1024 },
+    // Blocos grandes permitem arquivos de até 12 * 64 KiB; um i-node por arquivo desse tamanho.
+    { "midia",    "poucos arquivos grandes (midia)",      65536, 12 * 65536 },
+};
+
+/*
+ * Converte um tamanho com sufixo opcional (K, M ou G, em potências de 1024) para bytes.
+ * input:
+ * text - O texto (ex.: "64M").
+ * value - Recebe o valor em bytes.
+ * output: 0 em caso de sucesso, -1 se o texto for inválido ou o valor não couber em 32 bits.
+ */
+static int parse_size(const char* text, unsigned int* value) {
+    char* end = NULL;
+    unsigned long long result = strtoull(text, &end, 10);
+    if (end == text) return -1;
+    if (*end == 'K' || *end == 'k') { result <<= 10; end++; }
+    else if (*end == 'M' || *end == 'm') { result <<= 20; end++; }
+    else if (*end == 'G' || *end == 'g') { result <<= 30; end++; }
+    if (*end != '\0' || result == 0 || result > 0xFFFFFFFFull) return -1;
+    *value = (unsigned int) result;
+    return 0;
+}
+
+/*
+ * Configura os membros do volume distribuído a partir do argumento de -m: uma quantidade
+ * (os membros se chamam <imagem>.0, <imagem>.1, ...) ou uma lista de caminhos separados por vírgula.
+ * input:
+ * members_arg - O argumento de -m.
+ * disk_path - O caminho da imagem (a descrição do volume).
+ * stripe_size - O tamanho da faixa em bytes.
+ * member_count - Recebe a quantidade de membros.
+ * output: 0 em caso de sucesso, -1 se o argumento for inválido.
+ */
+static int build_member_list(const char* members_arg, const char* disk_path, unsigned int stripe_size, unsigned int* member_count) {
+    static char names[DISK_MAX_MEMBERS][1024];
+    const char* paths[DISK_MAX_MEMBERS];
+    unsigned int count = 0;
+    char* end = NULL;
+    unsigned long requested = strtoul(members_arg, &end, 10);
+
+    if (end != members_arg && *end == '\0') {
+        if (requested < 1 || requested > DISK_MAX_MEMBERS) {
+            fprintf(stderr, "Quantidade de membros invalida: '%s' (de 1 a %d)\n", members_arg, DISK_MAX_MEMBERS);
+            return -1;
+        }
+        for (count = 0; count < requested; count++) {
+            int length = snprintf(names[count], sizeof(names[count]), "%s.%u", disk_path, count);
+            if (length < 0 || (size_t) length >= sizeof(names[count])) return -1;
+            paths[count] = names[count];
+        }
+    } else {
+        const char* cursor = members_arg;
+        while (*cursor) {
+            size_t length = strcspn(cursor, ",");
+            if (count == DISK_MAX_MEMBERS || length == 0 || length >= sizeof(names[count])) {
+                fprintf(stderr, "Lista de membros invalida: '%s' (ate %d caminhos)\n", members_arg, DISK_MAX_MEMBERS);
+                return -1;
+            }
+            memcpy(names[count], cursor, length);
+            names[count][length] = '\0';
+            paths[count] = names[count];
+            count++;
+            cursor += length;
+            if (*cursor == ',') cursor++;
+        }
+    }
+
+    if (disk_set_members(paths, count, stripe_size) != 0) {
+        fprintf(stderr, "Membros invalidos para o volume.\n");
+        return -1;
+    }
+    *member_count = count;
+    return 0;
+}
+
+/*
+ * Imprime a forma de uso e os perfis disponíveis.
+ * input:
+ * program - O nome do programa.
+ * output: nenhum.
+ */
+static void print_usage(const char* program) {
+    fprintf(stderr, "Uso: %s [-s tamanho] [-b tamanho_do_bloco] [-i bytes_por_inode] [-p perfil] [-m membros] [-S faixa] [imagem]\n", program);
+    fprintf(stderr, "  -m N ou -m caminho1,caminho2,...  cria um volume distribuido (membros <imagem>.0 ... <imagem>.N-1)\n");
+    fprintf(stderr, "  -S tamanho                       tamanho da faixa do volume (padrao %u KiB)\n", MKFS_DEFAULT_STRIPE / 1024);
+    fprintf(stderr, "Perfis:\n");
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+        fprintf(stderr, "  %-9s %s (blocos de %u bytes, um i-node a cada %u bytes)\n", profiles[i].name,
+                profiles[i].description, profiles[i].block_size, profiles[i].bytes_per_inode);
+    }
+}
+
+/*
+ * Ponto de entrada do formatador.
+ * Uso: mkfs [-s tamanho] [-b tamanho_do_bloco] [-i bytes_por_inode] [-p perfil] [-m membros] [-S faixa] [imagem]
+ * input:
+ * argc, argv - Os argumentos da linha de comando.
+ * output: 0 em caso de sucesso, 1 em caso de erro.
+ */
+int main(int argc, char* argv[]) {
+    const char* disk_path = MKFS_DEFAULT_DISK;
+    const FormatProfile* profile = &profiles[0];
+    unsigned int disk_size = MKFS_DEFAULT_SIZE, block_size = 0, bytes_per_inode = 0;
+    unsigned int stripe_size = MKFS_DEFAULT_STRIPE;
+    const char* members_arg = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-s") == 0 && has_value) {
+            if (parse_size(argv[++i], &disk_size) != 0) { fprintf(stderr, "Tamanho invalido: '%s'\n", argv[i]); return 1; }
+        } else if (strcmp(argv[i], "-b") == 0 && has_value) {
+            if (parse_size(argv[++i], &block_size) != 0) { fprintf(stderr, "Tamanho de bloco invalido: '%s'\n", argv[i]); return 1; }
+        } else if (strcmp(argv[i], "-i") == 0 && has_value) {
+            if (parse_size(argv[++i], &bytes_per_inode) != 0) { fprintf(stderr, "Proporcao invalida: '%s'\n", argv[i]); return 1; }
+        } else if (strcmp(argv[i], "-m") == 0 && has_value) {
+            members_arg = argv[++i];
+        } else if (strcmp(argv[i], "-S") == 0 && has_value) {
+            if (parse_size(argv[++i], &stripe_size) != 0) { fprintf(stderr, "Tamanho de faixa invalido: '%s'\n", argv[i]); return 1; }
+        } else if (strcmp(argv[i], "-p") == 0 && has_value) {
+            const char* name = argv[++i];
+            profile = NULL;
+            for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++) {
+                if (strcmp(profiles[p].name, name) == 0) profile = &profiles[p];
+            }
+            if (!profile) { fprintf(stderr, "Perfil desconhecido: '%s'\n", name); print_usage(argv[0]); return 1; }
+        } else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            disk_path = argv[i];
+        }
+    }
+
+    // Ajuste automático: o perfil só vale para o que não foi informado, e é reduzido
+    // quando a imagem é pequena demais para ele.
+    if (block_size == 0) {
+        block_size = profile->block_size;
+        while (block_size > FS_MIN_BLOCK_SIZE && disk_size / block_size < MKFS_MIN_DATA_BLOCKS) block_size /= 2;
+    }
+    if (bytes_per_inode == 0) {
+        bytes_per_inode = profile->bytes_per_inode;
+        if (disk_size / bytes_per_inode < MKFS_MIN_INODES) bytes_per_inode = disk_size / MKFS_MIN_INODES;
+        if (bytes_per_inode == 0) bytes_per_inode = 1;
+    }
+
+    if (strcmp(disk_path, MKFS_DEFAULT_DISK) == 0) {
+        struct stat st = {0};
+        if (stat("dados", &st) == -1) mkdir("dados", 0700);
+    }
+    disk_set_path(disk_path);
+    unsigned int member_count = 0;
+    if (members_arg && build_member_list(members_arg, disk_path, stripe_size, &member_count) != 0) return 1;
+    if (fs_format(disk_size, block_size, bytes_per_inode) != 0) {
+        fprintf(stderr, "Nao foi possivel formatar '%s'.\n", disk_path);
+        return 1;
+    }
+
+    Superblock sb = fs_get_superblock_info();
+    unsigned int data_blocks = sb.total_blocks - sb.data_blocks_start_block;
+    printf("\nImagem '%s' (perfil %s):\n", disk_path, profile->name);
+    printf("  %u blocos de %u bytes, %u i-nodes (um a cada %u bytes)\n", sb.total_blocks, sb.block_size, sb.total_inodes, bytes_per_inode);
+    printf("  Metadados: %u blocos (%.1f%%), dados: %u blocos (%u KiB)\n", sb.data_blocks_start_block,
+           100.0 * sb.data_blocks_start_block / sb.total_blocks, data_blocks,
+           (unsigned int) ((unsigned long long) data_blocks * sb.block_size / 1024));
+    printf("  Tamanho maximo de arquivo sem compressao: %u KiB\n", 12 * sb.block_size / 1024);
+    if (member_count > 0) printf("  Volume distribuido: %u membros, faixas de %u KiB\n", member_count, stripe_size / 1024);
+    return 0;
+}